@@ -0,0 +1,192 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QObject>
+
+#include <algorithm>
+
+#include "GeoKeyDirectory.h"
+
+
+//
+// Constructors
+//
+
+FileFormats::GeoKeyDirectory::GeoKeyDirectory(const TIFFTagTable& fields)
+{
+    auto directory = fields.shorts(34735);
+    if (directory.empty())
+    {
+        return;
+    }
+
+    // Header: version, revision, minor revision, number of keys
+    if (directory.size() < 4)
+    {
+        throw QObject::tr("Invalid data for tag 34735.", "FileFormats::GeoKeyDirectory");
+    }
+    if (directory[0] != 1)
+    {
+        throw QObject::tr("GeoKey directory version %1 is not supported.", "FileFormats::GeoKeyDirectory").arg(directory[0]);
+    }
+    auto keyCount = size_t(directory[3]);
+    if (directory.size() < 4*(keyCount + 1))
+    {
+        throw QObject::tr("Invalid data for tag 34735.", "FileFormats::GeoKeyDirectory");
+    }
+    auto doubleParams = fields.doubles(34736);
+    auto asciiParams = fields.ascii(34737);
+
+    // Entries: key, location, count, value or offset. Location zero means
+    // that the value is stored in the entry itself.
+    m_entries.reserve(qsizetype(keyCount));
+    for (size_t i=1; i<=keyCount; i++)
+    {
+        auto key = directory[4*i];
+        auto location = directory[4*i + 1];
+        auto count = size_t(directory[4*i + 2]);
+        auto valueOrOffset = size_t(directory[4*i + 3]);
+
+        Entry entry {key, TIFFTagTable::DT_Short, {}, {}};
+        switch (location)
+        {
+        case 0:
+            entry.numbers.append(double(valueOrOffset));
+            break;
+
+        case 34735:
+            if (valueOrOffset + count > directory.size())
+            {
+                throw QObject::tr("Invalid data for GeoKey %1.", "FileFormats::GeoKeyDirectory").arg(key);
+            }
+            for (auto value : directory.subspan(valueOrOffset, count))
+            {
+                entry.numbers.append(value);
+            }
+            break;
+
+        case 34736:
+            if (valueOrOffset + count > doubleParams.size())
+            {
+                throw QObject::tr("Invalid data for GeoKey %1.", "FileFormats::GeoKeyDirectory").arg(key);
+            }
+            entry.type = TIFFTagTable::DT_Double;
+            entry.numbers = QVector<double>(doubleParams.begin() + qsizetype(valueOrOffset), doubleParams.begin() + qsizetype(valueOrOffset + count));
+            break;
+
+        case 34737:
+        {
+            if (valueOrOffset + count > size_t(asciiParams.size()))
+            {
+                throw QObject::tr("Invalid data for GeoKey %1.", "FileFormats::GeoKeyDirectory").arg(key);
+            }
+            // Strings are terminated by '|', which replaces the NUL of
+            // ordinary TIFF strings
+            auto text = asciiParams.sliced(qsizetype(valueOrOffset), qsizetype(count));
+            while (text.endsWith('|') || text.endsWith('\0'))
+            {
+                text = text.chopped(1);
+            }
+            entry.type = TIFFTagTable::DT_Ascii;
+            entry.text = QString::fromLatin1(text);
+            break;
+        }
+
+        default:
+            // Keys that refer to other tags are not part of the standard
+            continue;
+        }
+        m_entries.append(entry);
+    }
+    std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+}
+
+
+
+//
+// Getter Methods
+//
+
+QVector<quint16> FileFormats::GeoKeyDirectory::keys() const
+{
+    QVector<quint16> result;
+    result.reserve(m_entries.size());
+    for (const auto& entry : m_entries)
+    {
+        result.append(entry.key);
+    }
+    return result;
+}
+
+quint16 FileFormats::GeoKeyDirectory::shortValue(quint16 key, quint16 defaultValue) const
+{
+    const auto* entry = find(key);
+    if ((entry == nullptr) || (entry->type != TIFFTagTable::DT_Short) || entry->numbers.isEmpty())
+    {
+        return defaultValue;
+    }
+    return quint16(entry->numbers.constFirst());
+}
+
+double FileFormats::GeoKeyDirectory::doubleValue(quint16 key, double defaultValue) const
+{
+    const auto* entry = find(key);
+    if ((entry == nullptr) || (entry->type != TIFFTagTable::DT_Double) || entry->numbers.isEmpty())
+    {
+        return defaultValue;
+    }
+    return entry->numbers.constFirst();
+}
+
+QVector<double> FileFormats::GeoKeyDirectory::values(quint16 key) const
+{
+    const auto* entry = find(key);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return entry->numbers;
+}
+
+QString FileFormats::GeoKeyDirectory::ascii(quint16 key) const
+{
+    const auto* entry = find(key);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return entry->text;
+}
+
+
+
+//
+// Private Methods
+//
+
+const FileFormats::GeoKeyDirectory::Entry* FileFormats::GeoKeyDirectory::find(quint16 key) const
+{
+    auto iterator = std::lower_bound(m_entries.cbegin(), m_entries.cend(), key, [](const Entry& entry, quint16 key) { return entry.key < key; });
+    if ((iterator == m_entries.cend()) || (iterator->key != key))
+    {
+        return nullptr;
+    }
+    return &*iterator;
+}
@@ -0,0 +1,225 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include "TIFFTagTable.h"
+
+namespace FileFormats
+{
+
+/*! \brief GeoKey directory of a GeoTIFF file
+ *
+ *  This class holds the GeoKeys of a GeoTIFF file, as specified here:
+ *  https://gis-lab.info/docs/geotiff-1.8.2.pdf
+ *
+ *  The GeoKeyDirectory (tag 34735) lists the keys. Keys of type SHORT are
+ *  stored in the directory itself, keys of type DOUBLE and ASCII refer to the
+ *  GeoDoubleParams (tag 34736) and GeoAsciiParams (tag 34737). This class
+ *  resolves these references, so that the values of all keys are available
+ *  by key.
+ */
+
+class GeoKeyDirectory
+{
+public:
+    /*! \brief GeoKeys, as specified in the GeoTIFF standard */
+    enum Key : quint16 {
+        GTModelType = 1024,
+        GTRasterType,
+        GTCitation,
+
+        GeographicType = 2048,
+        GeogCitation,
+        GeogGeodeticDatum,
+        GeogPrimeMeridian,
+        GeogLinearUnits,
+        GeogLinearUnitSize,
+        GeogAngularUnits,
+        GeogAngularUnitSize,
+        GeogEllipsoid,
+        GeogSemiMajorAxis,
+        GeogSemiMinorAxis,
+        GeogInvFlattening,
+        GeogAzimuthUnits,
+        GeogPrimeMeridianLong,
+
+        ProjectedCSType = 3072,
+        PCSCitation,
+        Projection,
+        ProjCoordTrans,
+        ProjLinearUnits,
+        ProjLinearUnitSize,
+        ProjStdParallel1,
+        ProjStdParallel2,
+        ProjNatOriginLong,
+        ProjNatOriginLat,
+        ProjFalseEasting,
+        ProjFalseNorthing,
+        ProjFalseOriginLong,
+        ProjFalseOriginLat,
+        ProjFalseOriginEasting,
+        ProjFalseOriginNorthing,
+        ProjCenterLong,
+        ProjCenterLat,
+        ProjCenterEasting,
+        ProjCenterNorthing,
+        ProjScaleAtNatOrigin,
+        ProjScaleAtCenter,
+        ProjAzimuthAngle,
+        ProjStraightVertPoleLong,
+
+        VerticalCSType = 4096,
+        VerticalCitation,
+        VerticalDatum,
+        VerticalUnits
+    };
+
+    /*! \brief Model types, values of GTModelType */
+    enum ModelType : quint16 {
+        ModelTypeProjected = 1,
+        ModelTypeGeographic,
+        ModelTypeGeocentric
+    };
+
+    /*! \brief Raster types, values of GTRasterType */
+    enum RasterType : quint16 {
+        RasterPixelIsArea = 1,
+        RasterPixelIsPoint
+    };
+
+    /*! \brief Code for user-defined values, as specified in the GeoTIFF standard */
+    static constexpr quint16 userDefined = 32767;
+
+    /*! \brief Constructs an empty directory */
+    GeoKeyDirectory() = default;
+
+    /*! \brief Constructor
+     *
+     *  Reads the GeoKeys from the values of tags 34735, 34736 and 34737. If
+     *  tag 34735 is not decoded, the directory is empty.
+     *
+     *  @param fields TIFF fields of a GeoTIFF file
+     *
+     *  @throws QString with a human-readable, translated error message if the
+     *  directory is malformed
+     */
+    explicit GeoKeyDirectory(const TIFFTagTable& fields);
+
+
+    //
+    // Getter Methods
+    //
+
+    /*! \brief Check if the directory is empty
+     *
+     *  @returns True if the directory holds no keys
+     */
+    [[nodiscard]] bool isEmpty() const { return m_entries.isEmpty(); }
+
+    /*! \brief Check if a key exists
+     *
+     *  @param key GeoKey
+     *
+     *  @returns True if the directory holds the key
+     */
+    [[nodiscard]] bool contains(quint16 key) const { return find(key) != nullptr; }
+
+    /*! \brief Keys in the directory
+     *
+     *  @returns Keys, sorted in ascending order
+     */
+    [[nodiscard]] QVector<quint16> keys() const;
+
+    /*! \brief Value of a key of type SHORT
+     *
+     *  @param key GeoKey
+     *
+     *  @param defaultValue Value returned if the key does not exist or has a
+     *  different type
+     *
+     *  @returns First value of the key
+     */
+    [[nodiscard]] quint16 shortValue(quint16 key, quint16 defaultValue) const;
+
+    /*! \brief Value of a key of type DOUBLE
+     *
+     *  @param key GeoKey
+     *
+     *  @param defaultValue Value returned if the key does not exist or has a
+     *  different type
+     *
+     *  @returns First value of the key
+     */
+    [[nodiscard]] double doubleValue(quint16 key, double defaultValue) const;
+
+    /*! \brief Values of a key of type SHORT or DOUBLE
+     *
+     *  @param key GeoKey
+     *
+     *  @returns Values of the key, or an empty vector if the key does not
+     *  exist or has type ASCII
+     */
+    [[nodiscard]] QVector<double> values(quint16 key) const;
+
+    /*! \brief Value of a key of type ASCII
+     *
+     *  @param key GeoKey
+     *
+     *  @returns Value of the key, without the terminating '|', or an empty
+     *  string if the key does not exist or has a different type
+     */
+    [[nodiscard]] QString ascii(quint16 key) const;
+
+    /*! \brief Model type
+     *
+     *  @returns Value of GTModelType. Files without GeoKeys are treated as
+     *  geographic, as has been the behavior of this library.
+     */
+    [[nodiscard]] quint16 modelType() const { return shortValue(GTModelType, ModelTypeGeographic); }
+
+    /*! \brief Raster type
+     *
+     *  @returns Value of GTRasterType, which defaults to RasterPixelIsArea
+     */
+    [[nodiscard]] quint16 rasterType() const { return shortValue(GTRasterType, RasterPixelIsArea); }
+
+private:
+    // Key, type of the values (SHORT, DOUBLE or ASCII) and values. Numbers
+    // hold values of type SHORT and DOUBLE, text holds values of type ASCII.
+    struct Entry
+    {
+        quint16 key;
+        quint16 type;
+        QVector<double> numbers;
+        QString text;
+    };
+
+    // Returns the entry of a key, or nullptr
+    [[nodiscard]] const Entry* find(quint16 key) const;
+
+    // Entries, sorted by key
+    QVector<Entry> m_entries;
+};
+
+} // namespace FileFormats
@@ -19,6 +19,15 @@
  ***************************************************************************/
 
 #include <QFile>
+#include <QtEndian>
+
+#include <QSet>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
 
 #include "GeoTIFF.h"
 
@@ -27,51 +36,211 @@
 // Enums and static helper functions
 //
 
-enum DataType {
-    DT_Byte = 1,
-    DT_Ascii,
-    DT_Short,
-    DT_Long,
-    DT_Rational,
-    DT_SByte,
-    DT_Undefined,
-    DT_SShort,
-    DT_SLong,
-    DT_SRational,
-    DT_Float,
-    DT_Double,
-    DT_Ifd,
-    DT_Long8,
-    DT_SLong8,
-    DT_Ifd8
-};
+using enum FileFormats::TIFFTagTable::DataType;
 
-// Checks the status of dataStream. If status is OK, this method does nothing.
-// Otherwiese, it throws a QString with a human-readable, translated error
+// Reads a value of type T (quint16, quint32, quint64 or double) from data at the given
+// offset, using the given byte order. If the value does not lie within data,
+// this method throws a QString with a human-readable, translated error
 // message.
-void checkForError(QDataStream& dataStream)
+template<typename T>
+T readFromMemory(QByteArrayView data, qint64 offset, bool littleEndian)
 {
-    switch(dataStream.status())
+    if ((offset < 0) || (offset + qint64(sizeof(T)) > data.size()))
     {
-    case QDataStream::ReadCorruptData:
-        throw QObject::tr("Found corrupt data while reading the data stream.", "FileFormats::GeoTIFF");
-    case QDataStream::ReadPastEnd:
         throw QObject::tr("Read past end of data stream.", "FileFormats::GeoTIFF");
-    case QDataStream::WriteFailed:
-        throw QObject::tr("Error writing to data stream.", "FileFormats::GeoTIFF");
-    case QDataStream::Ok:
-        break;
     }
+    if constexpr (std::is_same_v<T, double>)
+    {
+        auto bits = littleEndian ? qFromLittleEndian<quint64>(data.data()+offset) : qFromBigEndian<quint64>(data.data()+offset);
+        return std::bit_cast<double>(bits);
+    }
+    else
+    {
+        return littleEndian ? qFromLittleEndian<T>(data.data()+offset) : qFromBigEndian<T>(data.data()+offset);
+    }
+}
+
+// Reads an unsigned integer of 2, 4 or 8 bytes from data at the given offset,
+// as readFromMemory() does
+quint64 readUnsigned(QByteArrayView data, qint64 offset, qint64 size, bool littleEndian)
+{
+    switch (size)
+    {
+    case 2:
+        return readFromMemory<quint16>(data, offset, littleEndian);
+    case 4:
+        return readFromMemory<quint32>(data, offset, littleEndian);
+    default:
+        return readFromMemory<quint64>(data, offset, littleEndian);
+    }
+}
+
+// Sizes of the parts of an image file directory, in classic TIFF and in
+// BigTIFF
+struct IFDLayout
+{
+    // Size of the number of entries
+    qint64 countSize;
+
+    // Size of an entry
+    qint64 entrySize;
+
+    // Size of offsets, of the number of values in an entry, and of the
+    // value field of an entry
+    qint64 offsetSize;
+
+    // Size of an IFD with the given number of entries
+    [[nodiscard]] qint64 size(quint64 entryCount) const { return countSize + entrySize*qint64(entryCount) + offsetSize; }
+};
+const IFDLayout classicLayout {2, 12, 4};
+const IFDLayout bigTIFFLayout {8, 20, 8};
+
+// Reads the TIFF header (magic bytes, version and offset of IFD0) from the
+// first eight bytes of data, or the first sixteen bytes for BigTIFF. Sets
+// littleEndian according to the byte order of the file, bigTIFF according to
+// the version, and returns the offset of IFD0. On failure, it throws a QString
+// with a human-readable, translated error message.
+quint64 readTIFFHeader(QByteArrayView data, bool& littleEndian, bool& bigTIFF)
+{
+    // Check magic bytes
+    if (data.size() < 8)
+    {
+        throw QObject::tr("Found invalid TIFF file data.", "FileFormats::GeoTIFF");
+    }
+    if (data.first(2) == "II")
+    {
+        littleEndian = true;
+    }
+    else if (data.first(2) == "MM")
+    {
+        littleEndian = false;
+    }
+    else
+    {
+        throw QObject::tr("Found invalid TIFF file data.", "FileFormats::GeoTIFF");
+    }
+
+    // version
+    auto version = readFromMemory<quint16>(data, 2, littleEndian);
+    if (version == 42)
+    {
+        bigTIFF = false;
+        return readFromMemory<quint32>(data, 4, littleEndian);
+    }
+    if (version != 43)
+    {
+        throw QObject::tr("Found an unsupported TIFF version.", "FileFormats::GeoTIFF");
+    }
+
+    // BigTIFF specifies the size of offsets, which is always eight, followed
+    // by a reserved word
+    if ((readFromMemory<quint16>(data, 4, littleEndian) != 8) || (readFromMemory<quint16>(data, 6, littleEndian) != 0))
+    {
+        throw QObject::tr("Found invalid BigTIFF file data.", "FileFormats::GeoTIFF");
+    }
+    bigTIFF = true;
+    return readFromMemory<quint64>(data, 8, littleEndian);
+}
+
+// Entry of an image file directory. If the data of the entry fits into the
+// entry itself, then dataOffset is the offset of the value field within the
+// IFD data. Otherwise, it is the offset of the data within the file.
+struct IFDEntry
+{
+    quint16 tag {0};
+    quint16 type {0};
+    quint32 count {0};
+    qint64 byteSize {0};
+    qint64 dataOffset {0};
+    bool isInline {true};
+};
+
+// Reads the IFD entry found at entryOffset in data. On failure, it throws a
+// QString with a human-readable, translated error message.
+IFDEntry readIFDEntry(QByteArrayView data, qint64 entryOffset, bool littleEndian, const IFDLayout& layout)
+{
+    IFDEntry entry;
+    entry.tag = readFromMemory<quint16>(data, entryOffset, littleEndian);
+    entry.type = readFromMemory<quint16>(data, entryOffset+2, littleEndian);
+
+    // BigTIFF allows 64-bit counts. Fields with more than 2^32 values are
+    // rejected, as are offsets that do not fit into qint64.
+    auto count = readUnsigned(data, entryOffset+4, layout.offsetSize, littleEndian);
+    if (count > 0xFFFFFFFF)
+    {
+        throw QObject::tr("Found a TIFF field with too many values.", "FileFormats::GeoTIFF");
+    }
+    entry.count = quint32(count);
+    entry.byteSize = qint64(FileFormats::TIFFTagTable::typeSize(entry.type))*entry.count;
+    entry.isInline = (entry.byteSize <= layout.offsetSize);
+    auto valueOffset = entryOffset + 4 + layout.offsetSize;
+    auto dataOffset = entry.isInline ? quint64(valueOffset) : readUnsigned(data, valueOffset, layout.offsetSize, littleEndian);
+    if (dataOffset > quint64(std::numeric_limits<qint64>::max()))
+    {
+        throw QObject::tr("Read past end of data stream.", "FileFormats::GeoTIFF");
+    }
+    entry.dataOffset = qint64(dataOffset);
+    return entry;
+}
+
+// Returns true if the value of the entry is supported by TIFFTagTable and its
+// tag is contained in the sorted list tags
+bool needsDecoding(const IFDEntry& entry, const QList<quint16>& tags)
+{
+    return FileFormats::TIFFTagTable::isSupportedType(entry.type) && std::binary_search(tags.cbegin(), tags.cend(), entry.tag);
+}
+
+// Returns the payload of an IFD entry, as found in data. On failure, it throws
+// a QString with a human-readable, translated error message.
+QByteArrayView payload(QByteArrayView data, qint64 offset, qint64 size)
+{
+    if ((offset < 0) || (offset + size > data.size()))
+    {
+        throw QObject::tr("Cannot read data.", "FileFormats::GeoTIFF");
+    }
+    return data.sliced(offset, size);
 }
 
+// Maximal number of tags that will be read from an IFD
+const quint16 maxTagCount = 100;
+
+// Maximal number of IFDs that will be visited in search of overviews
+const qsizetype maxIFDCount = 64;
+
+// Out-of-line payloads that lie closer together than this number of bytes
+// are fetched in a single read
+const qint64 maxReadGap = 4096;
+
+// Number of bytes at the beginning of the file that are fetched with the
+// header. In most files, they contain IFD0 and its out-of-line values.
+const qint64 prefetchSize = 16384;
 
 
 //
 // Constructors
 //
 
-FileFormats::GeoTIFF::GeoTIFF(const QString& fileName)
+FileFormats::GeoTIFF::GeoTIFF(const QString& fileName, const QList<quint16>& requestedTags)
+    : m_fileName(fileName)
 {
+    // Files in ZIP archives are read without extracting them
+    QString archiveName;
+    QString entryName;
+    if (ZIPArchive::splitPath(fileName, archiveName, entryName))
+    {
+        ZIPArchive const archive(archiveName);
+        try
+        {
+            auto reader = archive.reader(entryName);
+            readTIFFData(*reader, tagsToDecode(requestedTags));
+        }
+        catch (QString& message)
+        {
+            setError(message);
+        }
+        return;
+    }
+
     QFile inFile(fileName);
     if (!inFile.open(QFile::ReadOnly))
     {
@@ -79,83 +248,182 @@ FileFormats::GeoTIFF::GeoTIFF(const QString& fileName)
         return;
     }
 
-    readTIFFData(inFile);
+    auto reader = RangeReader::create(inFile);
+    readTIFFData(*reader, tagsToDecode(requestedTags));
 }
 
-FileFormats::GeoTIFF::GeoTIFF(QIODevice& device)
+FileFormats::GeoTIFF::GeoTIFF(QIODevice& device, const QList<quint16>& requestedTags)
 {
-    readTIFFData(device);
+    auto reader = RangeReader::create(device);
+    readTIFFData(*reader, tagsToDecode(requestedTags));
+}
+
+FileFormats::GeoTIFF::GeoTIFF(RangeReader& reader, const QList<quint16>& requestedTags)
+{
+    readTIFFData(reader, tagsToDecode(requestedTags));
 }
 
 
 
 //
-// Private Methods
+// Methods
 //
 
-void FileFormats::GeoTIFF::readTIFFData(QIODevice& device)
+const FileFormats::TIFFRaster& FileFormats::GeoTIFF::rasterForScale(double scale) const
 {
-    QDataStream dataStream(&device);
-
-    try
+    // Overviews are sorted by decreasing size, so the last one that is large
+    // enough is the smallest
+    const auto* result = &m_raster;
+    for (const auto& overview : m_overviews)
     {
-        // Move to beginning of the data stream
-        if (!device.seek(0))
+        if ((overview.size().width() < scale*m_raster.size().width()) || (overview.size().height() < scale*m_raster.size().height()))
         {
-            throw device.errorString();
+            break;
         }
+        result = &overview;
+    }
+    return *result;
+}
 
-        // Check magic bytes
-        auto magicBytes = device.read(2);
-        if (magicBytes == "II")
-        {
-            dataStream.setByteOrder(QDataStream::LittleEndian);
-        }
-        else if (magicBytes == "MM")
-        {
-            dataStream.setByteOrder(QDataStream::BigEndian);
-        }
-        else
-        {
-            throw QObject::tr("Found invalid TIFF file data.", "FileFormats::GeoTIFF");
-        }
+QImage FileFormats::GeoTIFF::readWindow(const QRect& window, const TIFFReadOptions& options) const
+{
+    return readWindow(window, 1.0, options);
+}
+
+QImage FileFormats::GeoTIFF::readWindow(QIODevice& device, const QRect& window, const TIFFReadOptions& options) const
+{
+    return readWindow(device, window, 1.0, options);
+}
 
-        // version
-        quint16 version = 0;
-        dataStream >> version;
-        if (version == 43)
+QImage FileFormats::GeoTIFF::readWindow(RangeReader& reader, const QRect& window, const TIFFReadOptions& options) const
+{
+    return readWindow(reader, window, 1.0, options);
+}
+
+QImage FileFormats::GeoTIFF::readWindow(const QRect& window, double scale, const TIFFReadOptions& options) const
+{
+    if (m_fileName.isEmpty())
+    {
+        return {};
+    }
+
+    QString archiveName;
+    QString entryName;
+    if (ZIPArchive::splitPath(m_fileName, archiveName, entryName))
+    {
+        // The reader is kept, together with its access points. Stored files
+        // are views into the mapped archive and can be read by several
+        // threads at once. Compressed files are inflated by a single stream,
+        // so their reads hold the mutex.
+        QMutexLocker locker(&m_archiveMutex);
+        try
         {
-            throw QObject::tr("BigTIFF files are not supported.", "FileFormats::GeoTIFF");
+            if (m_archiveReader == nullptr)
+            {
+                auto archive = std::make_unique<ZIPArchive>(archiveName);
+                m_archiveReader = archive->reader(entryName);
+                m_archive = std::move(archive);
+            }
+            if (!m_archiveReader->data().isEmpty())
+            {
+                locker.unlock();
+            }
+            return readWindow(*m_archiveReader, window, scale, options);
         }
-        if (version != 42)
+        catch (QString&)
         {
-            throw QObject::tr("Found an unsupported TIFF version.", "FileFormats::GeoTIFF");
+            return {};
         }
+    }
+
+    QFile inFile(m_fileName);
+    if (!inFile.open(QFile::ReadOnly))
+    {
+        return {};
+    }
+    return readWindow(inFile, window, scale, options);
+}
+
+QImage FileFormats::GeoTIFF::readWindow(QIODevice& device, const QRect& window, double scale, const TIFFReadOptions& options) const
+{
+    auto reader = RangeReader::create(device);
+    return readWindow(*reader, window, scale, options);
+}
+
+QImage FileFormats::GeoTIFF::readWindow(RangeReader& reader, const QRect& window, double scale, const TIFFReadOptions& options) const
+{
+    if (!isValid() || m_raster.isNull())
+    {
+        return {};
+    }
+
+    // Map the window to the coordinates of the raster, rounding outwards
+    const auto& raster = rasterForScale(scale);
+    auto scaleX = double(raster.size().width())/m_raster.size().width();
+    auto scaleY = double(raster.size().height())/m_raster.size().height();
+    QPoint const topLeft(int(std::floor(window.left()*scaleX)), int(std::floor(window.top()*scaleY)));
+    QPoint const bottomRight(int(std::ceil((window.right()+1)*scaleX))-1, int(std::ceil((window.bottom()+1)*scaleY))-1);
+    try
+    {
+        return raster.readWindow(reader, QRect(topLeft, bottomRight), options);
+    }
+    catch (QString&)
+    {
+        return {};
+    }
+}
 
-        // ifd0Offset
-        quint32 result = 0;
-        dataStream >> result;
-        checkForError(dataStream);
-        if (!device.seek(result))
-        {
-            throw device.errorString();
-        }
 
-        quint16 tagCount = 0;
-        dataStream >> tagCount;
-        checkForError(dataStream);
-        if (tagCount > 100)
-        {
-            addWarning( QObject::tr("Found more than 100 tags in the TIFF file. Reading only the first 100.", "FileFormats::GeoTIFF") );
-            tagCount = 100;
-        }
 
-        for (quint16 i=0; i<tagCount; ++i)
+//
+// Private Methods
+//
+
+QList<quint16> FileFormats::GeoTIFF::overviewTags()
+{
+    auto tags = TIFFRaster::tags();
+    tags += {254, 330};
+    std::sort(tags.begin(), tags.end());
+    return tags;
+}
+
+QList<quint16> FileFormats::GeoTIFF::tagsToDecode(const QList<quint16>& requestedTags)
+{
+    QList<quint16> tags {254, 256, 257, 270, 330, 33550, 33922, 34264, 34735, 34736, 34737, 42113};
+    tags += TIFFRaster::tags();
+    tags += requestedTags;
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+    return tags;
+}
+
+void FileFormats::GeoTIFF::readTIFFData(RangeReader& reader, const QList<quint16>& tags)
+{
+    try
+    {
+        // Data resident in memory is parsed without further reads
+        auto data = reader.data();
+        if (!data.isEmpty())
         {
-            readTIFFField(device, dataStream);
+            readTIFFData(data, tags);
+            return;
         }
 
+        // Fetch the header together with the beginning of the file, so that
+        // IFD0 needs no further round trip in most files
+        auto prefix = reader.read(0, prefetchSize);
+        bool littleEndian = true;
+        bool bigTIFF = false;
+        auto ifd0Offset = readTIFFHeader(prefix, littleEndian, bigTIFF);
+
+        auto nextIFDOffset = readIFD(reader, prefix, ifd0Offset, littleEndian, bigTIFF, tags, m_TIFFFields);
+        m_TIFFFields.squeeze();
         interpretGeoData();
+        interpretRasterData(littleEndian, ifd0Offset);
+        auto const tagsOfOverviews = overviewTags();
+        readOverviews(ifd0Offset, nextIFDOffset, littleEndian, [&](quint64 offset, TIFFTagTable& fields) {
+            return readIFD(reader, prefix, offset, littleEndian, bigTIFF, tagsOfOverviews, fields);
+        });
     }
     catch (QString& message)
     {
@@ -163,212 +431,255 @@ void FileFormats::GeoTIFF::readTIFFData(QIODevice& device)
     }
 }
 
-void FileFormats::GeoTIFF::readTIFFField(QIODevice& device, QDataStream& dataStream)
+void FileFormats::GeoTIFF::readTIFFData(QByteArrayView data, const QList<quint16>& tags)
 {
-    // Read tag, type, and count
-    quint16 tag = 0;
-    quint16 type = DT_Undefined;
-    quint32 count = 0;
-    dataStream >> tag;
-    dataStream >> type;
-    dataStream >> count;
-    checkForError(dataStream);
-
-    // Compute the data size of this type
-    int typeSize = 0;
-    switch(type)
-    {
-    case DT_Byte:
-    case DT_SByte:
-    case DT_Ascii:
-    case DT_Undefined:
-        typeSize = 1;
-        break;
-
-    case DT_Short:
-    case DT_SShort:
-        typeSize = 2;
-        break;
-
-    case DT_Long:
-    case DT_SLong:
-    case DT_Ifd:
-    case DT_Float:
-        typeSize = 4;
-        break;
+    bool littleEndian = true;
+    bool bigTIFF = false;
+    auto ifd0Offset = readTIFFHeader(data, littleEndian, bigTIFF);
+
+    auto nextIFDOffset = readIFD(data, ifd0Offset, littleEndian, bigTIFF, tags, m_TIFFFields);
+    m_TIFFFields.squeeze();
+    interpretGeoData();
+    interpretRasterData(littleEndian, ifd0Offset);
+    auto const tagsOfOverviews = overviewTags();
+    readOverviews(ifd0Offset, nextIFDOffset, littleEndian, [&](quint64 offset, TIFFTagTable& fields) {
+        return readIFD(data, offset, littleEndian, bigTIFF, tagsOfOverviews, fields);
+    });
+}
 
-    case DT_Rational:
-    case DT_SRational:
-    case DT_Long8:
-    case DT_SLong8:
-    case DT_Ifd8:
-    case DT_Double:
-        typeSize = 8;
-        break;
+quint64 FileFormats::GeoTIFF::readIFD(RangeReader& reader, const QByteArray& prefix, quint64 offset, bool littleEndian, bool bigTIFF, const QList<quint16>& tags, TIFFTagTable& fields)
+{
+    const auto& layout = bigTIFF ? bigTIFFLayout : classicLayout;
+    if (offset > quint64(std::numeric_limits<qint64>::max()))
+    {
+        throw QObject::tr("Read past end of data stream.", "FileFormats::GeoTIFF");
+    }
+    auto position = qint64(offset);
 
-    default:
-        typeSize = 0;
-        break;
+    // Take the IFD from the prefix if it lies there completely. Otherwise,
+    // read it in one go. Since the number of tags is not known in advance,
+    // read enough bytes for the maximal number of tags.
+    QByteArray ifd;
+    if (position + layout.countSize <= prefix.size())
+    {
+        auto ifdSize = layout.size(qMin<quint64>(readUnsigned(prefix, position, layout.countSize, littleEndian), maxTagCount));
+        if (position + ifdSize <= prefix.size())
+        {
+            ifd = prefix.mid(position, ifdSize);
+        }
+    }
+    if (ifd.isEmpty())
+    {
+        ifd = reader.read(position, layout.size(maxTagCount));
+    }
+    auto tagCount = readUnsigned(ifd, 0, layout.countSize, littleEndian);
+    quint64 nextIFDOffset = 0;
+    if (tagCount > maxTagCount)
+    {
+        addWarning( QObject::tr("Found more than 100 tags in the TIFF file. Reading only the first 100.", "FileFormats::GeoTIFF") );
+        tagCount = maxTagCount;
+    }
+    else if (ifd.size() >= layout.size(tagCount))
+    {
+        nextIFDOffset = readUnsigned(ifd, layout.size(tagCount) - layout.offsetSize, layout.offsetSize, littleEndian);
+    }
+    QVector<IFDEntry> entries;
+    entries.reserve(qsizetype(tagCount));
+    for (quint64 i=0; i<tagCount; ++i)
+    {
+        entries.append(readIFDEntry(ifd, layout.countSize + layout.entrySize*qint64(i), littleEndian, layout));
     }
 
-    // Save file position and move to the position where the data actually
-    // resides.
-    auto filePos = device.pos();
-    auto byteSize = typeSize*count;
-    if (byteSize > 4)
+    // Coalesce the out-of-line payloads of those entries that need to be
+    // decoded into as few contiguous chunks as possible. Chunks are taken
+    // from the prefix where possible, all others are read with a single call
+    // to the reader.
+    QVector<const IFDEntry*> outOfLine;
+    for (const auto& entry : entries)
     {
-        quint32 newPos = 0;
-        dataStream >> newPos;
-        checkForError(dataStream);
-        if (!device.seek(newPos))
+        if (!entry.isInline && needsDecoding(entry, tags))
         {
-            throw device.errorString();
+            outOfLine.append(&entry);
         }
     }
+    std::sort(outOfLine.begin(), outOfLine.end(), [](const IFDEntry* a, const IFDEntry* b) { return a->dataOffset < b->dataOffset; });
 
-    // Read data entries from the device
-    QVariantList values;
-    switch (type)
+    struct Chunk
     {
-    case DT_Ascii:
+        qint64 begin;
+        qint64 end;
+        QByteArray bytes;
+    };
+    QVector<Chunk> chunks;
+    for (const auto* entry : outOfLine)
     {
-        auto tmpString = device.read(count);
-        if (tmpString.size() != count)
+        if (!chunks.isEmpty() && (entry->dataOffset <= chunks.last().end + maxReadGap))
         {
-            throw QObject::tr("Cannot read data.", "FileFormats::GeoTIFF");
+            chunks.last().end = qMax(chunks.last().end, entry->dataOffset + entry->byteSize);
+            continue;
         }
-        foreach(auto subStrings, tmpString.split(0))
+        chunks.append({entry->dataOffset, entry->dataOffset + entry->byteSize, {}});
+    }
+    QVector<RangeReader::Range> ranges;
+    QVector<Chunk*> rangeChunks;
+    for (auto& chunk : chunks)
+    {
+        if (chunk.end <= prefix.size())
         {
-            values.append(QString::fromLatin1(subStrings));
+            chunk.bytes = prefix.mid(chunk.begin, chunk.end - chunk.begin);
+            continue;
         }
+        ranges.append(RangeReader::Range{chunk.begin, chunk.end - chunk.begin});
+        rangeChunks.append(&chunk);
     }
-    break;
-    case DT_Short:
-        values.reserve(count);
-        for (quint32 i = 0; i < count; ++i)
+    if (!ranges.isEmpty())
+    {
+        auto bytes = reader.readRanges(ranges);
+        for (qsizetype i=0; i<rangeChunks.size(); ++i)
         {
-            quint16 tmpInt = 0;
-            dataStream >> tmpInt;
-            checkForError(dataStream);
-            values.append(tmpInt);
+            rangeChunks[i]->bytes = bytes[i];
         }
-        break;
-    case DT_Double:
-        values.reserve(count);
-        for (quint32 i = 0; i < count; ++i)
+    }
+
+    // Decode the entries
+    for (const auto& entry : entries)
+    {
+        if (!needsDecoding(entry, tags))
         {
-            double tmpFloat = NAN;
-            dataStream >> tmpFloat;
-            checkForError(dataStream);
-            values.append(tmpFloat);
+            fields.index(entry.tag, entry.type, entry.count);
+            continue;
         }
-        break;
-    default:
-        break;
+        if (entry.isInline)
+        {
+            fields.insert(entry.tag, entry.type, entry.count, payload(ifd, entry.dataOffset, entry.byteSize), littleEndian);
+            continue;
+        }
+
+        auto chunk = std::upper_bound(chunks.cbegin(), chunks.cend(), entry.dataOffset, [](qint64 offset, const Chunk& chunk) { return offset < chunk.begin; });
+        if (chunk == chunks.cbegin())
+        {
+            continue;
+        }
+        --chunk;
+        fields.insert(entry.tag, entry.type, entry.count, payload(chunk->bytes, entry.dataOffset - chunk->begin, entry.byteSize), littleEndian);
     }
+    return nextIFDOffset;
+}
 
-    // Position the device at the byte following the current entry
-    if (!device.seek(filePos+4))
+quint64 FileFormats::GeoTIFF::readIFD(QByteArrayView data, quint64 offset, bool littleEndian, bool bigTIFF, const QList<quint16>& tags, TIFFTagTable& fields)
+{
+    const auto& layout = bigTIFF ? bigTIFFLayout : classicLayout;
+    if (offset > quint64(data.size()))
     {
-        throw device.errorString();
+        throw QObject::tr("Read past end of data stream.", "FileFormats::GeoTIFF");
     }
+    auto position = qint64(offset);
 
-    m_TIFFFields[tag] = values;
-}
+    auto tagCount = readUnsigned(data, position, layout.countSize, littleEndian);
+    quint64 nextIFDOffset = 0;
+    if (tagCount > maxTagCount)
+    {
+        addWarning( QObject::tr("Found more than 100 tags in the TIFF file. Reading only the first 100.", "FileFormats::GeoTIFF") );
+        tagCount = maxTagCount;
+    }
+    else if (position + layout.size(tagCount) <= data.size())
+    {
+        nextIFDOffset = readUnsigned(data, position + layout.size(tagCount) - layout.offsetSize, layout.offsetSize, littleEndian);
+    }
 
-void FileFormats::GeoTIFF::interpretGeoData()
-{
-    // Handle Tag 33922, name
-    if (m_TIFFFields.contains(270))
+    for (quint64 i=0; i<tagCount; ++i)
     {
-        auto values = m_TIFFFields[270];
-        if (values.isEmpty())
+        auto entry = readIFDEntry(data, position + layout.countSize + layout.entrySize*qint64(i), littleEndian, layout);
+        if (!needsDecoding(entry, tags))
         {
-            throw QObject::tr("No data for tag 270.", "FileFormats::GeoTIFF");
+            fields.index(entry.tag, entry.type, entry.count);
+            continue;
         }
-        m_name = values.constLast().toString();
+        fields.insert(entry.tag, entry.type, entry.count, payload(data, entry.dataOffset, entry.byteSize), littleEndian);
     }
+    return nextIFDOffset;
+}
 
-    // Handle Tag 33922, compute top left of the bounding box
+void FileFormats::GeoTIFF::readOverviews(quint64 ifd0Offset, quint64 nextIFDOffset, bool littleEndian, const std::function<quint64(quint64, TIFFTagTable&)>& readOverviewIFD)
+{
+    if (m_raster.isNull())
     {
-        if (m_TIFFFields.contains(33922))
-        {
-            auto values = m_TIFFFields[33922];
-            if (values.size() < 5)
-            {
-                throw QObject::tr("Invalid data for tag 33922.", "FileFormats::GeoTIFF");
-            }
+        return;
+    }
 
-            bool ok = false;
-            auto lat = m_TIFFFields[33922].at(4).toDouble(&ok);
-            if (!ok)
-            {
-                throw QObject::tr("Invalid data for tag 33922.", "FileFormats::GeoTIFF");
-            }
-            auto lon = m_TIFFFields[33922].at(3).toDouble(&ok);
-            if (!ok)
-            {
-                throw QObject::tr("Invalid data for tag 33922.", "FileFormats::GeoTIFF");
-            }
+    // Overviews are found in the chain of IFDs that follows IFD0, and in
+    // SubIFDs. IFDs are visited at most once, in case the file contains
+    // loops.
+    QVector<quint64> pending;
+    pending += m_TIFFFields.unsignedIntegers(330);
+    pending.append(nextIFDOffset);
+    QSet<quint64> visited {ifd0Offset};
+    while (!pending.isEmpty() && (visited.size() < maxIFDCount))
+    {
+        auto offset = pending.takeFirst();
+        if ((offset == 0) || visited.contains(offset))
+        {
+            continue;
+        }
+        visited.insert(offset);
 
-            QGeoCoordinate const coord(lat, lon);
-            if (!coord.isValid())
-            {
-                throw QObject::tr("Invalid data for tag 33922.", "FileFormats::GeoTIFF");
-            }
-            m_bBox.setTopLeft(coord);
+        TIFFTagTable fields;
+        try
+        {
+            pending.append(readOverviewIFD(offset, fields));
         }
-        else
+        catch (QString& message)
         {
-            throw QObject::tr("Tag 33922 is not set.", "FileFormats::GeoTIFF");
+            addWarning(message);
+            continue;
         }
-    }
+        pending += fields.unsignedIntegers(330);
 
-    // Handle Tag 33922, compute pixel width and height
-    double pixelWidth = NAN;
-    double pixelHeight = NAN;
-    {
-        if (m_TIFFFields.contains(33550))
+        // NewSubfileType marks reduced-resolution images with bit 0 and
+        // transparency masks with bit 2. Other IFDs are further pages.
+        auto subfileType = fields.unsignedInteger(254, 0);
+        if (((subfileType & 1) == 0) || ((subfileType & 4) != 0))
         {
-            auto values = m_TIFFFields[33550];
-            if (values.size() < 2)
-            {
-                throw QObject::tr("Invalid data for tag 33550.", "FileFormats::GeoTIFF");
-            }
-            bool ok = false;
-            pixelWidth = values.at(0).toDouble(&ok);
-            if (!ok)
-            {
-                throw QObject::tr("Invalid data for tag 33550.", "FileFormats::GeoTIFF");
-            }
-            pixelHeight = values.at(1).toDouble(&ok);
-            if (!ok)
+            continue;
+        }
+        try
+        {
+            TIFFRaster overview(fields, littleEndian, offset);
+            if ((overview.size().width() < m_raster.size().width()) && (overview.size().height() <= m_raster.size().height()))
             {
-                throw QObject::tr("Invalid data for tag 33550.", "FileFormats::GeoTIFF");
+                m_overviews.append(overview);
             }
         }
-        else
+        catch (QString& message)
         {
-            throw QObject::tr("Tag 33550 is not set.", "FileFormats::GeoTIFF");
+            addWarning(message);
         }
     }
 
+    // Largest overview first
+    std::sort(m_overviews.begin(), m_overviews.end(), [](const TIFFRaster& a, const TIFFRaster& b) { return a.size().width() > b.size().width(); });
+}
+
+void FileFormats::GeoTIFF::interpretGeoData()
+{
+    // Handle Tag 270, name
+    if (m_TIFFFields.contains(270))
+    {
+        auto value = m_TIFFFields.ascii(270);
+        m_name = QString::fromLatin1(QByteArray::fromRawData(value.data(), value.size()).split(0).constLast());
+    }
+
     // Handle Tag 256, compute width
-    quint16 width = 0;
+    quint64 width = 0;
     {
         if (m_TIFFFields.contains(256))
         {
-            auto values = m_TIFFFields.value(256);
-            if (values.isEmpty())
+            auto values = m_TIFFFields.unsignedIntegers(256);
+            if (values.empty())
             {
                 throw QObject::tr("No data for tag 256.", "FileFormats::GeoTIFF");
             }
-            bool ok = false;
-            width = values.constLast().toUInt(&ok);
-            if (!ok)
-            {
-                throw QObject::tr("Invalid data for tag 256.", "FileFormats::GeoTIFF");
-            }
+            width = values.constLast();
         }
         else
         {
@@ -377,21 +688,16 @@ void FileFormats::GeoTIFF::interpretGeoData()
     }
 
     // Handle Tag 257, compute height
-    quint16 height = 0;
+    quint64 height = 0;
     {
         if (m_TIFFFields.contains(257))
         {
-            auto values = m_TIFFFields.value(257);
-            if (values.isEmpty())
+            auto values = m_TIFFFields.unsignedIntegers(257);
+            if (values.empty())
             {
                 throw QObject::tr("No data for tag 257.", "FileFormats::GeoTIFF");
             }
-            bool ok = false;
-            height = values.constLast().toUInt(&ok);
-            if (!ok)
-            {
-                throw QObject::tr("Invalid data for tag 257.", "FileFormats::GeoTIFF");
-            }
+            height = values.constLast();
         }
         else
         {
@@ -399,20 +705,145 @@ void FileFormats::GeoTIFF::interpretGeoData()
         }
     }
 
-    // Computer bottom right of bounding box
-    QGeoCoordinate coord = m_bBox.topLeft();
-    coord.setLongitude(coord.longitude() + (width-1)*pixelWidth);
-    if (pixelHeight > 0)
+    m_rasterSize = QSize(int(width), int(height));
+
+    // Handle Tags 34735, 34736 and 34737, GeoKeys. Files without GeoKeys are
+    // treated as geographic.
+    m_geoKeys = GeoKeyDirectory(m_TIFFFields);
+    auto projection = Projection::fromGeoKeys(m_geoKeys);
+
+    // Coefficients of the affine transformation from raster to model
+    // coordinates: x = a[0]*i + a[1]*j + a[2], y = a[3]*i + a[4]*j + a[5]
+    std::array<double, 6> a {};
+    if (m_TIFFFields.contains(34264))
     {
-        coord.setLatitude(coord.latitude() - (height-1)*pixelHeight);
+        // Handle Tag 34264, a 4x4 matrix in row-major order
+        auto values = m_TIFFFields.doubles(34264);
+        if (values.size() < 16)
+        {
+            throw QObject::tr("Invalid data for tag 34264.", "FileFormats::GeoTIFF");
+        }
+        a = {values[0], values[1], values[3], values[4], values[5], values[7]};
     }
     else
     {
-        coord.setLatitude(coord.latitude() + (height-1)*pixelHeight);
+        // Handle Tag 33922, tie point
+        if (!m_TIFFFields.contains(33922))
+        {
+            throw QObject::tr("Tag 33922 is not set.", "FileFormats::GeoTIFF");
+        }
+        auto tiePoint = m_TIFFFields.doubles(33922);
+        if (tiePoint.size() < 5)
+        {
+            throw QObject::tr("Invalid data for tag 33922.", "FileFormats::GeoTIFF");
+        }
+
+        // Handle Tag 33550, pixel width and height. Some files give the pixel
+        // height with a negative sign. Since the raster is north-up in any
+        // case, the sign is ignored.
+        if (!m_TIFFFields.contains(33550))
+        {
+            throw QObject::tr("Tag 33550 is not set.", "FileFormats::GeoTIFF");
+        }
+        auto pixelScale = m_TIFFFields.doubles(33550);
+        if (pixelScale.size() < 2)
+        {
+            throw QObject::tr("Invalid data for tag 33550.", "FileFormats::GeoTIFF");
+        }
+        auto pixelWidth = pixelScale[0];
+        auto pixelHeight = std::abs(pixelScale[1]);
+        a = {pixelWidth, 0.0, tiePoint[3] - tiePoint[0]*pixelWidth, 0.0, -pixelHeight, tiePoint[4] + tiePoint[1]*pixelHeight};
+    }
+
+    // With PixelIsPoint, raster coordinates refer to the centers of pixels.
+    // Shift by half a pixel, so that the transformation maps pixel corners.
+    if (m_geoKeys.rasterType() == GeoKeyDirectory::RasterPixelIsPoint)
+    {
+        a[2] -= 0.5*(a[0] + a[1]);
+        a[5] -= 0.5*(a[3] + a[4]);
     }
-    m_bBox.setBottomRight(coord);
+
+    // Model coordinates are given in angular units for geographic coordinate
+    // systems, and in linear units for projected ones
+    auto unit = (projection.method() == Projection::Method::Geographic) ? Projection::angularUnit(m_geoKeys) : Projection::linearUnit(m_geoKeys);
+    for (auto& coefficient : a)
+    {
+        coefficient *= unit;
+    }
+    m_transform = GeoTransform(a, projection);
+    if (!m_transform.isValid())
+    {
+        throw QObject::tr("The model transformation is not invertible.", "FileFormats::GeoTIFF");
+    }
+
+    // Compute bounding box from points along the edges of the raster. The
+    // edges may be rotated, and curved if the coordinate system is
+    // projected.
+    const int steps = (projection.method() == Projection::Method::Geographic) ? 1 : 16;
+    QVector<double> x;
+    QVector<double> y;
+    for (int step=0; step<steps; step++)
+    {
+        auto fraction = double(step)/steps;
+        x += {fraction*double(width), double(width), (1.0 - fraction)*double(width), 0.0};
+        y += {0.0, fraction*double(height), double(height), (1.0 - fraction)*double(height)};
+    }
+    m_transform.toGeo(x, y, x, y);
+    if (std::any_of(x.cbegin(), x.cend(), [](double value) { return std::isnan(value); }) || std::any_of(y.cbegin(), y.cend(), [](double value) { return std::isnan(value); }))
+    {
+        throw QObject::tr("The bounding box is invalid.", "FileFormats::GeoTIFF");
+    }
+    auto [minLon, maxLon] = std::minmax_element(x.cbegin(), x.cend());
+    auto [minLat, maxLat] = std::minmax_element(y.cbegin(), y.cend());
+    m_bBox = QGeoRectangle(QGeoCoordinate(*maxLat, *minLon), QGeoCoordinate(*minLat, *maxLon));
     if (!m_bBox.isValid())
     {
         throw QObject::tr("The bounding box is invalid.", "FileFormats::GeoTIFF");
     }
 }
+
+void FileFormats::GeoTIFF::interpretRasterData(bool littleEndian, quint64 ifdOffset)
+{
+    try
+    {
+        m_raster = TIFFRaster(m_TIFFFields, littleEndian, ifdOffset);
+    }
+    catch (QString& message)
+    {
+        addWarning(message);
+        return;
+    }
+
+    // Handle Tag 42113, GDAL_NODATA. The value is given as a string.
+    if (!m_TIFFFields.contains(42113))
+    {
+        return;
+    }
+    auto value = m_TIFFFields.ascii(42113);
+    bool ok = false;
+    auto noData = QByteArray::fromRawData(value.data(), value.size()).split(0).constFirst().trimmed().toDouble(&ok);
+    if (!ok || (noData < 0.0) || (noData > 255.0) || (noData != std::floor(noData)))
+    {
+        addWarning(QObject::tr("Value of tag 42113 is not supported.", "FileFormats::GeoTIFF"));
+        return;
+    }
+    auto sample = int(noData);
+    switch (m_raster.format())
+    {
+    case QImage::Format_Grayscale8:
+        // Images with photometric interpretation WhiteIsZero are inverted
+        // when read
+        sample = (m_raster.photometric() == 0) ? 255 - sample : sample;
+        m_noDataColor = qRgb(sample, sample, sample);
+        break;
+    case QImage::Format_RGB888:
+        m_noDataColor = qRgb(sample, sample, sample);
+        break;
+    default:
+        if (!m_raster.colorTable().isEmpty())
+        {
+            m_noDataColor = m_raster.colorTable().value(sample);
+        }
+        break;
+    }
+}
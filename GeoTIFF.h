@@ -21,9 +21,20 @@
 #pragma once
 
 #include <QGeoRectangle>
-#include <QVariant>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+
+#include <functional>
+#include <memory>
+#include <optional>
 
 #include "DataFileAbstract.h"
+#include "GeoKeyDirectory.h"
+#include "GeoTransform.h"
+#include "TIFFRaster.h"
+#include "TIFFTagTable.h"
+#include "ZIPArchive.h"
 
 namespace FileFormats
 {
@@ -33,10 +44,12 @@ namespace FileFormats
  *  This class reads GeoTIFF files, as specified here:
  *  https://gis-lab.info/docs/geotiff-1.8.2.pdf
  *
- *  It extracts bounding box coordinates, as well as the name of the file. This
- *  class does not read the raster data. GeoTIFF is a huge and complex standard,
+ *  It extracts bounding box coordinates, as well as the name of the file. The
+ *  raster data is not read by the constructor, but windows of the raster can be
+ *  read on demand with readWindow(). GeoTIFF is a huge and complex standard,
  *  and this class is definitively not able to read all possible valid GeoTIFF
  *  files. We restrict ourselves to files that appear in real-world aviation.
+ *  Classic TIFF and BigTIFF files are supported.
  */
 
 class GeoTIFF : public DataFileAbstract
@@ -47,19 +60,50 @@ public:
      *  The constructor opens and analyzes the GeoTIFF file. It does not read
      *  the raster data and is therefore lightweight.
      *
-     *  \param fileName File name of a GeoTIFF file.
+     *  All entries of the image file directory are indexed, but only the
+     *  values of the tags required to compute name and bounding box, and of
+     *  the requested tags, are read and decoded.
+     *
+     *  \param fileName File name of a GeoTIFF file, or path of a GeoTIFF file
+     *  in a ZIP archive, see ZIPArchive::splitPath(). Files in archives are
+     *  read without extracting them.
+     *
+     *  \param requestedTags Additional tags whose values are decoded and made
+     *  available via TIFFFields().
      */
-    GeoTIFF(const QString& fileName);
+    GeoTIFF(const QString& fileName, const QList<quint16>& requestedTags = {});
 
     /*! \brief Constructor
      *
      *  The constructor opens and analyzes the GeoTIFF file. It does not read
      *  the raster data and is therefore lightweight.
      *
+     *  All entries of the image file directory are indexed, but only the
+     *  values of the tags required to compute name and bounding box, and of
+     *  the requested tags, are read and decoded.
+     *
      *  \param device Device from which the GeoTIFF is read. The device must be
      *  opened and seekable. The device will not be closed by this method.
+     *
+     *  \param requestedTags Additional tags whose values are decoded and made
+     *  available via TIFFFields().
+     */
+    GeoTIFF(QIODevice& device, const QList<quint16>& requestedTags = {});
+
+    /*! \brief Constructor
+     *
+     *  The constructor analyzes the GeoTIFF file. It does not read the raster
+     *  data and is therefore lightweight. Unless the reader provides the data
+     *  in memory, the constructor fetches the first 16 KiB of the file
+     *  together with the header. In most files, they contain the first image
+     *  file directory and its values, so that one round trip suffices.
+     *
+     *  \param reader Reader from which the GeoTIFF is read
+     *
+     *  \param requestedTags Additional tags whose values are decoded and made
+     *  available via TIFFFields().
      */
-    GeoTIFF(QIODevice& device);
+    GeoTIFF(RangeReader& reader, const QList<quint16>& requestedTags = {});
 
 
     //
@@ -73,11 +117,215 @@ public:
     [[nodiscard]] QString name() const { return m_name; }
 
     /*! \brief Bounding box, as specified in the GeoTIFF file
+     *
+     *  The bounding box covers the whole raster, from the outer corners of
+     *  the corner pixels. It is computed from the ModelTransformation (tag
+     *  34264) if present, or else from the ModelTiepoint (tag 33922) and
+     *  ModelPixelScale (tag 33550), honoring the raster type, units and
+     *  projection given by the GeoKeys, see Projection::fromGeoKeys().
      *
      *  @returns Bounding box, which might be invalid
      */
     [[nodiscard]] QGeoRectangle bBox() const { return m_bBox; }
 
+    /*! \brief Size of the raster image, as specified in the GeoTIFF file
+     *
+     *  @returns Width and height of the raster image in pixels, or an invalid
+     *  size if the file is invalid
+     */
+    [[nodiscard]] QSize rasterSize() const { return m_rasterSize; }
+
+    /*! \brief Transformation between raster and geographic coordinates
+     *
+     *  The transformation is the one used to compute bBox(). Use its batch
+     *  methods to transform many points at once.
+     *
+     *  @returns Transformation, which is invalid if the file is invalid
+     */
+    [[nodiscard]] const GeoTransform& transform() const { return m_transform; }
+
+    /*! \brief GeoKeys
+     *
+     *  @returns GeoKey directory, which is empty if the file has no GeoKeys
+     */
+    [[nodiscard]] const GeoKeyDirectory& geoKeys() const { return m_geoKeys; }
+
+    /*! \brief Color of pixels without data
+     *
+     *  The color is computed from the tag GDAL_NODATA (42113), which gives a
+     *  sample value. For palette images, the value is an index into the color
+     *  map. For 8-bit gray and RGB images, all samples of a pixel without
+     *  data have this value. Images with other layouts mark pixels without
+     *  data by an alpha channel, and the tag is ignored.
+     *
+     *  @returns Color in the images returned by readWindow(), or
+     *  std::nullopt if the file does not mark pixels without data by a color
+     */
+    [[nodiscard]] std::optional<QRgb> noDataColor() const { return m_noDataColor; }
+
+    /*! \brief TIFF fields found in the first image file directory
+     *
+     *  The table contains all tags of the image file directory. Values are
+     *  available only for the tags that were decoded, see the constructor.
+     *
+     *  @returns Table of TIFF fields
+     */
+    [[nodiscard]] const TIFFTagTable& TIFFFields() const { return m_TIFFFields; }
+
+    /*! \brief Raster layout
+     *
+     *  If the raster layout is not supported, the raster is null and
+     *  warnings() contains an explanation.
+     *
+     *  @returns Layout of the raster data
+     */
+    [[nodiscard]] const TIFFRaster& raster() const { return m_raster; }
+
+    /*! \brief Overviews
+     *
+     *  Overviews are reduced-resolution versions of the raster, found in
+     *  further image file directories or in SubIFDs and marked by the TIFF
+     *  tag NewSubfileType. Overviews whose layout is not supported are
+     *  omitted, and warnings() contains an explanation.
+     *
+     *  @returns Overviews, largest first
+     */
+    [[nodiscard]] const QVector<TIFFRaster>& overviews() const { return m_overviews; }
+
+    /*! \brief Raster for reading at reduced scale
+     *
+     *  @param scale Number of image pixels per raster pixel, typically
+     *  between 0 and 1
+     *
+     *  @returns The smallest of raster() and overviews() whose resolution is
+     *  at least the given scale times the resolution of raster()
+     */
+    [[nodiscard]] const TIFFRaster& rasterForScale(double scale) const;
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Read a window of the raster
+     *
+     *  This method reopens the file whose name was passed to the constructor
+     *  and reads only those strips or tiles of the raster that intersect the
+     *  window. For files in a ZIP archive, the archive and the reader of the
+     *  file are opened by the first call and kept, so that later calls of
+     *  compressed files restart inflation at the access points recorded by
+     *  earlier ones, see ZIPArchive. Calls for compressed files in an
+     *  archive are serialized. Stored files are read from the mapped archive
+     *  without locking.
+     *
+     *  @param window Window in raster coordinates. The window is clipped to
+     *  the raster.
+     *
+     *  @param options Number of decoding threads and memory budget, see
+     *  TIFFRaster::readWindow()
+     *
+     *  @returns Image of the clipped window, or a null image if the raster
+     *  cannot be read, or if this object was constructed from a device or
+     *  reader.
+     */
+    [[nodiscard]] QImage readWindow(const QRect& window, const TIFFReadOptions& options = {}) const;
+
+    /*! \brief Read a window of the raster
+     *
+     *  Reads only those strips or tiles of the raster that intersect the
+     *  window.
+     *
+     *  @param device Device from which the GeoTIFF is read. The device must be
+     *  opened and seekable.
+     *
+     *  @param window Window in raster coordinates. The window is clipped to
+     *  the raster.
+     *
+     *  @param options Number of decoding threads and memory budget, see
+     *  TIFFRaster::readWindow()
+     *
+     *  @returns Image of the clipped window, or a null image if the raster
+     *  cannot be read
+     */
+    [[nodiscard]] QImage readWindow(QIODevice& device, const QRect& window, const TIFFReadOptions& options = {}) const;
+
+    /*! \brief Read a window of the raster
+     *
+     *  Reads only those strips or tiles of the raster that intersect the
+     *  window.
+     *
+     *  @param reader Reader from which the GeoTIFF is read
+     *
+     *  @param window Window in raster coordinates. The window is clipped to
+     *  the raster.
+     *
+     *  @param options Number of decoding threads and memory budget, see
+     *  TIFFRaster::readWindow()
+     *
+     *  @returns Image of the clipped window, or a null image if the raster
+     *  cannot be read
+     */
+    [[nodiscard]] QImage readWindow(RangeReader& reader, const QRect& window, const TIFFReadOptions& options = {}) const;
+
+    /*! \brief Read a window of the raster at reduced scale
+     *
+     *  This method reads the window from rasterForScale(), so that zoomed-out
+     *  views read only a fraction of the data. The returned image has the
+     *  resolution of that raster, which is at least the requested resolution.
+     *  Scaling it to the exact size is left to the caller.
+     *
+     *  @param window Window in coordinates of raster(). The window is clipped
+     *  to the raster.
+     *
+     *  @param scale Number of image pixels per raster pixel
+     *
+     *  @param options Number of decoding threads and memory budget, see
+     *  TIFFRaster::readWindow()
+     *
+     *  @returns Image of the clipped window, or a null image if the raster
+     *  cannot be read, or if this object was constructed from a device or
+     *  reader.
+     */
+    [[nodiscard]] QImage readWindow(const QRect& window, double scale, const TIFFReadOptions& options = {}) const;
+
+    /*! \brief Read a window of the raster at reduced scale
+     *
+     *  This method reads the window from rasterForScale(), see above.
+     *
+     *  @param device Device from which the GeoTIFF is read. The device must be
+     *  opened and seekable.
+     *
+     *  @param window Window in coordinates of raster(). The window is clipped
+     *  to the raster.
+     *
+     *  @param scale Number of image pixels per raster pixel
+     *
+     *  @param options Number of decoding threads and memory budget, see
+     *  TIFFRaster::readWindow()
+     *
+     *  @returns Image of the clipped window, or a null image if the raster
+     *  cannot be read
+     */
+    [[nodiscard]] QImage readWindow(QIODevice& device, const QRect& window, double scale, const TIFFReadOptions& options = {}) const;
+
+    /*! \brief Read a window of the raster at reduced scale
+     *
+     *  This method reads the window from rasterForScale(), see above.
+     *
+     *  @param reader Reader from which the GeoTIFF is read
+     *
+     *  @param window Window in coordinates of raster(). The window is clipped
+     *  to the raster.
+     *
+     *  @param scale Number of image pixels per raster pixel
+     *
+     *  @param options Number of decoding threads and memory budget, see
+     *  TIFFRaster::readWindow()
+     *
+     *  @returns Image of the clipped window, or a null image if the raster
+     *  cannot be read
+     */
+    [[nodiscard]] QImage readWindow(RangeReader& reader, const QRect& window, double scale, const TIFFReadOptions& options = {}) const;
 
 
     //
@@ -92,46 +340,112 @@ public:
 
 private:
 
-    /* This methods reads the TIFF data from the device. On success, it fills
-     * the memeber m_TIFFFields with appropriate data. On failure, it throws a
-     * QString with a human-readable, translated error message.
+    /* This methods reads the TIFF data from the reader. On success, it fills
+     * the memeber m_TIFFFields with appropriate data. On failure, it sets an
+     * error message.
+     *
+     * If the reader provides the data in memory, the data is parsed directly.
+     * Otherwise, the header is read together with the first 16 KiB of the
+     * file. IFDs and out-of-line values that lie outside of this prefix are
+     * read with one call to the reader per IFD, and one for the values.
+     *
+     * @param reader Reader from which the TIFF data is read
      *
-     * @param device QIODevice from which the TIFF header will be read. This
-     * device must be seekable.
+     * @param tags Sorted list of tags whose values are decoded
      */
-    void readTIFFData(QIODevice& device);
+    void readTIFFData(RangeReader& reader, const QList<quint16>& tags);
 
-    /* This methods reads a single TIFF field from the device. On success, it
-     * adds an entry to the member m_TIFFFields and positions the device on the
-     * byte following the structure. On failure, it throws a QString with a
-     * human-readable, translated error message.
-     *
-     * This method only reads values of type ASCII, SHORT and DOUBLE. Values of
-     * other types will be ignored.
+    /* This methods reads the TIFF data from memory. On success, it fills the
+     * memeber m_TIFFFields with appropriate data. On failure, it throws a
+     * QString with a human-readable, translated error message.
      *
-     * @param device QIODevice from which the TIFF header will be read. This
-     * device must be open, seekable, and positioned to the beginning of the
-     * TIFF field structure.
+     * @param data Complete content of the TIFF file
      *
-     * @param dataStream QDataStream that is connected to the device and has the
-     * correct endianness set.
+     * @param tags Sorted list of tags whose values are decoded
+     */
+    void readTIFFData(QByteArrayView data, const QList<quint16>& tags);
+
+    /* This methods reads the IFD at the given offset and fills fields. Data
+     * found in prefix, which holds the beginning of the file, is not read
+     * again. The IFD has the layout of BigTIFF if bigTIFF is set. It returns
+     * the offset of the next IFD, or zero. On failure, it throws a QString
+     * with a human-readable, translated error message.
+     */
+    quint64 readIFD(RangeReader& reader, const QByteArray& prefix, quint64 offset, bool littleEndian, bool bigTIFF, const QList<quint16>& tags, TIFFTagTable& fields);
+
+    /* This methods reads the IFD at the given offset from memory and fills
+     * fields, as above. It returns the offset of the next IFD, or zero. On
+     * failure, it throws a QString with a human-readable, translated error
+     * message.
+     */
+    quint64 readIFD(QByteArrayView data, quint64 offset, bool littleEndian, bool bigTIFF, const QList<quint16>& tags, TIFFTagTable& fields);
+
+    /* This methods visits the IFDs that follow IFD0 and the SubIFDs, and
+     * writes the reduced-resolution rasters to m_overviews. IFDs are read with
+     * readOverviewIFD, which takes an offset, fills a table with the values
+     * of overviewTags() and returns the offset of the next IFD. Overviews
+     * that cannot be read add warnings.
+     */
+    void readOverviews(quint64 ifd0Offset, quint64 nextIFDOffset, bool littleEndian, const std::function<quint64(quint64, TIFFTagTable&)>& readOverviewIFD);
+
+    /* Returns a sorted list of the tags required to read overviews */
+    static QList<quint16> overviewTags();
+
+    /* Returns a sorted list that contains the tags required by
+     * interpretGeoData() and the requested tags.
      */
-    void readTIFFField(QIODevice& device, QDataStream& dataStream);
+    static QList<quint16> tagsToDecode(const QList<quint16>& requestedTags);
 
     /* This methods interprets the data found in m_TIFFFields and writes to
-     * m_bBox and m_name.On failure, it throws a QString with a human-readable,
-     * translated error message.
+     * m_bBox, m_geoKeys, m_name, m_rasterSize and m_transform. On failure, it
+     * throws a QString with a human-readable, translated error message.
      */
     void interpretGeoData();
 
+    /* This methods interprets the raster layout found in m_TIFFFields and
+     * writes to m_raster and m_noDataColor. If the layout is not supported, it
+     * adds a warning.
+     * The byte order and the offset of the image file directory are those of
+     * the TIFF file.
+     */
+    void interpretRasterData(bool littleEndian, quint64 ifdOffset);
+
     // TIFF tags and associated data
-    QMap<quint16, QVariantList> m_TIFFFields;
+    TIFFTagTable m_TIFFFields;
+
+    // GeoKeys
+    GeoKeyDirectory m_geoKeys;
+
+    // Transformation between raster and geographic coordinates
+    GeoTransform m_transform;
 
     // Bounding box
     QGeoRectangle m_bBox;
 
     // Name
     QString m_name;
+
+    // Size of the raster image
+    QSize m_rasterSize;
+
+    // Raster layout
+    TIFFRaster m_raster;
+
+    // Color of pixels without data
+    std::optional<QRgb> m_noDataColor;
+
+    // Reduced-resolution rasters, largest first
+    QVector<TIFFRaster> m_overviews;
+
+    // File name, or empty if constructed from a device or reader
+    QString m_fileName;
+
+    // Archive and reader of a file in a ZIP archive, opened by readWindow()
+    // under the mutex. Readers of compressed files inflate a single stream,
+    // so their reads also hold the mutex.
+    mutable QMutex m_archiveMutex;
+    mutable std::unique_ptr<ZIPArchive> m_archive;
+    mutable std::unique_ptr<RangeReader> m_archiveReader;
 };
 
 } // namespace FileFormats
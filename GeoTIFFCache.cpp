@@ -0,0 +1,305 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "GeoTIFFCache.h"
+
+
+//
+// File layout
+//
+
+namespace {
+
+// Header: magic (8 bytes), version (quint32), number of records (quint32),
+// offset of the string pool (quint64)
+const QByteArrayView magic("GTIFFCAT");
+const quint32 formatVersion = 1;
+const qint64 headerSize = 24;
+
+// Record fields and their offsets within the record
+enum RecordField : qint64 {
+    RF_PathHash = 0,        // quint64
+    RF_PathOffset = 8,      // quint32
+    RF_PathLength = 12,     // quint32
+    RF_FileSize = 16,       // qint64
+    RF_LastModified = 24,   // qint64
+    RF_Top = 32,            // double
+    RF_Left = 40,           // double
+    RF_Bottom = 48,         // double
+    RF_Right = 56,          // double
+    RF_Width = 64,          // qint32
+    RF_Height = 68,         // qint32
+    RF_NameOffset = 72,     // quint32
+    RF_NameLength = 76,     // quint32
+    RF_ErrorOffset = 80,    // quint32
+    RF_ErrorLength = 84,    // quint32
+    RF_WarningsOffset = 88, // quint32
+    RF_WarningsLength = 92, // quint32
+    RF_IsValid = 96,        // quint8
+    RF_Size = 104
+};
+
+// Stable 64-bit FNV-1a hash of the path. Unlike qHash, this does not depend
+// on a per-process seed.
+quint64 pathHash(QByteArrayView path)
+{
+    quint64 hash = 14695981039346656037ULL;
+    for (auto byte : path)
+    {
+        hash ^= quint8(byte);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template<typename T>
+T readValue(const char* data)
+{
+    if constexpr (std::is_same_v<T, double>)
+    {
+        return std::bit_cast<double>(qFromLittleEndian<quint64>(data));
+    }
+    else
+    {
+        return qFromLittleEndian<T>(data);
+    }
+}
+
+template<typename T>
+void writeValue(char* data, T value)
+{
+    if constexpr (std::is_same_v<T, double>)
+    {
+        qToLittleEndian<quint64>(std::bit_cast<quint64>(value), data);
+    }
+    else
+    {
+        qToLittleEndian<T>(value, data);
+    }
+}
+
+} // namespace
+
+
+//
+// Constructors
+//
+
+FileFormats::GeoTIFFCache::GeoTIFFCache(const QString& fileName)
+    : m_file(fileName)
+{
+    if (!m_file.open(QFile::ReadOnly))
+    {
+        return;
+    }
+    auto size = m_file.size();
+    if (size < headerSize)
+    {
+        return;
+    }
+    auto* data = m_file.map(0, size);
+    if (data == nullptr)
+    {
+        return;
+    }
+    QByteArrayView const mapped(data, size);
+
+    // Validate header. Records are not validated here, so that opening the
+    // cache does not depend on the number of entries.
+    if (mapped.first(magic.size()) != magic)
+    {
+        return;
+    }
+    if (readValue<quint32>(mapped.data()+8) != formatVersion)
+    {
+        return;
+    }
+    auto recordCount = readValue<quint32>(mapped.data()+12);
+    auto stringsOffset = readValue<quint64>(mapped.data()+16);
+    if ((stringsOffset != quint64(headerSize + recordCount*RF_Size)) || (stringsOffset > quint64(size)))
+    {
+        return;
+    }
+
+    m_data = mapped;
+    m_recordCount = recordCount;
+}
+
+
+//
+// Getter methods
+//
+
+std::optional<FileFormats::GeoTIFFCatalog::Entry> FileFormats::GeoTIFFCache::find(const QString& path, qint64 fileSize, qint64 lastModified) const
+{
+    if (m_recordCount == 0)
+    {
+        return std::nullopt;
+    }
+
+    auto pathUtf8 = path.toUtf8();
+    auto hash = pathHash(pathUtf8);
+    const char* records = m_data.data() + headerSize;
+
+    // Binary search for the first record with the given hash
+    qsizetype low = 0;
+    qsizetype high = m_recordCount;
+    while (low < high)
+    {
+        auto mid = low + (high-low)/2;
+        if (readValue<quint64>(records + mid*RF_Size + RF_PathHash) < hash)
+        {
+            low = mid+1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    for (auto index = low; index < m_recordCount; ++index)
+    {
+        const char* record = records + index*RF_Size;
+        if (readValue<quint64>(record + RF_PathHash) != hash)
+        {
+            break;
+        }
+        if (string(readValue<quint32>(record + RF_PathOffset), readValue<quint32>(record + RF_PathLength)) != QByteArrayView(pathUtf8))
+        {
+            continue;
+        }
+        if ((readValue<qint64>(record + RF_FileSize) != fileSize) || (readValue<qint64>(record + RF_LastModified) != lastModified))
+        {
+            return std::nullopt;
+        }
+
+        GeoTIFFCatalog::Entry entry;
+        entry.path = path;
+        entry.fileSize = fileSize;
+        entry.lastModified = lastModified;
+        entry.name = QString::fromUtf8(string(readValue<quint32>(record + RF_NameOffset), readValue<quint32>(record + RF_NameLength)));
+        entry.error = QString::fromUtf8(string(readValue<quint32>(record + RF_ErrorOffset), readValue<quint32>(record + RF_ErrorLength)));
+        auto warnings = string(readValue<quint32>(record + RF_WarningsOffset), readValue<quint32>(record + RF_WarningsLength));
+        if (!warnings.isEmpty())
+        {
+            entry.warnings = QString::fromUtf8(warnings).split(u'\n');
+        }
+        entry.isValid = (readValue<quint8>(record + RF_IsValid) != 0);
+        entry.rasterSize = QSize(readValue<qint32>(record + RF_Width), readValue<qint32>(record + RF_Height));
+
+        auto top = readValue<double>(record + RF_Top);
+        auto left = readValue<double>(record + RF_Left);
+        auto bottom = readValue<double>(record + RF_Bottom);
+        auto right = readValue<double>(record + RF_Right);
+        if (!std::isnan(top) && !std::isnan(left) && !std::isnan(bottom) && !std::isnan(right))
+        {
+            entry.bBox = QGeoRectangle(QGeoCoordinate(top, left), QGeoCoordinate(bottom, right));
+        }
+        return entry;
+    }
+    return std::nullopt;
+}
+
+
+//
+// Static methods
+//
+
+bool FileFormats::GeoTIFFCache::write(const QString& fileName, const QVector<GeoTIFFCatalog::Entry>& entries)
+{
+    // Build string pool and records
+    QByteArray strings;
+    auto addString = [&strings](const QByteArray& string, char* record, qint64 offsetField, qint64 lengthField) {
+        writeValue<quint32>(record + offsetField, strings.size());
+        writeValue<quint32>(record + lengthField, string.size());
+        strings += string;
+    };
+
+    QVector<QByteArray> records;
+    records.reserve(entries.size());
+    for (const auto& entry : entries)
+    {
+        QByteArray record(RF_Size, '\0');
+        auto* data = record.data();
+        auto path = entry.path.toUtf8();
+
+        writeValue<quint64>(data + RF_PathHash, pathHash(path));
+        addString(path, data, RF_PathOffset, RF_PathLength);
+        writeValue<qint64>(data + RF_FileSize, entry.fileSize);
+        writeValue<qint64>(data + RF_LastModified, entry.lastModified);
+        auto valid = entry.bBox.isValid();
+        writeValue<double>(data + RF_Top, valid ? entry.bBox.topLeft().latitude() : NAN);
+        writeValue<double>(data + RF_Left, valid ? entry.bBox.topLeft().longitude() : NAN);
+        writeValue<double>(data + RF_Bottom, valid ? entry.bBox.bottomRight().latitude() : NAN);
+        writeValue<double>(data + RF_Right, valid ? entry.bBox.bottomRight().longitude() : NAN);
+        writeValue<qint32>(data + RF_Width, entry.rasterSize.width());
+        writeValue<qint32>(data + RF_Height, entry.rasterSize.height());
+        addString(entry.name.toUtf8(), data, RF_NameOffset, RF_NameLength);
+        addString(entry.error.toUtf8(), data, RF_ErrorOffset, RF_ErrorLength);
+        addString(entry.warnings.join(u'\n').toUtf8(), data, RF_WarningsOffset, RF_WarningsLength);
+        writeValue<quint8>(data + RF_IsValid, entry.isValid ? 1 : 0);
+        records.append(record);
+    }
+    std::sort(records.begin(), records.end(), [](const QByteArray& a, const QByteArray& b) {
+        return readValue<quint64>(a.constData() + RF_PathHash) < readValue<quint64>(b.constData() + RF_PathHash);
+    });
+
+    // Write file
+    QByteArray header(headerSize, '\0');
+    std::copy(magic.begin(), magic.end(), header.data());
+    writeValue<quint32>(header.data()+8, formatVersion);
+    writeValue<quint32>(header.data()+12, records.size());
+    writeValue<quint64>(header.data()+16, headerSize + records.size()*RF_Size);
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    file.write(header);
+    for (const auto& record : records)
+    {
+        file.write(record);
+    }
+    file.write(strings);
+    return file.commit();
+}
+
+
+//
+// Private Methods
+//
+
+QByteArrayView FileFormats::GeoTIFFCache::string(quint32 offset, quint32 length) const
+{
+    auto stringsOffset = headerSize + m_recordCount*RF_Size;
+    if (stringsOffset + qint64(offset) + qint64(length) > m_data.size())
+    {
+        return {};
+    }
+    return m_data.sliced(stringsOffset + offset, length);
+}
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QFile>
+
+#include <optional>
+
+#include "GeoTIFFCatalog.h"
+
+namespace FileFormats
+{
+
+/*! \brief Persistent cache of GeoTIFF metadata
+ *
+ *  This class reads a binary cache file that stores the results of
+ *  GeoTIFFCatalog, keyed by path, size and modification time of the GeoTIFF
+ *  files. The cache file is mapped into memory and used in place. Opening a
+ *  cache is therefore independent of the number of entries, and a lookup is a
+ *  binary search over fixed-size records.
+ *
+ *  The file consists of a header, an array of fixed-size records sorted by a
+ *  stable hash of the path, and a pool of UTF-8 strings. All numbers are
+ *  stored in little-endian byte order.
+ *
+ *  Lookups are thread-safe.
+ */
+
+class GeoTIFFCache
+{
+public:
+    /*! \brief Constructor
+     *
+     *  The constructor opens and maps the cache file. If the file does not
+     *  exist or is not a valid cache file, the cache is empty.
+     *
+     *  \param fileName File name of the cache file
+     */
+    GeoTIFFCache(const QString& fileName);
+
+    ~GeoTIFFCache() = default;
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Look up a file
+     *
+     *  @param path Absolute path of the GeoTIFF file
+     *
+     *  @param fileSize Current size of the file in bytes
+     *
+     *  @param lastModified Current modification time of the file, in
+     *  milliseconds since epoch
+     *
+     *  @returns The cached entry, if the cache contains an entry for the path
+     *  whose size and modification time match. Otherwise, std::nullopt.
+     */
+    [[nodiscard]] std::optional<GeoTIFFCatalog::Entry> find(const QString& path, qint64 fileSize, qint64 lastModified) const;
+
+    /*! \brief Number of entries
+     *
+     *  @returns Number of entries in the cache
+     */
+    [[nodiscard]] qsizetype size() const { return m_recordCount; }
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Write a cache file
+     *
+     *  The file is written atomically, so that concurrent readers see either
+     *  the old or the new version.
+     *
+     *  @param fileName File name of the cache file
+     *
+     *  @param entries Entries to store
+     *
+     *  @returns True on success
+     */
+    static bool write(const QString& fileName, const QVector<GeoTIFFCatalog::Entry>& entries);
+
+private:
+    Q_DISABLE_COPY_MOVE(GeoTIFFCache)
+
+    // Returns the string stored in the pool at the given offset and length
+    [[nodiscard]] QByteArrayView string(quint32 offset, quint32 length) const;
+
+    // Cache file, kept open for the lifetime of the mapping
+    QFile m_file;
+
+    // Mapped content of the cache file, or empty if the cache is empty
+    QByteArrayView m_data;
+
+    // Number of records in the cache file
+    qsizetype m_recordCount {0};
+};
+
+} // namespace FileFormats
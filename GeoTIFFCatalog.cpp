@@ -0,0 +1,176 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDateTime>
+#include <QDirIterator>
+#include <QMimeDatabase>
+#include <QThreadPool>
+
+#include "GeoTIFF.h"
+#include "GeoTIFFCache.h"
+#include "GeoTIFFCatalog.h"
+#include "ZIPArchive.h"
+
+
+//
+// Methods
+//
+
+QVector<FileFormats::GeoTIFFCatalog::Entry> FileFormats::GeoTIFFCatalog::scan(const QString& directory)
+{
+    m_canceled = false;
+
+    // Find files. The entries contain path, size and modification time.
+    auto entries = findFiles(directory);
+    auto total = entries.size();
+
+    // Open cache, if any
+    std::unique_ptr<GeoTIFFCache> cache;
+    if (!m_cacheFileName.isEmpty())
+    {
+        cache = std::make_unique<GeoTIFFCache>(m_cacheFileName);
+    }
+
+    // Analyze files on a bounded thread pool. Every task writes only to its
+    // own slot of the result vector.
+    QVector<char> analyzed(total, 0);
+    std::atomic<qsizetype> done {0};
+    std::atomic<qsizetype> cacheHits {0};
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_maxThreadCount);
+    for (qsizetype i=0; i<total; ++i)
+    {
+        pool.start([this, i, total, &entries, &analyzed, &done, &cacheHits, &cache]() {
+            if (m_canceled)
+            {
+                return;
+            }
+
+            auto& entry = entries[i];
+            std::optional<Entry> cached;
+            if (cache)
+            {
+                cached = cache->find(entry.path, entry.fileSize, entry.lastModified);
+            }
+            if (cached)
+            {
+                entry = *cached;
+                ++cacheHits;
+            }
+            else
+            {
+                GeoTIFF const geoTIFF(entry.path);
+                entry.name = geoTIFF.name();
+                entry.bBox = geoTIFF.bBox();
+                entry.isValid = geoTIFF.isValid();
+                entry.error = geoTIFF.error();
+                entry.warnings = geoTIFF.warnings();
+                entry.rasterSize = geoTIFF.rasterSize();
+            }
+            analyzed[i] = 1;
+
+            auto count = ++done;
+            if (m_progressCallback)
+            {
+                m_progressCallback(count, total);
+            }
+        });
+    }
+    pool.waitForDone();
+
+    // Drop files that were not analyzed because the scan was canceled
+    if (done != total)
+    {
+        QVector<Entry> result;
+        result.reserve(done);
+        for (qsizetype i=0; i<total; ++i)
+        {
+            if (analyzed[i] != 0)
+            {
+                result.append(entries[i]);
+            }
+        }
+        return result;
+    }
+
+    // Update cache file if files have been added, changed or removed. The
+    // cache must be closed before the file is replaced.
+    if (cache && ((cacheHits != total) || (cache->size() != total)))
+    {
+        cache.reset();
+        GeoTIFFCache::write(m_cacheFileName, entries);
+    }
+    return entries;
+}
+
+
+//
+// Private Methods
+//
+
+QVector<FileFormats::GeoTIFFCatalog::Entry> FileFormats::GeoTIFFCatalog::findFiles(const QString& directory)
+{
+    QVector<Entry> result;
+
+    QMimeDatabase const mimeDatabase;
+    auto mimeTypes = GeoTIFF::mimeTypes();
+    auto archiveMimeTypes = ZIPArchive::mimeTypes();
+    auto inheritsAny = [](const QMimeType& mimeType, const QStringList& names) {
+        return std::any_of(names.cbegin(), names.cend(), [&mimeType](const QString& name) { return mimeType.inherits(name); });
+    };
+    QDirIterator iterator(directory, QDir::Files|QDir::Readable, QDirIterator::Subdirectories);
+    while (iterator.hasNext())
+    {
+        iterator.next();
+        auto fileInfo = iterator.fileInfo();
+        auto mimeType = mimeDatabase.mimeTypeForFile(fileInfo);
+
+        // Files in ZIP archives are recognized by their names only, so that
+        // they need not be read. They share the modification time of the
+        // archive.
+        if (inheritsAny(mimeType, archiveMimeTypes))
+        {
+            ZIPArchive const archive(fileInfo.absoluteFilePath());
+            for (const auto& archiveEntry : archive.entries())
+            {
+                if (inheritsAny(mimeDatabase.mimeTypeForFile(archiveEntry.name, QMimeDatabase::MatchExtension), mimeTypes))
+                {
+                    Entry entry;
+                    entry.path = fileInfo.absoluteFilePath() + u"/"_qs + archiveEntry.name;
+                    entry.fileSize = archiveEntry.size;
+                    entry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+                    result.append(entry);
+                }
+            }
+            continue;
+        }
+
+        if (inheritsAny(mimeType, mimeTypes))
+        {
+            Entry entry;
+            entry.path = fileInfo.absoluteFilePath();
+            entry.fileSize = fileInfo.size();
+            entry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+            result.append(entry);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,189 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoRectangle>
+#include <QSize>
+#include <QStringList>
+#include <QThread>
+
+#include <atomic>
+#include <functional>
+
+namespace FileFormats
+{
+
+/*! \brief Catalog of GeoTIFF files
+ *
+ *  This class walks a directory tree, finds all files whose mime type is
+ *  listed in GeoTIFF::mimeTypes(), and analyzes them with GeoTIFF. The files
+ *  are analyzed in parallel, on a thread pool of bounded size. Since GeoTIFF
+ *  reads only the file headers, the work scales with the number of cores.
+ *
+ *  GeoTIFF files in ZIP archives are found and analyzed without extracting
+ *  them. Their paths have the form "<archive>/<file in archive>", see
+ *  ZIPArchive::splitPath(), and can be passed to GeoTIFF.
+ *
+ *  A scan can be canceled from any thread. Progress is reported through an
+ *  optional callback.
+ *
+ *  If a cache file is set, results are stored in a GeoTIFFCache, and files
+ *  whose path, size and modification time have not changed since the last
+ *  scan are not analyzed again.
+ */
+
+class GeoTIFFCatalog
+{
+public:
+    /*! \brief Result of the analysis of a single file */
+    struct Entry
+    {
+        /*! \brief Absolute path of the file, or of the file in a ZIP archive */
+        QString path;
+
+        /*! \brief Name, as returned by GeoTIFF::name() */
+        QString name;
+
+        /*! \brief Bounding box, as returned by GeoTIFF::bBox() */
+        QGeoRectangle bBox;
+
+        /*! \brief Validity, as returned by GeoTIFF::isValid() */
+        bool isValid {false};
+
+        /*! \brief Error, as returned by GeoTIFF::error() */
+        QString error;
+
+        /*! \brief Warnings, as returned by GeoTIFF::warnings() */
+        QStringList warnings;
+
+        /*! \brief Raster size, as returned by GeoTIFF::rasterSize() */
+        QSize rasterSize;
+
+        /*! \brief Size of the file in bytes */
+        qint64 fileSize {0};
+
+        /*! \brief Modification time of the file, in milliseconds since epoch */
+        qint64 lastModified {0};
+    };
+
+    /*! \brief Progress callback
+     *
+     *  The callback is called from worker threads, once for every file that
+     *  has been analyzed. Implementations must be thread-safe.
+     *
+     *  The first argument is the number of files analyzed so far, the second
+     *  argument is the total number of files found.
+     */
+    using ProgressCallback = std::function<void(qsizetype, qsizetype)>;
+
+    GeoTIFFCatalog() = default;
+    ~GeoTIFFCatalog() = default;
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Scan a directory tree
+     *
+     *  This method walks the directory tree and analyzes all GeoTIFF files
+     *  found. It blocks until all files have been analyzed or the scan has
+     *  been canceled.
+     *
+     *  @param directory Root of the directory tree
+     *
+     *  @returns Results for all files that have been analyzed, in the order
+     *  in which the files were found. If the scan has been canceled, files
+     *  that were not analyzed are not contained in the list.
+     */
+    [[nodiscard]] QVector<Entry> scan(const QString& directory);
+
+    /*! \brief Cancel a running scan
+     *
+     *  This method can be called from any thread. The running scan stops as
+     *  soon as the files currently being analyzed are done.
+     */
+    void cancel() { m_canceled = true; }
+
+
+    //
+    // Getter/Setter methods
+    //
+
+    /*! \brief Check if the last scan has been canceled
+     *
+     *  @returns True if cancel() has been called during the last scan
+     */
+    [[nodiscard]] bool isCanceled() const { return m_canceled; }
+
+    /*! \brief Maximal number of worker threads
+     *
+     *  @returns Maximal number of threads used to analyze files. By default,
+     *  this is QThread::idealThreadCount().
+     */
+    [[nodiscard]] int maxThreadCount() const { return m_maxThreadCount; }
+
+    /*! \brief Set maximal number of worker threads
+     *
+     *  @param count Maximal number of threads used to analyze files. Values
+     *  smaller than one are treated as one.
+     */
+    void setMaxThreadCount(int count) { m_maxThreadCount = qMax(1, count); }
+
+    /*! \brief Set progress callback
+     *
+     *  @param callback Callback, or an empty function to disable progress
+     *  reporting
+     */
+    void setProgressCallback(const ProgressCallback& callback) { m_progressCallback = callback; }
+
+    /*! \brief Cache file
+     *
+     *  @returns File name of the cache file, or an empty string if no cache
+     *  is used
+     */
+    [[nodiscard]] QString cacheFileName() const { return m_cacheFileName; }
+
+    /*! \brief Set cache file
+     *
+     *  Scans look up files in the cache and update the cache file if files
+     *  have been added, changed or removed. Scans that are canceled do not
+     *  update the cache file.
+     *
+     *  @param fileName File name of the cache file, or an empty string to
+     *  disable caching
+     */
+    void setCacheFileName(const QString& fileName) { m_cacheFileName = fileName; }
+
+private:
+    Q_DISABLE_COPY_MOVE(GeoTIFFCatalog)
+
+    // Returns entries for all GeoTIFF files in the directory tree. Only path,
+    // file size and modification time are set.
+    [[nodiscard]] static QVector<Entry> findFiles(const QString& directory);
+
+    std::atomic<bool> m_canceled {false};
+    int m_maxThreadCount {QThread::idealThreadCount()};
+    ProgressCallback m_progressCallback;
+    QString m_cacheFileName;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,347 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+#include "GeoTIFFIndex.h"
+
+
+namespace {
+
+// Position of (x, y) on the Hilbert curve that fills the square
+// [0, 0xFFFF] x [0, 0xFFFF]
+quint32 hilbert(quint32 x, quint32 y)
+{
+    quint32 a = x ^ y;
+    quint32 b = 0xFFFF ^ a;
+    quint32 c = 0xFFFF ^ (x | y);
+    quint32 d = x & (y ^ 0xFFFF);
+
+    quint32 A = a | (b >> 1);
+    quint32 B = (a >> 1) ^ a;
+    quint32 C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    quint32 D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A; b = B; c = C; d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    quint32 i0 = x ^ y;
+    quint32 i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+// Distance between a value and an interval, or zero if the interval contains
+// the value
+double distance(double value, double min, double max)
+{
+    return std::max({min - value, 0.0, value - max});
+}
+
+} // namespace
+
+
+//
+// Constructors
+//
+
+FileFormats::GeoTIFFIndex::GeoTIFFIndex(const QVector<QGeoRectangle>& boxes)
+{
+    // Collect leaves. Rectangles that cross the antimeridian give two leaves
+    // with the same index.
+    QVector<Box> leaves;
+    QVector<qsizetype> leafIndices;
+    for (qsizetype i=0; i<boxes.size(); ++i)
+    {
+        if (!boxes[i].isValid())
+        {
+            continue;
+        }
+        m_size++;
+        for (const auto& box : GeoTIFFIndex::boxes(boxes[i]))
+        {
+            leaves.append(box);
+            leafIndices.append(i);
+        }
+    }
+    auto leafCount = leaves.size();
+    if (leafCount == 0)
+    {
+        return;
+    }
+
+    // Sort leaves by the Hilbert value of their centers, relative to the
+    // extent of all leaves
+    Box extent = leaves[0];
+    for (const auto& leaf : leaves)
+    {
+        extent.minX = qMin(extent.minX, leaf.minX);
+        extent.minY = qMin(extent.minY, leaf.minY);
+        extent.maxX = qMax(extent.maxX, leaf.maxX);
+        extent.maxY = qMax(extent.maxY, leaf.maxY);
+    }
+    auto width = qMax(extent.maxX - extent.minX, 1e-9);
+    auto height = qMax(extent.maxY - extent.minY, 1e-9);
+
+    QVector<std::pair<quint32, qsizetype>> order;
+    order.reserve(leafCount);
+    for (qsizetype i=0; i<leafCount; ++i)
+    {
+        const auto& leaf = leaves[i];
+        auto x = static_cast<quint32>(0xFFFF * ((leaf.minX + leaf.maxX) / 2 - extent.minX) / width);
+        auto y = static_cast<quint32>(0xFFFF * ((leaf.minY + leaf.maxY) / 2 - extent.minY) / height);
+        order.append({hilbert(x, y), i});
+    }
+    std::sort(order.begin(), order.end());
+
+    // Compute level bounds
+    qsizetype count = leafCount;
+    qsizetype nodeCount = leafCount;
+    m_levelBounds.append(nodeCount);
+    do
+    {
+        count = (count + nodeSize - 1) / nodeSize;
+        nodeCount += count;
+        m_levelBounds.append(nodeCount);
+    } while (count != 1);
+
+    m_boxes.reserve(nodeCount);
+    m_indices.reserve(nodeCount);
+    for (const auto& [hilbertValue, leaf] : order)
+    {
+        m_boxes.append(leaves[leaf]);
+        m_indices.append(leafIndices[leaf]);
+    }
+
+    // Build higher levels, grouping nodeSize consecutive nodes of the level
+    // below into one parent
+    qsizetype position = 0;
+    for (qsizetype level=0; level<m_levelBounds.size()-1; ++level)
+    {
+        auto end = m_levelBounds[level];
+        while (position < end)
+        {
+            auto first = position;
+            Box box = m_boxes[position];
+            for (qsizetype i=0; (i<nodeSize) && (position<end); ++i, ++position)
+            {
+                const auto& child = m_boxes[position];
+                box.minX = qMin(box.minX, child.minX);
+                box.minY = qMin(box.minY, child.minY);
+                box.maxX = qMax(box.maxX, child.maxX);
+                box.maxY = qMax(box.maxY, child.maxY);
+            }
+            m_boxes.append(box);
+            m_indices.append(first);
+        }
+    }
+}
+
+
+
+//
+// Methods
+//
+
+QVector<qsizetype> FileFormats::GeoTIFFIndex::find(const QGeoCoordinate& coordinate) const
+{
+    QVector<qsizetype> result;
+    if (!coordinate.isValid())
+    {
+        return result;
+    }
+
+    // The antimeridian is found at longitude 180 and -180. Bounding boxes
+    // that cross it are indexed as two leaves, which then both contain the
+    // coordinate.
+    Box const box {coordinate.longitude(), coordinate.latitude(), coordinate.longitude(), coordinate.latitude()};
+    search(box, result);
+    if (std::abs(coordinate.longitude()) == 180.0)
+    {
+        search({-box.minX, box.minY, -box.maxX, box.maxY}, result);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+
+QVector<qsizetype> FileFormats::GeoTIFFIndex::find(const QGeoRectangle& rectangle) const
+{
+    QVector<qsizetype> result;
+    if (!rectangle.isValid())
+    {
+        return result;
+    }
+
+    auto parts = boxes(rectangle);
+    for (const auto& box : parts)
+    {
+        search(box, result);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+
+QVector<qsizetype> FileFormats::GeoTIFFIndex::nearest(const QGeoCoordinate& coordinate, qsizetype count) const
+{
+    QVector<qsizetype> result;
+    if (!coordinate.isValid() || (count <= 0) || m_boxes.isEmpty())
+    {
+        return result;
+    }
+
+    auto x = coordinate.longitude();
+    auto y = coordinate.latitude();
+    auto scale = std::cos(qDegreesToRadians(y));
+
+    // Squared distance between the coordinate and a node, taking the shorter
+    // way around the antimeridian
+    auto nodeDistance = [&](qsizetype position) {
+        const auto& box = m_boxes[position];
+        auto dx = std::min({distance(x, box.minX, box.maxX),
+                            distance(x + 360.0, box.minX, box.maxX),
+                            distance(x - 360.0, box.minX, box.maxX)}) * scale;
+        auto dy = distance(y, box.minY, box.maxY);
+        return dx*dx + dy*dy;
+    };
+
+    // Best-first search. Queue elements are (distance, position, level).
+    using QueueEntry = std::tuple<double, qsizetype, qsizetype>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>> queue;
+    auto root = m_boxes.size() - 1;
+    queue.emplace(nodeDistance(root), root, m_levelBounds.size() - 1);
+
+    while (!queue.empty())
+    {
+        auto [dist, position, level] = queue.top();
+        queue.pop();
+
+        if (level == 0)
+        {
+            // Leaves of rectangles that cross the antimeridian appear twice
+            auto index = m_indices[position];
+            if (!result.contains(index))
+            {
+                result.append(index);
+                if (result.size() == count)
+                {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        auto first = m_indices[position];
+        auto end = qMin(first + nodeSize, m_levelBounds[level-1]);
+        for (auto child=first; child<end; ++child)
+        {
+            queue.emplace(nodeDistance(child), child, level-1);
+        }
+    }
+    return result;
+}
+
+
+
+//
+// Private Methods
+//
+
+QVector<FileFormats::GeoTIFFIndex::Box> FileFormats::GeoTIFFIndex::boxes(const QGeoRectangle& rectangle)
+{
+    auto topLeft = rectangle.topLeft();
+    auto bottomRight = rectangle.bottomRight();
+    auto minY = bottomRight.latitude();
+    auto maxY = topLeft.latitude();
+
+    if (topLeft.longitude() <= bottomRight.longitude())
+    {
+        return {{topLeft.longitude(), minY, bottomRight.longitude(), maxY}};
+    }
+    return {{topLeft.longitude(), minY, 180.0, maxY},
+            {-180.0, minY, bottomRight.longitude(), maxY}};
+}
+
+
+void FileFormats::GeoTIFFIndex::search(const Box& box, QVector<qsizetype>& result) const
+{
+    if (m_boxes.isEmpty())
+    {
+        return;
+    }
+
+    // Stack of nodes to visit, as (position, level)
+    QVector<std::pair<qsizetype, qsizetype>> stack;
+    stack.emplaceBack(m_boxes.size() - 1, m_levelBounds.size() - 1);
+    while (!stack.isEmpty())
+    {
+        auto [first, level] = stack.takeLast();
+        auto end = qMin(first + nodeSize, m_levelBounds[level]);
+        for (auto position=first; position<end; ++position)
+        {
+            const auto& node = m_boxes[position];
+            if ((box.maxX < node.minX) || (box.maxY < node.minY) || (box.minX > node.maxX) || (box.minY > node.maxY))
+            {
+                continue;
+            }
+            if (level == 0)
+            {
+                result.append(m_indices[position]);
+            }
+            else
+            {
+                stack.emplaceBack(m_indices[position], level-1);
+            }
+        }
+    }
+}
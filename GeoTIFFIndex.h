@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoCoordinate>
+#include <QGeoRectangle>
+#include <QVector>
+
+namespace FileFormats
+{
+
+/*! \brief Spatial index over bounding boxes
+ *
+ *  This class implements a static, packed Hilbert R-tree over a list of
+ *  bounding boxes, typically the return values of GeoTIFF::bBox(). It answers
+ *  point, rectangle and nearest-neighbor queries in logarithmic time.
+ *
+ *  The index is built once, in O(n log n), and cannot be modified
+ *  afterwards. All query methods are const and do not modify the index, so
+ *  that any number of threads can query the same index without locking.
+ *
+ *  Bounding boxes that cross the antimeridian (that is, whose top left
+ *  longitude is larger than the bottom right longitude) are supported.
+ *  Invalid bounding boxes are ignored.
+ *
+ *  Query results are indices into the list of bounding boxes passed to the
+ *  constructor.
+ */
+
+class GeoTIFFIndex
+{
+public:
+    /*! \brief Constructor
+     *
+     *  \param boxes Bounding boxes to index
+     */
+    GeoTIFFIndex(const QVector<QGeoRectangle>& boxes = {});
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Number of indexed bounding boxes
+     *
+     *  @returns Number of valid bounding boxes passed to the constructor
+     */
+    [[nodiscard]] qsizetype size() const { return m_size; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Find bounding boxes that contain a point
+     *
+     *  @param coordinate Coordinate
+     *
+     *  @returns Indices of all bounding boxes that contain the coordinate,
+     *  in ascending order. Points on the boundary are contained. Longitudes
+     *  180 and -180 denote the same meridian.
+     */
+    [[nodiscard]] QVector<qsizetype> find(const QGeoCoordinate& coordinate) const;
+
+    /*! \brief Find bounding boxes that intersect a rectangle
+     *
+     *  @param rectangle Rectangle, which may cross the antimeridian
+     *
+     *  @returns Indices of all bounding boxes that intersect the rectangle,
+     *  in ascending order
+     */
+    [[nodiscard]] QVector<qsizetype> find(const QGeoRectangle& rectangle) const;
+
+    /*! \brief Find bounding boxes nearest to a point
+     *
+     *  Distances are measured in an equirectangular projection centered at
+     *  the coordinate. This is accurate enough to rank charts around an
+     *  aircraft position, but it is not a geodesic distance. Bounding boxes
+     *  that contain the coordinate have distance zero.
+     *
+     *  @param coordinate Coordinate
+     *
+     *  @param count Maximal number of results
+     *
+     *  @returns Indices of the nearest bounding boxes, ordered by distance
+     */
+    [[nodiscard]] QVector<qsizetype> nearest(const QGeoCoordinate& coordinate, qsizetype count) const;
+
+private:
+    // Axis-aligned box in degrees, with minX <= maxX
+    struct Box
+    {
+        double minX {0.0};
+        double minY {0.0};
+        double maxX {0.0};
+        double maxY {0.0};
+    };
+
+    // Appends the indices of all items that intersect box
+    void search(const Box& box, QVector<qsizetype>& result) const;
+
+    // Splits a rectangle at the antimeridian into one or two boxes
+    [[nodiscard]] static QVector<Box> boxes(const QGeoRectangle& rectangle);
+
+    // Maximal number of children of a node
+    static constexpr qsizetype nodeSize = 16;
+
+    // Boxes of all nodes. Leaves come first, in Hilbert order, followed by
+    // the nodes of each higher level. The root is the last node.
+    QVector<Box> m_boxes;
+
+    // For leaves, the index of the bounding box passed to the constructor.
+    // For other nodes, the position of the first child in m_boxes.
+    QVector<qsizetype> m_indices;
+
+    // End position of each level in m_boxes
+    QVector<qsizetype> m_levelBounds;
+
+    // Number of valid bounding boxes passed to the constructor
+    qsizetype m_size {0};
+};
+
+} // namespace FileFormats
@@ -0,0 +1,247 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "GeoTIFFMosaic.h"
+
+
+namespace {
+
+// Returns true if the source contributes to the mosaic
+bool isUsable(const FileFormats::GeoTIFF* source)
+{
+    if ((source == nullptr) || !source->isValid() || !source->bBox().isValid() || source->rasterSize().isEmpty())
+    {
+        return false;
+    }
+    return source->bBox().topLeft().longitude() <= source->bBox().bottomRight().longitude();
+}
+
+// Returns the usable sources in ascending order of priority. Among sources of
+// equal priority, the order is kept.
+QVector<const FileFormats::GeoTIFF*> sortedSources(const QVector<const FileFormats::GeoTIFF*>& sources, const QVector<int>& priorities)
+{
+    QVector<qsizetype> indices;
+    for (qsizetype i=0; i<sources.size(); ++i)
+    {
+        if (isUsable(sources[i]))
+        {
+            indices << i;
+        }
+    }
+    std::stable_sort(indices.begin(), indices.end(), [&priorities](qsizetype a, qsizetype b) { return priorities.value(a) < priorities.value(b); });
+
+    QVector<const FileFormats::GeoTIFF*> result;
+    result.reserve(indices.size());
+    for (auto index : indices)
+    {
+        result << sources[index];
+    }
+    return result;
+}
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::GeoTIFFMosaic::GeoTIFFMosaic(const QVector<const GeoTIFF*>& sources, const QVector<int>& priorities)
+    : m_renderer(sortedSources(sources, priorities))
+{
+    // Union of the bounding boxes, and finest resolution in degrees per pixel
+    auto west = std::numeric_limits<double>::infinity();
+    auto east = -std::numeric_limits<double>::infinity();
+    auto south = std::numeric_limits<double>::infinity();
+    auto north = -std::numeric_limits<double>::infinity();
+    auto degreesX = std::numeric_limits<double>::infinity();
+    auto degreesY = std::numeric_limits<double>::infinity();
+    for (const auto* source : sources)
+    {
+        if (!isUsable(source))
+        {
+            continue;
+        }
+        auto box = source->bBox();
+        west = qMin(west, box.topLeft().longitude());
+        east = qMax(east, box.bottomRight().longitude());
+        south = qMin(south, box.bottomRight().latitude());
+        north = qMax(north, box.topLeft().latitude());
+        degreesX = qMin(degreesX, box.width()/source->rasterSize().width());
+        degreesY = qMin(degreesY, box.height()/source->rasterSize().height());
+    }
+    if (!std::isfinite(west) || !(degreesX > 0.0) || !(degreesY > 0.0))
+    {
+        return;
+    }
+
+    // The raster is rounded up to whole pixels, so that it covers all sources
+    auto width = qBound(1.0, std::ceil((east - west)/degreesX - 1e-6), double(1 << 30));
+    auto height = qBound(1.0, std::ceil((north - south)/degreesY - 1e-6), double(1 << 30));
+    m_rasterSize = QSize(int(width), int(height));
+    m_transform = GeoTransform({degreesX, 0.0, west, 0.0, -degreesY, north});
+    m_bBox = QGeoRectangle(QGeoCoordinate(north, west), QGeoCoordinate(qMax(-90.0, north - height*degreesY), qMin(180.0, west + width*degreesX)));
+
+    m_levelCount = 1;
+    while (qMax(m_rasterSize.width(), m_rasterSize.height()) > (blockSize << (m_levelCount - 1)))
+    {
+        m_levelCount++;
+    }
+}
+
+
+
+//
+// Setter methods
+//
+
+void FileFormats::GeoTIFFMosaic::setResampling(TileRenderer::Resampling resampling)
+{
+    m_renderer.setResampling(resampling);
+    m_cache.clear();
+}
+
+void FileFormats::GeoTIFFMosaic::setReadOptions(const TIFFReadOptions& options)
+{
+    m_renderer.setReadOptions(options);
+    m_cache.clear();
+}
+
+
+
+//
+// Methods
+//
+
+int FileFormats::GeoTIFFMosaic::levelForScale(double scale) const
+{
+    if (m_levelCount == 0)
+    {
+        return 0;
+    }
+    if (!(scale > 0.0))
+    {
+        return m_levelCount - 1;
+    }
+    if (scale >= 1.0)
+    {
+        return 0;
+    }
+    return qMin(int(std::floor(std::log2(1.0/scale))), m_levelCount - 1);
+}
+
+QImage FileFormats::GeoTIFFMosaic::readWindow(const QRect& window, double scale, TIFFPredictor::Instructions instructions) const
+{
+    auto clipped = window.intersected(QRect(QPoint(0, 0), m_rasterSize));
+    if (clipped.isEmpty())
+    {
+        return {};
+    }
+
+    // Window in pixels of the level
+    auto level = levelForScale(scale);
+    QRect const levelWindow(QPoint(clipped.left() >> level, clipped.top() >> level), QPoint(clipped.right() >> level, clipped.bottom() >> level));
+    QImage image(levelWindow.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+
+    for (auto row=levelWindow.top()/blockSize; row<=levelWindow.bottom()/blockSize; ++row)
+    {
+        for (auto column=levelWindow.left()/blockSize; column<=levelWindow.right()/blockSize; ++column)
+        {
+            auto pixels = block(level, column, row, instructions);
+            if (pixels.isEmpty())
+            {
+                continue;
+            }
+
+            QRect const blockRect(column*blockSize, row*blockSize, blockSize, blockSize);
+            auto intersection = blockRect.intersected(levelWindow);
+            for (auto y=intersection.top(); y<=intersection.bottom(); ++y)
+            {
+                const auto* source = pixels.constData() + (qsizetype(y - blockRect.top())*blockSize + (intersection.left() - blockRect.left()))*4;
+                auto* destination = image.scanLine(y - levelWindow.top()) + qsizetype(intersection.left() - levelWindow.left())*4;
+                std::memcpy(destination, source, qsizetype(intersection.width())*4);
+            }
+        }
+    }
+    return image;
+}
+
+
+
+//
+// Private Methods
+//
+
+QByteArray FileFormats::GeoTIFFMosaic::block(int level, int column, int row, TIFFPredictor::Instructions instructions) const
+{
+    auto levelWidth = ((m_rasterSize.width() - 1) >> level) + 1;
+    auto blocksAcross = (levelWidth + blockSize - 1)/blockSize;
+    TIFFTileCache::Key const key {QString(), quint64(level), qsizetype(row)*blocksAcross + column};
+    auto pixels = m_cache.find(key);
+    if (!pixels.isNull())
+    {
+        return pixels;
+    }
+
+    // Part of the block within the level, and its bounds. The last pixels of
+    // the level may extend beyond the raster; their bounds are clamped to the
+    // valid range of coordinates.
+    auto levelHeight = ((m_rasterSize.height() - 1) >> level) + 1;
+    auto rect = QRect(column*blockSize, row*blockSize, blockSize, blockSize).intersected(QRect(0, 0, levelWidth, levelHeight));
+    const auto& coefficients = m_transform.coefficients();
+    auto factor = double(1 << level);
+    QGeoRectangle const bounds(QGeoCoordinate(coefficients[5] + rect.top()*factor*coefficients[4], coefficients[2] + rect.left()*factor*coefficients[0]),
+                               QGeoCoordinate(qMax(-90.0, coefficients[5] + (rect.bottom() + 1)*factor*coefficients[4]),
+                                              qMin(180.0, coefficients[2] + (rect.right() + 1)*factor*coefficients[0])));
+
+    auto image = m_renderer.render(bounds, rect.size(), instructions);
+    auto isTransparent = [&image]() {
+        for (int y=0; y<image.height(); ++y)
+        {
+            const auto* line = reinterpret_cast<const quint32*>(image.constScanLine(y));
+            if (std::any_of(line, line + image.width(), [](quint32 pixel) { return pixel != 0; }))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (image.isNull() || isTransparent())
+    {
+        pixels = QByteArray("", 0);
+    }
+    else
+    {
+        pixels = QByteArray(qsizetype(blockSize)*blockSize*4, 0);
+        for (int y=0; y<image.height(); ++y)
+        {
+            std::memcpy(pixels.data() + qsizetype(y)*blockSize*4, image.constScanLine(y), qsizetype(image.width())*4);
+        }
+    }
+    m_cache.insert(key, pixels);
+    return pixels;
+}
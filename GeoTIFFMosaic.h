@@ -0,0 +1,215 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoRectangle>
+#include <QImage>
+
+#include "GeoTIFF.h"
+#include "TIFFTileCache.h"
+#include "TileRenderer.h"
+
+namespace FileFormats
+{
+
+/*! \brief Virtual raster composited from several GeoTIFF files
+ *
+ *  This class presents a list of GeoTIFF files, typically adjacent charts
+ *  that overlap at their margins, as one raster in the equirectangular
+ *  projection (EPSG:4326). The raster covers the union of the bounding boxes
+ *  of the sources, at the finest resolution of all sources. Like the
+ *  overviews of a GeoTIFF file, there are levels of reduced resolution:
+ *  level k has 2^-k times the resolution of the raster.
+ *
+ *  Windows of the raster are composited in blocks of blockSize × blockSize
+ *  pixels with TileRenderer. A block is composited only from the sources
+ *  whose bounding boxes intersect it, from the top down, so that sources
+ *  are not read where sources of higher priority are opaque. Alpha channels
+ *  and GeoTIFF::noDataColor() are honored. Composited blocks are kept in a
+ *  cache, so that windows read while a map is panned across chart
+ *  boundaries do not read and composite the same area twice.
+ *
+ *  Sources whose bounding boxes cross the antimeridian are ignored.
+ *
+ *  Reading windows is thread-safe. The setter methods are not, and clear the
+ *  cache.
+ */
+
+class GeoTIFFMosaic
+{
+public:
+    /*! \brief Constructor
+     *
+     *  Sources must have been constructed from a file name, see
+     *  GeoTIFF::readWindow(). Invalid sources are ignored.
+     *
+     *  \param sources GeoTIFF files. The objects are not copied and must
+     *  outlive the mosaic.
+     *
+     *  \param priorities Priority of every source. Sources of higher priority
+     *  are drawn on top of sources of lower priority. Among sources of equal
+     *  priority, later sources are drawn on top. Missing priorities are zero.
+     */
+    GeoTIFFMosaic(const QVector<const GeoTIFF*>& sources, const QVector<int>& priorities = {});
+
+    ~GeoTIFFMosaic() = default;
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Bounding box
+     *
+     *  @returns Union of the bounding boxes of the sources, or an invalid
+     *  rectangle if there are no valid sources
+     */
+    [[nodiscard]] QGeoRectangle bBox() const { return m_bBox; }
+
+    /*! \brief Size of the raster
+     *
+     *  @returns Width and height of the raster in pixels, or an empty size if
+     *  there are no valid sources
+     */
+    [[nodiscard]] QSize rasterSize() const { return m_rasterSize; }
+
+    /*! \brief Transformation between raster and geographic coordinates
+     *
+     *  @returns Transformation, which is invalid if there are no valid
+     *  sources
+     */
+    [[nodiscard]] const GeoTransform& transform() const { return m_transform; }
+
+    /*! \brief Number of resolution levels
+     *
+     *  @returns Number of levels. The last level fits into one block.
+     */
+    [[nodiscard]] int levelCount() const { return m_levelCount; }
+
+    /*! \brief Resampling method
+     *
+     *  @returns Resampling method used to composite the blocks. By default,
+     *  this is bilinear.
+     */
+    [[nodiscard]] TileRenderer::Resampling resampling() const { return m_renderer.resampling(); }
+
+    /*! \brief Options for reading source windows
+     *
+     *  @returns Options passed to GeoTIFF::readWindow()
+     */
+    [[nodiscard]] const TIFFReadOptions& readOptions() const { return m_renderer.readOptions(); }
+
+    /*! \brief Cache of composited blocks
+     *
+     *  Use the cache to change its budget, which is 64 MiB by default, or to
+     *  query hit and miss counters.
+     *
+     *  @returns Cache that is owned by this mosaic
+     */
+    [[nodiscard]] TIFFTileCache& cache() const { return m_cache; }
+
+
+    //
+    // Setter methods
+    //
+
+    /*! \brief Set resampling method
+     *
+     *  @param resampling Resampling method
+     */
+    void setResampling(TileRenderer::Resampling resampling);
+
+    /*! \brief Set options for reading source windows
+     *
+     *  @param options Options passed to GeoTIFF::readWindow()
+     */
+    void setReadOptions(const TIFFReadOptions& options);
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Level for reading at reduced scale
+     *
+     *  @param scale Number of image pixels per raster pixel, typically
+     *  between 0 and 1
+     *
+     *  @returns The highest level whose resolution is at least the given
+     *  scale times the resolution of the raster
+     */
+    [[nodiscard]] int levelForScale(double scale) const;
+
+    /*! \brief Read a window of the raster
+     *
+     *  This method reads the window from levelForScale(), as
+     *  GeoTIFF::readWindow() reads from an overview. The returned image covers
+     *  the pixels of the level that intersect the window, and starts at the
+     *  pixel that contains the top left corner of the window. For level k,
+     *  this is pixel (floor(left/2^k), floor(top/2^k)).
+     *
+     *  Sources that cannot be read are treated as transparent, as in
+     *  TileRenderer::render().
+     *
+     *  @param window Window in raster coordinates. The window is clipped to
+     *  the raster.
+     *
+     *  @param scale Number of image pixels per raster pixel
+     *
+     *  @param instructions Instruction set used for resampling. If the
+     *  processor does not support the instruction set, scalar code is used.
+     *
+     *  @returns Image in QImage::Format_ARGB32_Premultiplied, transparent
+     *  where no source covers it, or a null image if the clipped window is
+     *  empty
+     */
+    [[nodiscard]] QImage readWindow(const QRect& window, double scale = 1.0, TIFFPredictor::Instructions instructions = TIFFPredictor::bestInstructions()) const;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Width and height of the composited blocks in pixels */
+    static constexpr int blockSize = 256;
+
+private:
+    Q_DISABLE_COPY_MOVE(GeoTIFFMosaic)
+
+    // Returns the pixels of a block of a level, in
+    // QImage::Format_ARGB32_Premultiplied with blockSize*4 bytes per line.
+    // Blocks that are transparent are returned as an empty, non-null array.
+    [[nodiscard]] QByteArray block(int level, int column, int row, TIFFPredictor::Instructions instructions) const;
+
+    // Renderer, with the sources in ascending order of priority
+    TileRenderer m_renderer;
+
+    QGeoRectangle m_bBox;
+    QSize m_rasterSize;
+    GeoTransform m_transform;
+    int m_levelCount {0};
+
+    // Composited blocks. The key holds the level in place of the image file
+    // directory.
+    mutable TIFFTileCache m_cache {64*1024*1024};
+};
+
+} // namespace FileFormats
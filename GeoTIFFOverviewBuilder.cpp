@@ -0,0 +1,257 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "GeoTIFF.h"
+#include "GeoTIFFOverviewBuilder.h"
+#include "GeoTIFFWriter.h"
+#include "ZIPArchive.h"
+
+
+namespace {
+
+// Band of a level, one tile high, that is filled from the level above
+struct Level
+{
+    QSize size;
+    int image {0};
+    QImage band;
+    int bandTop {0};
+};
+
+// Averages blocks of 2x2 pixels of the source, and writes the result to the
+// target, starting at the given row. Pixels at the right and bottom edges of
+// the source are replicated if its width or height is odd.
+void downsample(const QImage& source, QImage& target, int targetRow, int pixelBytes)
+{
+    auto width = target.width();
+    auto lastX = source.width() - 1;
+    for (int y=0; y<(source.height()+1)/2; ++y)
+    {
+        const auto* row0 = source.constScanLine(2*y);
+        const auto* row1 = source.constScanLine(qMin(2*y + 1, source.height() - 1));
+        auto* out = target.scanLine(targetRow + y);
+        for (int x=0; x<width; ++x)
+        {
+            auto x0 = 2*x*pixelBytes;
+            auto x1 = qMin(2*x + 1, lastX)*pixelBytes;
+            for (int c=0; c<pixelBytes; ++c)
+            {
+                out[x*pixelBytes + c] = uchar((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+} // namespace
+
+
+
+//
+// Methods
+//
+
+void FileFormats::GeoTIFFOverviewBuilder::write(const QString& inputFileName, const QString& outputFileName) const
+{
+    GeoTIFF const source(inputFileName, {34735, 34736, 34737});
+    if (!source.isValid())
+    {
+        throw source.error();
+    }
+    const auto& raster = source.raster();
+
+    // Files in ZIP archives are read through one reader for all bands, so
+    // that inflation continues where the previous band ended
+    QString archiveName;
+    QString entryName;
+    std::unique_ptr<ZIPArchive> archive;
+    QFile file;
+    std::unique_ptr<RangeReader> reader;
+    if (ZIPArchive::splitPath(inputFileName, archiveName, entryName))
+    {
+        archive = std::make_unique<ZIPArchive>(archiveName);
+        reader = archive->reader(entryName);
+    }
+    else
+    {
+        file.setFileName(inputFileName);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            throw file.errorString();
+        }
+        reader = RangeReader::create(file);
+    }
+
+    // Palette colors are opaque
+    auto format = raster.colorTable().isEmpty() ? outputFormat(raster.format()) : QImage::Format_RGB888;
+    TIFFReadOptions options;
+    options.threadCount = m_maxThreadCount;
+    options.tileCache = nullptr;
+    write(raster.size(), format, [&](const QRect& window) { return raster.readWindow(*reader, window, options); }, source.TIFFFields(), outputFileName);
+}
+
+void FileFormats::GeoTIFFOverviewBuilder::write(const QImage& image, const TIFFTagTable& geoFields, const QString& outputFileName) const
+{
+    if (image.isNull())
+    {
+        throw QObject::tr("The image is empty.", "FileFormats::GeoTIFFOverviewBuilder");
+    }
+    write(image.size(), outputFormat(image.format()), [&image](const QRect& window) { return image.copy(window); }, geoFields, outputFileName);
+}
+
+void FileFormats::GeoTIFFOverviewBuilder::write(QSize size, QImage::Format format, const RasterSource& source, const TIFFTagTable& geoFields, const QString& outputFileName) const
+{
+    if (outputFormat(format) != format)
+    {
+        throw QObject::tr("Image format is not supported.", "FileFormats::GeoTIFFOverviewBuilder");
+    }
+    auto pixelBytes = QImage(1, 1, format).depth()/8;
+
+    GeoTIFFWriter writer(outputFileName, m_cloudOptimized ? GeoTIFFWriter::Layout::CloudOptimized : GeoTIFFWriter::Layout::Sequential);
+    writer.setGeoFields(geoFields);
+
+    // Levels halve in size until a level fits into a single tile
+    QVector<Level> levels;
+    for (auto levelSize = size; ; levelSize = QSize((levelSize.width() + 1)/2, (levelSize.height() + 1)/2))
+    {
+        levels.append({levelSize, writer.addImage(levelSize, {m_tileSize, m_tileSize}, format), {}, 0});
+        if ((levelSize.width() <= m_tileSize) && (levelSize.height() <= m_tileSize))
+        {
+            break;
+        }
+    }
+
+    // Compression runs on the pool. The semaphore bounds the number of tiles
+    // waiting there. The pool is declared last, so that it waits for all
+    // tasks before the objects they use are destructed.
+    QSemaphore queueSlots(2*m_maxThreadCount);
+    QMutex errorMutex;
+    QString error;
+    std::atomic<bool> failed {false};
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_maxThreadCount);
+
+    // Writes the tiles of a full band, and downsamples it into the band of
+    // the next level. Bands of the next level are written recursively once
+    // they are full.
+    std::function<void(int, const QImage&, int)> flush = [&](int level, const QImage& band, int top) {
+        const auto& current = levels[level];
+        auto tilesAcross = (current.size.width() + m_tileSize - 1)/m_tileSize;
+        for (int tx=0; (tx<tilesAcross) && !failed; ++tx)
+        {
+            auto tile = band.copy(tx*m_tileSize, 0, qMin(m_tileSize, current.size.width() - tx*m_tileSize), band.height());
+            auto index = qsizetype(top/m_tileSize)*tilesAcross + tx;
+            queueSlots.acquire();
+            pool.start([&, tile, index, image = current.image]() {
+                try
+                {
+                    writer.writeTile(image, index, tile);
+                }
+                catch (QString& message)
+                {
+                    QMutexLocker const locker(&errorMutex);
+                    if (!failed)
+                    {
+                        error = message;
+                        failed = true;
+                    }
+                }
+                queueSlots.release();
+            });
+        }
+
+        if (level + 1 >= levels.size())
+        {
+            return;
+        }
+        auto& next = levels[level + 1];
+        if (next.band.isNull())
+        {
+            next.band = QImage(next.size.width(), qMin(m_tileSize, next.size.height() - next.bandTop), format);
+        }
+        auto row = top/2 - next.bandTop;
+        downsample(band, next.band, row, pixelBytes);
+        if (row + (band.height() + 1)/2 == next.band.height())
+        {
+            auto full = std::exchange(next.band, QImage());
+            auto fullTop = std::exchange(next.bandTop, next.bandTop + m_tileSize);
+            flush(level + 1, full, fullTop);
+        }
+    };
+
+    for (int y=0; (y<size.height()) && !failed; y+=m_tileSize)
+    {
+        QRect const window(0, y, size.width(), qMin(m_tileSize, size.height() - y));
+        auto band = source(window);
+        if (band.size() != window.size())
+        {
+            throw QObject::tr("The raster source returned an image of wrong size.", "FileFormats::GeoTIFFOverviewBuilder");
+        }
+        if (band.format() != format)
+        {
+            band.convertTo(format);
+        }
+        flush(0, band, y);
+    }
+    pool.waitForDone();
+
+    if (failed)
+    {
+        throw error;
+    }
+    writer.finish();
+}
+
+
+
+//
+// Static methods
+//
+
+QImage::Format FileFormats::GeoTIFFOverviewBuilder::outputFormat(QImage::Format format)
+{
+    switch (format)
+    {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_Grayscale16:
+        return QImage::Format_Grayscale8;
+    case QImage::Format_RGB32:
+    case QImage::Format_RGB888:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBX32FPx4:
+        return QImage::Format_RGB888;
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGBA64_Premultiplied:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        return QImage::Format_RGBA8888_Premultiplied;
+    default:
+        return QImage::Format_RGBA8888;
+    }
+}
@@ -0,0 +1,190 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QThread>
+
+#include <functional>
+
+#include "TIFFTagTable.h"
+
+namespace FileFormats
+{
+
+/*! \brief Builder for tiled GeoTIFF files with overviews
+ *
+ *  This class writes a raster, read from a GeoTIFF file, a QImage or any
+ *  other source, to a tiled GeoTIFF file with internal overviews, whose
+ *  resolution halves from level to level until an overview fits into a
+ *  single tile. Overviews are computed with a box filter, which averages
+ *  blocks of 2x2 pixels. By default, files are written as Cloud Optimized
+ *  GeoTIFF, see GeoTIFFWriter::Layout.
+ *
+ *  The raster is streamed: the source is read in bands that are one tile
+ *  high, and every level holds at most one band, so that memory use depends
+ *  on the width of the raster, but not on its height. Tiles are compressed
+ *  in parallel, on a thread pool of bounded size.
+ */
+
+class GeoTIFFOverviewBuilder
+{
+public:
+    /*! \brief Source of raster data
+     *
+     *  The function is called with windows that span the full width of the
+     *  raster and are one tile high, from top to bottom. It returns an image
+     *  of the size of the window, or throws a QString with a human-readable,
+     *  translated error message. It is called from the thread that called
+     *  write().
+     */
+    using RasterSource = std::function<QImage(const QRect&)>;
+
+    GeoTIFFOverviewBuilder() = default;
+    ~GeoTIFFOverviewBuilder() = default;
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Write a tiled copy of a GeoTIFF file, with overviews
+     *
+     *  The georeferencing and the name of the source are preserved. Palette
+     *  images are expanded to RGB.
+     *
+     *  On failure, this method throws a QString with a human-readable,
+     *  translated error message. The output file is then left unchanged.
+     *
+     *  @param inputFileName Name of a GeoTIFF file, possibly in a ZIP
+     *  archive, see ZIPArchive::splitPath()
+     *
+     *  @param outputFileName Name of the file to write
+     */
+    void write(const QString& inputFileName, const QString& outputFileName) const;
+
+    /*! \brief Write an image to a tiled GeoTIFF file, with overviews
+     *
+     *  On failure, this method throws a QString, see above.
+     *
+     *  @param image Raster image, converted to outputFormat()
+     *
+     *  @param geoFields Georeferencing and name, see
+     *  GeoTIFFWriter::setGeoFields()
+     *
+     *  @param outputFileName Name of the file to write
+     */
+    void write(const QImage& image, const TIFFTagTable& geoFields, const QString& outputFileName) const;
+
+    /*! \brief Write a raster source to a tiled GeoTIFF file, with overviews
+     *
+     *  On failure, this method throws a QString, see above.
+     *
+     *  @param size Size of the raster
+     *
+     *  @param format Format of the written images. This must be one of the
+     *  values returned by outputFormat(). Images returned by the source are
+     *  converted to this format.
+     *
+     *  @param source Source of raster data
+     *
+     *  @param geoFields Georeferencing and name, see
+     *  GeoTIFFWriter::setGeoFields()
+     *
+     *  @param outputFileName Name of the file to write
+     */
+    void write(QSize size, QImage::Format format, const RasterSource& source, const TIFFTagTable& geoFields, const QString& outputFileName) const;
+
+
+    //
+    // Getter/Setter methods
+    //
+
+    /*! \brief Tile size
+     *
+     *  @returns Width and height of the tiles in pixels. By default, this
+     *  is 256.
+     */
+    [[nodiscard]] int tileSize() const { return m_tileSize; }
+
+    /*! \brief Set tile size
+     *
+     *  @param size Width and height of the tiles in pixels. The value is
+     *  rounded up to a multiple of 16, as required by the TIFF
+     *  specification.
+     */
+    void setTileSize(int size) { m_tileSize = qMax(16, (size + 15) & ~15); }
+
+    /*! \brief Maximal number of worker threads
+     *
+     *  @returns Maximal number of threads used to decode and compress tiles.
+     *  By default, this is QThread::idealThreadCount().
+     */
+    [[nodiscard]] int maxThreadCount() const { return m_maxThreadCount; }
+
+    /*! \brief Set maximal number of worker threads
+     *
+     *  @param count Maximal number of threads used to decode and compress
+     *  tiles. Values smaller than one are treated as one.
+     */
+    void setMaxThreadCount(int count) { m_maxThreadCount = qMax(1, count); }
+
+    /*! \brief Cloud Optimized GeoTIFF
+     *
+     *  @returns True if files are written as Cloud Optimized GeoTIFF. By
+     *  default, this is true.
+     */
+    [[nodiscard]] bool isCloudOptimized() const { return m_cloudOptimized; }
+
+    /*! \brief Set Cloud Optimized GeoTIFF
+     *
+     *  @param cloudOptimized If true, files are written as Cloud Optimized
+     *  GeoTIFF. Otherwise, tile data is written directly to the file, which
+     *  avoids the temporary copy.
+     */
+    void setCloudOptimized(bool cloudOptimized) { m_cloudOptimized = cloudOptimized; }
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Format of the written images
+     *
+     *  Images with 16 bits per sample are reduced to 8 bits per sample.
+     *  Images are written as grayscale, RGB or RGBA, with associated alpha if
+     *  the format is premultiplied.
+     *
+     *  @param format Format of the source raster
+     *
+     *  @returns Format of the written images
+     */
+    [[nodiscard]] static QImage::Format outputFormat(QImage::Format format);
+
+private:
+    Q_DISABLE_COPY_MOVE(GeoTIFFOverviewBuilder)
+
+    int m_tileSize {256};
+    int m_maxThreadCount {QThread::idealThreadCount()};
+    bool m_cloudOptimized {true};
+};
+
+} // namespace FileFormats
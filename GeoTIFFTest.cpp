@@ -15,12 +15,711 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QBuffer>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSemaphore>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QtEndian>
+#include <QtMath>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <span>
+#include <tuple>
+#include <vector>
+#include <zlib.h>
+
 #include "GeoTIFF.h"
+#include "GeoTIFFCache.h"
+#include "GeoTIFFCatalog.h"
+#include "GeoTIFFIndex.h"
+#include "GeoTIFFMosaic.h"
+#include "GeoTIFFOverviewBuilder.h"
+#include "GeoTIFFWriter.h"
 #include "GeoTIFFTest.h"
+#include "HTTPRangeReader.h"
+#include "TIFFCodecs.h"
+#include "TIFFPredictor.h"
+#include "TIFFTileCache.h"
+#include "TileArchiveWriter.h"
+#include "TileExporter.h"
+#include "TileRenderer.h"
+#include "ZIPArchive.h"
 
 QTEST_MAIN(GeoTIFFTest)
 
 
+namespace
+{
+
+// Stand-in for an HTTP server that answers range requests for a single file.
+// It serves connections one after the other from a thread of its own, using
+// the blocking socket API, and counts connections and requests.
+class RangeServer
+{
+public:
+    RangeServer(QByteArray data) : m_data(std::move(data))
+    {
+        m_thread.reset(QThread::create([this]() { serve(); }));
+        m_thread->start();
+        m_listening.acquire();
+    }
+
+    ~RangeServer()
+    {
+        m_stop = true;
+        m_thread->wait();
+    }
+
+    [[nodiscard]] QUrl url() const { return QUrl(u"http://127.0.0.1:%1/file.tif"_qs.arg(m_port)); }
+
+    std::atomic<int> connections {0};
+    std::atomic<int> requests {0};
+
+private:
+    void serve()
+    {
+        QTcpServer server;
+        server.listen(QHostAddress::LocalHost);
+        m_port = server.serverPort();
+        m_listening.release();
+
+        while (!m_stop)
+        {
+            if (!server.waitForNewConnection(50))
+            {
+                continue;
+            }
+            std::unique_ptr<QTcpSocket> const socket(server.nextPendingConnection());
+            ++connections;
+
+            // Answer pipelined requests until the client closes the connection
+            QByteArray pending;
+            while ((socket->bytesAvailable() > 0) || socket->waitForReadyRead(1000))
+            {
+                pending += socket->readAll();
+                for (auto end = pending.indexOf("\r\n\r\n"); end >= 0; end = pending.indexOf("\r\n\r\n"))
+                {
+                    auto request = pending.left(end);
+                    pending.remove(0, end + 4);
+                    ++requests;
+                    socket->write(response(request));
+                    socket->waitForBytesWritten(1000);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] QByteArray response(const QByteArray& request) const
+    {
+        auto begin = request.indexOf("Range: bytes=");
+        if (begin < 0)
+        {
+            return "HTTP/1.1 200 OK\r\nContent-Length: " + QByteArray::number(m_data.size()) + "\r\nETag: \"1\"\r\n\r\n" + m_data;
+        }
+        begin += 13;
+        auto dash = request.indexOf('-', begin);
+        auto end = request.indexOf("\r\n", dash);
+        auto first = request.mid(begin, dash - begin).toLongLong();
+        auto last = request.mid(dash + 1, (end < 0 ? request.size() : end) - dash - 1).toLongLong();
+        if (first >= m_data.size())
+        {
+            return "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n";
+        }
+        last = qMin(last, qint64(m_data.size()) - 1);
+        auto body = m_data.mid(first, last - first + 1);
+        return "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + QByteArray::number(first) + "-" + QByteArray::number(last) + "/" + QByteArray::number(m_data.size())
+               + "\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\nETag: \"1\"\r\n\r\n" + body;
+    }
+
+    QByteArray m_data;
+    std::unique_ptr<QThread> m_thread;
+    QSemaphore m_listening;
+    std::atomic<bool> m_stop {false};
+    quint16 m_port {0};
+};
+
+
+// Returns a 16-bit number in little-endian byte order
+QByteArray number16(quint16 value)
+{
+    QByteArray bytes(2, '\0');
+    qToLittleEndian(value, bytes.data());
+    return bytes;
+}
+
+// Returns a 32-bit number in little-endian byte order
+QByteArray number32(quint32 value)
+{
+    QByteArray bytes(4, '\0');
+    qToLittleEndian(value, bytes.data());
+    return bytes;
+}
+
+// Returns a ZIP archive that holds the files. Files are compressed with
+// deflate if compress is set, and stored otherwise.
+QByteArray zipArchive(const QVector<std::tuple<QString, QByteArray, bool>>& files)
+{
+    QByteArray archive;
+    QByteArray directory;
+    for (const auto& [name, contents, compress] : files)
+    {
+        // Raw deflate data is the zlib stream without header and checksum
+        auto data = compress ? FileFormats::TIFFCodecs::compressDeflate(contents).mid(2) : contents;
+        if (compress)
+        {
+            data.chop(4);
+        }
+        auto crc = crc32(0, reinterpret_cast<const Bytef*>(contents.constData()), uInt(contents.size()));
+        auto method = quint16(compress ? 8 : 0);
+        auto common = number16(20) + number16(0x0800) + number16(method) + number32(0) + number32(quint32(crc))
+                      + number32(quint32(data.size())) + number32(quint32(contents.size())) + number16(quint16(name.toUtf8().size())) + number16(0);
+        directory += number32(0x02014b50) + number16(20) + common + number16(0) + number16(0) + number16(0) + number32(0) + number32(quint32(archive.size())) + name.toUtf8();
+        archive += number32(0x04034b50) + common + name.toUtf8() + data;
+    }
+    auto directoryOffset = archive.size();
+    archive += directory;
+    archive += number32(0x06054b50) + number16(0) + number16(0) + number16(quint16(files.size())) + number16(quint16(files.size()))
+               + number32(quint32(directory.size())) + number32(quint32(directoryOffset)) + number16(0);
+    return archive;
+}
+
+// Range reader that counts the bytes read
+class CountingRangeReader : public FileFormats::RangeReader
+{
+public:
+    CountingRangeReader(QIODevice& device) : m_reader(device) {}
+
+    [[nodiscard]] qint64 size() override { return m_reader.size(); }
+    [[nodiscard]] QByteArray read(qint64 offset, qint64 length) override
+    {
+        auto result = m_reader.read(offset, length);
+        bytesRead += result.size();
+        return result;
+    }
+
+    qint64 bytesRead {0};
+
+private:
+    FileFormats::DeviceRangeReader m_reader;
+};
+
+// Returns a table with GeoKeys and further geo fields of type DOUBLE
+FileFormats::TIFFTagTable geoFields(const QVector<quint16>& geoKeys, const QVector<double>& geoDoubles, const QByteArray& geoAscii, const QVector<std::pair<quint16, QVector<double>>>& doubleFields)
+{
+    using enum FileFormats::TIFFTagTable::DataType;
+    FileFormats::TIFFTagTable result;
+    auto doubles = [](const QVector<double>& values) {
+        QByteArray bytes(8*values.size(), '\0');
+        for (qsizetype i=0; i<values.size(); i++)
+        {
+            qToLittleEndian(std::bit_cast<quint64>(values[i]), bytes.data() + 8*i);
+        }
+        return bytes;
+    };
+    for (const auto& [tag, values] : doubleFields)
+    {
+        result.insert(tag, DT_Double, quint32(values.size()), doubles(values), true);
+    }
+    QByteArray shorts(2*geoKeys.size(), '\0');
+    for (qsizetype i=0; i<geoKeys.size(); i++)
+    {
+        qToLittleEndian(geoKeys[i], shorts.data() + 2*i);
+    }
+    result.insert(34735, DT_Short, quint32(geoKeys.size()), shorts, true);
+    if (!geoDoubles.isEmpty())
+    {
+        result.insert(34736, DT_Double, quint32(geoDoubles.size()), doubles(geoDoubles), true);
+    }
+    if (!geoAscii.isEmpty())
+    {
+        result.insert(34737, DT_Ascii, quint32(geoAscii.size()), geoAscii, true);
+    }
+    return result;
+}
+
+// Writes a GeoTIFF file of the given size, with the given geo fields
+void writeGeoTIFF(const QString& fileName, QSize size, const FileFormats::TIFFTagTable& fields)
+{
+    FileFormats::GeoTIFFWriter writer(fileName);
+    writer.setGeoFields(fields);
+    auto image = writer.addImage(size, {256, 256}, QImage::Format_Grayscale8);
+    QImage tile(256, 256, QImage::Format_Grayscale8);
+    tile.fill(0);
+    writer.writeTile(image, 0, tile);
+    writer.finish();
+}
+
+// Color of pixel (i, j) of the rasters written by writePatternGeoTIFF(),
+// which is unique for rasters of up to 4096x4096 pixels
+QRgb patternColor(int i, int j)
+{
+    return qRgb(i & 0xFF, j & 0xFF, ((i >> 8) << 4) | ((j >> 8) & 0x0F));
+}
+
+// Writes a GeoTIFF file with internal overviews, whose pixels have the
+// colors given by patternColor()
+void writePatternGeoTIFF(const QString& fileName, QSize size, const FileFormats::TIFFTagTable& fields)
+{
+    QImage image(size, QImage::Format_RGB32);
+    for (int j=0; j<size.height(); j++)
+    {
+        for (int i=0; i<size.width(); i++)
+        {
+            image.setPixel(i, j, patternColor(i, j));
+        }
+    }
+    FileFormats::GeoTIFFOverviewBuilder().write(image, fields, fileName);
+}
+
+// Returns the tile of the given zoom level that contains a coordinate
+QPoint tileAt(int zoom, const QGeoCoordinate& coordinate)
+{
+    auto n = double(1 << zoom);
+    auto latitude = qDegreesToRadians(coordinate.latitude());
+    return {int((coordinate.longitude() + 180.0)/360.0*n), int((1.0 - std::asinh(std::tan(latitude))/std::numbers::pi)/2.0*n)};
+}
+
+// Benchmarks the forward and inverse projection of a grid of points around
+// Freiburg
+void benchmarkProjectionRoundTrip(const FileFormats::Projection& projection)
+{
+    qsizetype const count = 1 << 18;
+    QVector<double> x(count);
+    QVector<double> y(count);
+    QVector<double> longitudes(count);
+    QVector<double> latitudes(count);
+    for (qsizetype i=0; i<count; i++)
+    {
+        longitudes[i] = 7.0 + double(i % 512)/256.0;
+        latitudes[i] = 47.0 + double(i / 512)/256.0;
+    }
+    QBENCHMARK
+    {
+        projection.forward(longitudes, latitudes, x, y);
+        projection.inverse(x, y, longitudes, latitudes);
+    }
+}
+
+// Benchmarks rendering a tile of zoom level 14 from a raster of 1024x1024
+// pixels in UTM coordinates. Source tiles are read from the cache.
+void benchmarkRenderTile(FileFormats::TileRenderer::Resampling resampling, FileFormats::TIFFPredictor::Instructions instructions)
+{
+    using FileFormats::GeoKeyDirectory;
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto fileName = tempDir.filePath(u"utm.tif"_qs);
+    writePatternGeoTIFF(fileName, {1024, 1024},
+                        geoFields({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeProjected, GeoKeyDirectory::ProjectedCSType, 0, 1, 32632}, {}, {},
+                                  {{33550, {10.0, 10.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 410000.0, 5320000.0, 0.0}}}));
+    FileFormats::GeoTIFF const geoTIFF(fileName);
+    QVERIFY( geoTIFF.isValid() );
+
+    FileFormats::TileRenderer renderer({&geoTIFF});
+    renderer.setResampling(resampling);
+    auto tile = tileAt(14, geoTIFF.transform().toGeo({512.0, 512.0}));
+    QVERIFY( !renderer.render(14, tile.x(), tile.y(), instructions).isNull() );
+    QBENCHMARK
+    {
+        auto image = renderer.render(14, tile.x(), tile.y(), instructions);
+        Q_UNUSED(image)
+    }
+}
+
+// Compresses data with LZW (compression scheme 5), as libtiff does
+QByteArray compressLZW(QByteArrayView input)
+{
+    // The string table is a tree. The children of a code are the codes of
+    // its string followed by one more byte.
+    struct Entry
+    {
+        quint16 firstChild;
+        quint16 nextSibling;
+        uchar byte;
+    };
+    std::array<Entry, 4096> table {};
+    quint16 nextCode = 258;
+    int codeLength = 9;
+
+    QByteArray result;
+    quint64 bitBuffer = 0;
+    int bitCount = 0;
+    auto write = [&](quint16 code) {
+        bitBuffer = (bitBuffer << codeLength) | code;
+        bitCount += codeLength;
+        while (bitCount >= 8)
+        {
+            bitCount -= 8;
+            result.append(char(bitBuffer >> bitCount));
+        }
+    };
+
+    write(256);
+    if (!input.isEmpty())
+    {
+        auto prefix = quint16(uchar(input[0]));
+        for (qsizetype i=1; i<input.size(); i++)
+        {
+            auto byte = uchar(input[i]);
+            auto child = table[prefix].firstChild;
+            while ((child != 0) && (table[child].byte != byte))
+            {
+                child = table[child].nextSibling;
+            }
+            if (child != 0)
+            {
+                prefix = child;
+                continue;
+            }
+
+            write(prefix);
+            table[nextCode] = {0, table[prefix].firstChild, byte};
+            table[prefix].firstChild = nextCode;
+            ++nextCode;
+            if (nextCode >= 4094)
+            {
+                // The table is full. Start over, with a clear code.
+                write(256);
+                for (auto& entry : std::span(table.data(), 258))
+                {
+                    entry.firstChild = 0;
+                }
+                nextCode = 258;
+                codeLength = 9;
+            }
+            else if (nextCode >= (1 << codeLength))
+            {
+                ++codeLength;
+            }
+            prefix = byte;
+        }
+        write(prefix);
+        ++nextCode;
+        if ((nextCode >= (1 << codeLength)) && (codeLength < 12))
+        {
+            ++codeLength;
+        }
+    }
+    write(257);
+    if (bitCount > 0)
+    {
+        result.append(char(bitBuffer << (8 - bitCount)));
+    }
+    return result;
+}
+
+// Color of pixel (i, j) of the files written by writeLargeTIFF(). Gradients
+// with some noise, so that the data does not compress too well.
+QRgb largeTIFFColor(int i, int j)
+{
+    auto noise = int((quint32(i)*73856093U ^ quint32(j)*19349663U) >> 28);
+    return qRgb((i/8 + noise) & 0xFF, (j/8 + noise) & 0xFF, ((i+j)/16 + noise) & 0xFF);
+}
+
+// Returns a little-endian GeoTIFF file with one image. The fields describe
+// the raster, as tag, type, count and little-endian values. Offsets and byte
+// counts of the strips or tiles are added, and so are geo fields: pixels are
+// 1E-4 degrees wide and high, with the top left corner at 7°E 48°N.
+QByteArray tiffFile(QVector<std::tuple<quint16, quint16, quint32, QByteArray>> fields, const QVector<QByteArray>& chunks, bool tiled)
+{
+    QByteArray file = QByteArray("II\x2A\0", 4) + number32(0);
+    QByteArray offsets;
+    QByteArray byteCounts;
+    for (const auto& chunk : chunks)
+    {
+        offsets += number32(quint32(file.size()));
+        byteCounts += number32(quint32(chunk.size()));
+        file += chunk;
+    }
+
+    auto doubles = [](const QVector<double>& values) {
+        QByteArray bytes;
+        for (auto value : values)
+        {
+            bytes += number32(quint32(std::bit_cast<quint64>(value))) + number32(quint32(std::bit_cast<quint64>(value) >> 32));
+        }
+        return bytes;
+    };
+    using FileFormats::GeoKeyDirectory;
+    QByteArray geoKeys;
+    for (auto value : QVector<quint16>{1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeGeographic, GeoKeyDirectory::GeographicType, 0, 1, 4326})
+    {
+        geoKeys += number16(value);
+    }
+    auto count = quint32(chunks.size());
+    fields += {{tiled ? 324 : 273, 4, count, offsets}, {tiled ? 325 : 279, 4, count, byteCounts},
+               {33550, 12, 3, doubles({1.0E-4, 1.0E-4, 0.0})}, {33922, 12, 6, doubles({0.0, 0.0, 0.0, 7.0, 48.0, 0.0})}, {34735, 3, 12, geoKeys}};
+    std::sort(fields.begin(), fields.end(), [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+
+    // Values that do not fit into the directory entries are written before
+    // the directory
+    QByteArray directory = number16(quint16(fields.size()));
+    for (const auto& [tag, type, valueCount, values] : fields)
+    {
+        QByteArray value = values;
+        if (values.size() > 4)
+        {
+            file.append(file.size() % 2, '\0');
+            value = number32(quint32(file.size()));
+            file += values;
+        }
+        directory += number16(tag) + number16(type) + number32(valueCount) + value + QByteArray(4 - value.size(), '\0');
+    }
+    file.append(file.size() % 2, '\0');
+    qToLittleEndian(quint32(file.size()), file.data() + 4);
+    file += directory + number32(0);
+    return file;
+}
+
+// Returns rows of 32-bit floating point samples in little-endian byte order,
+// or with floating point differencing (predictor 3) as libtiff writes them:
+// byte planes, most significant byte first, followed by differences between
+// bytes of neighboring pixels
+QByteArray floatSamples(const QVector<float>& samples, int pixelsPerRow, int samplesPerPixel, bool differencing)
+{
+    QByteArray result;
+    for (auto sample : samples)
+    {
+        result += number32(std::bit_cast<quint32>(sample));
+    }
+    if (!differencing)
+    {
+        return result;
+    }
+
+    auto rowSamples = pixelsPerRow*samplesPerPixel;
+    for (qsizetype row=0; row<samples.size()/rowSamples; row++)
+    {
+        auto* out = reinterpret_cast<uchar*>(result.data()) + 4*row*rowSamples;
+        for (int i=0; i<rowSamples; i++)
+        {
+            auto bits = std::bit_cast<quint32>(samples[row*rowSamples + i]);
+            for (int byte=0; byte<4; byte++)
+            {
+                out[byte*rowSamples + i] = uchar(bits >> (8*(3-byte)));
+            }
+        }
+        for (int i=4*rowSamples-1; i>=samplesPerPixel; i--)
+        {
+            out[i] -= out[i-samplesPerPixel];
+        }
+    }
+    return result;
+}
+
+// Writes an RGB GeoTIFF file of 8192x8192 pixels with the colors given by
+// largeTIFFColor(), compressed with LZW or Deflate and horizontal predictor,
+// in strips of 32 rows or in tiles of 256x256 pixels
+void writeLargeTIFF(const QString& fileName, quint16 compression, bool tiled)
+{
+    int const size = 8192;
+    QSize const chunkSize = tiled ? QSize(256, 256) : QSize(size, 32);
+    QVector<QByteArray> chunks;
+    QByteArray chunk(3*chunkSize.width()*chunkSize.height(), Qt::Uninitialized);
+    for (int y0=0; y0<size; y0+=chunkSize.height())
+    {
+        for (int x0=0; x0<size; x0+=chunkSize.width())
+        {
+            for (int y=0; y<chunkSize.height(); y++)
+            {
+                auto* row = reinterpret_cast<uchar*>(chunk.data()) + 3*chunkSize.width()*y;
+                for (int x=0; x<chunkSize.width(); x++)
+                {
+                    auto color = largeTIFFColor(x0+x, y0+y);
+                    row[3*x] = uchar(qRed(color));
+                    row[3*x+1] = uchar(qGreen(color));
+                    row[3*x+2] = uchar(qBlue(color));
+                }
+                for (int x=3*chunkSize.width()-1; x>=3; x--)
+                {
+                    row[x] -= row[x-3];
+                }
+            }
+            chunks += (compression == 5) ? compressLZW(chunk) : FileFormats::TIFFCodecs::compressDeflate(chunk);
+        }
+    }
+
+    QVector<std::tuple<quint16, quint16, quint32, QByteArray>> fields {
+        {256, 4, 1, number32(size)}, {257, 4, 1, number32(size)}, {258, 3, 3, number16(8) + number16(8) + number16(8)},
+        {259, 3, 1, number16(compression)}, {262, 3, 1, number16(2)}, {277, 3, 1, number16(3)}, {284, 3, 1, number16(1)}, {317, 3, 1, number16(2)}};
+    if (tiled)
+    {
+        fields += {{322, 4, 1, number32(quint32(chunkSize.width()))}, {323, 4, 1, number32(quint32(chunkSize.height()))}};
+    }
+    else
+    {
+        fields.append({278, 4, 1, number32(quint32(chunkSize.height()))});
+    }
+    QFile file(fileName);
+    QVERIFY( file.open(QIODevice::WriteOnly) );
+    file.write(tiffFile(fields, chunks, tiled));
+}
+
+// Returns the name of a file written by writeLargeTIFF(). Files are written on
+// first use and removed when the test ends.
+QString largeTIFF(quint16 compression, bool tiled)
+{
+    static QTemporaryDir const directory;
+    auto fileName = directory.filePath(u"large-%1-%2.tif"_qs.arg(compression).arg(tiled ? u"tiles"_qs : u"strips"_qs));
+    if (!QFile::exists(fileName))
+    {
+        writeLargeTIFF(fileName, compression, tiled);
+    }
+    return fileName;
+}
+
+// Benchmarks reading a file written by writeLargeTIFF() with
+// GeoTIFF::readWindow(), or with QImage for comparison. Writing and reading
+// the files takes a while, so the benchmarks only run if the environment
+// variable GEOTIFF_LARGE_BENCHMARKS is set.
+void benchmarkLargeTIFF(quint16 compression, bool tiled, bool qImage)
+{
+    if (qEnvironmentVariable("GEOTIFF_LARGE_BENCHMARKS").isEmpty())
+    {
+        QSKIP("GEOTIFF_LARGE_BENCHMARKS is not set");
+    }
+    if (qImage && !QImageReader::supportedImageFormats().contains("tiff"))
+    {
+        QSKIP("Qt cannot read TIFF files");
+    }
+    auto fileName = largeTIFF(compression, tiled);
+    QImage image;
+    if (qImage)
+    {
+        QBENCHMARK
+        {
+            image = QImage(fileName);
+        }
+    }
+    else
+    {
+        FileFormats::GeoTIFF const geoTIFF(fileName);
+        FileFormats::TIFFReadOptions options;
+        options.tileCache = nullptr;
+        QBENCHMARK
+        {
+            image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()), options);
+        }
+    }
+    QCOMPARE( image.size(), QSize(8192, 8192) );
+    for (auto [i, j] : {std::pair(0, 0), std::pair(1000, 77), std::pair(4097, 8191), std::pair(8191, 5000)})
+    {
+        QCOMPARE( image.pixel(i, j), largeTIFFColor(i, j) );
+    }
+}
+
+// Decompresses gzip data
+QByteArray gunzip(QByteArrayView input)
+{
+    z_stream stream {};
+    inflateInit2(&stream, MAX_WBITS + 16);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = uInt(input.size());
+    QByteArray result;
+    char buffer[16384];
+    int status = Z_OK;
+    while (status == Z_OK)
+    {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        result.append(buffer, qsizetype(sizeof(buffer) - stream.avail_out));
+    }
+    inflateEnd(&stream);
+    return (status == Z_STREAM_END) ? result : QByteArray();
+}
+
+// Looks up a tile in a PMTiles archive, following the specification. Returns
+// a null byte array if the archive does not contain the tile.
+QByteArray pmtilesTile(const QByteArray& archive, int zoom, int x, int y)
+{
+    auto number = [&archive](qsizetype offset) { return qFromLittleEndian<quint64>(archive.constData() + offset); };
+    auto tileID = FileFormats::PMTilesWriter::tileID(zoom, x, y);
+    auto directoryOffset = number(8);
+    auto directoryLength = number(16);
+    for (int depth=0; depth<4; depth++)
+    {
+        auto directory = gunzip(QByteArrayView(archive).sliced(qsizetype(directoryOffset), qsizetype(directoryLength)));
+        qsizetype position = 0;
+        auto varint = [&]() {
+            quint64 value = 0;
+            for (int shift=0; ; shift+=7)
+            {
+                auto byte = quint8(directory[position++]);
+                value |= quint64(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+        };
+        auto count = qsizetype(varint());
+        QVector<quint64> ids(count);
+        QVector<quint64> runLengths(count);
+        QVector<quint64> lengths(count);
+        QVector<quint64> offsets(count);
+        quint64 last = 0;
+        for (auto& id : ids)
+        {
+            last += varint();
+            id = last;
+        }
+        for (auto& runLength : runLengths)
+        {
+            runLength = varint();
+        }
+        for (auto& length : lengths)
+        {
+            length = varint();
+        }
+        for (qsizetype i=0; i<count; i++)
+        {
+            auto value = varint();
+            offsets[i] = ((value == 0) && (i > 0)) ? offsets[i-1] + lengths[i-1] : value - 1;
+        }
+
+        // Last entry whose tile ID is not larger than the one searched
+        auto i = std::upper_bound(ids.begin(), ids.end(), tileID) - ids.begin() - 1;
+        if (i < 0)
+        {
+            return {};
+        }
+        if (runLengths[i] == 0)
+        {
+            directoryOffset = number(40) + offsets[i];
+            directoryLength = lengths[i];
+            continue;
+        }
+        if (tileID >= ids[i] + runLengths[i])
+        {
+            return {};
+        }
+        return archive.mid(qsizetype(number(56) + offsets[i]), qsizetype(lengths[i]));
+    }
+    return {};
+}
+
+} // namespace
+
+
 void GeoTIFFTest::test()
 {
 
@@ -31,3 +730,1934 @@ void GeoTIFFTest::test()
     QVERIFY( test1.name() == u""_qs );
 
 }
+
+void GeoTIFFTest::testDevice()
+{
+    // Mapped file device
+    QFile file( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    FileFormats::GeoTIFF const mapped(file);
+    QVERIFY( mapped.isValid() );
+
+    // Non-mappable device, read through the data stream
+    QBuffer buffer;
+    buffer.setData(file.readAll());
+    QVERIFY( buffer.open(QIODevice::ReadOnly) );
+    FileFormats::GeoTIFF const streamed(buffer);
+    QVERIFY( streamed.isValid() );
+
+    QCOMPARE( streamed.bBox(), mapped.bBox() );
+    QCOMPARE( streamed.name(), mapped.name() );
+}
+
+void GeoTIFFTest::testRequestedTags()
+{
+    auto fileName = QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs;
+
+    // By default, tag 305 (Software) is indexed, but not decoded
+    FileFormats::GeoTIFF const lazy(fileName);
+    QVERIFY( lazy.isValid() );
+    QVERIFY( lazy.TIFFFields().contains(305) );
+    QVERIFY( !lazy.TIFFFields().isDecoded(305) );
+    QVERIFY( lazy.TIFFFields().ascii(305).isEmpty() );
+
+    // Requested tags are decoded
+    FileFormats::GeoTIFF const requested(fileName, {305});
+    QVERIFY( requested.isValid() );
+    QVERIFY( requested.TIFFFields().isDecoded(305) );
+    QVERIFY( requested.TIFFFields().ascii(305).startsWith("GIMP") );
+    QCOMPARE( requested.bBox(), lazy.bBox() );
+}
+
+void GeoTIFFTest::testCatalog()
+{
+    FileFormats::GeoTIFFCatalog catalog;
+    catalog.setMaxThreadCount(2);
+    std::atomic<qsizetype> progress {0};
+    catalog.setProgressCallback([&progress](qsizetype done, qsizetype total) {
+        Q_UNUSED(total)
+        progress = done;
+    });
+
+    auto entries = catalog.scan( QString::fromLatin1(SRC) + u"/testData/GeoTIFF"_qs );
+    QCOMPARE( entries.size(), 1 );
+    QCOMPARE( progress.load(), 1 );
+    QVERIFY( !catalog.isCanceled() );
+    QVERIFY( entries[0].path.endsWith(u"EDKA.tiff"_qs) );
+    QVERIFY( entries[0].isValid );
+    QVERIFY( entries[0].bBox.topLeft().distanceTo({50.8549, 6.11667}) < 10 );
+}
+
+
+void GeoTIFFTest::testCache()
+{
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto cacheFileName = tempDir.filePath(u"catalog.cache"_qs);
+
+    FileFormats::GeoTIFFCatalog catalog;
+    catalog.setCacheFileName(cacheFileName);
+    auto entries = catalog.scan( QString::fromLatin1(SRC) + u"/testData/GeoTIFF"_qs );
+    QCOMPARE( entries.size(), 1 );
+    QVERIFY( QFile::exists(cacheFileName) );
+
+    FileFormats::GeoTIFFCache const cache(cacheFileName);
+    QCOMPARE( cache.size(), 1 );
+    auto cached = cache.find(entries[0].path, entries[0].fileSize, entries[0].lastModified);
+    QVERIFY( cached.has_value() );
+    QCOMPARE( cached->name, entries[0].name );
+    QCOMPARE( cached->bBox, entries[0].bBox );
+    QCOMPARE( cached->rasterSize, QSize(1472, 1471) );
+    QVERIFY( !cache.find(entries[0].path, entries[0].fileSize+1, entries[0].lastModified).has_value() );
+
+    auto rescanned = catalog.scan( QString::fromLatin1(SRC) + u"/testData/GeoTIFF"_qs );
+    QCOMPARE( rescanned.size(), 1 );
+    QCOMPARE( rescanned[0].path, entries[0].path );
+    QCOMPARE( rescanned[0].bBox, entries[0].bBox );
+    QCOMPARE( rescanned[0].isValid, entries[0].isValid );
+}
+
+
+void GeoTIFFTest::testIndex()
+{
+    QVector<QGeoRectangle> boxes;
+    boxes.append( FileFormats::GeoTIFF(QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs).bBox() );
+    boxes.append( QGeoRectangle({51.0, 6.0}, {50.0, 7.0}) );
+    boxes.append( QGeoRectangle({-10.0, 170.0}, {-20.0, -170.0}) ); // Crosses the antimeridian
+    boxes.append( QGeoRectangle() );
+
+    FileFormats::GeoTIFFIndex const index(boxes);
+    QCOMPARE( index.size(), 3 );
+    QCOMPARE( index.find(QGeoCoordinate(50.8, 6.2)), QVector<qsizetype>({0, 1}) );
+    QCOMPARE( index.find(QGeoCoordinate(50.2, 6.2)), QVector<qsizetype>({1}) );
+    QCOMPARE( index.find(QGeoCoordinate(-15.0, 175.0)), QVector<qsizetype>({2}) );
+    QCOMPARE( index.find(QGeoCoordinate(-15.0, -175.0)), QVector<qsizetype>({2}) );
+    QVERIFY( index.find(QGeoCoordinate(-15.0, 0.0)).isEmpty() );
+
+    // On the antimeridian, both halves of a box that crosses it contain the
+    // point. The index is returned once.
+    QCOMPARE( index.find(QGeoCoordinate(-15.0, 180.0)), QVector<qsizetype>({2}) );
+    QCOMPARE( index.find(QGeoCoordinate(-15.0, -180.0)), QVector<qsizetype>({2}) );
+    QCOMPARE( index.find(QGeoRectangle({-12.0, 179.0}, {-13.0, -179.0})), QVector<qsizetype>({2}) );
+    QCOMPARE( index.nearest(QGeoCoordinate(-15.0, -160.0), 1), QVector<qsizetype>({2}) );
+    QCOMPARE( index.nearest(QGeoCoordinate(50.2, 6.2), 2), QVector<qsizetype>({1, 0}) );
+
+    // Compare against a linear scan
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<double> latitude(-80.0, 80.0);
+    std::uniform_real_distribution<double> longitude(-180.0, 180.0);
+    std::uniform_real_distribution<double> extent(0.0, 5.0);
+    boxes.clear();
+    for (int i=0; i<2000; i++)
+    {
+        auto top = latitude(generator);
+        auto left = longitude(generator);
+        auto right = left + extent(generator);
+        if (right > 180.0)
+        {
+            right -= 360.0;
+        }
+        boxes.append( QGeoRectangle({top, left}, {top - extent(generator), right}) );
+    }
+    FileFormats::GeoTIFFIndex const randomIndex(boxes);
+    for (int i=0; i<200; i++)
+    {
+        QGeoCoordinate const coordinate(latitude(generator), longitude(generator));
+        QVector<qsizetype> expected;
+        for (qsizetype j=0; j<boxes.size(); j++)
+        {
+            if (boxes[j].contains(coordinate))
+            {
+                expected.append(j);
+            }
+        }
+        QCOMPARE( randomIndex.find(coordinate), expected );
+    }
+}
+
+
+void GeoTIFFTest::testReadWindow()
+{
+    // The test files contain a synthetic pattern with red = 2x, green = 3y
+    // and blue = x+y. The tiled file has an additional alpha channel.
+    auto checkPattern = [](const QImage& image, const QRect& window) {
+        QCOMPARE( image.size(), window.size() );
+        for (int y=0; y<image.height(); y++)
+        {
+            for (int x=0; x<image.width(); x++)
+            {
+                auto pixel = image.pixel(x, y);
+                auto rasterX = window.x() + x;
+                auto rasterY = window.y() + y;
+                QCOMPARE( qRed(pixel), (2*rasterX) & 255 );
+                QCOMPARE( qGreen(pixel), (3*rasterY) & 255 );
+                QCOMPARE( qBlue(pixel), (rasterX+rasterY) & 255 );
+            }
+        }
+    };
+
+    FileFormats::GeoTIFF const strips( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-strips.tif"_qs );
+    QVERIFY( strips.isValid() );
+    QVERIFY( !strips.raster().isNull() );
+    QVERIFY( !strips.raster().isTiled() );
+    QCOMPARE( strips.rasterSize(), QSize(100, 70) );
+    QCOMPARE( strips.raster().format(), QImage::Format_RGB888 );
+    checkPattern( strips.readWindow(QRect(30, 10, 45, 40)), QRect(30, 10, 45, 40) );
+    checkPattern( strips.readWindow(QRect(90, 60, 50, 50)), QRect(90, 60, 10, 10) );
+    QVERIFY( strips.readWindow(QRect(200, 200, 10, 10)).isNull() );
+
+    FileFormats::GeoTIFF const tiles( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-tiles.tif"_qs );
+    QVERIFY( tiles.isValid() );
+    QVERIFY( tiles.raster().isTiled() );
+    QCOMPARE( tiles.raster().tileSize(), QSize(32, 32) );
+    QCOMPARE( tiles.raster().format(), QImage::Format_RGBA8888 );
+    checkPattern( tiles.readWindow(QRect(30, 10, 45, 40)), QRect(30, 10, 45, 40) );
+    checkPattern( tiles.readWindow(QRect(QPoint(0, 0), tiles.rasterSize())), QRect(0, 0, 100, 70) );
+
+    // Objects constructed from a device read windows from a device
+    QFile file( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-tiles.tif"_qs );
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    QBuffer buffer;
+    buffer.setData(file.readAll());
+    QVERIFY( buffer.open(QIODevice::ReadOnly) );
+    FileFormats::GeoTIFF const streamed(buffer);
+    QVERIFY( streamed.readWindow(QRect(0, 0, 10, 10)).isNull() );
+    checkPattern( streamed.readWindow(buffer, QRect(64, 32, 36, 38)), QRect(64, 32, 36, 38) );
+}
+
+
+void GeoTIFFTest::testCompression()
+{
+    // LZW with predictor, Deflate with predictor in tiles, and PackBits
+    for (const auto& name : {u"pattern-lzw.tif"_qs, u"pattern-deflate.tif"_qs, u"pattern-packbits.tif"_qs})
+    {
+        FileFormats::GeoTIFF const geoTIFF( QString::fromLatin1(SRC) + u"/testData/Raster/"_qs + name );
+        QVERIFY( geoTIFF.isValid() );
+        QVERIFY( !geoTIFF.raster().isNull() );
+        auto image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()));
+        QCOMPARE( image.size(), QSize(100, 70) );
+        for (int y=0; y<image.height(); y++)
+        {
+            for (int x=0; x<image.width(); x++)
+            {
+                auto pixel = image.pixel(x, y);
+                QCOMPARE( qRed(pixel), (2*x) & 255 );
+                QCOMPARE( qGreen(pixel), (3*y) & 255 );
+                QCOMPARE( qBlue(pixel), (x+y) & 255 );
+            }
+        }
+    }
+
+    // EDKA.tiff is Deflate compressed with predictor. The channel sums were
+    // computed with libtiff.
+    FileFormats::GeoTIFF const geoTIFF( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    auto image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()));
+    QCOMPARE( image.size(), QSize(1472, 1471) );
+    std::array<qint64, 4> sums {0, 0, 0, 0};
+    for (int y=0; y<image.height(); y++)
+    {
+        const auto* line = image.constScanLine(y);
+        for (int x=0; x<4*image.width(); x++)
+        {
+            sums[x % 4] += line[x];
+        }
+    }
+    QCOMPARE( sums, (std::array<qint64, 4>{470280557, 474147469, 477347622, 552154560}) );
+
+    QRect const window(500, 300, 200, 200);
+    QCOMPARE( geoTIFF.readWindow(window), image.copy(window) );
+}
+
+void GeoTIFFTest::testSixteenBit()
+{
+    // Gray = 300x+500y, little-endian, tiled, Deflate with predictor
+    FileFormats::GeoTIFF const gray( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-gray16.tif"_qs );
+    QVERIFY( gray.isValid() );
+    QCOMPARE( gray.raster().format(), QImage::Format_Grayscale16 );
+    QRect const window(30, 10, 45, 40);
+    auto image = gray.readWindow(window);
+    QCOMPARE( image.size(), window.size() );
+    for (int y=0; y<image.height(); y++)
+    {
+        const auto* line = reinterpret_cast<const quint16*>(image.constScanLine(y));
+        for (int x=0; x<image.width(); x++)
+        {
+            QCOMPARE( int(line[x]), 300*(window.x()+x) + 500*(window.y()+y) );
+        }
+    }
+
+    // Red = 600x, green = 900y, blue = 300x+400y, big-endian, strips, Deflate
+    // with predictor. RGB is expanded to RGBX.
+    FileFormats::GeoTIFF const rgb( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-rgb16-be.tif"_qs );
+    QVERIFY( rgb.isValid() );
+    QCOMPARE( rgb.raster().format(), QImage::Format_RGBX64 );
+    image = rgb.readWindow(QRect(QPoint(0, 0), rgb.rasterSize()));
+    QCOMPARE( image.size(), QSize(100, 70) );
+    for (int y=0; y<image.height(); y++)
+    {
+        const auto* line = reinterpret_cast<const quint16*>(image.constScanLine(y));
+        for (int x=0; x<image.width(); x++)
+        {
+            QCOMPARE( int(line[4*x]), 600*x );
+            QCOMPARE( int(line[4*x+1]), 900*y );
+            QCOMPARE( int(line[4*x+2]), 300*x+400*y );
+            QCOMPARE( int(line[4*x+3]), 0xFFFF );
+        }
+    }
+}
+
+void GeoTIFFTest::testFloatingPoint()
+{
+    // Gray, in strips of 8 rows, Deflate without and with floating point
+    // differencing. Gray is replicated to RGBX.
+    auto gray = [](int x, int y) { return 1.0E-3F*float(x*x) - 1.7F*float(y) + 0.125F; };
+    QSize const size(37, 23);
+    auto grayFile = [&](quint16 predictor) {
+        QVector<QByteArray> strips;
+        for (int y0=0; y0<size.height(); y0+=8)
+        {
+            QVector<float> samples;
+            for (int y=y0; y<qMin(y0+8, size.height()); y++)
+            {
+                for (int x=0; x<size.width(); x++)
+                {
+                    samples.append(gray(x, y));
+                }
+            }
+            strips += FileFormats::TIFFCodecs::compressDeflate(floatSamples(samples, size.width(), 1, predictor == 3));
+        }
+        return tiffFile({{256, 3, 1, number16(quint16(size.width()))}, {257, 3, 1, number16(quint16(size.height()))}, {258, 3, 1, number16(32)}, {259, 3, 1, number16(8)},
+                         {262, 3, 1, number16(1)}, {277, 3, 1, number16(1)}, {278, 3, 1, number16(8)}, {317, 3, 1, number16(predictor)}, {339, 3, 1, number16(3)}},
+                        strips, false);
+    };
+    for (quint16 predictor : {1, 3})
+    {
+        auto file = grayFile(predictor);
+        QBuffer buffer(&file);
+        QVERIFY( buffer.open(QIODevice::ReadOnly) );
+        FileFormats::GeoTIFF const geoTIFF(buffer);
+        QVERIFY( geoTIFF.isValid() );
+        QCOMPARE( geoTIFF.raster().format(), QImage::Format_RGBX32FPx4 );
+        QRect const window(3, 5, 30, 15);
+        auto image = geoTIFF.readWindow(buffer, window);
+        QCOMPARE( image.size(), window.size() );
+        for (int y=0; y<image.height(); y++)
+        {
+            const auto* line = reinterpret_cast<const float*>(image.constScanLine(y));
+            for (int x=0; x<image.width(); x++)
+            {
+                auto expected = gray(window.x()+x, window.y()+y);
+                QCOMPARE( line[4*x], expected );
+                QCOMPARE( line[4*x+1], expected );
+                QCOMPARE( line[4*x+2], expected );
+                QCOMPARE( line[4*x+3], 1.0F );
+            }
+        }
+    }
+
+    // RGB, in tiles of 16x16 pixels, LZW with floating point differencing
+    auto rgb = [](int x, int y, int channel) { return float(channel+1)*1.0E-3F*float(x*x) - 1.7F*float(y) + 1.0E6F*float(channel); };
+    QSize const rgbSize(40, 20);
+    QVector<QByteArray> tiles;
+    for (int y0=0; y0<rgbSize.height(); y0+=16)
+    {
+        for (int x0=0; x0<rgbSize.width(); x0+=16)
+        {
+            QVector<float> samples;
+            for (int y=y0; y<y0+16; y++)
+            {
+                for (int x=x0; x<x0+16; x++)
+                {
+                    samples += {rgb(x, y, 0), rgb(x, y, 1), rgb(x, y, 2)};
+                }
+            }
+            tiles += compressLZW(floatSamples(samples, 16, 3, true));
+        }
+    }
+    auto file = tiffFile({{256, 3, 1, number16(quint16(rgbSize.width()))}, {257, 3, 1, number16(quint16(rgbSize.height()))}, {258, 3, 3, number16(32) + number16(32) + number16(32)},
+                          {259, 3, 1, number16(5)}, {262, 3, 1, number16(2)}, {277, 3, 1, number16(3)}, {317, 3, 1, number16(3)}, {322, 3, 1, number16(16)}, {323, 3, 1, number16(16)},
+                          {339, 3, 3, number16(3) + number16(3) + number16(3)}},
+                         tiles, true);
+    QBuffer buffer(&file);
+    QVERIFY( buffer.open(QIODevice::ReadOnly) );
+    FileFormats::GeoTIFF const geoTIFF(buffer);
+    QCOMPARE( geoTIFF.raster().format(), QImage::Format_RGBX32FPx4 );
+    auto image = geoTIFF.readWindow(buffer, QRect(QPoint(0, 0), rgbSize));
+    QCOMPARE( image.size(), rgbSize );
+    for (int y=0; y<image.height(); y++)
+    {
+        const auto* line = reinterpret_cast<const float*>(image.constScanLine(y));
+        for (int x=0; x<image.width(); x++)
+        {
+            QCOMPARE( line[4*x], rgb(x, y, 0) );
+            QCOMPARE( line[4*x+1], rgb(x, y, 1) );
+            QCOMPARE( line[4*x+2], rgb(x, y, 2) );
+            QCOMPARE( line[4*x+3], 1.0F );
+        }
+    }
+
+    // Horizontal differencing is not defined for floating point samples
+    auto invalidFile = grayFile(2);
+    QBuffer invalidBuffer(&invalidFile);
+    QVERIFY( invalidBuffer.open(QIODevice::ReadOnly) );
+    QVERIFY( FileFormats::GeoTIFF(invalidBuffer).raster().isNull() );
+}
+
+void GeoTIFFTest::testPalette()
+{
+    // Index = x+2y, color map red = i, green = 255-i, blue = 7i
+    FileFormats::GeoTIFF const palette( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-palette.tif"_qs );
+    QVERIFY( palette.isValid() );
+    QCOMPARE( palette.raster().format(), QImage::Format_ARGB32_Premultiplied );
+    QCOMPARE( palette.raster().colorTable().size(), 256 );
+
+    QRect const window(5, 20, 90, 45);
+    auto expanded = palette.readWindow(window);
+    QCOMPARE( expanded.format(), QImage::Format_ARGB32_Premultiplied );
+    QCOMPARE( expanded.size(), window.size() );
+    for (int y=0; y<expanded.height(); y++)
+    {
+        for (int x=0; x<expanded.width(); x++)
+        {
+            auto index = (window.x() + x + 2*(window.y() + y)) & 255;
+            QCOMPARE( expanded.pixel(x, y), qRgb(index, 255-index, (7*index) & 255) );
+        }
+    }
+
+    // Indexed images share the color table
+    FileFormats::TIFFReadOptions options;
+    options.keepIndexed = true;
+    auto indexed = palette.readWindow(window, options);
+    QCOMPARE( indexed.format(), QImage::Format_Indexed8 );
+    QCOMPARE( indexed.colorTable(), palette.raster().colorTable() );
+    QCOMPARE( indexed.convertToFormat(QImage::Format_ARGB32_Premultiplied), expanded );
+
+    // Other images are not affected
+    FileFormats::GeoTIFF const strips( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-strips.tif"_qs );
+    QCOMPARE( strips.readWindow(window, options).format(), QImage::Format_RGB888 );
+}
+
+void GeoTIFFTest::testPredictor()
+{
+    using FileFormats::TIFFPredictor::Instructions;
+
+    // Vector code must agree with scalar code, for all row lengths and pixel
+    // layouts. Instruction sets that the processor does not support fall
+    // back to scalar code.
+    std::mt19937 generator(1);
+    for (auto instructions : {Instructions::SSE41, Instructions::AVX2})
+    {
+        for (int bitsPerSample : {8, 16})
+        {
+            for (int samplesPerPixel=1; samplesPerPixel<=4; samplesPerPixel++)
+            {
+                for (int width : {1, 3, 7, 17, 64, 101, 333})
+                {
+                    QByteArray expected(3*width*samplesPerPixel*bitsPerSample/8, Qt::Uninitialized);
+                    for (auto& byte : expected)
+                    {
+                        byte = char(generator());
+                    }
+                    auto actual = expected;
+                    FileFormats::TIFFPredictor::undoHorizontal(reinterpret_cast<uchar*>(expected.data()), 3, width, samplesPerPixel, bitsPerSample, Instructions::Scalar);
+                    FileFormats::TIFFPredictor::undoHorizontal(reinterpret_cast<uchar*>(actual.data()), 3, width, samplesPerPixel, bitsPerSample, instructions);
+                    QCOMPARE( actual, expected );
+                }
+            }
+        }
+
+        for (int samplesPerPixel=1; samplesPerPixel<=4; samplesPerPixel++)
+        {
+            for (int width : {1, 5, 16, 33, 100})
+            {
+                QByteArray expected(2*4*width*samplesPerPixel, Qt::Uninitialized);
+                for (auto& byte : expected)
+                {
+                    byte = char(generator());
+                }
+                auto actual = expected;
+                QByteArray scratch(4*width*samplesPerPixel, Qt::Uninitialized);
+                FileFormats::TIFFPredictor::undoFloatingPoint(reinterpret_cast<uchar*>(expected.data()), 2, width, samplesPerPixel, reinterpret_cast<uchar*>(scratch.data()), Instructions::Scalar);
+                FileFormats::TIFFPredictor::undoFloatingPoint(reinterpret_cast<uchar*>(actual.data()), 2, width, samplesPerPixel, reinterpret_cast<uchar*>(scratch.data()), instructions);
+                QCOMPARE( actual, expected );
+            }
+        }
+    }
+
+    // Horizontal differencing of 16-bit samples
+    std::array<quint16, 6> samples {1000, 2000, 1, 65535, 2, 3};
+    FileFormats::TIFFPredictor::undoHorizontal(reinterpret_cast<uchar*>(samples.data()), 1, 3, 2, 16);
+    QCOMPARE( samples, (std::array<quint16, 6>{1000, 2000, 1001, 1999, 1003, 2002}) );
+
+    // Floating point differencing, as written by libtiff: byte planes, most
+    // significant byte first, followed by byte differences
+    std::array<float, 5> const values {1.5F, -2.0F, 3.25F, 1.0E10F, 0.0F};
+    std::array<uchar, 20> encoded {};
+    for (int i=0; i<5; i++)
+    {
+        quint32 bits = 0;
+        memcpy(&bits, &values[i], 4);
+        for (int byte=0; byte<4; byte++)
+        {
+            encoded[byte*5 + i] = uchar(bits >> (8*(3-byte)));
+        }
+    }
+    for (int i=19; i>0; i--)
+    {
+        encoded[i] -= encoded[i-1];
+    }
+    std::array<uchar, 20> scratch {};
+    FileFormats::TIFFPredictor::undoFloatingPoint(encoded.data(), 1, 5, 1, scratch.data());
+    std::array<float, 5> decoded {};
+    memcpy(decoded.data(), encoded.data(), 20);
+    QCOMPARE( decoded, values );
+}
+
+void GeoTIFFTest::testOverviews()
+{
+    // Red = 2x and green = 3y in the coordinates of each level, blue = 50
+    // times the level. The first overview is a SubIFD, the second follows in
+    // the IFD chain.
+    auto fileName = QString::fromLatin1(SRC) + u"/testData/Raster/pattern-overviews.tif"_qs;
+    auto checkLevel = [](const QImage& image, const QRect& window, int level) {
+        QCOMPARE( image.size(), window.size() );
+        for (int y=0; y<image.height(); y++)
+        {
+            for (int x=0; x<image.width(); x++)
+            {
+                auto pixel = image.pixel(x, y);
+                QCOMPARE( qRed(pixel), (2*(window.x()+x)) & 255 );
+                QCOMPARE( qGreen(pixel), (3*(window.y()+y)) & 255 );
+                QCOMPARE( qBlue(pixel), 50*level );
+            }
+        }
+    };
+
+    for (auto fromDevice : {false, true})
+    {
+        QFile file(fileName);
+        QVERIFY( file.open(QIODevice::ReadOnly) );
+        QBuffer buffer;
+        buffer.setData(file.readAll());
+        QVERIFY( buffer.open(QIODevice::ReadOnly) );
+        auto geoTIFF = fromDevice ? FileFormats::GeoTIFF(buffer) : FileFormats::GeoTIFF(fileName);
+        QVERIFY( geoTIFF.isValid() );
+        QCOMPARE( geoTIFF.rasterSize(), QSize(100, 70) );
+        QCOMPARE( geoTIFF.overviews().size(), 2 );
+        QCOMPARE( geoTIFF.overviews()[0].size(), QSize(50, 35) );
+        QCOMPARE( geoTIFF.overviews()[1].size(), QSize(25, 18) );
+
+        QCOMPARE( geoTIFF.rasterForScale(1.0).size(), QSize(100, 70) );
+        QCOMPARE( geoTIFF.rasterForScale(0.6).size(), QSize(100, 70) );
+        QCOMPARE( geoTIFF.rasterForScale(0.5).size(), QSize(50, 35) );
+        QCOMPARE( geoTIFF.rasterForScale(0.3).size(), QSize(50, 35) );
+        QCOMPARE( geoTIFF.rasterForScale(0.25).size(), QSize(25, 18) );
+        QCOMPARE( geoTIFF.rasterForScale(0.01).size(), QSize(25, 18) );
+
+        // Windows are mapped to the overview, rounding outwards
+        checkLevel( geoTIFF.readWindow(buffer, QRect(20, 10, 40, 30), 1.0), QRect(20, 10, 40, 30), 0 );
+        checkLevel( geoTIFF.readWindow(buffer, QRect(20, 10, 40, 30), 0.5), QRect(10, 5, 20, 15), 1 );
+        checkLevel( geoTIFF.readWindow(buffer, QRect(21, 11, 40, 30), 0.5), QRect(10, 5, 21, 16), 1 );
+        checkLevel( geoTIFF.readWindow(buffer, QRect(0, 0, 100, 70), 0.1), QRect(0, 0, 25, 18), 2 );
+    }
+
+    // Files without overviews
+    FileFormats::GeoTIFF const strips( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-strips.tif"_qs );
+    QVERIFY( strips.overviews().isEmpty() );
+    QCOMPARE( strips.readWindow(QRect(30, 10, 45, 40), 0.1), strips.readWindow(QRect(30, 10, 45, 40)) );
+}
+
+void GeoTIFFTest::testTileCache()
+{
+    // Eviction gives entries that were used a second chance
+    FileFormats::TIFFTileCache cache(100);
+    FileFormats::TIFFTileCache::Key const a {u"file"_qs, 8, 0};
+    FileFormats::TIFFTileCache::Key const b {u"file"_qs, 8, 1};
+    FileFormats::TIFFTileCache::Key const c {u"file"_qs, 16, 0};
+    cache.insert(a, QByteArray(40, 'a'));
+    cache.insert(b, QByteArray(40, 'b'));
+    QCOMPARE( cache.size(), 80 );
+    QCOMPARE( cache.find(a), QByteArray(40, 'a') );
+    cache.insert(c, QByteArray(40, 'c'));
+    QCOMPARE( cache.size(), 80 );
+    QCOMPARE( cache.find(a), QByteArray(40, 'a') );
+    QVERIFY( cache.find(b).isNull() );
+    QCOMPARE( cache.find(c), QByteArray(40, 'c') );
+    QCOMPARE( cache.hits(), 3 );
+    QCOMPARE( cache.misses(), 1 );
+
+    // Data larger than the budget is not cached
+    cache.insert(b, QByteArray(101, 'b'));
+    QVERIFY( cache.find(b).isNull() );
+    cache.setBudget(0);
+    QCOMPARE( cache.size(), 0 );
+    QVERIFY( cache.find(a).isNull() );
+
+    // Repeated reads do not decode again
+    cache.setBudget(64*1024*1024);
+    cache.resetCounters();
+    FileFormats::TIFFReadOptions options;
+    options.tileCache = &cache;
+    auto fileName = QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs;
+    FileFormats::GeoTIFF const geoTIFF(fileName);
+    QRect const window(500, 300, 600, 200);
+    auto uncached = geoTIFF.readWindow(window, options);
+    auto misses = cache.misses();
+    QVERIFY( misses > 0 );
+    QCOMPARE( cache.hits(), 0 );
+    QVERIFY( cache.size() > 0 );
+    QCOMPARE( geoTIFF.readWindow(window, options), uncached );
+    QCOMPARE( cache.hits(), misses );
+    QCOMPARE( cache.misses(), misses );
+
+    // Devices other than files are not cached
+    QFile file(fileName);
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    QBuffer buffer;
+    buffer.setData(file.readAll());
+    QVERIFY( buffer.open(QIODevice::ReadOnly) );
+    QCOMPARE( geoTIFF.readWindow(buffer, window, options), uncached );
+    QCOMPARE( cache.hits() + cache.misses(), 2*misses );
+}
+
+void GeoTIFFTest::testParallelRead()
+{
+    FileFormats::TIFFReadOptions options;
+    options.threadCount = 4;
+
+    for (const auto& name : {u"GeoTIFF/EDKA.tiff"_qs, u"Raster/pattern-tiles.tif"_qs, u"Raster/pattern-lzw.tif"_qs})
+    {
+        FileFormats::GeoTIFF const geoTIFF( QString::fromLatin1(SRC) + u"/testData/"_qs + name );
+        QRect const full(QPoint(0, 0), geoTIFF.rasterSize());
+        auto serial = geoTIFF.readWindow(full);
+        QVERIFY( !serial.isNull() );
+
+        // Mapped file
+        options.inFlightBudget = 64*1024*1024;
+        QCOMPARE( geoTIFF.readWindow(full, options), serial );
+
+        // Budget smaller than a single strip or tile
+        options.inFlightBudget = 1024;
+        QCOMPARE( geoTIFF.readWindow(full, options), serial );
+
+        // Device that cannot be mapped
+        QFile file( QString::fromLatin1(SRC) + u"/testData/"_qs + name );
+        QVERIFY( file.open(QIODevice::ReadOnly) );
+        QBuffer buffer;
+        buffer.setData(file.readAll());
+        QVERIFY( buffer.open(QIODevice::ReadOnly) );
+        QCOMPARE( geoTIFF.readWindow(buffer, full, options), serial );
+    }
+}
+
+void GeoTIFFTest::benchmarkReadWindowParallel()
+{
+    FileFormats::GeoTIFF const geoTIFF( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    FileFormats::TIFFReadOptions options;
+    options.threadCount = QThread::idealThreadCount();
+    options.tileCache = nullptr;
+    QImage image;
+    QBENCHMARK
+    {
+        image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()), options);
+    }
+    QVERIFY( !image.isNull() );
+}
+
+void GeoTIFFTest::testOverviewBuilder()
+{
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto input = QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs;
+    auto output = tempDir.filePath(u"EDKA-overviews.tif"_qs);
+
+    FileFormats::GeoTIFFOverviewBuilder builder;
+    builder.setMaxThreadCount(4);
+    builder.write(input, output);
+
+    FileFormats::GeoTIFF const source(input);
+    FileFormats::GeoTIFF const result(output);
+    QVERIFY( result.isValid() );
+    QCOMPARE( result.name(), source.name() );
+    QCOMPARE( result.bBox(), source.bBox() );
+    QCOMPARE( result.raster().format(), source.raster().format() );
+    QCOMPARE( result.raster().tileSize(), QSize(256, 256) );
+    QCOMPARE( result.overviews().size(), 3 );
+    QCOMPARE( result.overviews()[0].size(), QSize(736, 736) );
+    QCOMPARE( result.overviews()[1].size(), QSize(368, 368) );
+    QCOMPARE( result.overviews()[2].size(), QSize(184, 184) );
+
+    // The full-resolution raster is copied without loss
+    QRect const full(QPoint(0, 0), source.rasterSize());
+    auto image = source.readWindow(full);
+    QCOMPARE( result.readWindow(full), image );
+
+    // Overview pixels average blocks of 2x2 pixels. The last row of the
+    // raster, whose height is odd, is replicated.
+    auto overview = result.readWindow(full, 0.5);
+    QCOMPARE( overview.size(), QSize(736, 736) );
+    for (auto point : {QPoint(0, 0), QPoint(123, 456), QPoint(735, 735)})
+    {
+        const auto* row0 = image.constScanLine(2*point.y());
+        const auto* row1 = image.constScanLine(qMin(2*point.y() + 1, image.height() - 1));
+        const auto* pixel = overview.constScanLine(point.y()) + 4*point.x();
+        for (int c=0; c<4; c++)
+        {
+            auto x0 = 8*point.x() + c;
+            auto sum = row0[x0] + row0[x0 + 4] + row1[x0] + row1[x0 + 4];
+            QCOMPARE( int(pixel[c]), (sum + 2)/4 );
+        }
+    }
+
+    // Files in ZIP archives are read through the archive
+    QFile inputFile(input);
+    QVERIFY( inputFile.open(QIODevice::ReadOnly) );
+    auto zipName = tempDir.filePath(u"charts.zip"_qs);
+    QFile zipFile(zipName);
+    QVERIFY( zipFile.open(QIODevice::WriteOnly) );
+    zipFile.write(zipArchive({{u"charts/EDKA.tiff"_qs, inputFile.readAll(), true}}));
+    zipFile.close();
+    auto zipOutput = tempDir.filePath(u"EDKA-zip-overviews.tif"_qs);
+    builder.write(zipName + u"/charts/EDKA.tiff"_qs, zipOutput);
+    FileFormats::GeoTIFF const zipResult(zipOutput);
+    QCOMPARE( zipResult.bBox(), source.bBox() );
+    QCOMPARE( zipResult.readWindow(full), image );
+    QCOMPARE( zipResult.readWindow(full, 0.5), overview );
+
+    // Tile sizes are multiples of 16
+    builder.setTileSize(100);
+    QCOMPARE( builder.tileSize(), 112 );
+
+    // Palette images are expanded, and 16-bit samples are reduced to 8 bits
+    QVector<std::pair<QString, QImage::Format>> const patterns {
+        {u"pattern-palette.tif"_qs, QImage::Format_RGB888},
+        {u"pattern-gray16.tif"_qs, QImage::Format_Grayscale8},
+        {u"pattern-strips.tif"_qs, QImage::Format_RGB888},
+        {u"pattern-tiles.tif"_qs, QImage::Format_RGBA8888},
+    };
+    for (const auto& [name, format] : patterns)
+    {
+        auto patternInput = QString::fromLatin1(SRC) + u"/testData/Raster/"_qs + name;
+        auto patternOutput = tempDir.filePath(name);
+        builder.write(patternInput, patternOutput);
+
+        FileFormats::GeoTIFF const pattern(patternInput);
+        FileFormats::GeoTIFF const written(patternOutput);
+        QCOMPARE( written.raster().format(), format );
+        QCOMPARE( written.raster().tileSize(), QSize(112, 112) );
+        QRect const window(QPoint(0, 0), pattern.rasterSize());
+        QCOMPARE( written.readWindow(window), pattern.readWindow(window).convertToFormat(format) );
+    }
+
+    // Failures leave no output file behind
+    auto missing = tempDir.filePath(u"missing.tif"_qs);
+    QString error;
+    try
+    {
+        builder.write(tempDir.filePath(u"nonexistent.tif"_qs), missing);
+    }
+    catch (QString& message)
+    {
+        error = message;
+    }
+    QVERIFY( !error.isEmpty() );
+    QVERIFY( !QFile::exists(missing) );
+}
+
+void GeoTIFFTest::testCloudOptimized()
+{
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto input = QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs;
+    FileFormats::GeoTIFF const source(input);
+    QRect const full(QPoint(0, 0), source.rasterSize());
+    auto image = source.readWindow(full);
+
+    FileFormats::GeoTIFFOverviewBuilder builder;
+    builder.setMaxThreadCount(4);
+    QVERIFY( builder.isCloudOptimized() );
+    auto cog = tempDir.filePath(u"cog.tif"_qs);
+    builder.write(input, cog);
+    builder.setCloudOptimized(false);
+    auto sequential = tempDir.filePath(u"sequential.tif"_qs);
+    builder.write(input, sequential);
+
+    // Both layouts hold the same images
+    FileFormats::GeoTIFF const cogTIFF(cog);
+    FileFormats::GeoTIFF const sequentialTIFF(sequential);
+    QCOMPARE( cogTIFF.bBox(), source.bBox() );
+    QCOMPARE( cogTIFF.readWindow(full), image );
+    QCOMPARE( cogTIFF.overviews().size(), sequentialTIFF.overviews().size() );
+    for (auto scale : {0.5, 0.25, 0.125})
+    {
+        QCOMPARE( cogTIFF.readWindow(full, scale), sequentialTIFF.readWindow(full, scale) );
+    }
+
+    // Walk the IFD chain of the COG. All IFDs precede all tile data, and the
+    // tile data of smaller images precedes that of larger ones.
+    QFile file(cog);
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    auto data = file.readAll();
+    const auto* bytes = reinterpret_cast<const uchar*>(data.constData());
+    QCOMPARE( data.left(4), QByteArray("II*\0", 4) );
+    QCOMPARE( qFromLittleEndian<quint32>(bytes + 4), 8U );
+    quint32 lastIFDEnd = 0;
+    QVector<std::pair<quint32, quint32>> tileRanges;
+    for (auto ifd = qFromLittleEndian<quint32>(bytes + 4); ifd != 0; )
+    {
+        auto count = qFromLittleEndian<quint16>(bytes + ifd);
+        quint32 tileCount = 0;
+        quint32 offsetsAt = 0;
+        for (int i=0; i<count; i++)
+        {
+            const auto* entry = bytes + ifd + 2 + 12*i;
+            if (qFromLittleEndian<quint16>(entry) == 324)
+            {
+                // A single offset is stored in the entry itself
+                tileCount = qFromLittleEndian<quint32>(entry + 4);
+                offsetsAt = (tileCount == 1) ? (ifd + 2 + 12*i + 8) : qFromLittleEndian<quint32>(entry + 8);
+            }
+        }
+        QVERIFY( tileCount > 0 );
+        lastIFDEnd = qMax(lastIFDEnd, offsetsAt + 4*tileCount);
+        quint32 first = UINT_MAX;
+        quint32 last = 0;
+        for (quint32 i=0; i<tileCount; i++)
+        {
+            auto offset = qFromLittleEndian<quint32>(bytes + offsetsAt + 4*i);
+            first = qMin(first, offset);
+            last = qMax(last, offset);
+        }
+        tileRanges.append(std::make_pair(first, last));
+        ifd = qFromLittleEndian<quint32>(bytes + ifd + 2 + 12*count);
+    }
+    QCOMPARE( tileRanges.size(), 4 );
+    QVERIFY( lastIFDEnd < tileRanges.last().first );
+    for (qsizetype i=1; i<tileRanges.size(); i++)
+    {
+        QVERIFY( tileRanges[i].second < tileRanges[i-1].first );
+    }
+
+    // Images and custom sources
+    QImage generated(300, 200, QImage::Format_ARGB32);
+    for (int y=0; y<generated.height(); y++)
+    {
+        for (int x=0; x<generated.width(); x++)
+        {
+            generated.setPixel(x, y, qRgba(x & 255, y, (x+y) & 255, 255));
+        }
+    }
+    auto fromImage = tempDir.filePath(u"image.tif"_qs);
+    builder.setCloudOptimized(true);
+    builder.write(generated, source.TIFFFields(), fromImage);
+    FileFormats::GeoTIFF const imageTIFF(fromImage);
+    QVERIFY( imageTIFF.isValid() );
+    QCOMPARE( imageTIFF.bBox().topLeft(), source.bBox().topLeft() );
+    QCOMPARE( imageTIFF.overviews().size(), 1 );
+    QCOMPARE( imageTIFF.readWindow(generated.rect()), generated.convertToFormat(QImage::Format_RGBA8888) );
+
+    QString error;
+    try
+    {
+        builder.write(QSize(300, 200), QImage::Format_RGB888, [](const QRect& window) { return QImage(window.width(), 1, QImage::Format_RGB888); }, source.TIFFFields(), tempDir.filePath(u"invalid.tif"_qs));
+    }
+    catch (QString& message)
+    {
+        error = message;
+    }
+    QVERIFY( !error.isEmpty() );
+    QVERIFY( !QFile::exists(tempDir.filePath(u"invalid.tif"_qs)) );
+}
+
+void GeoTIFFTest::testRangeReader()
+{
+    auto fileName = QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs;
+    QFile file(fileName);
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    auto data = file.readAll();
+    QBuffer buffer;
+    buffer.setData(data);
+    QVERIFY( buffer.open(QIODevice::ReadOnly) );
+
+    // Device and mapped readers return the same ranges, truncated at the end
+    // of the file
+    FileFormats::DeviceRangeReader deviceReader(buffer);
+    auto mappedReader = FileFormats::RangeReader::create(file);
+    QVERIFY( !mappedReader->data().isEmpty() );
+    QCOMPARE( mappedReader->size(), data.size() );
+    QCOMPARE( deviceReader.size(), data.size() );
+    QVector<FileFormats::RangeReader::Range> const ranges {{100, 50}, {0, 8}, {data.size()-10, 100}, {data.size()+10, 5}};
+    auto expected = QVector<QByteArray> {data.mid(100, 50), data.left(8), data.right(10), QByteArray()};
+    QCOMPARE( deviceReader.readRanges(ranges), expected );
+    QCOMPARE( mappedReader->readRanges(ranges), expected );
+
+    // HTTP reader against a local stand-in server
+    RangeServer server(data);
+    FileFormats::HTTPRangeReader httpReader(server.url());
+    QCOMPARE( httpReader.readRanges(ranges), expected );
+    QCOMPARE( httpReader.size(), data.size() );
+    QVERIFY( !httpReader.identity().isEmpty() );
+
+    // Parsing the header of a remote file needs few round trips, and windows
+    // read remotely equal those read locally
+    FileFormats::GeoTIFF const local(fileName);
+    server.connections = 0;
+    FileFormats::GeoTIFF const remote(httpReader);
+    QVERIFY( remote.isValid() );
+    QVERIFY( server.connections <= 2 );
+    QCOMPARE( remote.bBox(), local.bBox() );
+    QCOMPARE( remote.rasterSize(), local.rasterSize() );
+
+    FileFormats::TIFFReadOptions options;
+    options.tileCache = nullptr;
+    QRect const window(100, 100, 300, 200);
+    server.connections = 0;
+    QCOMPARE( remote.readWindow(httpReader, window, options), local.readWindow(window, options) );
+    QCOMPARE( server.connections.load(), 1 );
+
+    // Files that are not served produce errors, not crashes
+    FileFormats::HTTPRangeReader missing(QUrl(u"http://127.0.0.1:1/none.tif"_qs), 1000);
+    FileFormats::GeoTIFF const invalid(missing);
+    QVERIFY( !invalid.isValid() );
+}
+
+void GeoTIFFTest::testZIPArchive()
+{
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    QFile file( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    auto tiff = file.readAll();
+    QByteArray text;
+    for (int i=0; i<300000; i++)
+    {
+        text += QByteArray::number(i);
+        text += ' ';
+    }
+    auto zip = zipArchive({{u"EDKA.tiff"_qs, tiff, false}, {u"charts/EDKA.tiff"_qs, tiff, true}, {u"numbers.txt"_qs, text, true}});
+    auto zipName = tempDir.filePath(u"charts.zip"_qs);
+    QFile zipFile(zipName);
+    QVERIFY( zipFile.open(QIODevice::WriteOnly) );
+    zipFile.write(zip);
+    zipFile.close();
+
+    FileFormats::ZIPArchive const archive(zipName);
+    QVERIFY( archive.isValid() );
+    QCOMPARE( archive.entries().size(), 3 );
+    QCOMPARE( archive.entries()[1].name, u"charts/EDKA.tiff"_qs );
+    QCOMPARE( archive.entries()[1].size, tiff.size() );
+
+    // Stored files are views into the mapped archive
+    auto stored = archive.reader(u"EDKA.tiff"_qs);
+    QCOMPARE( stored->data(), QByteArrayView(tiff) );
+
+    // Compressed files can be read at random
+    auto deflated = archive.reader(u"numbers.txt"_qs);
+    QVERIFY( deflated->data().isEmpty() );
+    QCOMPARE( deflated->size(), text.size() );
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<qint64> offsets(0, text.size());
+    for (int i=0; i<50; i++)
+    {
+        auto offset = offsets(generator);
+        QCOMPARE( deflated->read(offset, 1000), text.mid(offset, 1000) );
+    }
+    QCOMPARE( deflated->read(0, text.size()), text );
+    QVector<FileFormats::RangeReader::Range> const ranges {{2000000, 10}, {5, 10}, {1000000, 10}};
+    QCOMPARE( deflated->readRanges(ranges), (QVector<QByteArray> {text.mid(2000000, 10), text.mid(5, 10), text.mid(1000000, 10)}) );
+
+    // GeoTIFF files in archives are opened by path
+    FileFormats::GeoTIFF const original(file.fileName());
+    QRect const window(200, 300, 400, 100);
+    for (const auto& name : {u"EDKA.tiff"_qs, u"charts/EDKA.tiff"_qs})
+    {
+        FileFormats::GeoTIFF const geoTIFF(zipName + u"/"_qs + name);
+        QVERIFY( geoTIFF.isValid() );
+        QCOMPARE( geoTIFF.bBox(), original.bBox() );
+        QCOMPARE( geoTIFF.readWindow(window), original.readWindow(window) );
+    }
+    QVERIFY( !FileFormats::GeoTIFF(zipName + u"/missing.tiff"_qs).isValid() );
+
+    // Parsing the header of a compressed file inflates only its beginning
+    QBuffer buffer(&zip);
+    QVERIFY( buffer.open(QIODevice::ReadOnly) );
+    CountingRangeReader counter(buffer);
+    FileFormats::ZIPArchive const bufferedArchive(counter);
+    QVERIFY( bufferedArchive.isValid() );
+    auto compressed = bufferedArchive.reader(u"charts/EDKA.tiff"_qs);
+    counter.bytesRead = 0;
+    FileFormats::GeoTIFF const geoTIFF(*compressed);
+    QVERIFY( geoTIFF.isValid() );
+    QVERIFY( counter.bytesRead < 256*1024 );
+
+    // The catalog lists the GeoTIFF files in archives
+    FileFormats::GeoTIFFCatalog catalog;
+    auto entries = catalog.scan(tempDir.path());
+    QCOMPARE( entries.size(), 2 );
+    for (const auto& entry : entries)
+    {
+        QVERIFY( entry.isValid );
+        QVERIFY( entry.path.startsWith(QFileInfo(zipName).absoluteFilePath() + u"/"_qs) );
+        QCOMPARE( entry.bBox, original.bBox() );
+    }
+
+    // Several threads can read windows of the same file in an archive at
+    // once
+    FileFormats::TIFFReadOptions options;
+    options.tileCache = nullptr;
+    auto expectedWindow = original.readWindow(window, options);
+    for (const auto& name : {u"EDKA.tiff"_qs, u"charts/EDKA.tiff"_qs})
+    {
+        FileFormats::GeoTIFF const geoTIFF(zipName + u"/"_qs + name);
+        std::atomic<int> mismatches {0};
+        std::vector<std::unique_ptr<QThread>> threads;
+        for (int i=0; i<4; i++)
+        {
+            threads.emplace_back(QThread::create([&]() {
+                for (int j=0; j<3; j++)
+                {
+                    if (geoTIFF.readWindow(window, options) != expectedWindow)
+                    {
+                        mismatches++;
+                    }
+                }
+            }));
+            threads.back()->start();
+        }
+        for (auto& thread : threads)
+        {
+            thread->wait();
+        }
+        QCOMPARE( mismatches.load(), 0 );
+    }
+
+    // GeoTIFF keeps the reader of a compressed file, so that a second read
+    // near the end restarts at an access point and not at the beginning of
+    // the file. Corrupting the beginning of the compressed data shows this.
+    QRect const bottom(0, original.rasterSize().height()-50, original.rasterSize().width(), 50);
+    auto expected = original.readWindow(bottom, options);
+    FileFormats::GeoTIFF const compressedGeoTIFF(zipName + u"/charts/EDKA.tiff"_qs);
+    QCOMPARE( compressedGeoTIFF.readWindow(bottom, options), expected );
+    auto entry = archive.entries()[1];
+    QVERIFY( zipFile.open(QIODevice::ReadWrite) );
+    QVERIFY( zipFile.seek(entry.localHeaderOffset + 30 + entry.name.toUtf8().size() + 1000) );
+    zipFile.write(QByteArray(1000, '\xFF'));
+    zipFile.close();
+    QCOMPARE( compressedGeoTIFF.readWindow(bottom, options), expected );
+    QVERIFY( FileFormats::GeoTIFF(zipName + u"/charts/EDKA.tiff"_qs).readWindow(bottom, options) != expected );
+}
+
+void GeoTIFFTest::testBigTIFF()
+{
+    // Converted from pattern-tiles.tif, little-endian, with LONG8 offsets
+    FileFormats::GeoTIFF const tiles( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-tiles.tif"_qs );
+    FileFormats::GeoTIFF const bigTiles( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-bigtiff.tif"_qs, {324} );
+    QVERIFY( bigTiles.isValid() );
+    QCOMPARE( bigTiles.TIFFFields().long8s(324).size(), size_t(tiles.raster().tileCount()) );
+    QRect const full(QPoint(0, 0), tiles.rasterSize());
+    QCOMPARE( bigTiles.readWindow(full), tiles.readWindow(full) );
+
+    // Converted from pattern-rgb16-be.tif, big-endian
+    FileFormats::GeoTIFF const rgb( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-rgb16-be.tif"_qs );
+    FileFormats::GeoTIFF const bigRGB( QString::fromLatin1(SRC) + u"/testData/Raster/pattern-bigtiff-be.tif"_qs );
+    QVERIFY( bigRGB.isValid() );
+    QCOMPARE( bigRGB.readWindow(full), rgb.readWindow(full) );
+
+    // Files written as BigTIFF read like classic files
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    FileFormats::GeoTIFF const source( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    QImage generated(300, 200, QImage::Format_RGBA8888);
+    for (int y=0; y<generated.height(); y++)
+    {
+        for (int x=0; x<generated.width(); x++)
+        {
+            generated.setPixel(x, y, qRgba(x & 255, y, (x+y) & 255, 255));
+        }
+    }
+    for (auto layout : {FileFormats::GeoTIFFWriter::Layout::Sequential, FileFormats::GeoTIFFWriter::Layout::CloudOptimized})
+    {
+        for (auto bigTIFF : {false, true})
+        {
+            auto fileName = tempDir.filePath(u"big.tif"_qs);
+            FileFormats::GeoTIFFWriter writer(fileName, layout);
+            writer.setGeoFields(source.TIFFFields());
+            writer.setBigTIFF(bigTIFF);
+            auto image = writer.addImage(generated.size(), {256, 256}, generated.format());
+            auto overview = writer.addImage({150, 100}, {256, 256}, generated.format());
+            writer.writeTile(image, 0, generated.copy(0, 0, 256, 200));
+            writer.writeTile(image, 1, generated.copy(256, 0, 44, 200));
+            writer.writeTile(overview, 0, generated.scaled(150, 100));
+            writer.finish();
+
+            QFile file(fileName);
+            QVERIFY( file.open(QIODevice::ReadOnly) );
+            auto data = file.readAll();
+            QCOMPARE( data.left(4), bigTIFF ? QByteArray("II+\0", 4) : QByteArray("II*\0", 4) );
+            QBuffer buffer;
+            buffer.setData(data);
+            QVERIFY( buffer.open(QIODevice::ReadOnly) );
+            FileFormats::GeoTIFF const written(buffer);
+            QVERIFY( written.isValid() );
+            QCOMPARE( written.bBox().topLeft(), source.bBox().topLeft() );
+            QCOMPARE( written.overviews().size(), 1 );
+            QCOMPARE( FileFormats::GeoTIFF(fileName).readWindow(generated.rect()), generated );
+        }
+    }
+}
+
+void GeoTIFFTest::testGeoKeys()
+{
+    using FileFormats::GeoKeyDirectory;
+
+    // EDKA.tiff is geographic, WGS 84, with PixelIsPoint
+    FileFormats::GeoTIFF const edka( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    QVERIFY( !edka.geoKeys().isEmpty() );
+    QCOMPARE( edka.geoKeys().keys(), QVector<quint16>({GeoKeyDirectory::GTModelType, GeoKeyDirectory::GTRasterType, GeoKeyDirectory::GeographicType}) );
+    QCOMPARE( edka.geoKeys().modelType(), quint16(GeoKeyDirectory::ModelTypeGeographic) );
+    QCOMPARE( edka.geoKeys().rasterType(), quint16(GeoKeyDirectory::RasterPixelIsPoint) );
+    QCOMPARE( edka.geoKeys().shortValue(GeoKeyDirectory::GeographicType, 0), quint16(4326) );
+
+    // Values of type SHORT, DOUBLE and ASCII
+    auto fields = geoFields({1, 1, 0, 5,
+                             GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeProjected,
+                             GeoKeyDirectory::GTCitation, 34737, 7, 0,
+                             GeoKeyDirectory::ProjectedCSType, 0, 1, 32632,
+                             GeoKeyDirectory::ProjStdParallel1, 34736, 2, 0,
+                             GeoKeyDirectory::ProjLinearUnits, 34735, 1, 24,
+                             9001},
+                            {48.0, 50.0}, QByteArray("UTM 32|", 8), {});
+    GeoKeyDirectory const keys(fields);
+    QCOMPARE( keys.keys().size(), 5 );
+    QCOMPARE( keys.modelType(), quint16(GeoKeyDirectory::ModelTypeProjected) );
+    QCOMPARE( keys.rasterType(), quint16(GeoKeyDirectory::RasterPixelIsArea) );
+    QCOMPARE( keys.shortValue(GeoKeyDirectory::ProjectedCSType, 0), quint16(32632) );
+    QCOMPARE( keys.shortValue(GeoKeyDirectory::ProjLinearUnits, 0), quint16(9001) );
+    QCOMPARE( keys.doubleValue(GeoKeyDirectory::ProjStdParallel1, 0.0), 48.0 );
+    QCOMPARE( keys.values(GeoKeyDirectory::ProjStdParallel1), QVector<double>({48.0, 50.0}) );
+    QCOMPARE( keys.ascii(GeoKeyDirectory::GTCitation), u"UTM 32"_qs );
+    QCOMPARE( keys.shortValue(GeoKeyDirectory::GTCitation, 7), quint16(7) );
+    QVERIFY( !keys.contains(GeoKeyDirectory::GeographicType) );
+
+    // Malformed directories throw
+    QString error;
+    try
+    {
+        GeoKeyDirectory const invalid(geoFields({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, 2}, {}, {}, {}));
+    }
+    catch (QString& message)
+    {
+        error = message;
+    }
+    QVERIFY( !error.isEmpty() );
+
+    // Bounding boxes cover the raster from the outer corners of the corner
+    // pixels. With PixelIsPoint, the tie point is the center of a pixel.
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    QVector<quint16> const geographic {1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeGeographic, GeoKeyDirectory::GeographicType, 0, 1, 4326};
+    QVector<quint16> const point {1, 1, 0, 3, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeGeographic, GeoKeyDirectory::GTRasterType, 0, 1, GeoKeyDirectory::RasterPixelIsPoint, GeoKeyDirectory::GeographicType, 0, 1, 4326};
+    auto area = tempDir.filePath(u"area.tif"_qs);
+    writeGeoTIFF(area, {100, 50}, geoFields(geographic, {}, {}, {{33550, {0.01, 0.02, 0.0}}, {33922, {0.0, 0.0, 0.0, 7.0, 48.0, 0.0}}}));
+    FileFormats::GeoTIFF const areaTIFF(area);
+    QVERIFY( areaTIFF.isValid() );
+    QCOMPARE( areaTIFF.bBox().topLeft(), QGeoCoordinate(48.0, 7.0) );
+    QCOMPARE( areaTIFF.bBox().bottomRight(), QGeoCoordinate(47.0, 8.0) );
+
+    auto pointFile = tempDir.filePath(u"point.tif"_qs);
+    writeGeoTIFF(pointFile, {100, 50}, geoFields(point, {}, {}, {{33550, {0.01, 0.02, 0.0}}, {33922, {0.0, 0.0, 0.0, 7.005, 47.99, 0.0}}}));
+    FileFormats::GeoTIFF const pointTIFF(pointFile);
+    QVERIFY( pointTIFF.isValid() );
+    QVERIFY( pointTIFF.bBox().topLeft().distanceTo(areaTIFF.bBox().topLeft()) < 0.01 );
+    QVERIFY( pointTIFF.bBox().bottomRight().distanceTo(areaTIFF.bBox().bottomRight()) < 0.01 );
+
+    // The ModelTransformation takes precedence and may rotate the raster
+    auto rotated = tempDir.filePath(u"rotated.tif"_qs);
+    QVector<double> const matrix {0.0, 0.01, 0.0, 7.0,
+                                  0.01, 0.0, 0.0, 47.0,
+                                  0.0, 0.0, 0.0, 0.0,
+                                  0.0, 0.0, 0.0, 1.0};
+    writeGeoTIFF(rotated, {100, 50}, geoFields(geographic, {}, {}, {{34264, matrix}, {33550, {1.0, 1.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}}}));
+    FileFormats::GeoTIFF const rotatedTIFF(rotated);
+    QVERIFY( rotatedTIFF.isValid() );
+    QVERIFY( rotatedTIFF.bBox().topLeft().distanceTo({48.0, 7.0}) < 0.01 );
+    QVERIFY( rotatedTIFF.bBox().bottomRight().distanceTo({47.0, 7.5}) < 0.01 );
+
+    // Projected coordinate systems without a projection are invalid
+    auto projected = tempDir.filePath(u"projected.tif"_qs);
+    writeGeoTIFF(projected, {100, 50}, geoFields({1, 1, 0, 1, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeProjected}, {}, {},
+                                                 {{33550, {10.0, 10.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 400000.0, 5300000.0, 0.0}}}));
+    FileFormats::GeoTIFF const projectedTIFF(projected);
+    QVERIFY( !projectedTIFF.isValid() );
+}
+
+void GeoTIFFTest::testGeoTransform()
+{
+    FileFormats::GeoTIFF const edka( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    const auto& transform = edka.transform();
+    QVERIFY( transform.isValid() );
+    QVERIFY( transform.toGeo({0.0, 0.0}).distanceTo(edka.bBox().topLeft()) < 0.01 );
+    auto corner = transform.toRaster(edka.bBox().bottomRight());
+    QVERIFY( qAbs(corner.x() - edka.rasterSize().width()) < 1e-6 );
+    QVERIFY( qAbs(corner.y() - edka.rasterSize().height()) < 1e-6 );
+
+    // Batch methods agree with the methods for single points, for all
+    // instruction sets, and for counts that leave remainders
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> distribution(-100.0, 2000.0);
+    qsizetype const count = 1001;
+    QVector<double> x(count);
+    QVector<double> y(count);
+    for (qsizetype i=0; i<count; i++)
+    {
+        x[i] = distribution(generator);
+        y[i] = distribution(generator);
+    }
+    using FileFormats::TIFFPredictor::Instructions;
+    for (auto instructions : {Instructions::Scalar, Instructions::SSE41, Instructions::AVX2})
+    {
+        QVector<double> longitudes(count);
+        QVector<double> latitudes(count);
+        transform.toGeo(x, y, longitudes, latitudes, instructions);
+        for (qsizetype i=0; i<count; i++)
+        {
+            auto expected = transform.toGeo({x[i], y[i]});
+            QVERIFY( qAbs(longitudes[i] - expected.longitude()) < 1e-9 );
+            QVERIFY( qAbs(latitudes[i] - expected.latitude()) < 1e-9 );
+        }
+
+        // Round trip, in place
+        transform.toRaster(longitudes, latitudes, longitudes, latitudes, instructions);
+        for (qsizetype i=0; i<count; i++)
+        {
+            QVERIFY( qAbs(longitudes[i] - x[i]) < 1e-6 );
+            QVERIFY( qAbs(latitudes[i] - y[i]) < 1e-6 );
+        }
+    }
+
+    // Singular mappings are invalid
+    FileFormats::GeoTransform const singular({1.0, 2.0, 0.0, 2.0, 4.0, 0.0});
+    QVERIFY( !singular.isValid() );
+    QVERIFY( !singular.toGeo({1.0, 1.0}).isValid() );
+    QVERIFY( std::isnan(singular.toRaster(QGeoCoordinate(48.0, 7.0)).x()) );
+}
+
+void GeoTIFFTest::testProjection()
+{
+    using FileFormats::GeoKeyDirectory;
+    using FileFormats::Projection;
+
+    // Examples of the EPSG Guidance Note 7-2
+    Projection::Ellipsoid const airy {6377563.396, 299.3249646};
+    Projection::Ellipsoid const clarke1866 {6378206.4, 294.9786982};
+    auto const usFoot = 1200.0/3937.0;
+    struct Example
+    {
+        Projection projection;
+        QGeoCoordinate coordinate;
+        QPointF projected;
+    };
+    QVector<Example> const examples {
+        {Projection::transverseMercator(airy, 49.0, -2.0, 0.9996012717, 400000.0, -100000.0), {50.5, 0.5}, {577274.99, 69740.50}},
+        {Projection::lambertConformalConic(clarke1866, 28.0 + 23.0/60.0, 30.0 + 17.0/60.0, 27.0 + 50.0/60.0, -99.0, 2000000.0*usFoot, 0.0), {28.5, -96.0}, {2963503.91*usFoot, 254759.80*usFoot}},
+        {Projection::lambertConformalConic1SP(clarke1866, 18.0, -77.0, 1.0, 250000.0, 150000.0), {17.0 + 55.0/60.0 + 55.80/3600.0, -(76.0 + 56.0/60.0 + 37.26/3600.0)}, {255966.58, 142493.51}},
+    };
+    for (const auto& example : examples)
+    {
+        auto projected = example.projection.forward(example.coordinate);
+        QVERIFY( qAbs(projected.x() - example.projected.x()) < 0.01 );
+        QVERIFY( qAbs(projected.y() - example.projected.y()) < 0.01 );
+        auto coordinate = example.projection.inverse(example.projected);
+        QVERIFY( coordinate.distanceTo(example.coordinate) < 0.01 );
+    }
+
+    // UTM round trips, single points and batches
+    auto utm = Projection::utm({}, 32, true);
+    QCOMPARE( utm.method(), Projection::Method::TransverseMercator );
+    auto origin = utm.forward(QGeoCoordinate(0.0, 9.0));
+    QVERIFY( qAbs(origin.x() - 500000.0) < 1e-6 );
+    QVERIFY( qAbs(origin.y()) < 1e-6 );
+    QVector<double> longitudes;
+    QVector<double> latitudes;
+    for (int i=0; i<=20; i++)
+    {
+        for (int j=0; j<=20; j++)
+        {
+            longitudes.append(3.0 + 0.6*i);
+            latitudes.append(-80.0 + 8.0*j);
+        }
+    }
+    QVector<double> x(longitudes.size());
+    QVector<double> y(longitudes.size());
+    utm.forward(longitudes, latitudes, x, y);
+    QVector<double> longitudes2(longitudes.size());
+    QVector<double> latitudes2(longitudes.size());
+    utm.inverse(x, y, longitudes2, latitudes2);
+    for (qsizetype i=0; i<longitudes.size(); i++)
+    {
+        QCOMPARE( utm.forward(QGeoCoordinate(latitudes[i], longitudes[i])), QPointF(x[i], y[i]) );
+        QVERIFY( qAbs(longitudes2[i] - longitudes[i]) < 1e-9 );
+        QVERIFY( qAbs(latitudes2[i] - latitudes[i]) < 1e-9 );
+    }
+
+    // Coordinate systems given by GeoKeys
+    auto keys = [](const QVector<quint16>& directory, const QVector<double>& doubles) { return GeoKeyDirectory(geoFields(directory, doubles, {}, {})); };
+    QCOMPARE( Projection::fromGeoKeys(keys({1, 1, 0, 1, GeoKeyDirectory::GTModelType, 0, 1, 2}, {})).method(), Projection::Method::Geographic );
+    QCOMPARE( Projection::fromGeoKeys(keys({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, 1, GeoKeyDirectory::ProjectedCSType, 0, 1, 32632}, {})).forward(QGeoCoordinate(0.0, 9.0)), origin );
+    QCOMPARE( Projection::fromGeoKeys(keys({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, 1, GeoKeyDirectory::ProjectedCSType, 0, 1, 3034}, {})).method(), Projection::Method::LambertConformalConic );
+
+    // User-defined Lambert Conformal Conic, with the false origin given by
+    // the keys of the natural origin, in US survey feet
+    auto texas = Projection::fromGeoKeys(keys({1, 1, 0, 10,
+                                               GeoKeyDirectory::GTModelType, 0, 1, 1,
+                                               GeoKeyDirectory::GeographicType, 0, 1, 4267,
+                                               GeoKeyDirectory::ProjectedCSType, 0, 1, GeoKeyDirectory::userDefined,
+                                               GeoKeyDirectory::ProjCoordTrans, 0, 1, 8,
+                                               GeoKeyDirectory::ProjLinearUnits, 0, 1, 9003,
+                                               GeoKeyDirectory::ProjStdParallel1, 34736, 1, 0,
+                                               GeoKeyDirectory::ProjStdParallel2, 34736, 1, 1,
+                                               GeoKeyDirectory::ProjNatOriginLong, 34736, 1, 2,
+                                               GeoKeyDirectory::ProjNatOriginLat, 34736, 1, 3,
+                                               GeoKeyDirectory::ProjFalseEasting, 34736, 1, 4},
+                                              {28.0 + 23.0/60.0, 30.0 + 17.0/60.0, -99.0, 27.0 + 50.0/60.0, 2000000.0}));
+    QVERIFY( qAbs(texas.forward(QGeoCoordinate(28.5, -96.0)).x() - 2963503.91*usFoot) < 0.01 );
+
+    // Unsupported coordinate systems throw
+    QString error;
+    try
+    {
+        Q_UNUSED( Projection::fromGeoKeys(keys({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, 1, GeoKeyDirectory::ProjectedCSType, 0, 1, 27700}, {})) )
+    }
+    catch (QString& message)
+    {
+        error = message;
+    }
+    QVERIFY( !error.isEmpty() );
+
+    // GeoTIFF files in UTM coordinates. The bounding box contains the
+    // corners, and raster coordinates survive round trips.
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto fileName = tempDir.filePath(u"utm.tif"_qs);
+    writeGeoTIFF(fileName, {100, 50}, geoFields({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, 1, GeoKeyDirectory::ProjectedCSType, 0, 1, 32632}, {}, {},
+                                                {{33550, {100.0, 100.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 400000.0, 5300000.0, 0.0}}}));
+    FileFormats::GeoTIFF const geoTIFF(fileName);
+    QVERIFY( geoTIFF.isValid() );
+    for (const auto& corner : {QPointF(400000.0, 5300000.0), QPointF(410000.0, 5300000.0), QPointF(400000.0, 5295000.0), QPointF(410000.0, 5295000.0)})
+    {
+        auto coordinate = utm.inverse(corner);
+        QVERIFY( geoTIFF.bBox().contains(coordinate) );
+        QVERIFY( coordinate.distanceTo(geoTIFF.transform().toGeo({(corner.x() - 400000.0)/100.0, (5300000.0 - corner.y())/100.0})) < 0.001 );
+    }
+    QVERIFY( geoTIFF.bBox().width() < 0.2 );
+    QVERIFY( geoTIFF.bBox().height() < 0.1 );
+    auto raster = geoTIFF.transform().toRaster(geoTIFF.transform().toGeo({12.5, 34.5}));
+    QVERIFY( qAbs(raster.x() - 12.5) < 1e-6 );
+    QVERIFY( qAbs(raster.y() - 34.5) < 1e-6 );
+}
+
+void GeoTIFFTest::testTileRenderer()
+{
+    using FileFormats::GeoKeyDirectory;
+    using FileFormats::TileRenderer;
+
+    // Tile bounds
+    QVERIFY( TileRenderer::tileBounds(0, 0, 0).topLeft().distanceTo({85.0511287798, -180.0}) < 1.0 );
+    QVERIFY( TileRenderer::tileBounds(0, 0, 0).bottomRight().distanceTo({-85.0511287798, 180.0}) < 1.0 );
+    QVERIFY( !TileRenderer::tileBounds(2, 4, 0).isValid() );
+    QVERIFY( !TileRenderer::tileBounds(2, 0, -1).isValid() );
+    QVERIFY( !TileRenderer::tileBounds(TileRenderer::maxZoom + 1, 0, 0).isValid() );
+    auto tile = tileAt(12, {47.5, 7.5});
+    QVERIFY( TileRenderer::tileBounds(12, tile.x(), tile.y()).contains({47.5, 7.5}) );
+
+    // A geographic raster from 7°E to 8°E and from 47°N to 48°N, and a
+    // raster in UTM coordinates around Freiburg
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto geographicFile = tempDir.filePath(u"geographic.tif"_qs);
+    writePatternGeoTIFF(geographicFile, {1024, 1024},
+                        geoFields({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeGeographic, GeoKeyDirectory::GeographicType, 0, 1, 4326}, {}, {},
+                                  {{33550, {1.0/1024.0, 1.0/1024.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 7.0, 48.0, 0.0}}}));
+    FileFormats::GeoTIFF const geographic(geographicFile);
+    QVERIFY( geographic.isValid() );
+    QVERIFY( !geographic.overviews().isEmpty() );
+    auto utmFile = tempDir.filePath(u"utm.tif"_qs);
+    writePatternGeoTIFF(utmFile, {1024, 1024},
+                        geoFields({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeProjected, GeoKeyDirectory::ProjectedCSType, 0, 1, 32632}, {}, {},
+                                  {{33550, {5.0, 5.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 410000.0, 5320000.0, 0.0}}}));
+    FileFormats::GeoTIFF const utm(utmFile);
+    QVERIFY( utm.isValid() );
+
+    // Nearest neighbor resampling picks the raster pixel that contains the
+    // center of the tile pixel. Pixels close to the boundary between two
+    // raster pixels may be picked from either side.
+    auto matches = [](const QImage& image, const FileFormats::GeoTIFF& source, int zoom, QPoint tile) {
+        qsizetype count = 0;
+        for (int py=0; py<image.height(); py++)
+        {
+            for (int px=0; px<image.width(); px++)
+            {
+                QGeoCoordinate const center(TileRenderer::latitude(zoom, tile.y() + (py + 0.5)/image.height()),
+                                            TileRenderer::longitude(zoom, tile.x() + (px + 0.5)/image.width()));
+                auto raster = source.transform().toRaster(center);
+                if (image.pixel(px, py) == patternColor(int(raster.x()), int(raster.y())))
+                {
+                    count++;
+                }
+            }
+        }
+        return double(count)/double(image.width()*image.height());
+    };
+    for (const auto* source : {&geographic, &utm})
+    {
+        TileRenderer renderer({source});
+        renderer.setResampling(TileRenderer::Resampling::Nearest);
+        auto center = source->transform().toGeo({512.0, 512.0});
+        tile = tileAt(14, center);
+        auto image = renderer.render(14, tile.x(), tile.y());
+        QCOMPARE( image.size(), QSize(256, 256) );
+        QCOMPARE( image.format(), QImage::Format_ARGB32_Premultiplied );
+        QVERIFY( matches(image, *source, 14, tile) > 0.99 );
+
+        renderer.setTileSize(512);
+        image = renderer.render(14, tile.x(), tile.y());
+        QCOMPARE( image.size(), QSize(512, 512) );
+        QVERIFY( matches(image, *source, 14, tile) > 0.99 );
+    }
+
+    // Bilinear resampling gives the same results with all instruction sets
+    TileRenderer renderer({&geographic, &utm});
+    for (int zoom : {9, 12, 15})
+    {
+        tile = tileAt(zoom, {47.9, 7.9});
+        auto scalar = renderer.render(zoom, tile.x(), tile.y(), FileFormats::TIFFPredictor::Instructions::Scalar);
+        QVERIFY( !scalar.isNull() );
+        QCOMPARE( renderer.render(zoom, tile.x(), tile.y(), FileFormats::TIFFPredictor::Instructions::AVX2), scalar );
+    }
+
+    // Tiles are transparent outside of the sources. The north-west corner of
+    // the geographic raster lies inside the tile.
+    tile = tileAt(12, {48.0, 7.0});
+    auto corner = renderer.render(12, tile.x(), tile.y());
+    QCOMPARE( qAlpha(corner.pixel(0, 0)), 0 );
+    QCOMPARE( qAlpha(corner.pixel(255, 255)), 255 );
+
+    // Tiles that do not intersect any source, and tiles that do not exist
+    QVERIFY( renderer.render(12, 0, 0).isNull() );
+    QVERIFY( renderer.render(12, 4096, 0).isNull() );
+    QVERIFY( TileRenderer().render(0, 0, 0).isNull() );
+}
+
+void GeoTIFFTest::testTileArchives()
+{
+    using FileFormats::PMTilesWriter;
+
+    // Tile IDs follow the Hilbert curve, as in the PMTiles specification
+    QCOMPARE( PMTilesWriter::tileID(0, 0, 0), 0ULL );
+    QCOMPARE( PMTilesWriter::tileID(1, 0, 0), 1ULL );
+    QCOMPARE( PMTilesWriter::tileID(1, 0, 1), 2ULL );
+    QCOMPARE( PMTilesWriter::tileID(1, 1, 1), 3ULL );
+    QCOMPARE( PMTilesWriter::tileID(1, 1, 0), 4ULL );
+    QCOMPARE( PMTilesWriter::tileID(2, 0, 0), 5ULL );
+    QCOMPARE( PMTilesWriter::tileID(12, 3423, 1763), 19078479ULL );
+
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    QVector<std::tuple<int, int, int, QByteArray>> const tiles {
+        {0, 0, 0, "world"}, {1, 0, 0, "north-west"}, {1, 1, 0, "north-west"}, {1, 0, 1, "south-west"}, {2, 3, 3, "south-east"}};
+
+    // PMTiles stores identical tiles once
+    auto pmtilesFile = tempDir.filePath(u"tiles.pmtiles"_qs);
+    {
+        PMTilesWriter writer(pmtilesFile);
+        writer.setName(u"Test"_qs);
+        for (const auto& [zoom, x, y, data] : tiles)
+        {
+            writer.writeTile(zoom, x, y, data);
+        }
+        QVERIFY( !QFile::exists(pmtilesFile) );
+        writer.finish();
+    }
+    QFile file(pmtilesFile);
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    auto archive = file.readAll();
+    QCOMPARE( archive.left(8), QByteArray("PMTiles\x03", 8) );
+    QCOMPARE( qFromLittleEndian<quint64>(archive.constData() + 72), 5ULL );
+    QCOMPARE( qFromLittleEndian<quint64>(archive.constData() + 88), 4ULL );
+    QCOMPARE( int(archive[97]), 2 );
+    QCOMPARE( int(archive[99]), 2 );
+    QCOMPARE( int(archive[100]), 0 );
+    QCOMPARE( int(archive[101]), 2 );
+    for (const auto& [zoom, x, y, data] : tiles)
+    {
+        QCOMPARE( pmtilesTile(archive, zoom, x, y), data );
+    }
+    QVERIFY( pmtilesTile(archive, 2, 0, 0).isNull() );
+    auto metadata = gunzip(QByteArrayView(archive).sliced(qsizetype(qFromLittleEndian<quint64>(archive.constData() + 24)),
+                                                          qsizetype(qFromLittleEndian<quint64>(archive.constData() + 32))));
+    QCOMPARE( QJsonDocument::fromJson(metadata).object().value(u"name"_qs).toString(), u"Test"_qs );
+
+    // If a tile is written twice, the last version wins, even if the first
+    // one was merged into a run with the previous tile
+    auto rewrittenFile = tempDir.filePath(u"rewritten.pmtiles"_qs);
+    {
+        PMTilesWriter writer(rewrittenFile);
+        writer.writeTile(1, 0, 0, "A");
+        writer.writeTile(1, 0, 1, "A");
+        writer.writeTile(1, 1, 1, "A");
+        writer.writeTile(1, 0, 1, "B");
+        writer.finish();
+    }
+    QFile rewrittenArchiveFile(rewrittenFile);
+    QVERIFY( rewrittenArchiveFile.open(QIODevice::ReadOnly) );
+    auto rewritten = rewrittenArchiveFile.readAll();
+    QCOMPARE( qFromLittleEndian<quint64>(rewritten.constData() + 72), 3ULL );
+    QCOMPARE( qFromLittleEndian<quint64>(rewritten.constData() + 80), 3ULL );
+    QCOMPARE( pmtilesTile(rewritten, 1, 0, 0), QByteArray("A") );
+    QCOMPARE( pmtilesTile(rewritten, 1, 0, 1), QByteArray("B") );
+    QCOMPARE( pmtilesTile(rewritten, 1, 1, 1), QByteArray("A") );
+
+    // Large archives have leaf directories. Runs of identical tiles are
+    // merged.
+    auto largeFile = tempDir.filePath(u"large.pmtiles"_qs);
+    {
+        PMTilesWriter writer(largeFile);
+        for (int i=0; i<60000; i++)
+        {
+            writer.writeTile(10, i % 1024, i / 1024, QByteArray::number((i % 5000)*7919 % 4999));
+        }
+        for (int x=0; x<1024; x++)
+        {
+            writer.writeTile(10, x, 10, "sea");
+        }
+        writer.finish();
+    }
+    QFile largeArchiveFile(largeFile);
+    QVERIFY( largeArchiveFile.open(QIODevice::ReadOnly) );
+    auto large = largeArchiveFile.readAll();
+    QVERIFY( qFromLittleEndian<quint64>(large.constData() + 48) > 0 );
+    QVERIFY( qFromLittleEndian<quint64>(large.constData() + 16) <= quint64(PMTilesWriter::rootSize - PMTilesWriter::headerSize) );
+    QCOMPARE( qFromLittleEndian<quint64>(large.constData() + 72), 60000ULL );
+    for (int i=0; i<60000; i+=997)
+    {
+        QByteArray const expected = (i / 1024 == 10) ? QByteArray("sea") : QByteArray::number((i % 5000)*7919 % 4999);
+        QCOMPARE( pmtilesTile(large, 10, i % 1024, i / 1024), expected );
+    }
+    QVERIFY( pmtilesTile(large, 10, 0, 1000).isNull() );
+
+    // MBTiles references identical tiles from the table "map" and counts rows
+    // from the south
+    auto mbtilesFile = tempDir.filePath(u"tiles.mbtiles"_qs);
+    {
+        auto writer = FileFormats::TileArchiveWriter::create(FileFormats::TileArchiveWriter::Format::MBTiles, mbtilesFile);
+        for (const auto& [zoom, x, y, data] : tiles)
+        {
+            writer->writeTile(zoom, x, y, data);
+        }
+        writer->finish();
+    }
+    QVERIFY( QFile::exists(mbtilesFile) );
+    {
+        auto database = QSqlDatabase::addDatabase(u"QSQLITE"_qs, u"testTileArchives"_qs);
+        database.setDatabaseName(mbtilesFile);
+        QVERIFY( database.open() );
+        for (const auto& [zoom, x, y, data] : tiles)
+        {
+            QSqlQuery query(database);
+            QVERIFY( query.prepare(u"SELECT tile_data FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?"_qs) );
+            query.addBindValue(zoom);
+            query.addBindValue(x);
+            query.addBindValue((1 << zoom) - 1 - y);
+            QVERIFY( query.exec() );
+            QVERIFY( query.next() );
+            QCOMPARE( query.value(0).toByteArray(), data );
+        }
+        QSqlQuery images(database);
+        QVERIFY( images.exec(u"SELECT COUNT(*) FROM images"_qs) );
+        QVERIFY( images.next() );
+        QCOMPARE( images.value(0).toInt(), 4 );
+        QSqlQuery metadataQuery(database);
+        QVERIFY( metadataQuery.exec(u"SELECT value FROM metadata WHERE name = 'format'"_qs) );
+        QVERIFY( metadataQuery.next() );
+        QCOMPARE( metadataQuery.value(0).toString(), u"png"_qs );
+        database.close();
+    }
+    QSqlDatabase::removeDatabase(u"testTileArchives"_qs);
+
+    // Tiles that do not exist are rejected
+    QString error;
+    try
+    {
+        PMTilesWriter writer(tempDir.filePath(u"invalid.pmtiles"_qs));
+        writer.writeTile(1, 2, 0, "invalid");
+    }
+    catch (QString& message)
+    {
+        error = message;
+    }
+    QVERIFY( !error.isEmpty() );
+}
+
+void GeoTIFFTest::testTileExporter()
+{
+    using FileFormats::GeoKeyDirectory;
+    using FileFormats::TileArchiveWriter;
+
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    auto fileName = tempDir.filePath(u"geographic.tif"_qs);
+    writePatternGeoTIFF(fileName, {1024, 1024},
+                        geoFields({1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeGeographic, GeoKeyDirectory::GeographicType, 0, 1, 4326}, {}, {},
+                                  {{33550, {1.0/1024.0, 1.0/1024.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 7.0, 48.0, 0.0}}}));
+    FileFormats::GeoTIFF const geoTIFF(fileName);
+    QVERIFY( geoTIFF.isValid() );
+
+    // The tiles of every zoom level cover the bounding box
+    FileFormats::TileExporter exporter({&geoTIFF});
+    exporter.setZoomRange(6, 9);
+    exporter.setMaxThreadCount(4);
+    qint64 expectedCount = 0;
+    for (int zoom=6; zoom<=9; zoom++)
+    {
+        auto topLeft = FileFormats::TileRenderer::tileAt(zoom, geoTIFF.bBox().topLeft());
+        auto bottomRight = FileFormats::TileRenderer::tileAt(zoom, geoTIFF.bBox().bottomRight());
+        expectedCount += qint64(bottomRight.x() - topLeft.x() + 1)*(bottomRight.y() - topLeft.y() + 1);
+    }
+    QCOMPARE( exporter.tileCount(), expectedCount );
+
+    // Exported tiles are those of the renderer
+    std::atomic<qint64> progress {0};
+    exporter.setProgressCallback([&progress](qint64 done, qint64 /*total*/) { progress = qMax(progress.load(), done); });
+    auto pmtilesFile = tempDir.filePath(u"charts.pmtiles"_qs);
+    exporter.write(pmtilesFile, TileArchiveWriter::Format::PMTiles);
+    QCOMPARE( progress.load(), expectedCount );
+    QFile file(pmtilesFile);
+    QVERIFY( file.open(QIODevice::ReadOnly) );
+    auto archive = file.readAll();
+    QCOMPARE( qFromLittleEndian<quint64>(archive.constData() + 72), quint64(expectedCount) );
+    FileFormats::TileRenderer const renderer({&geoTIFF});
+    auto tile = FileFormats::TileRenderer::tileAt(9, {47.5, 7.5});
+    QByteArray expected;
+    QBuffer buffer(&expected);
+    QVERIFY( buffer.open(QIODevice::WriteOnly) );
+    QVERIFY( renderer.render(9, tile.x(), tile.y()).save(&buffer, "png") );
+    QCOMPARE( pmtilesTile(archive, 9, tile.x(), tile.y()), expected );
+    QVERIFY( pmtilesTile(archive, 9, 0, 0).isNull() );
+
+    // MBTiles archives are written by the calling thread, which owns the
+    // database connection
+    auto mbtilesFile = tempDir.filePath(u"charts.mbtiles"_qs);
+    exporter.write(mbtilesFile, TileArchiveWriter::Format::MBTiles);
+    QVERIFY( QFile::exists(mbtilesFile) );
+    {
+        auto database = QSqlDatabase::addDatabase(u"QSQLITE"_qs, u"testTileExporter"_qs);
+        database.setDatabaseName(mbtilesFile);
+        QVERIFY( database.open() );
+        QSqlQuery count(database);
+        QVERIFY( count.exec(u"SELECT COUNT(*) FROM map"_qs) );
+        QVERIFY( count.next() );
+        QCOMPARE( count.value(0).toLongLong(), expectedCount );
+        QSqlQuery query(database);
+        QVERIFY( query.prepare(u"SELECT tile_data FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?"_qs) );
+        query.addBindValue(9);
+        query.addBindValue(tile.x());
+        query.addBindValue((1 << 9) - 1 - tile.y());
+        QVERIFY( query.exec() );
+        QVERIFY( query.next() );
+        QCOMPARE( query.value(0).toByteArray(), expected );
+        database.close();
+    }
+    QSqlDatabase::removeDatabase(u"testTileExporter"_qs);
+
+    // Canceled exports write no archive
+    exporter.setProgressCallback([&exporter](qint64 /*done*/, qint64 /*total*/) { exporter.cancel(); });
+    auto canceledFile = tempDir.filePath(u"canceled.pmtiles"_qs);
+    exporter.write(canceledFile, TileArchiveWriter::Format::PMTiles);
+    QVERIFY( exporter.isCanceled() );
+    QVERIFY( !QFile::exists(canceledFile) );
+}
+
+void GeoTIFFTest::testGeoTIFFMosaic()
+{
+    using FileFormats::GeoKeyDirectory;
+
+    // A raster from 7°E to 8°E and from 47°N to 48°N, and a raster of half
+    // the resolution from 7.5°E to 8.5°E and from 47.5°N to 48.5°N, whose
+    // black pixel (0, 0) has no data
+    QTemporaryDir const tempDir;
+    QVERIFY( tempDir.isValid() );
+    QVector<quint16> const geographicKeys {1, 1, 0, 2, GeoKeyDirectory::GTModelType, 0, 1, GeoKeyDirectory::ModelTypeGeographic, GeoKeyDirectory::GeographicType, 0, 1, 4326};
+    auto lowerFile = tempDir.filePath(u"lower.tif"_qs);
+    writePatternGeoTIFF(lowerFile, {1024, 1024}, geoFields(geographicKeys, {}, {}, {{33550, {1.0/1024.0, 1.0/1024.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 7.0, 48.0, 0.0}}}));
+    FileFormats::GeoTIFF const lower(lowerFile);
+    QVERIFY( lower.isValid() );
+    QVERIFY( !lower.noDataColor().has_value() );
+    auto upperFields = geoFields(geographicKeys, {}, {}, {{33550, {1.0/512.0, 1.0/512.0, 0.0}}, {33922, {0.0, 0.0, 0.0, 7.5, 48.5, 0.0}}});
+    upperFields.insert(42113, FileFormats::TIFFTagTable::DT_Ascii, 2, QByteArray("0\0", 2), true);
+    auto upperFile = tempDir.filePath(u"upper.tif"_qs);
+    writePatternGeoTIFF(upperFile, {512, 512}, upperFields);
+    FileFormats::GeoTIFF const upper(upperFile);
+    QVERIFY( upper.isValid() );
+    QCOMPARE( upper.noDataColor(), std::optional<QRgb>(qRgb(0, 0, 0)) );
+
+    // The mosaic covers both rasters at the finer resolution
+    FileFormats::GeoTIFFMosaic mosaic({&lower, &upper});
+    QCOMPARE( mosaic.rasterSize(), QSize(1536, 1536) );
+    QVERIFY( mosaic.bBox().topLeft().distanceTo({48.5, 7.0}) < 1.0 );
+    QVERIFY( mosaic.bBox().bottomRight().distanceTo({47.0, 8.5}) < 1.0 );
+    QCOMPARE( mosaic.levelCount(), 4 );
+    QCOMPARE( mosaic.levelForScale(1.0), 0 );
+    QCOMPARE( mosaic.levelForScale(0.3), 1 );
+    QCOMPARE( mosaic.levelForScale(0.25), 2 );
+    QCOMPARE( mosaic.levelForScale(0.0), 3 );
+
+    // With nearest neighbor resampling, every pixel of the mosaic has the
+    // color of the topmost source that has data at its center
+    auto matches = [](const QImage& image, const FileFormats::GeoTIFFMosaic& mosaic, const QVector<const FileFormats::GeoTIFF*>& topDown) {
+        qsizetype count = 0;
+        for (int y=0; y<image.height(); y++)
+        {
+            for (int x=0; x<image.width(); x++)
+            {
+                auto center = mosaic.transform().toGeo({x + 0.5, y + 0.5});
+                QRgb expected = 0;
+                for (const auto* source : topDown)
+                {
+                    auto raster = source->transform().toRaster(center);
+                    if (QRectF(0.0, 0.0, source->rasterSize().width(), source->rasterSize().height()).contains(raster) && (patternColor(int(raster.x()), int(raster.y())) != source->noDataColor()))
+                    {
+                        expected = patternColor(int(raster.x()), int(raster.y()));
+                        break;
+                    }
+                }
+                if (image.pixel(x, y) == expected)
+                {
+                    count++;
+                }
+            }
+        }
+        return double(count)/double(image.width()*image.height());
+    };
+    mosaic.setResampling(FileFormats::TileRenderer::Resampling::Nearest);
+    auto image = mosaic.readWindow(QRect(0, 0, 1536, 1536));
+    QCOMPARE( image.size(), QSize(1536, 1536) );
+    QCOMPARE( image.format(), QImage::Format_ARGB32_Premultiplied );
+    QVERIFY( matches(image, mosaic, {&upper, &lower}) > 0.999 );
+    QCOMPARE( qAlpha(image.pixel(0, 0)), 0 );
+    QCOMPARE( qAlpha(image.pixel(1535, 1535)), 0 );
+    QCOMPARE( qAlpha(image.pixel(512, 0)), 0 );
+    QCOMPARE( qAlpha(image.pixel(514, 0)), 255 );
+
+    // Windows are composited from cached blocks
+    auto misses = mosaic.cache().misses();
+    auto window = mosaic.readWindow(QRect(300, 400, 700, 500));
+    QCOMPARE( mosaic.cache().misses(), misses );
+    QCOMPARE( window, image.copy(300, 400, 700, 500) );
+    QCOMPARE( mosaic.readWindow(QRect(-100, -100, 200, 200)), image.copy(0, 0, 100, 100) );
+    QVERIFY( mosaic.readWindow(QRect(2000, 0, 10, 10)).isNull() );
+
+    // Priorities override the order of the sources
+    FileFormats::GeoTIFFMosaic reversed({&lower, &upper}, {1, 0});
+    reversed.setResampling(FileFormats::TileRenderer::Resampling::Nearest);
+    QVERIFY( matches(reversed.readWindow(QRect(0, 0, 1536, 1536)), reversed, {&lower, &upper}) > 0.999 );
+
+    // Levels of reduced resolution
+    auto overview = mosaic.readWindow(QRect(100, 100, 1000, 1000), 0.25);
+    QCOMPARE( overview.size(), QSize(250, 250) );
+    QCOMPARE( qAlpha(overview.pixel(200, 200)), 255 );
+    QCOMPARE( qAlpha(overview.pixel(249, 249)), 0 );
+
+    // Mosaics without valid sources are empty
+    FileFormats::GeoTIFFMosaic const empty({});
+    QVERIFY( empty.rasterSize().isEmpty() );
+    QVERIFY( empty.readWindow(QRect(0, 0, 10, 10)).isNull() );
+}
+
+void GeoTIFFTest::benchmarkReadWindow()
+{
+    FileFormats::GeoTIFF const geoTIFF( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    FileFormats::TIFFReadOptions options;
+    options.tileCache = nullptr;
+    QImage image;
+    QBENCHMARK
+    {
+        image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()), options);
+    }
+    QVERIFY( !image.isNull() );
+}
+
+void GeoTIFFTest::benchmarkReadWindowCached()
+{
+    FileFormats::GeoTIFF const geoTIFF( QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs );
+    FileFormats::TIFFTileCache cache;
+    FileFormats::TIFFReadOptions options;
+    options.tileCache = &cache;
+    QImage image;
+    QBENCHMARK
+    {
+        image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()), options);
+    }
+    QVERIFY( !image.isNull() );
+}
+
+void GeoTIFFTest::benchmarkQImage()
+{
+    auto fileName = QString::fromLatin1(SRC) + u"/testData/GeoTIFF/EDKA.tiff"_qs;
+    QImage image;
+    QBENCHMARK
+    {
+        image = QImage(fileName);
+    }
+}
+
+void GeoTIFFTest::benchmarkPredictorScalar()
+{
+    // One strip of an RGB image, 4096 pixels wide and 256 rows high
+    QByteArray data(4096*256*3, 1);
+    QBENCHMARK
+    {
+        FileFormats::TIFFPredictor::undoHorizontal(reinterpret_cast<uchar*>(data.data()), 256, 4096, 3, 8, FileFormats::TIFFPredictor::Instructions::Scalar);
+    }
+}
+
+void GeoTIFFTest::benchmarkPredictor()
+{
+    // One strip of an RGB image, 4096 pixels wide and 256 rows high
+    QByteArray data(4096*256*3, 1);
+    QBENCHMARK
+    {
+        FileFormats::TIFFPredictor::undoHorizontal(reinterpret_cast<uchar*>(data.data()), 256, 4096, 3, 8);
+    }
+}
+
+void GeoTIFFTest::benchmarkGeoTransformScalar()
+{
+    // One million points
+    FileFormats::GeoTransform const transform({1e-4, 0.0, 7.0, 0.0, -1e-4, 48.0});
+    QVector<double> x(1 << 20, 100.0);
+    QVector<double> y(1 << 20, 200.0);
+    QBENCHMARK
+    {
+        transform.toGeo(x, y, x, y, FileFormats::TIFFPredictor::Instructions::Scalar);
+        transform.toRaster(x, y, x, y, FileFormats::TIFFPredictor::Instructions::Scalar);
+    }
+}
+
+void GeoTIFFTest::benchmarkGeoTransform()
+{
+    // One million points
+    FileFormats::GeoTransform const transform({1e-4, 0.0, 7.0, 0.0, -1e-4, 48.0});
+    QVector<double> x(1 << 20, 100.0);
+    QVector<double> y(1 << 20, 200.0);
+    QBENCHMARK
+    {
+        transform.toGeo(x, y, x, y);
+        transform.toRaster(x, y, x, y);
+    }
+}
+
+void GeoTIFFTest::benchmarkProjectionUTM()
+{
+    benchmarkProjectionRoundTrip(FileFormats::Projection::utm({}, 32, true));
+}
+
+void GeoTIFFTest::benchmarkProjectionLCC()
+{
+    benchmarkProjectionRoundTrip(FileFormats::Projection::lambertConformalConic({6378137.0, 298.257222101}, 35.0, 65.0, 52.0, 10.0, 4000000.0, 2800000.0));
+}
+
+void GeoTIFFTest::benchmarkTileRendererNearest()
+{
+    benchmarkRenderTile(FileFormats::TileRenderer::Resampling::Nearest, FileFormats::TIFFPredictor::Instructions::Scalar);
+}
+
+void GeoTIFFTest::benchmarkTileRendererBilinearScalar()
+{
+    benchmarkRenderTile(FileFormats::TileRenderer::Resampling::Bilinear, FileFormats::TIFFPredictor::Instructions::Scalar);
+}
+
+void GeoTIFFTest::benchmarkTileRendererBilinear()
+{
+    benchmarkRenderTile(FileFormats::TileRenderer::Resampling::Bilinear, FileFormats::TIFFPredictor::bestInstructions());
+}
+
+void GeoTIFFTest::benchmarkLargeLZWStrips()
+{
+    benchmarkLargeTIFF(5, false, false);
+}
+
+void GeoTIFFTest::benchmarkLargeLZWStripsQImage()
+{
+    benchmarkLargeTIFF(5, false, true);
+}
+
+void GeoTIFFTest::benchmarkLargeLZWTiles()
+{
+    benchmarkLargeTIFF(5, true, false);
+}
+
+void GeoTIFFTest::benchmarkLargeLZWTilesQImage()
+{
+    benchmarkLargeTIFF(5, true, true);
+}
+
+void GeoTIFFTest::benchmarkLargeDeflateStrips()
+{
+    benchmarkLargeTIFF(8, false, false);
+}
+
+void GeoTIFFTest::benchmarkLargeDeflateStripsQImage()
+{
+    benchmarkLargeTIFF(8, false, true);
+}
+
+void GeoTIFFTest::benchmarkLargeDeflateTiles()
+{
+    benchmarkLargeTIFF(8, true, false);
+}
+
+void GeoTIFFTest::benchmarkLargeDeflateTilesQImage()
+{
+    benchmarkLargeTIFF(8, true, true);
+}
+
+void GeoTIFFTest::benchmarkLargeFiles()
+{
+    // Optionally, set the environment variable GEOTIFF_BENCHMARK_DIR to a
+    // directory with further GeoTIFF files.
+    auto directory = qEnvironmentVariable("GEOTIFF_BENCHMARK_DIR");
+    if (directory.isEmpty())
+    {
+        QSKIP("GEOTIFF_BENCHMARK_DIR is not set");
+    }
+
+    QDirIterator iterator(directory, {u"*.tif"_qs, u"*.tiff"_qs}, QDir::Files);
+    while (iterator.hasNext())
+    {
+        auto fileName = iterator.next();
+        QElapsedTimer timer;
+
+        FileFormats::TIFFReadOptions options;
+        options.tileCache = nullptr;
+        timer.start();
+        FileFormats::GeoTIFF const geoTIFF(fileName);
+        auto image = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()), options);
+        auto readWindowTime = timer.elapsed();
+
+        options.threadCount = QThread::idealThreadCount();
+        timer.start();
+        auto parallelImage = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()), options);
+        auto parallelTime = timer.elapsed();
+
+        timer.start();
+        QImage const reference(fileName);
+        auto qImageTime = timer.elapsed();
+
+        qInfo() << fileName << geoTIFF.rasterSize()
+                << u"readWindow:"_qs << readWindowTime << u"ms,"_qs
+                << u"parallel readWindow:"_qs << parallelTime << u"ms,"_qs
+                << u"QImage:"_qs << qImageTime << u"ms"_qs;
+        QVERIFY( !image.isNull() );
+        QCOMPARE( parallelImage, image );
+    }
+}
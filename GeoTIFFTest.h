@@ -30,4 +30,52 @@ public:
 
 private slots:
     static void test();
+    static void testDevice();
+    static void testRequestedTags();
+    static void testCatalog();
+    static void testCache();
+    static void testIndex();
+    static void testReadWindow();
+    static void testCompression();
+    static void testSixteenBit();
+    static void testFloatingPoint();
+    static void testPalette();
+    static void testPredictor();
+    static void testOverviews();
+    static void testTileCache();
+    static void testParallelRead();
+    static void testOverviewBuilder();
+    static void testCloudOptimized();
+    static void testRangeReader();
+    static void testZIPArchive();
+    static void testBigTIFF();
+    static void testGeoKeys();
+    static void testGeoTransform();
+    static void testProjection();
+    static void testTileRenderer();
+    static void testTileArchives();
+    static void testTileExporter();
+    static void testGeoTIFFMosaic();
+    static void benchmarkReadWindow();
+    static void benchmarkReadWindowCached();
+    static void benchmarkReadWindowParallel();
+    static void benchmarkQImage();
+    static void benchmarkPredictorScalar();
+    static void benchmarkPredictor();
+    static void benchmarkGeoTransformScalar();
+    static void benchmarkGeoTransform();
+    static void benchmarkProjectionUTM();
+    static void benchmarkProjectionLCC();
+    static void benchmarkTileRendererNearest();
+    static void benchmarkTileRendererBilinearScalar();
+    static void benchmarkTileRendererBilinear();
+    static void benchmarkLargeLZWStrips();
+    static void benchmarkLargeLZWStripsQImage();
+    static void benchmarkLargeLZWTiles();
+    static void benchmarkLargeLZWTilesQImage();
+    static void benchmarkLargeDeflateStrips();
+    static void benchmarkLargeDeflateStripsQImage();
+    static void benchmarkLargeDeflateTiles();
+    static void benchmarkLargeDeflateTilesQImage();
+    static void benchmarkLargeFiles();
 };
@@ -0,0 +1,465 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <numeric>
+
+#include "GeoTIFFWriter.h"
+#include "TIFFCodecs.h"
+#include "TIFFPredictor.h"
+
+
+namespace {
+
+using enum FileFormats::TIFFTagTable::DataType;
+
+// Returns the number of samples per pixel of a supported image format, or
+// zero
+int samplesPerPixel(QImage::Format format)
+{
+    switch (format)
+    {
+    case QImage::Format_Grayscale8:
+        return 1;
+    case QImage::Format_RGB888:
+        return 3;
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+// Sizes of the file headers
+const qint64 classicHeaderSize = 8;
+const qint64 bigTIFFHeaderSize = 16;
+
+// Appends a value in little-endian byte order
+template<typename T>
+void appendLittleEndian(QByteArray& data, T value)
+{
+    std::array<char, sizeof(T)> bytes {};
+    qToLittleEndian<T>(value, bytes.data());
+    data.append(bytes.data(), qsizetype(bytes.size()));
+}
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::GeoTIFFWriter::GeoTIFFWriter(const QString& fileName, Layout layout)
+    : m_file(fileName), m_layout(layout)
+{
+    if (!m_file.open(QIODevice::WriteOnly))
+    {
+        throw m_file.errorString();
+    }
+    if ((layout == Layout::CloudOptimized) && !m_tileData.open())
+    {
+        throw m_tileData.errorString();
+    }
+
+    // Room for the header, which is written by finish(), once it is known
+    // whether the file needs BigTIFF. Classic TIFF headers are followed by
+    // eight unused bytes.
+    if (m_layout == Layout::Sequential)
+    {
+        QByteArray const placeholder(bigTIFFHeaderSize, '\0');
+        if (m_file.write(placeholder) != placeholder.size())
+        {
+            throw m_file.errorString();
+        }
+    }
+}
+
+
+
+//
+// Getter methods
+//
+
+qsizetype FileFormats::GeoTIFFWriter::tileCount(int image) const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_images.value(image).offsets.size();
+}
+
+
+
+//
+// Setter methods
+//
+
+void FileFormats::GeoTIFFWriter::setGeoFields(const TIFFTagTable& fields)
+{
+    QMutexLocker const locker(&m_mutex);
+    for (quint16 tag : {33550, 33922, 34264, 34736})
+    {
+        auto values = fields.doubles(tag);
+        if (values.empty())
+        {
+            continue;
+        }
+        QByteArray data;
+        for (auto value : values)
+        {
+            appendLittleEndian<quint64>(data, std::bit_cast<quint64>(value));
+        }
+        m_extraFields.append({tag, DT_Double, quint32(values.size()), data});
+    }
+
+    auto geoKeys = fields.shorts(34735);
+    if (!geoKeys.empty())
+    {
+        QByteArray data;
+        for (auto value : geoKeys)
+        {
+            appendLittleEndian<quint16>(data, value);
+        }
+        m_extraFields.append({34735, DT_Short, quint32(geoKeys.size()), data});
+    }
+
+    for (quint16 tag : {270, 34737, 42113})
+    {
+        auto value = fields.ascii(tag);
+        if (!value.isEmpty())
+        {
+            m_extraFields.append({tag, DT_Ascii, quint32(value.size()), value.toByteArray()});
+        }
+    }
+}
+
+
+
+//
+// Methods
+//
+
+int FileFormats::GeoTIFFWriter::addImage(QSize size, QSize tileSize, QImage::Format format)
+{
+    if (size.isEmpty() || tileSize.isEmpty() || ((tileSize.width() % 16) != 0) || ((tileSize.height() % 16) != 0))
+    {
+        throw QObject::tr("Invalid image or tile size.", "FileFormats::GeoTIFFWriter");
+    }
+    if (samplesPerPixel(format) == 0)
+    {
+        throw QObject::tr("Image format is not supported.", "FileFormats::GeoTIFFWriter");
+    }
+
+    Image image;
+    image.size = size;
+    image.tileSize = tileSize;
+    image.format = format;
+    image.tilesAcross = (size.width() + tileSize.width() - 1) / tileSize.width();
+    auto tilesDown = (size.height() + tileSize.height() - 1) / tileSize.height();
+    image.offsets.fill(0, image.tilesAcross*tilesDown);
+    image.byteCounts.fill(0, image.tilesAcross*tilesDown);
+
+    QMutexLocker const locker(&m_mutex);
+    m_images.append(image);
+    return int(m_images.size()) - 1;
+}
+
+void FileFormats::GeoTIFFWriter::writeTile(int image, qsizetype index, const QImage& tile)
+{
+    // Images are only appended, so their layout can be read before locking
+    QSize tileSize;
+    QImage::Format format = QImage::Format_Invalid;
+    {
+        QMutexLocker const locker(&m_mutex);
+        if ((image < 0) || (image >= m_images.size()) || (index < 0) || (index >= m_images[image].offsets.size()))
+        {
+            throw QObject::tr("Invalid tile.", "FileFormats::GeoTIFFWriter");
+        }
+        tileSize = m_images[image].tileSize;
+        format = m_images[image].format;
+    }
+
+    // Copy the tile into a contiguous buffer, padded with zeros
+    auto converted = (tile.format() == format) ? tile : tile.convertToFormat(format);
+    auto pixelBytes = samplesPerPixel(format);
+    auto rowBytes = qsizetype(tileSize.width())*pixelBytes;
+    QByteArray data(rowBytes*tileSize.height(), 0);
+    auto copyBytes = qsizetype(qMin(converted.width(), tileSize.width()))*pixelBytes;
+    for (int y=0; y<qMin(converted.height(), tileSize.height()); ++y)
+    {
+        memcpy(data.data() + y*rowBytes, converted.constScanLine(y), copyBytes);
+    }
+    TIFFPredictor::applyHorizontal(reinterpret_cast<uchar*>(data.data()), tileSize.height(), tileSize.width(), pixelBytes, 8);
+    auto compressed = TIFFCodecs::compressDeflate(data);
+
+    QMutexLocker const locker(&m_mutex);
+    auto& device = (m_layout == Layout::Sequential) ? static_cast<QFileDevice&>(m_file) : static_cast<QFileDevice&>(m_tileData);
+    auto offset = device.pos();
+    if (device.write(compressed) != compressed.size())
+    {
+        throw device.errorString();
+    }
+    m_images[image].offsets[index] = quint64(offset);
+    m_images[image].byteCounts[index] = quint64(compressed.size());
+}
+
+void FileFormats::GeoTIFFWriter::finish()
+{
+    QMutexLocker const locker(&m_mutex);
+    if (m_images.isEmpty())
+    {
+        throw QObject::tr("The file contains no image.", "FileFormats::GeoTIFFWriter");
+    }
+
+    // Classic TIFF addresses at most 4 GB. All offsets in the file point
+    // before the end of the last directory or tile.
+    auto bigTIFF = m_bigTIFF;
+    qint64 ifd0Offset = 0;
+    if (m_layout == Layout::Sequential)
+    {
+        // Directories follow the tile data, starting on a word boundary
+        ifd0Offset = m_file.pos() + (m_file.pos() & 1);
+        bigTIFF = bigTIFF || (ifd0Offset + directories(ifd0Offset, false).size() > qint64(UINT_MAX));
+        QByteArray data(ifd0Offset - m_file.pos(), '\0');
+        data += directories(ifd0Offset, bigTIFF);
+        if (m_file.write(data) != data.size())
+        {
+            throw m_file.errorString();
+        }
+    }
+    else
+    {
+        // Directories follow the header. Since their size does not depend on
+        // the tile offsets, the tile data can be placed before the offsets
+        // are known. Tile data starts with the smallest overview.
+        qint64 tileDataSize = 0;
+        for (const auto& image : m_images)
+        {
+            tileDataSize += std::accumulate(image.byteCounts.cbegin(), image.byteCounts.cend(), qint64(0));
+        }
+        bigTIFF = bigTIFF || (classicHeaderSize + directories(classicHeaderSize, false).size() + tileDataSize > qint64(UINT_MAX));
+        ifd0Offset = bigTIFF ? bigTIFFHeaderSize : classicHeaderSize;
+        auto position = ifd0Offset + directories(ifd0Offset, bigTIFF).size();
+        QVector<QVector<quint64>> tileDataOffsets;
+        for (auto& image : m_images)
+        {
+            tileDataOffsets.append(image.offsets);
+        }
+        for (auto image=m_images.size()-1; image>=0; --image)
+        {
+            for (qsizetype index=0; index<m_images[image].offsets.size(); ++index)
+            {
+                m_images[image].offsets[index] = (m_images[image].byteCounts[index] == 0) ? 0 : quint64(position);
+                position += qint64(m_images[image].byteCounts[index]);
+            }
+        }
+
+        auto data = QByteArray(ifd0Offset, '\0') + directories(ifd0Offset, bigTIFF);
+        if (m_file.write(data) != data.size())
+        {
+            throw m_file.errorString();
+        }
+        for (auto image=m_images.size()-1; image>=0; --image)
+        {
+            for (qsizetype index=0; index<m_images[image].offsets.size(); ++index)
+            {
+                auto byteCount = m_images[image].byteCounts[index];
+                if (byteCount == 0)
+                {
+                    continue;
+                }
+                if (!m_tileData.seek(qint64(tileDataOffsets[image][index])))
+                {
+                    throw m_tileData.errorString();
+                }
+                auto tile = m_tileData.read(qint64(byteCount));
+                if ((tile.size() != qint64(byteCount)) || (m_file.write(tile) != tile.size()))
+                {
+                    throw QObject::tr("Cannot copy tile data.", "FileFormats::GeoTIFFWriter");
+                }
+            }
+        }
+    }
+
+    auto data = header(ifd0Offset, bigTIFF);
+    if (!m_file.seek(0) || (m_file.write(data) != data.size()) || !m_file.commit())
+    {
+        throw m_file.errorString();
+    }
+}
+
+
+
+//
+// Private Methods
+//
+
+QByteArray FileFormats::GeoTIFFWriter::directories(qint64 start, bool bigTIFF) const
+{
+    // In BigTIFF, the number of entries, counts, offsets and value fields
+    // take eight bytes each
+    qint64 const countSize = bigTIFF ? 8 : 2;
+    qint64 const offsetSize = bigTIFF ? 8 : 4;
+    qint64 const entrySize = 4 + 2*offsetSize;
+    auto appendOffset = [bigTIFF](QByteArray& data, qint64 value) {
+        if (bigTIFF)
+        {
+            appendLittleEndian<quint64>(data, quint64(value));
+        }
+        else
+        {
+            appendLittleEndian<quint32>(data, quint32(value));
+        }
+    };
+
+    // Compute the offsets of all IFDs first, so that each IFD can point to the
+    // next. Out-of-line values follow their IFD, starting on word boundaries.
+    QVector<QVector<Field>> allFields;
+    QVector<qint64> ifdOffsets;
+    auto position = start;
+    for (int image=0; image<m_images.size(); ++image)
+    {
+        allFields.append(fields(image, bigTIFF));
+        ifdOffsets.append(position);
+        position += countSize + entrySize*qint64(allFields.last().size()) + offsetSize;
+        for (const auto& field : allFields.last())
+        {
+            if (field.data.size() > offsetSize)
+            {
+                position += field.data.size() + (field.data.size() & 1);
+            }
+        }
+    }
+
+    QByteArray result;
+    for (int image=0; image<m_images.size(); ++image)
+    {
+        const auto& fields = allFields[image];
+        auto valueOffset = ifdOffsets[image] + countSize + entrySize*qint64(fields.size()) + offsetSize;
+        QByteArray values;
+
+        if (bigTIFF)
+        {
+            appendLittleEndian<quint64>(result, quint64(fields.size()));
+        }
+        else
+        {
+            appendLittleEndian<quint16>(result, quint16(fields.size()));
+        }
+        for (const auto& field : fields)
+        {
+            appendLittleEndian<quint16>(result, field.tag);
+            appendLittleEndian<quint16>(result, field.type);
+            appendOffset(result, field.count);
+            if (field.data.size() <= offsetSize)
+            {
+                result.append(field.data);
+                result.append(offsetSize - field.data.size(), '\0');
+                continue;
+            }
+            appendOffset(result, valueOffset + values.size());
+            values.append(field.data);
+            if ((field.data.size() & 1) != 0)
+            {
+                values.append('\0');
+            }
+        }
+        appendOffset(result, (image + 1 < m_images.size()) ? ifdOffsets[image + 1] : 0);
+        result.append(values);
+    }
+    return result;
+}
+
+QVector<FileFormats::GeoTIFFWriter::Field> FileFormats::GeoTIFFWriter::fields(int image, bool bigTIFF) const
+{
+    const auto& data = m_images[image];
+    auto samples = samplesPerPixel(data.format);
+
+    QVector<Field> result;
+    result.append(integerField(254, DT_Long, {(image == 0) ? 0U : 1U}));
+    result.append(integerField(256, DT_Long, {quint32(data.size.width())}));
+    result.append(integerField(257, DT_Long, {quint32(data.size.height())}));
+    result.append(integerField(258, DT_Short, QVector<quint64>(samples, 8)));
+    result.append(integerField(259, DT_Short, {8}));
+    result.append(integerField(262, DT_Short, {(samples >= 3) ? 2U : 1U}));
+    result.append(integerField(277, DT_Short, {quint32(samples)}));
+    result.append(integerField(284, DT_Short, {1}));
+    result.append(integerField(317, DT_Short, {2}));
+    result.append(integerField(322, DT_Long, {quint32(data.tileSize.width())}));
+    result.append(integerField(323, DT_Long, {quint32(data.tileSize.height())}));
+    result.append(integerField(324, bigTIFF ? DT_Long8 : DT_Long, data.offsets));
+    result.append(integerField(325, bigTIFF ? DT_Long8 : DT_Long, data.byteCounts));
+    if (samples == 4)
+    {
+        // Associated or unassociated alpha
+        result.append(integerField(338, DT_Short, {(data.format == QImage::Format_RGBA8888_Premultiplied) ? 1U : 2U}));
+    }
+    if (image == 0)
+    {
+        result += m_extraFields;
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Field& a, const Field& b) { return a.tag < b.tag; });
+    return result;
+}
+
+FileFormats::GeoTIFFWriter::Field FileFormats::GeoTIFFWriter::integerField(quint16 tag, quint16 type, const QVector<quint64>& values)
+{
+    Field field {tag, type, quint32(values.size()), {}};
+    for (auto value : values)
+    {
+        if (type == DT_Short)
+        {
+            appendLittleEndian<quint16>(field.data, quint16(value));
+        }
+        else if (type == DT_Long8)
+        {
+            appendLittleEndian<quint64>(field.data, value);
+        }
+        else
+        {
+            appendLittleEndian<quint32>(field.data, quint32(value));
+        }
+    }
+    return field;
+}
+
+QByteArray FileFormats::GeoTIFFWriter::header(qint64 ifd0Offset, bool bigTIFF)
+{
+    QByteArray result("II");
+    if (bigTIFF)
+    {
+        // Version, size of offsets and a reserved word
+        appendLittleEndian<quint16>(result, 43);
+        appendLittleEndian<quint16>(result, 8);
+        appendLittleEndian<quint16>(result, 0);
+        appendLittleEndian<quint64>(result, quint64(ifd0Offset));
+        return result;
+    }
+    appendLittleEndian<quint16>(result, 42);
+    appendLittleEndian<quint32>(result, quint32(ifd0Offset));
+    return result;
+}
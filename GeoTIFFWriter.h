@@ -0,0 +1,230 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#pragma once
+
+#include <QImage>
+#include <QMutex>
+#include <QSaveFile>
+#include <QTemporaryFile>
+
+#include "TIFFTagTable.h"
+
+namespace FileFormats
+{
+
+/*! \brief Writer for tiled GeoTIFF files
+ *
+ *  This class writes tiled TIFF files with one or more images: the
+ *  full-resolution raster, followed by reduced-resolution overviews. Tiles
+ *  are compressed with Deflate and horizontal differencing, and appended to
+ *  the file as soon as they are written, so that the writer never holds more
+ *  than a single tile in memory. The layout of the file is chosen in the
+ *  constructor: tile data can go straight to the file, followed by the image
+ *  file directories, or the file can be written as a Cloud Optimized GeoTIFF
+ *  (COG), where all image file directories follow the header, so that a
+ *  reader finds the layout of all images in the first bytes of the file.
+ *
+ *  Files that exceed 4 GB are written as BigTIFF, with 64-bit offsets. Smaller
+ *  files are written as classic TIFF, unless BigTIFF is requested with
+ *  setBigTIFF().
+ *
+ *  Supported image formats are QImage::Format_Grayscale8,
+ *  QImage::Format_RGB888, QImage::Format_RGBA8888 and
+ *  QImage::Format_RGBA8888_Premultiplied.
+ *
+ *  The file is written atomically: it appears under its name only after
+ *  finish() succeeds. On failure, the methods of this class throw a QString
+ *  with a human-readable, translated error message.
+ */
+
+class GeoTIFFWriter
+{
+public:
+    /*! \brief Layout of the file */
+    enum class Layout
+    {
+        /*! \brief Tile data in the order written, followed by the image file
+         *  directories */
+        Sequential,
+
+        /*! \brief Image file directories after the header, followed by the
+         *  tile data of the overviews, smallest first, and finally the tile
+         *  data of the full-resolution raster. Tiles are collected in a
+         *  temporary file and copied into place by finish(). */
+        CloudOptimized
+    };
+
+    /*! \brief Constructor
+     *
+     *  \param fileName Name of the file to write
+     *
+     *  \param layout Layout of the file
+     */
+    GeoTIFFWriter(const QString& fileName, Layout layout = Layout::Sequential);
+
+    ~GeoTIFFWriter() = default;
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Number of tiles of an image
+     *
+     *  @param image Index of the image, as returned by addImage()
+     *
+     *  @returns Number of tiles
+     */
+    [[nodiscard]] qsizetype tileCount(int image) const;
+
+    /*! \brief BigTIFF output
+     *
+     *  @returns True if the file is written as BigTIFF even if it is smaller
+     *  than 4 GB
+     */
+    [[nodiscard]] bool isBigTIFF() const { return m_bigTIFF; }
+
+
+    //
+    // Setter methods
+    //
+
+    /*! \brief Copy georeferencing
+     *
+     *  Copies the values of the tags ImageDescription (270), which holds the
+     *  name, ModelPixelScale (33550), ModelTiepoint (33922),
+     *  ModelTransformation (34264), GeoKeyDirectory (34735), GeoDoubleParams
+     *  (34736), GeoAsciiParams (34737) and GDAL_NODATA (42113), as far as
+     *  they are decoded in the table, to the first image.
+     *
+     *  \param fields TIFF fields of a GeoTIFF file
+     */
+    void setGeoFields(const TIFFTagTable& fields);
+
+    /*! \brief Request BigTIFF output
+     *
+     *  Must be called before finish().
+     *
+     *  \param bigTIFF If true, the file is written as BigTIFF even if it is
+     *  smaller than 4 GB
+     */
+    void setBigTIFF(bool bigTIFF) { m_bigTIFF = bigTIFF; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Add an image
+     *
+     *  The first image is the full-resolution raster. All further images are
+     *  marked as reduced-resolution overviews.
+     *
+     *  @param size Size of the image in pixels
+     *
+     *  @param tileSize Size of a tile. Width and height must be multiples of
+     *  16.
+     *
+     *  @param format Image format
+     *
+     *  @returns Index of the image
+     */
+    int addImage(QSize size, QSize tileSize, QImage::Format format);
+
+    /*! \brief Write a tile
+     *
+     *  The tile is converted to the format of the image, compressed and
+     *  appended to the file. Tiles may be written in any order. Tiles that are
+     *  never written are stored as empty, which readers decode as zeros. This
+     *  method is thread-safe: compression runs in the calling thread, and only
+     *  the write to the file is serialized.
+     *
+     *  @param image Index of the image, as returned by addImage()
+     *
+     *  @param index Index of the tile, in row-major order
+     *
+     *  @param tile Content of the tile. Tiles that are smaller than the tile
+     *  size, at the right and bottom edges of the image, are padded with
+     *  zeros.
+     */
+    void writeTile(int image, qsizetype index, const QImage& tile);
+
+    /*! \brief Finish the file
+     *
+     *  Writes the image file directories and commits the file.
+     */
+    void finish();
+
+private:
+    Q_DISABLE_COPY_MOVE(GeoTIFFWriter)
+
+    // Image and the location of its tiles in the file
+    struct Image
+    {
+        QSize size;
+        QSize tileSize;
+        QImage::Format format {QImage::Format_Invalid};
+        qsizetype tilesAcross {0};
+        QVector<quint64> offsets;
+        QVector<quint64> byteCounts;
+    };
+
+    // TIFF field, with its values in little-endian byte order
+    struct Field
+    {
+        quint16 tag {0};
+        quint16 type {0};
+        quint32 count {0};
+        QByteArray data;
+    };
+
+    // Returns the fields of an image, sorted by tag. BigTIFF files store
+    // tile offsets and byte counts as LONG8.
+    [[nodiscard]] QVector<Field> fields(int image, bool bigTIFF) const;
+
+    // Returns the image file directories of all images, as they appear in the
+    // file when the first one starts at the given position, which must be
+    // even
+    [[nodiscard]] QByteArray directories(qint64 start, bool bigTIFF) const;
+
+    // Returns a field with values of type SHORT, LONG or LONG8
+    [[nodiscard]] static Field integerField(quint16 tag, quint16 type, const QVector<quint64>& values);
+
+    // Returns the header of a file whose first image file directory starts at
+    // the given offset
+    [[nodiscard]] static QByteArray header(qint64 ifd0Offset, bool bigTIFF);
+
+    QSaveFile m_file;
+    Layout m_layout;
+    bool m_bigTIFF {false};
+
+    // Tile data of cloud-optimized files, until finish() copies it into place
+    QTemporaryFile m_tileData;
+
+    QVector<Image> m_images;
+
+    // Fields added to the first image
+    QVector<Field> m_extraFields;
+
+    // Serializes writes to m_file and access to the tile locations
+    mutable QMutex m_mutex;
+};
+
+} // namespace FileFormats
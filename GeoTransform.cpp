@@ -0,0 +1,202 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <limits>
+
+#include "GeoTransform.h"
+
+// As in TIFFPredictor.cpp, the instruction set is chosen at runtime
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GEOTRANSFORM_X86
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+using FileFormats::TIFFPredictor::Instructions;
+
+
+//
+// Scalar code
+//
+
+// Applies the affine mapping with coefficients c to the points from index
+// 'begin' to 'count'. Both coordinates are read before either is written, so
+// that output arrays may alias input arrays.
+void affineScalar(const std::array<double, 6>& c, const double* u, const double* v, double* s, double* t, qsizetype begin, qsizetype count)
+{
+    for (auto i=begin; i<count; ++i)
+    {
+        auto x = u[i];
+        auto y = v[i];
+        s[i] = c[0]*x + c[1]*y + c[2];
+        t[i] = c[3]*x + c[4]*y + c[5];
+    }
+}
+
+
+#ifdef GEOTRANSFORM_X86
+
+//
+// SSE4.1
+//
+
+// Applies the affine mapping to pairs of points and returns the number of
+// points done
+__attribute__((target("sse4.1"))) qsizetype affineSSE41(const std::array<double, 6>& c, const double* u, const double* v, double* s, double* t, qsizetype count)
+{
+    auto c0 = _mm_set1_pd(c[0]);
+    auto c1 = _mm_set1_pd(c[1]);
+    auto c2 = _mm_set1_pd(c[2]);
+    auto c3 = _mm_set1_pd(c[3]);
+    auto c4 = _mm_set1_pd(c[4]);
+    auto c5 = _mm_set1_pd(c[5]);
+    qsizetype i = 0;
+    for (; i+2<=count; i+=2)
+    {
+        auto x = _mm_loadu_pd(u + i);
+        auto y = _mm_loadu_pd(v + i);
+        _mm_storeu_pd(s + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(c0, x), _mm_mul_pd(c1, y)), c2));
+        _mm_storeu_pd(t + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(c3, x), _mm_mul_pd(c4, y)), c5));
+    }
+    return i;
+}
+
+
+//
+// AVX2
+//
+
+// Applies the affine mapping to groups of four points and returns the number
+// of points done. Multiplications and additions are not fused, so that the
+// results match those of the scalar code.
+__attribute__((target("avx2"))) qsizetype affineAVX2(const std::array<double, 6>& c, const double* u, const double* v, double* s, double* t, qsizetype count)
+{
+    auto c0 = _mm256_set1_pd(c[0]);
+    auto c1 = _mm256_set1_pd(c[1]);
+    auto c2 = _mm256_set1_pd(c[2]);
+    auto c3 = _mm256_set1_pd(c[3]);
+    auto c4 = _mm256_set1_pd(c[4]);
+    auto c5 = _mm256_set1_pd(c[5]);
+    qsizetype i = 0;
+    for (; i+4<=count; i+=4)
+    {
+        auto x = _mm256_loadu_pd(u + i);
+        auto y = _mm256_loadu_pd(v + i);
+        _mm256_storeu_pd(s + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c0, x), _mm256_mul_pd(c1, y)), c2));
+        _mm256_storeu_pd(t + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c3, x), _mm256_mul_pd(c4, y)), c5));
+    }
+    return i;
+}
+
+#endif
+
+
+//
+// Dispatch
+//
+
+void affine(const std::array<double, 6>& c, std::span<const double> u, std::span<const double> v, std::span<double> s, std::span<double> t, Instructions instructions)
+{
+    auto count = qsizetype(qMin(qMin(u.size(), v.size()), qMin(s.size(), t.size())));
+    instructions = qMin(instructions, FileFormats::TIFFPredictor::bestInstructions());
+    qsizetype done = 0;
+#ifdef GEOTRANSFORM_X86
+    if (instructions == Instructions::AVX2)
+    {
+        done = affineAVX2(c, u.data(), v.data(), s.data(), t.data(), count);
+    }
+    else if (instructions == Instructions::SSE41)
+    {
+        done = affineSSE41(c, u.data(), v.data(), s.data(), t.data(), count);
+    }
+#else
+    Q_UNUSED(instructions)
+#endif
+    affineScalar(c, u.data(), v.data(), s.data(), t.data(), done, count);
+}
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::GeoTransform::GeoTransform(const std::array<double, 6>& coefficients, const Projection& projection)
+    : m_toGeo(coefficients), m_projection(projection)
+{
+    const auto& a = m_toGeo;
+    auto determinant = a[0]*a[4] - a[1]*a[3];
+    if ((determinant == 0.0) || !std::isfinite(determinant) || !std::isfinite(a[2]) || !std::isfinite(a[5]))
+    {
+        m_toRaster.fill(std::numeric_limits<double>::quiet_NaN());
+        return;
+    }
+    m_toRaster = {a[4]/determinant, -a[1]/determinant, (a[1]*a[5] - a[4]*a[2])/determinant,
+                  -a[3]/determinant, a[0]/determinant, (a[3]*a[2] - a[0]*a[5])/determinant};
+    m_isValid = true;
+}
+
+
+
+//
+// Methods
+//
+
+QGeoCoordinate FileFormats::GeoTransform::toGeo(const QPointF& point) const
+{
+    if (!m_isValid)
+    {
+        return {};
+    }
+    const auto& a = m_toGeo;
+    return m_projection.inverse({a[0]*point.x() + a[1]*point.y() + a[2], a[3]*point.x() + a[4]*point.y() + a[5]});
+}
+
+QPointF FileFormats::GeoTransform::toRaster(const QGeoCoordinate& coordinate) const
+{
+    const auto& b = m_toRaster;
+    auto model = m_projection.forward(coordinate);
+    return {b[0]*model.x() + b[1]*model.y() + b[2], b[3]*model.x() + b[4]*model.y() + b[5]};
+}
+
+void FileFormats::GeoTransform::toGeo(std::span<const double> x, std::span<const double> y, std::span<double> longitudes, std::span<double> latitudes, TIFFPredictor::Instructions instructions) const
+{
+    affine(m_toGeo, x, y, longitudes, latitudes, instructions);
+    if (m_projection.method() != Projection::Method::Geographic)
+    {
+        m_projection.inverse(longitudes, latitudes, longitudes, latitudes);
+    }
+}
+
+void FileFormats::GeoTransform::toRaster(std::span<const double> longitudes, std::span<const double> latitudes, std::span<double> x, std::span<double> y, TIFFPredictor::Instructions instructions) const
+{
+    if (m_projection.method() == Projection::Method::Geographic)
+    {
+        affine(m_toRaster, longitudes, latitudes, x, y, instructions);
+        return;
+    }
+    m_projection.forward(longitudes, latitudes, x, y);
+    affine(m_toRaster, x, y, x, y, instructions);
+}
@@ -0,0 +1,180 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoCoordinate>
+#include <QPointF>
+
+#include <array>
+#include <span>
+
+#include "Projection.h"
+#include "TIFFPredictor.h"
+
+namespace FileFormats
+{
+
+/*! \brief Transformation between raster and geographic coordinates
+ *
+ *  This class maps raster coordinates of a GeoTIFF file to geographic
+ *  coordinates and back. Raster coordinates are first mapped to model
+ *  coordinates by an affine mapping,
+ *
+ *      u = a[0]*x + a[1]*y + a[2]
+ *      v = a[3]*x + a[4]*y + a[5]
+ *
+ *  Model coordinates are then unprojected, see Projection::inverse(). For
+ *  geographic coordinate systems, u is the longitude and v the latitude in
+ *  degrees. For projected coordinate systems, u is the easting and v the
+ *  northing in metres.
+ *
+ *  Raster coordinates refer to pixel corners: pixel (i, j) covers the square
+ *  from (i, j) to (i+1, j+1), so that its center is at (i+0.5, j+0.5).
+ *
+ *  Besides methods for single points, there are batch methods that transform
+ *  arrays of coordinates, given as separate arrays of x and y coordinates.
+ *  The affine mapping uses SSE4.1 or AVX2 if the processor supports it, see
+ *  TIFFPredictor::bestInstructions().
+ */
+
+class GeoTransform
+{
+public:
+    /*! \brief Constructs an invalid transformation */
+    GeoTransform() = default;
+
+    /*! \brief Constructor
+     *
+     *  @param coefficients Coefficients a[0], …, a[5] of the mapping from
+     *  raster to model coordinates, see class description
+     *
+     *  @param projection Projection of the model coordinates
+     */
+    explicit GeoTransform(const std::array<double, 6>& coefficients, const Projection& projection = {});
+
+
+    //
+    // Getter Methods
+    //
+
+    /*! \brief Check validity
+     *
+     *  @returns True if the transformation is invertible
+     */
+    [[nodiscard]] bool isValid() const { return m_isValid; }
+
+    /*! \brief Coefficients of the mapping from raster to model coordinates
+     *
+     *  @returns Coefficients a[0], …, a[5], see class description
+     */
+    [[nodiscard]] const std::array<double, 6>& coefficients() const { return m_toGeo; }
+
+    /*! \brief Coefficients of the mapping from model to raster coordinates
+     *
+     *  @returns Coefficients b[0], …, b[5] with x = b[0]*u + b[1]*v + b[2] and
+     *  y = b[3]*u + b[4]*v + b[5], or NaNs if the transformation is invalid
+     */
+    [[nodiscard]] const std::array<double, 6>& inverseCoefficients() const { return m_toRaster; }
+
+    /*! \brief Projection of the model coordinates
+     *
+     *  @returns Projection
+     */
+    [[nodiscard]] const Projection& projection() const { return m_projection; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Map raster to geographic coordinates
+     *
+     *  @param point Point in raster coordinates
+     *
+     *  @returns Geographic coordinate, or an invalid coordinate if the
+     *  transformation is invalid
+     */
+    [[nodiscard]] QGeoCoordinate toGeo(const QPointF& point) const;
+
+    /*! \brief Map geographic to raster coordinates
+     *
+     *  @param coordinate Geographic coordinate
+     *
+     *  @returns Point in raster coordinates, or (NaN, NaN) if the
+     *  transformation is invalid
+     */
+    [[nodiscard]] QPointF toRaster(const QGeoCoordinate& coordinate) const;
+
+    /*! \brief Map arrays of raster coordinates to geographic coordinates
+     *
+     *  The number of points is the smallest size of the four arrays. Output
+     *  arrays may be identical to input arrays, so that points can be
+     *  transformed in place.
+     *
+     *  @param x Raster x coordinates
+     *
+     *  @param y Raster y coordinates
+     *
+     *  @param longitudes Output, longitudes in degrees
+     *
+     *  @param latitudes Output, latitudes in degrees
+     *
+     *  @param instructions Instruction set. If the processor does not support
+     *  the instruction set, scalar code is used.
+     */
+    void toGeo(std::span<const double> x, std::span<const double> y, std::span<double> longitudes, std::span<double> latitudes,
+               TIFFPredictor::Instructions instructions = TIFFPredictor::bestInstructions()) const;
+
+    /*! \brief Map arrays of geographic coordinates to raster coordinates
+     *
+     *  The number of points is the smallest size of the four arrays. Output
+     *  arrays may be identical to input arrays, so that points can be
+     *  transformed in place. If the transformation is invalid, the output is
+     *  NaN.
+     *
+     *  @param longitudes Longitudes in degrees
+     *
+     *  @param latitudes Latitudes in degrees
+     *
+     *  @param x Output, raster x coordinates
+     *
+     *  @param y Output, raster y coordinates
+     *
+     *  @param instructions Instruction set. If the processor does not support
+     *  the instruction set, scalar code is used.
+     */
+    void toRaster(std::span<const double> longitudes, std::span<const double> latitudes, std::span<double> x, std::span<double> y,
+                  TIFFPredictor::Instructions instructions = TIFFPredictor::bestInstructions()) const;
+
+private:
+    // Coefficients of the mapping from raster to model coordinates, and of
+    // its inverse
+    std::array<double, 6> m_toGeo {};
+    std::array<double, 6> m_toRaster {};
+
+    // Projection of the model coordinates
+    Projection m_projection;
+
+    // True if the mapping is invertible
+    bool m_isValid {false};
+};
+
+} // namespace FileFormats
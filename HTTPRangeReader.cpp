@@ -0,0 +1,305 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QTcpSocket>
+
+#include <algorithm>
+#include <numeric>
+
+#include "HTTPRangeReader.h"
+
+
+namespace {
+
+// Ranges that lie closer together than this number of bytes are fetched with
+// a single request
+const qint64 maxRequestGap = 16*1024;
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::HTTPRangeReader::HTTPRangeReader(const QUrl& url, int timeout)
+    : m_url(url), m_timeout(timeout)
+{
+    if ((url.scheme() != u"http"_qs) || url.host().isEmpty())
+    {
+        throw QObject::tr("Only HTTP URLs are supported.", "FileFormats::HTTPRangeReader");
+    }
+}
+
+
+
+//
+// Methods
+//
+
+qint64 FileFormats::HTTPRangeReader::size()
+{
+    {
+        QMutexLocker const locker(&m_mutex);
+        if (m_size >= 0)
+        {
+            return m_size;
+        }
+    }
+
+    // The size is part of every Content-Range header
+    (void)readRanges({{0, 1}});
+    QMutexLocker const locker(&m_mutex);
+    if (m_size < 0)
+    {
+        throw QObject::tr("The server did not send the file size.", "FileFormats::HTTPRangeReader");
+    }
+    return m_size;
+}
+
+QByteArray FileFormats::HTTPRangeReader::read(qint64 offset, qint64 length)
+{
+    return readRanges({{offset, length}}).constFirst();
+}
+
+QVector<QByteArray> FileFormats::HTTPRangeReader::readRanges(const QVector<Range>& ranges)
+{
+    // Merge ranges that overlap or lie close together into requests
+    struct Request
+    {
+        qint64 begin;
+        qint64 end;
+        QByteArray body;
+    };
+    QVector<qsizetype> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&ranges](qsizetype a, qsizetype b) { return ranges[a].offset < ranges[b].offset; });
+    QVector<Request> requests;
+    QVector<qsizetype> requestOfRange(ranges.size(), -1);
+    for (auto index : order)
+    {
+        const auto& range = ranges[index];
+        if ((range.offset < 0) || (range.length <= 0))
+        {
+            continue;
+        }
+        if (requests.isEmpty() || (range.offset > requests.last().end + maxRequestGap))
+        {
+            requests.append({range.offset, range.offset + range.length, {}});
+        }
+        requests.last().end = qMax(requests.last().end, range.offset + range.length);
+        requestOfRange[index] = requests.size() - 1;
+    }
+
+    QVector<QByteArray> result(ranges.size());
+    if (requests.isEmpty())
+    {
+        return result;
+    }
+
+    // Send all requests at once, then read the responses in order
+    QTcpSocket socket;
+    socket.connectToHost(m_url.host(), quint16(m_url.port(80)));
+    if (!socket.waitForConnected(m_timeout))
+    {
+        throw socket.errorString();
+    }
+    auto target = m_url.path(QUrl::FullyEncoded);
+    if (target.isEmpty())
+    {
+        target = u"/"_qs;
+    }
+    if (m_url.hasQuery())
+    {
+        target += u"?"_qs + m_url.query(QUrl::FullyEncoded);
+    }
+    auto host = (m_url.port() < 0) ? m_url.host(QUrl::FullyEncoded) : u"%1:%2"_qs.arg(m_url.host(QUrl::FullyEncoded)).arg(m_url.port());
+    QByteArray message;
+    for (const auto& request : requests)
+    {
+        message += u"GET %1 HTTP/1.1\r\nHost: %2\r\nRange: bytes=%3-%4\r\n\r\n"_qs.arg(target, host).arg(request.begin).arg(request.end - 1).toLatin1();
+    }
+    if (socket.write(message) != message.size())
+    {
+        throw socket.errorString();
+    }
+
+    for (auto& request : requests)
+    {
+        int status = 0;
+        qint64 bodyOffset = 0;
+        auto body = readResponse(socket, status, bodyOffset);
+        if (status == 416)
+        {
+            // The range lies beyond the end of the file
+            continue;
+        }
+        if ((status != 200) && (status != 206))
+        {
+            throw QObject::tr("The server replied with status %1.", "FileFormats::HTTPRangeReader").arg(status);
+        }
+        if (request.begin >= bodyOffset)
+        {
+            request.body = body.mid(request.begin - bodyOffset, request.end - request.begin);
+        }
+    }
+    socket.disconnectFromHost();
+
+    for (qsizetype i=0; i<ranges.size(); ++i)
+    {
+        if (requestOfRange[i] >= 0)
+        {
+            const auto& request = requests[requestOfRange[i]];
+            result[i] = request.body.mid(ranges[i].offset - request.begin, ranges[i].length);
+        }
+    }
+    return result;
+}
+
+QString FileFormats::HTTPRangeReader::identity() const
+{
+    QMutexLocker const locker(&m_mutex);
+    if (m_validator.isEmpty())
+    {
+        return {};
+    }
+    return u"%1|%2|%3"_qs.arg(m_url.toString(), QString::number(m_size), m_validator);
+}
+
+
+
+//
+// Private Methods
+//
+
+QByteArray FileFormats::HTTPRangeReader::readResponse(QTcpSocket& socket, int& status, qint64& bodyOffset)
+{
+    // Status line, for instance "HTTP/1.1 206 Partial Content"
+    auto statusLine = readLine(socket).split(' ');
+    if ((statusLine.size() < 2) || !statusLine[0].startsWith("HTTP/"))
+    {
+        throw QObject::tr("The server sent an invalid response.", "FileFormats::HTTPRangeReader");
+    }
+    status = statusLine[1].toInt();
+
+    // Header fields
+    qint64 contentLength = -1;
+    qint64 size = -1;
+    QString eTag;
+    QString lastModified;
+    bodyOffset = 0;
+    for (auto line = readLine(socket); !line.isEmpty(); line = readLine(socket))
+    {
+        auto colon = line.indexOf(':');
+        if (colon < 0)
+        {
+            continue;
+        }
+        auto name = line.left(colon).trimmed().toLower();
+        auto value = line.mid(colon + 1).trimmed();
+        if (name == "content-length")
+        {
+            contentLength = value.toLongLong();
+        }
+        else if (name == "content-range")
+        {
+            // "bytes 100-199/1234", or "bytes */1234" if the range is not
+            // satisfiable
+            auto slash = value.indexOf('/');
+            auto dash = value.indexOf('-');
+            if (!value.startsWith("bytes ") || (slash < 0))
+            {
+                throw QObject::tr("The server sent an invalid response.", "FileFormats::HTTPRangeReader");
+            }
+            if ((dash > 0) && (dash < slash))
+            {
+                bodyOffset = value.mid(6, dash - 6).toLongLong();
+            }
+            bool ok = false;
+            size = value.mid(slash + 1).toLongLong(&ok);
+            if (!ok)
+            {
+                size = -1;
+            }
+        }
+        else if (name == "etag")
+        {
+            eTag = QString::fromLatin1(value);
+        }
+        else if (name == "last-modified")
+        {
+            lastModified = QString::fromLatin1(value);
+        }
+        else if ((name == "transfer-encoding") && (value != "identity"))
+        {
+            throw QObject::tr("The server sent a response in chunks, which is not supported.", "FileFormats::HTTPRangeReader");
+        }
+    }
+    if (contentLength < 0)
+    {
+        throw QObject::tr("The server sent a response without length.", "FileFormats::HTTPRangeReader");
+    }
+    if (status == 200)
+    {
+        size = contentLength;
+    }
+    auto body = readBytes(socket, contentLength);
+
+    QMutexLocker const locker(&m_mutex);
+    if (size >= 0)
+    {
+        m_size = size;
+    }
+    m_validator = eTag.isEmpty() ? lastModified : eTag;
+    return body;
+}
+
+QByteArray FileFormats::HTTPRangeReader::readLine(QTcpSocket& socket) const
+{
+    while (!socket.canReadLine())
+    {
+        if (!socket.waitForReadyRead(m_timeout))
+        {
+            throw QObject::tr("Cannot read from server: %1", "FileFormats::HTTPRangeReader").arg(socket.errorString());
+        }
+    }
+    auto line = socket.readLine();
+    while (line.endsWith('\n') || line.endsWith('\r'))
+    {
+        line.chop(1);
+    }
+    return line;
+}
+
+QByteArray FileFormats::HTTPRangeReader::readBytes(QTcpSocket& socket, qint64 count) const
+{
+    QByteArray result;
+    result.reserve(count);
+    while (result.size() < count)
+    {
+        if ((socket.bytesAvailable() == 0) && !socket.waitForReadyRead(m_timeout))
+        {
+            throw QObject::tr("Cannot read from server: %1", "FileFormats::HTTPRangeReader").arg(socket.errorString());
+        }
+        result += socket.read(count - result.size());
+    }
+    return result;
+}
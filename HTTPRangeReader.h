@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QMutex>
+#include <QUrl>
+
+#include "RangeReader.h"
+
+class QTcpSocket;
+
+namespace FileFormats
+{
+
+/*! \brief Range reader for files served over HTTP
+ *
+ *  Ranges are fetched with HTTP/1.1 range requests. All ranges of one call
+ *  to readRanges() are requested on a single connection: ranges that lie
+ *  close together are merged into one request, and the requests are
+ *  pipelined, so that a batch costs one round trip plus the connection
+ *  setup. Every call opens a new connection, so that the reader can be
+ *  used from any thread.
+ *
+ *  Only plain HTTP is supported. Servers must answer with status 206 and a
+ *  Content-Range header, or with status 200 and the complete file.
+ */
+
+class HTTPRangeReader : public RangeReader
+{
+public:
+    /*! \brief Constructor
+     *
+     *  @param url URL of the file, with scheme "http"
+     *
+     *  @param timeout Timeout for connecting and for every read from the
+     *  connection, in milliseconds
+     */
+    HTTPRangeReader(const QUrl& url, int timeout = 30000);
+
+    [[nodiscard]] qint64 size() override;
+    [[nodiscard]] QByteArray read(qint64 offset, qint64 length) override;
+    [[nodiscard]] QVector<QByteArray> readRanges(const QVector<Range>& ranges) override;
+
+    /*! \brief Identity of the data
+     *
+     *  @returns URL, size and the validator (ETag or Last-Modified) sent by
+     *  the server with the last response, or an empty string if the server
+     *  sent no validator
+     */
+    [[nodiscard]] QString identity() const override;
+
+private:
+    // Reads one response from the socket. Returns the body and sets status,
+    // and the offset of the first byte of the body within the file. On
+    // failure, throws a QString with a human-readable, translated error
+    // message.
+    [[nodiscard]] QByteArray readResponse(QTcpSocket& socket, int& status, qint64& bodyOffset);
+
+    // Reads a line, terminated by CRLF, from the socket
+    [[nodiscard]] QByteArray readLine(QTcpSocket& socket) const;
+
+    // Reads the given number of bytes from the socket
+    [[nodiscard]] QByteArray readBytes(QTcpSocket& socket, qint64 count) const;
+
+    QUrl m_url;
+    int m_timeout;
+
+    // Learned from the responses
+    mutable QMutex m_mutex;
+    qint64 m_size {-1};
+    QString m_validator;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,588 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QObject>
+#include <QtMath>
+
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <numbers>
+
+#include "Projection.h"
+
+
+//
+// Static helper functions
+//
+
+namespace {
+
+using FileFormats::GeoKeyDirectory;
+using FileFormats::Projection;
+
+// Ellipsoids, by EPSG code
+const Projection::Ellipsoid wgs84 {6378137.0, 298.257223563};
+const Projection::Ellipsoid grs80 {6378137.0, 298.257222101};
+const Projection::Ellipsoid clarke1866 {6378206.4, 294.978698214};
+const Projection::Ellipsoid bessel1841 {6377397.155, 299.1528128};
+const Projection::Ellipsoid international1924 {6378388.0, 297.0};
+
+// Returns the ellipsoid given by GeogEllipsoid, by the user-defined axes, or
+// implied by GeographicType. Throws a QString if the ellipsoid is not known.
+Projection::Ellipsoid ellipsoid(const GeoKeyDirectory& keys)
+{
+    auto code = keys.shortValue(GeoKeyDirectory::GeogEllipsoid, 0);
+    if ((code == GeoKeyDirectory::userDefined) || ((code == 0) && keys.contains(GeoKeyDirectory::GeogSemiMajorAxis)))
+    {
+        auto a = keys.doubleValue(GeoKeyDirectory::GeogSemiMajorAxis, 0.0);
+        auto inverseFlattening = keys.doubleValue(GeoKeyDirectory::GeogInvFlattening, 0.0);
+        if (!keys.contains(GeoKeyDirectory::GeogInvFlattening))
+        {
+            auto b = keys.doubleValue(GeoKeyDirectory::GeogSemiMinorAxis, a);
+            inverseFlattening = (b == a) ? 0.0 : a/(a - b);
+        }
+        if (!(a > 0.0) || !std::isfinite(inverseFlattening) || ((inverseFlattening != 0.0) && (inverseFlattening <= 1.0)))
+        {
+            throw QObject::tr("Invalid ellipsoid.", "FileFormats::Projection");
+        }
+        return {a, inverseFlattening};
+    }
+
+    switch (code)
+    {
+    case 0:
+        break;
+    case 7004:
+        return bessel1841;
+    case 7008:
+        return clarke1866;
+    case 7019:
+        return grs80;
+    case 7022:
+        return international1924;
+    case 7030:
+        return wgs84;
+    default:
+        throw QObject::tr("Ellipsoid %1 is not supported.", "FileFormats::Projection").arg(code);
+    }
+
+    code = keys.shortValue(GeoKeyDirectory::GeographicType, 0);
+    switch (code)
+    {
+    case 0:
+    case 4326:
+        return wgs84;
+    case 4171:
+    case 4258:
+    case 4269:
+        return grs80;
+    case 4230:
+        return international1924;
+    case 4267:
+        return clarke1866;
+    case 4314:
+        return bessel1841;
+    default:
+        throw QObject::tr("Geographic coordinate system %1 is not supported.", "FileFormats::Projection").arg(code);
+    }
+}
+
+// Returns the sum of a[j]·sin(2(j+1)ζ) for the complex number ζ = ξ + iη, by
+// Clenshaw summation. This needs one evaluation of sine, cosine and their
+// hyperbolic counterparts, instead of one per term.
+std::complex<double> kruegerSum(const std::array<double, 6>& a, double xi, double eta)
+{
+    auto sin2Xi = std::sin(2.0*xi);
+    auto cos2Xi = std::cos(2.0*xi);
+    auto exp2Eta = std::exp(2.0*eta);
+    auto sinh2Eta = (exp2Eta - 1.0/exp2Eta)/2.0;
+    auto cosh2Eta = (exp2Eta + 1.0/exp2Eta)/2.0;
+    std::complex<double> const sin2Zeta(sin2Xi*cosh2Eta, cos2Xi*sinh2Eta);
+    std::complex<double> const twoCos2Zeta(2.0*cos2Xi*cosh2Eta, -2.0*sin2Xi*sinh2Eta);
+    std::complex<double> b1;
+    std::complex<double> b2;
+    for (auto j=a.size(); j-->0; )
+    {
+        auto b0 = twoCos2Zeta*b1 - b2 + a[j];
+        b2 = b1;
+        b1 = b0;
+    }
+    return sin2Zeta*b1;
+}
+
+// Returns the angle normalized to the interval [-π, π]
+double normalizedAngle(double angle)
+{
+    return std::remainder(angle, 2.0*std::numbers::pi);
+}
+
+} // namespace
+
+
+
+//
+// Factory Methods
+//
+
+FileFormats::Projection FileFormats::Projection::transverseMercator(const Ellipsoid& ellipsoid, double latitudeOfOrigin, double centralMeridian, double scale, double falseEasting, double falseNorthing)
+{
+    Projection result;
+    result.m_method = Method::TransverseMercator;
+    result.setEllipsoid(ellipsoid);
+    result.m_lambda0 = qDegreesToRadians(centralMeridian);
+    result.m_falseEasting = falseEasting;
+    result.m_falseNorthing = falseNorthing;
+
+    // Krüger series in the third flattening n, see C. F. F. Karney,
+    // Transverse Mercator with an accuracy of a few nanometers, J. Geodesy 85
+    // (2011)
+    auto f = (ellipsoid.inverseFlattening == 0.0) ? 0.0 : 1.0/ellipsoid.inverseFlattening;
+    auto n = f/(2.0 - f);
+    auto n2 = n*n;
+    auto n3 = n2*n;
+    auto n4 = n3*n;
+    auto n5 = n4*n;
+    auto n6 = n5*n;
+    result.m_kA = scale*ellipsoid.semiMajorAxis/(1.0 + n)*(1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+    result.m_alpha = {
+        n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0 + 41.0*n4/180.0 - 127.0*n5/288.0 + 7891.0*n6/37800.0,
+        13.0*n2/48.0 - 3.0*n3/5.0 + 557.0*n4/1440.0 + 281.0*n5/630.0 - 1983433.0*n6/1935360.0,
+        61.0*n3/240.0 - 103.0*n4/140.0 + 15061.0*n5/26880.0 + 167603.0*n6/181440.0,
+        49561.0*n4/161280.0 - 179.0*n5/168.0 + 6601661.0*n6/7257600.0,
+        34729.0*n5/80640.0 - 3418889.0*n6/1995840.0,
+        212378941.0*n6/319334400.0
+    };
+    result.m_beta = {
+        n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0 - n4/360.0 - 81.0*n5/512.0 + 96199.0*n6/604800.0,
+        n2/48.0 + n3/15.0 - 437.0*n4/1440.0 + 46.0*n5/105.0 - 1118711.0*n6/3870720.0,
+        17.0*n3/480.0 - 37.0*n4/840.0 - 209.0*n5/4480.0 + 5569.0*n6/90720.0,
+        4397.0*n4/161280.0 - 11.0*n5/504.0 - 830251.0*n6/7257600.0,
+        4583.0*n5/161280.0 - 108847.0*n6/3991680.0,
+        20648693.0*n6/638668800.0
+    };
+
+    // Northing of the latitude of origin on the central meridian
+    double x = 0.0;
+    double y = 0.0;
+    result.forwardTM(result.m_lambda0, qDegreesToRadians(latitudeOfOrigin), x, y);
+    result.m_xi0 = (y - falseNorthing)/result.m_kA;
+    return result;
+}
+
+FileFormats::Projection FileFormats::Projection::utm(const Ellipsoid& ellipsoid, int zone, bool north)
+{
+    return transverseMercator(ellipsoid, 0.0, 6.0*zone - 183.0, 0.9996, 500000.0, north ? 0.0 : 10000000.0);
+}
+
+FileFormats::Projection FileFormats::Projection::lambertConformalConic(const Ellipsoid& ellipsoid, double standardParallel1, double standardParallel2, double latitudeOfOrigin, double longitudeOfOrigin, double falseEasting, double falseNorthing)
+{
+    Projection result;
+    result.m_method = Method::LambertConformalConic;
+    result.setEllipsoid(ellipsoid);
+    result.m_lambda0 = qDegreesToRadians(longitudeOfOrigin);
+    result.m_falseEasting = falseEasting;
+    result.m_falseNorthing = falseNorthing;
+
+    auto phi1 = qDegreesToRadians(standardParallel1);
+    auto phi2 = qDegreesToRadians(standardParallel2);
+    auto m = [&result](double phi) { return std::cos(phi)/std::sqrt(1.0 - result.m_e2*std::sin(phi)*std::sin(phi)); };
+    auto m1 = m(phi1);
+    auto t1 = result.lambertT(phi1);
+    if (phi1 == phi2)
+    {
+        result.m_n = std::sin(phi1);
+    }
+    else
+    {
+        result.m_n = (std::log(m1) - std::log(m(phi2)))/(std::log(t1) - std::log(result.lambertT(phi2)));
+    }
+    result.m_aFk = result.m_a*m1/(result.m_n*std::pow(t1, result.m_n));
+    result.m_rF = result.m_aFk*std::pow(result.lambertT(qDegreesToRadians(latitudeOfOrigin)), result.m_n);
+    return result;
+}
+
+FileFormats::Projection FileFormats::Projection::lambertConformalConic1SP(const Ellipsoid& ellipsoid, double latitudeOfOrigin, double longitudeOfOrigin, double scale, double falseEasting, double falseNorthing)
+{
+    // The cone touches the ellipsoid at the latitude of origin, and the
+    // radius is scaled
+    auto result = lambertConformalConic(ellipsoid, latitudeOfOrigin, latitudeOfOrigin, latitudeOfOrigin, longitudeOfOrigin, falseEasting, falseNorthing);
+    result.m_aFk *= scale;
+    result.m_rF *= scale;
+    return result;
+}
+
+FileFormats::Projection FileFormats::Projection::fromGeoKeys(const GeoKeyDirectory& keys)
+{
+    switch (keys.modelType())
+    {
+    case GeoKeyDirectory::ModelTypeGeographic:
+        return {};
+    case GeoKeyDirectory::ModelTypeProjected:
+        break;
+    default:
+        throw QObject::tr("Model type %1 is not supported.", "FileFormats::Projection").arg(keys.modelType());
+    }
+
+    // Projected coordinate systems by EPSG code
+    auto code = keys.shortValue(GeoKeyDirectory::ProjectedCSType, GeoKeyDirectory::userDefined);
+    if ((code > 32600) && (code <= 32660))
+    {
+        return utm(wgs84, code - 32600, true);
+    }
+    if ((code > 32700) && (code <= 32760))
+    {
+        return utm(wgs84, code - 32700, false);
+    }
+    if ((code >= 25828) && (code <= 25838))
+    {
+        return utm(grs80, code - 25800, true);
+    }
+    if ((code > 26900) && (code <= 26923))
+    {
+        return utm(grs80, code - 26900, true);
+    }
+    if (code == 2154)
+    {
+        return lambertConformalConic(grs80, 49.0, 44.0, 46.5, 3.0, 700000.0, 6600000.0);
+    }
+    if (code == 3034)
+    {
+        return lambertConformalConic(grs80, 35.0, 65.0, 52.0, 10.0, 4000000.0, 2800000.0);
+    }
+    if (code != GeoKeyDirectory::userDefined)
+    {
+        throw QObject::tr("Projected coordinate system %1 is not supported.", "FileFormats::Projection").arg(code);
+    }
+
+    // User-defined projected coordinate systems, with UTM zones given by code
+    auto geoEllipsoid = ellipsoid(keys);
+    code = keys.shortValue(GeoKeyDirectory::Projection, GeoKeyDirectory::userDefined);
+    if ((code > 16000) && (code <= 16060))
+    {
+        return utm(geoEllipsoid, code - 16000, true);
+    }
+    if ((code > 16100) && (code <= 16160))
+    {
+        return utm(geoEllipsoid, code - 16100, false);
+    }
+    if (code != GeoKeyDirectory::userDefined)
+    {
+        throw QObject::tr("Projection %1 is not supported.", "FileFormats::Projection").arg(code);
+    }
+
+    // User-defined projections. Angles are given in the angular unit,
+    // eastings and northings in the linear unit. Writers differ in the keys
+    // used for the false origin of the Lambert Conformal Conic projection.
+    auto degrees = angularUnit(keys);
+    auto metres = linearUnit(keys);
+    auto angle = [&](quint16 key, double defaultValue) { return degrees*keys.doubleValue(key, defaultValue); };
+    auto length = [&](quint16 key, double defaultValue) { return metres*keys.doubleValue(key, defaultValue); };
+    auto falseEasting = length(GeoKeyDirectory::ProjFalseEasting, 0.0);
+    auto falseNorthing = length(GeoKeyDirectory::ProjFalseNorthing, 0.0);
+    auto natOriginLat = angle(GeoKeyDirectory::ProjNatOriginLat, 0.0);
+    auto natOriginLong = angle(GeoKeyDirectory::ProjNatOriginLong, 0.0);
+    auto scale = keys.doubleValue(GeoKeyDirectory::ProjScaleAtNatOrigin, 1.0);
+    switch (keys.shortValue(GeoKeyDirectory::ProjCoordTrans, 0))
+    {
+    case 1: // CT_TransverseMercator
+        return transverseMercator(geoEllipsoid, natOriginLat, natOriginLong, scale, falseEasting, falseNorthing);
+
+    case 8: // CT_LambertConfConic_2SP
+        return lambertConformalConic(geoEllipsoid,
+                                     angle(GeoKeyDirectory::ProjStdParallel1, 0.0),
+                                     angle(GeoKeyDirectory::ProjStdParallel2, keys.doubleValue(GeoKeyDirectory::ProjStdParallel1, 0.0)),
+                                     angle(GeoKeyDirectory::ProjFalseOriginLat, natOriginLat/degrees),
+                                     angle(GeoKeyDirectory::ProjFalseOriginLong, natOriginLong/degrees),
+                                     length(GeoKeyDirectory::ProjFalseOriginEasting, falseEasting/metres),
+                                     length(GeoKeyDirectory::ProjFalseOriginNorthing, falseNorthing/metres));
+
+    case 9: // CT_LambertConfConic_1SP
+        return lambertConformalConic1SP(geoEllipsoid, natOriginLat, natOriginLong, scale, falseEasting, falseNorthing);
+
+    default:
+        throw QObject::tr("Coordinate transformation %1 is not supported.", "FileFormats::Projection").arg(keys.shortValue(GeoKeyDirectory::ProjCoordTrans, 0));
+    }
+}
+
+
+
+//
+// Methods
+//
+
+QPointF FileFormats::Projection::forward(const QGeoCoordinate& coordinate) const
+{
+    double x = coordinate.longitude();
+    double y = coordinate.latitude();
+    forward({&x, 1}, {&y, 1}, {&x, 1}, {&y, 1});
+    return {x, y};
+}
+
+QGeoCoordinate FileFormats::Projection::inverse(const QPointF& point) const
+{
+    double longitude = point.x();
+    double latitude = point.y();
+    inverse({&longitude, 1}, {&latitude, 1}, {&longitude, 1}, {&latitude, 1});
+    if (std::isnan(longitude) || std::isnan(latitude))
+    {
+        return {};
+    }
+    return {latitude, longitude};
+}
+
+void FileFormats::Projection::forward(std::span<const double> longitudes, std::span<const double> latitudes, std::span<double> x, std::span<double> y) const
+{
+    auto count = qMin(qMin(longitudes.size(), latitudes.size()), qMin(x.size(), y.size()));
+    switch (m_method)
+    {
+    case Method::Geographic:
+        for (size_t i=0; i<count; ++i)
+        {
+            auto latitude = latitudes[i];
+            x[i] = longitudes[i];
+            y[i] = latitude;
+        }
+        break;
+
+    case Method::TransverseMercator:
+        for (size_t i=0; i<count; ++i)
+        {
+            forwardTM(qDegreesToRadians(longitudes[i]), qDegreesToRadians(latitudes[i]), x[i], y[i]);
+        }
+        break;
+
+    case Method::LambertConformalConic:
+        for (size_t i=0; i<count; ++i)
+        {
+            forwardLCC(qDegreesToRadians(longitudes[i]), qDegreesToRadians(latitudes[i]), x[i], y[i]);
+        }
+        break;
+    }
+}
+
+void FileFormats::Projection::inverse(std::span<const double> x, std::span<const double> y, std::span<double> longitudes, std::span<double> latitudes) const
+{
+    auto count = qMin(qMin(longitudes.size(), latitudes.size()), qMin(x.size(), y.size()));
+    double lambda = 0.0;
+    double phi = 0.0;
+    switch (m_method)
+    {
+    case Method::Geographic:
+        for (size_t i=0; i<count; ++i)
+        {
+            auto northing = y[i];
+            longitudes[i] = x[i];
+            latitudes[i] = northing;
+        }
+        break;
+
+    case Method::TransverseMercator:
+        for (size_t i=0; i<count; ++i)
+        {
+            inverseTM(x[i], y[i], lambda, phi);
+            longitudes[i] = qRadiansToDegrees(lambda);
+            latitudes[i] = qRadiansToDegrees(phi);
+        }
+        break;
+
+    case Method::LambertConformalConic:
+        for (size_t i=0; i<count; ++i)
+        {
+            inverseLCC(x[i], y[i], lambda, phi);
+            longitudes[i] = qRadiansToDegrees(lambda);
+            latitudes[i] = qRadiansToDegrees(phi);
+        }
+        break;
+    }
+}
+
+
+
+//
+// Static methods
+//
+
+double FileFormats::Projection::angularUnit(const GeoKeyDirectory& keys)
+{
+    auto code = keys.shortValue(GeoKeyDirectory::GeogAngularUnits, 9102);
+    switch (code)
+    {
+    case 9101: // Radian
+        return qRadiansToDegrees(1.0);
+    case 9102: // Degree
+        return 1.0;
+    case 9103: // Arc-minute
+        return 1.0/60.0;
+    case 9104: // Arc-second
+        return 1.0/3600.0;
+    case 9105: // Grad
+        return 0.9;
+    case GeoKeyDirectory::userDefined: // Size given in radians
+    {
+        auto size = keys.doubleValue(GeoKeyDirectory::GeogAngularUnitSize, 0.0);
+        if (size > 0.0)
+        {
+            return qRadiansToDegrees(size);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    throw QObject::tr("Angular unit %1 is not supported.", "FileFormats::Projection").arg(code);
+}
+
+double FileFormats::Projection::linearUnit(const GeoKeyDirectory& keys)
+{
+    auto code = keys.shortValue(GeoKeyDirectory::ProjLinearUnits, 9001);
+    switch (code)
+    {
+    case 9001: // Metre
+        return 1.0;
+    case 9002: // Foot
+        return 0.3048;
+    case 9003: // US survey foot
+        return 1200.0/3937.0;
+    case 9030: // Nautical mile
+        return 1852.0;
+    case 9036: // Kilometre
+        return 1000.0;
+    case GeoKeyDirectory::userDefined: // Size given in metres
+    {
+        auto size = keys.doubleValue(GeoKeyDirectory::ProjLinearUnitSize, 0.0);
+        if (size > 0.0)
+        {
+            return size;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    throw QObject::tr("Linear unit %1 is not supported.", "FileFormats::Projection").arg(code);
+}
+
+
+
+//
+// Private Methods
+//
+
+void FileFormats::Projection::setEllipsoid(const Ellipsoid& ellipsoid)
+{
+    auto f = (ellipsoid.inverseFlattening == 0.0) ? 0.0 : 1.0/ellipsoid.inverseFlattening;
+    m_a = ellipsoid.semiMajorAxis;
+    m_e2 = f*(2.0 - f);
+    m_e = std::sqrt(m_e2);
+}
+
+void FileFormats::Projection::forwardTM(double lambda, double phi, double& x, double& y) const
+{
+    // Conformal latitude, then Gauss-Schreiber coordinates ξ', η' on the
+    // sphere, then the Krüger series
+    auto taup = conformalTangent(std::tan(phi));
+    auto dLambda = normalizedAngle(lambda - m_lambda0);
+    auto xip = std::atan2(taup, std::cos(dLambda));
+    auto etap = std::asinh(std::sin(dLambda)/std::hypot(taup, std::cos(dLambda)));
+    auto sum = kruegerSum(m_alpha, xip, etap);
+    x = m_falseEasting + m_kA*(etap + sum.imag());
+    y = m_falseNorthing + m_kA*(xip + sum.real() - m_xi0);
+}
+
+void FileFormats::Projection::inverseTM(double x, double y, double& lambda, double& phi) const
+{
+    auto xi = (y - m_falseNorthing)/m_kA + m_xi0;
+    auto eta = (x - m_falseEasting)/m_kA;
+    auto sum = kruegerSum(m_beta, xi, eta);
+    auto xip = xi - sum.real();
+    auto etap = eta - sum.imag();
+    auto sinhEtap = std::sinh(etap);
+    auto cosXip = std::cos(xip);
+    auto taup = std::sin(xip)/std::hypot(sinhEtap, cosXip);
+    lambda = normalizedAngle(m_lambda0 + std::atan2(sinhEtap, cosXip));
+    phi = std::atan(geodeticTangent(taup));
+}
+
+void FileFormats::Projection::forwardLCC(double lambda, double phi, double& x, double& y) const
+{
+    auto r = m_aFk*std::pow(lambertT(phi), m_n);
+    auto theta = m_n*normalizedAngle(lambda - m_lambda0);
+    x = m_falseEasting + r*std::sin(theta);
+    y = m_falseNorthing + m_rF - r*std::cos(theta);
+}
+
+void FileFormats::Projection::inverseLCC(double x, double y, double& lambda, double& phi) const
+{
+    auto dx = x - m_falseEasting;
+    auto dy = m_rF - (y - m_falseNorthing);
+    auto sign = (m_n < 0.0) ? -1.0 : 1.0;
+    auto r = sign*std::hypot(dx, dy);
+    auto t = std::pow(r/m_aFk, 1.0/m_n);
+    auto theta = std::atan2(sign*dx, sign*dy);
+    lambda = normalizedAngle(theta/m_n + m_lambda0);
+
+    // t = tan(π/4 - χ/2), where χ is the conformal latitude, so that
+    // tan χ = (1 - t²)/(2t)
+    phi = std::atan(geodeticTangent((1.0 - t*t)/(2.0*t)));
+    if (std::isnan(t))
+    {
+        lambda = phi = std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+double FileFormats::Projection::conformalTangent(double tau) const
+{
+    if (!std::isfinite(tau))
+    {
+        return tau;
+    }
+    auto sigma = std::sinh(m_e*std::atanh(m_e*tau/std::hypot(1.0, tau)));
+    return tau*std::hypot(1.0, sigma) - sigma*std::hypot(1.0, tau);
+}
+
+double FileFormats::Projection::geodeticTangent(double taup) const
+{
+    // Newton's method, see Karney (2011), equation (19)
+    if (!std::isfinite(taup))
+    {
+        return taup;
+    }
+    auto e2m = 1.0 - m_e2;
+    auto tau = taup/e2m;
+    auto tolerance = 1e-15*qMax(1.0, std::abs(taup));
+    for (int i=0; i<5; ++i)
+    {
+        auto taupa = conformalTangent(tau);
+        auto dtau = (taup - taupa)*(1.0 + e2m*tau*tau)/(e2m*std::hypot(1.0, tau)*std::hypot(1.0, taupa));
+        tau += dtau;
+        if (!(std::abs(dtau) >= tolerance))
+        {
+            break;
+        }
+    }
+    return tau;
+}
+
+double FileFormats::Projection::lambertT(double phi) const
+{
+    auto eSinPhi = m_e*std::sin(phi);
+    return std::tan(std::numbers::pi/4.0 - phi/2.0)/std::pow((1.0 - eSinPhi)/(1.0 + eSinPhi), m_e/2.0);
+}
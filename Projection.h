@@ -0,0 +1,310 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoCoordinate>
+#include <QPointF>
+
+#include <array>
+#include <span>
+
+#include "GeoKeyDirectory.h"
+
+namespace FileFormats
+{
+
+/*! \brief Map projection
+ *
+ *  This class implements the forward and inverse map projections used by
+ *  aviation charts: Transverse Mercator, including UTM, and Lambert Conformal
+ *  Conic with one or two standard parallels. Formulas follow the EPSG
+ *  Guidance Note 7-2. Transverse Mercator uses the series of Krüger to sixth
+ *  order in the third flattening, which is accurate to a few nanometres
+ *  within 4000 km of the central meridian.
+ *
+ *  Constants that depend only on the coordinate reference system are computed
+ *  by the constructor, so that transforming a point costs a handful of
+ *  transcendental functions. Besides methods for single points, there are
+ *  batch methods that transform arrays of coordinates.
+ *
+ *  Projected coordinates are given in metres, geographic coordinates in
+ *  degrees. Datum shifts are not applied: geographic coordinates refer to the
+ *  datum of the coordinate reference system, which for all datums in use
+ *  with GPS (WGS 84, ETRS89, NAD83) differs from WGS 84 by less than 2 m.
+ */
+
+class Projection
+{
+public:
+    /*! \brief Projection methods */
+    enum class Method
+    {
+        Geographic,
+        TransverseMercator,
+        LambertConformalConic
+    };
+
+    /*! \brief Ellipsoid */
+    struct Ellipsoid
+    {
+        /*! \brief Semi-major axis in metres */
+        double semiMajorAxis {6378137.0};
+
+        /*! \brief Inverse flattening, or zero for a sphere */
+        double inverseFlattening {298.257223563};
+    };
+
+    /*! \brief Constructs the identity, for geographic coordinates */
+    Projection() = default;
+
+
+    //
+    // Factory Methods
+    //
+
+    /*! \brief Transverse Mercator projection
+     *
+     *  @param ellipsoid Ellipsoid
+     *
+     *  @param latitudeOfOrigin Latitude of natural origin in degrees
+     *
+     *  @param centralMeridian Longitude of natural origin in degrees
+     *
+     *  @param scale Scale factor at natural origin
+     *
+     *  @param falseEasting False easting in metres
+     *
+     *  @param falseNorthing False northing in metres
+     *
+     *  @returns Projection
+     */
+    [[nodiscard]] static Projection transverseMercator(const Ellipsoid& ellipsoid, double latitudeOfOrigin, double centralMeridian, double scale, double falseEasting, double falseNorthing);
+
+    /*! \brief Universal Transverse Mercator projection
+     *
+     *  @param ellipsoid Ellipsoid
+     *
+     *  @param zone Zone, between 1 and 60
+     *
+     *  @param north True for the northern hemisphere
+     *
+     *  @returns Projection
+     */
+    [[nodiscard]] static Projection utm(const Ellipsoid& ellipsoid, int zone, bool north);
+
+    /*! \brief Lambert Conformal Conic projection with two standard parallels
+     *
+     *  @param ellipsoid Ellipsoid
+     *
+     *  @param standardParallel1 Latitude of the first standard parallel in
+     *  degrees
+     *
+     *  @param standardParallel2 Latitude of the second standard parallel in
+     *  degrees
+     *
+     *  @param latitudeOfOrigin Latitude of false origin in degrees
+     *
+     *  @param longitudeOfOrigin Longitude of false origin in degrees
+     *
+     *  @param falseEasting Easting at false origin in metres
+     *
+     *  @param falseNorthing Northing at false origin in metres
+     *
+     *  @returns Projection
+     */
+    [[nodiscard]] static Projection lambertConformalConic(const Ellipsoid& ellipsoid, double standardParallel1, double standardParallel2, double latitudeOfOrigin, double longitudeOfOrigin, double falseEasting, double falseNorthing);
+
+    /*! \brief Lambert Conformal Conic projection with one standard parallel
+     *
+     *  @param ellipsoid Ellipsoid
+     *
+     *  @param latitudeOfOrigin Latitude of natural origin in degrees, which is
+     *  the standard parallel
+     *
+     *  @param longitudeOfOrigin Longitude of natural origin in degrees
+     *
+     *  @param scale Scale factor at natural origin
+     *
+     *  @param falseEasting False easting in metres
+     *
+     *  @param falseNorthing False northing in metres
+     *
+     *  @returns Projection
+     */
+    [[nodiscard]] static Projection lambertConformalConic1SP(const Ellipsoid& ellipsoid, double latitudeOfOrigin, double longitudeOfOrigin, double scale, double falseEasting, double falseNorthing);
+
+    /*! \brief Projection described by GeoKeys
+     *
+     *  Supports geographic coordinate systems, projected coordinate systems
+     *  given by EPSG code (UTM zones on WGS 84, ETRS89 and NAD83, ETRS89
+     *  Lambert Conformal Conic Europe, Lambert-93), and user-defined projected
+     *  coordinate systems that use one of the methods above.
+     *
+     *  @param keys GeoKeys of a GeoTIFF file
+     *
+     *  @returns Projection
+     *
+     *  @throws QString with a human-readable, translated error message if the
+     *  coordinate system is not supported
+     */
+    [[nodiscard]] static Projection fromGeoKeys(const GeoKeyDirectory& keys);
+
+
+    //
+    // Getter Methods
+    //
+
+    /*! \brief Projection method
+     *
+     *  @returns Method
+     */
+    [[nodiscard]] Method method() const { return m_method; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Project a geographic coordinate
+     *
+     *  @param coordinate Geographic coordinate
+     *
+     *  @returns Projected coordinate in metres. For Method::Geographic, this
+     *  is (longitude, latitude).
+     */
+    [[nodiscard]] QPointF forward(const QGeoCoordinate& coordinate) const;
+
+    /*! \brief Unproject a projected coordinate
+     *
+     *  @param point Projected coordinate in metres. For Method::Geographic,
+     *  this is (longitude, latitude).
+     *
+     *  @returns Geographic coordinate, or an invalid coordinate if the point
+     *  lies outside the domain of the projection
+     */
+    [[nodiscard]] QGeoCoordinate inverse(const QPointF& point) const;
+
+    /*! \brief Project arrays of geographic coordinates
+     *
+     *  The number of points is the smallest size of the four arrays. Output
+     *  arrays may be identical to input arrays.
+     *
+     *  @param longitudes Longitudes in degrees
+     *
+     *  @param latitudes Latitudes in degrees
+     *
+     *  @param x Output, eastings in metres
+     *
+     *  @param y Output, northings in metres
+     */
+    void forward(std::span<const double> longitudes, std::span<const double> latitudes, std::span<double> x, std::span<double> y) const;
+
+    /*! \brief Unproject arrays of projected coordinates
+     *
+     *  The number of points is the smallest size of the four arrays. Output
+     *  arrays may be identical to input arrays. Points outside the domain of
+     *  the projection yield NaN.
+     *
+     *  @param x Eastings in metres
+     *
+     *  @param y Northings in metres
+     *
+     *  @param longitudes Output, longitudes in degrees
+     *
+     *  @param latitudes Output, latitudes in degrees
+     */
+    void inverse(std::span<const double> x, std::span<const double> y, std::span<double> longitudes, std::span<double> latitudes) const;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Angular unit of GeoKeys
+     *
+     *  @param keys GeoKeys of a GeoTIFF file
+     *
+     *  @returns Size of the unit given by GeogAngularUnits in degrees, by
+     *  default 1
+     *
+     *  @throws QString with a human-readable, translated error message if the
+     *  unit is not supported
+     */
+    [[nodiscard]] static double angularUnit(const GeoKeyDirectory& keys);
+
+    /*! \brief Linear unit of GeoKeys
+     *
+     *  @param keys GeoKeys of a GeoTIFF file
+     *
+     *  @returns Size of the unit given by ProjLinearUnits in metres, by
+     *  default 1
+     *
+     *  @throws QString with a human-readable, translated error message if the
+     *  unit is not supported
+     */
+    [[nodiscard]] static double linearUnit(const GeoKeyDirectory& keys);
+
+private:
+    // Sets the constants that depend on the ellipsoid only
+    void setEllipsoid(const Ellipsoid& ellipsoid);
+
+    // Projects or unprojects one point. Angles are in radians.
+    void forwardTM(double lambda, double phi, double& x, double& y) const;
+    void inverseTM(double x, double y, double& lambda, double& phi) const;
+    void forwardLCC(double lambda, double phi, double& x, double& y) const;
+    void inverseLCC(double x, double y, double& lambda, double& phi) const;
+
+    // Conformal latitude as tangent, from the tangent of the latitude, and
+    // its inverse, which is solved by Newton's method
+    [[nodiscard]] double conformalTangent(double tau) const;
+    [[nodiscard]] double geodeticTangent(double taup) const;
+
+    // The factor t of the Lambert Conformal Conic projection
+    [[nodiscard]] double lambertT(double phi) const;
+
+    Method m_method {Method::Geographic};
+
+    // Ellipsoid: semi-major axis, eccentricity and its square
+    double m_a {0.0};
+    double m_e {0.0};
+    double m_e2 {0.0};
+
+    // Longitude of origin in radians, false easting and northing in metres
+    double m_lambda0 {0.0};
+    double m_falseEasting {0.0};
+    double m_falseNorthing {0.0};
+
+    // Transverse Mercator: scale times rectifying radius, Krüger
+    // coefficients of the forward and inverse series, and the value of ξ at
+    // the latitude of origin
+    double m_kA {0.0};
+    std::array<double, 6> m_alpha {};
+    std::array<double, 6> m_beta {};
+    double m_xi0 {0.0};
+
+    // Lambert Conformal Conic: cone constant n, a·F·k and radius at the
+    // latitude of origin
+    double m_n {0.0};
+    double m_aFk {0.0};
+    double m_rF {0.0};
+};
+
+} // namespace FileFormats
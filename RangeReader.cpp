@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "RangeReader.h"
+#include "TIFFTileCache.h"
+
+
+//
+// RangeReader
+//
+
+QVector<QByteArray> FileFormats::RangeReader::readRanges(const QVector<Range>& ranges)
+{
+    QVector<QByteArray> result;
+    result.reserve(ranges.size());
+    for (const auto& range : ranges)
+    {
+        result.append(read(range.offset, range.length));
+    }
+    return result;
+}
+
+std::unique_ptr<FileFormats::RangeReader> FileFormats::RangeReader::create(QIODevice& device)
+{
+    auto* file = qobject_cast<QFileDevice*>(&device);
+    if (file != nullptr)
+    {
+        auto mapped = std::make_unique<MappedRangeReader>(*file);
+        if (!mapped->data().isEmpty())
+        {
+            return mapped;
+        }
+    }
+    return std::make_unique<DeviceRangeReader>(device);
+}
+
+
+
+//
+// DeviceRangeReader
+//
+
+QByteArray FileFormats::DeviceRangeReader::read(qint64 offset, qint64 length)
+{
+    if (length <= 0)
+    {
+        return {};
+    }
+    if (!m_device.seek(offset))
+    {
+        throw m_device.errorString();
+    }
+    return m_device.read(length);
+}
+
+QString FileFormats::DeviceRangeReader::identity() const
+{
+    auto* file = qobject_cast<QFileDevice*>(&m_device);
+    if (file == nullptr)
+    {
+        return {};
+    }
+    return TIFFTileCache::fileIdentity(file->fileName());
+}
+
+
+
+//
+// MappedRangeReader
+//
+
+FileFormats::MappedRangeReader::MappedRangeReader(QFileDevice& file)
+    : m_file(file)
+{
+    auto size = file.size();
+    m_mapping = (size > 0) ? file.map(0, size) : nullptr;
+    if (m_mapping != nullptr)
+    {
+        m_data = QByteArrayView(m_mapping, size);
+    }
+}
+
+FileFormats::MappedRangeReader::~MappedRangeReader()
+{
+    if (m_mapping != nullptr)
+    {
+        m_file.unmap(m_mapping);
+    }
+}
+
+QByteArray FileFormats::MappedRangeReader::read(qint64 offset, qint64 length)
+{
+    if ((offset < 0) || (offset >= m_data.size()) || (length <= 0))
+    {
+        return {};
+    }
+    return m_data.sliced(offset, qMin(length, m_data.size() - offset)).toByteArray();
+}
+
+QString FileFormats::MappedRangeReader::identity() const
+{
+    return TIFFTileCache::fileIdentity(m_file.fileName());
+}
@@ -0,0 +1,189 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFileDevice>
+#include <QVector>
+
+#include <memory>
+
+namespace FileFormats
+{
+
+/*! \brief Random access to the bytes of a file
+ *
+ *  GeoTIFF and TIFFRaster read files through this interface. It reads byte
+ *  ranges at given offsets, and can fetch several ranges with a single
+ *  request, so that implementations for remote or archive-backed sources can
+ *  answer a batch with one round trip. Sources that are resident in memory
+ *  also provide their complete data, which readers then use without copying.
+ *
+ *  Readers are used by one thread at a time. The view returned by data() can
+ *  be used by several threads at once.
+ *
+ *  On failure, the methods of this class throw a QString with a
+ *  human-readable, translated error message.
+ */
+
+class RangeReader
+{
+public:
+    /*! \brief Byte range */
+    struct Range
+    {
+        /*! \brief Offset of the first byte */
+        qint64 offset {0};
+
+        /*! \brief Number of bytes */
+        qint64 length {0};
+    };
+
+    RangeReader() = default;
+    virtual ~RangeReader() = default;
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Size of the data
+     *
+     *  @returns Size of the data in bytes
+     */
+    [[nodiscard]] virtual qint64 size() = 0;
+
+    /*! \brief Read a byte range
+     *
+     *  @param offset Offset of the first byte
+     *
+     *  @param length Number of bytes
+     *
+     *  @returns Bytes of the range. Ranges that extend beyond the end of the
+     *  data are truncated.
+     */
+    [[nodiscard]] virtual QByteArray read(qint64 offset, qint64 length) = 0;
+
+    /*! \brief Read several byte ranges
+     *
+     *  The default implementation calls read() for every range.
+     *  Implementations that can answer several ranges with one request
+     *  override this method.
+     *
+     *  @param ranges Byte ranges, in any order
+     *
+     *  @returns Bytes of the ranges, in the order of the ranges, truncated as
+     *  in read()
+     */
+    [[nodiscard]] virtual QVector<QByteArray> readRanges(const QVector<Range>& ranges);
+
+    /*! \brief Complete data
+     *
+     *  @returns Complete data, if it is resident in memory, or an empty view
+     *  otherwise. The view remains valid as long as the reader exists.
+     */
+    [[nodiscard]] virtual QByteArrayView data() const { return {}; }
+
+    /*! \brief Identity of the data
+     *
+     *  @returns A string that changes whenever the data changes, used as key
+     *  in TIFFTileCache, or an empty string if the data cannot be
+     *  identified. Decoded strips and tiles are cached only for data that can
+     *  be identified.
+     */
+    [[nodiscard]] virtual QString identity() const { return {}; }
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Reader for a device
+     *
+     *  @param device Open, seekable device. The device must outlive the
+     *  reader.
+     *
+     *  @returns A MappedRangeReader if the device is a file that can be mapped
+     *  into memory, and a DeviceRangeReader otherwise
+     */
+    [[nodiscard]] static std::unique_ptr<RangeReader> create(QIODevice& device);
+
+private:
+    Q_DISABLE_COPY_MOVE(RangeReader)
+};
+
+
+/*! \brief Range reader for a QIODevice
+ *
+ *  Every range is read with a seek and a read.
+ */
+
+class DeviceRangeReader : public RangeReader
+{
+public:
+    /*! \brief Constructor
+     *
+     *  @param device Open, seekable device. The device must outlive the
+     *  reader.
+     */
+    DeviceRangeReader(QIODevice& device) : m_device(device) {}
+
+    [[nodiscard]] qint64 size() override { return m_device.size(); }
+    [[nodiscard]] QByteArray read(qint64 offset, qint64 length) override;
+    [[nodiscard]] QString identity() const override;
+
+private:
+    QIODevice& m_device;
+};
+
+
+/*! \brief Range reader for a file that is mapped into memory
+ *
+ *  Ranges are copied from the mapped file, and data() gives access to the
+ *  complete file without copying.
+ */
+
+class MappedRangeReader : public RangeReader
+{
+public:
+    /*! \brief Constructor
+     *
+     *  Maps the file into memory. If this fails, the reader behaves like a
+     *  reader of an empty file, and data() is empty.
+     *
+     *  @param file Open file. The file must outlive the reader.
+     */
+    MappedRangeReader(QFileDevice& file);
+
+    ~MappedRangeReader() override;
+
+    [[nodiscard]] qint64 size() override { return m_data.size(); }
+    [[nodiscard]] QByteArray read(qint64 offset, qint64 length) override;
+    [[nodiscard]] QByteArrayView data() const override { return m_data; }
+    [[nodiscard]] QString identity() const override;
+
+private:
+    QFileDevice& m_file;
+    uchar* m_mapping {nullptr};
+    QByteArrayView m_data;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,291 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QObject>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <zlib.h>
+
+#include "TIFFCodecs.h"
+
+
+namespace {
+
+// Entry of the LZW string table. Every string in the table has been written
+// to the output before, so that a string is stored as its position in the
+// output and its length. Decoding a code is then a copy within the output.
+struct LZWEntry
+{
+    quint32 offset;
+    quint32 length;
+};
+
+// LZW codes with special meaning, and the largest code
+const quint16 lzwClearCode = 256;
+const quint16 lzwEndOfInformation = 257;
+const quint16 lzwFirstCode = 258;
+const quint16 lzwTableSize = 4096;
+
+// zlib stream, allocated once per thread and reset for every strip or tile
+struct Inflater
+{
+    Inflater()
+    {
+        isValid = (inflateInit(&stream) == Z_OK);
+    }
+    ~Inflater()
+    {
+        if (isValid)
+        {
+            inflateEnd(&stream);
+        }
+    }
+    Q_DISABLE_COPY_MOVE(Inflater)
+
+    z_stream stream {};
+    bool isValid {false};
+};
+
+} // namespace
+
+
+
+bool FileFormats::TIFFCodecs::isSupported(quint16 compression)
+{
+    switch (compression)
+    {
+    case 1:
+    case 5:
+    case 8:
+    case 32773:
+    case 32946:
+        return true;
+    default:
+        return false;
+    }
+}
+
+qsizetype FileFormats::TIFFCodecs::decompress(quint16 compression, QByteArrayView input, std::span<uchar> output)
+{
+    switch (compression)
+    {
+    case 1:
+    {
+        auto size = qMin(qsizetype(output.size()), input.size());
+        memcpy(output.data(), input.data(), size);
+        return size;
+    }
+    case 5:
+        return decompressLZW(input, output);
+    case 8:
+    case 32946:
+        return decompressDeflate(input, output);
+    case 32773:
+        return decompressPackBits(input, output);
+    default:
+        throw QObject::tr("Compression scheme %1 is not supported.", "FileFormats::TIFFCodecs").arg(compression);
+    }
+}
+
+qsizetype FileFormats::TIFFCodecs::decompressLZW(QByteArrayView input, std::span<uchar> output)
+{
+    std::array<LZWEntry, lzwTableSize> table;
+
+    const auto* in = reinterpret_cast<const uchar*>(input.data());
+    const auto* inEnd = in + input.size();
+    auto* outBegin = output.data();
+    auto* out = outBegin;
+    auto* outEnd = out + output.size();
+
+    // Codes are packed most significant bit first. The bit buffer holds the
+    // next bits of the input, left-aligned.
+    quint64 bitBuffer = 0;
+    int bitCount = 0;
+    int codeLength = 9;
+    quint16 nextCode = lzwFirstCode;
+    int oldCode = -1;
+    uchar* oldString = nullptr;
+
+    while (out < outEnd)
+    {
+        if (bitCount < codeLength)
+        {
+            while ((bitCount <= 56) && (in < inEnd))
+            {
+                bitBuffer |= quint64(*in++) << (56 - bitCount);
+                bitCount += 8;
+            }
+            if (bitCount < codeLength)
+            {
+                break;
+            }
+        }
+        auto code = quint16(bitBuffer >> (64 - codeLength));
+        bitBuffer <<= codeLength;
+        bitCount -= codeLength;
+
+        if (code < 256)
+        {
+            // Single byte. Its string in the table, if added, is the old
+            // string followed by this byte.
+            if ((oldCode >= 0) && (nextCode < lzwTableSize))
+            {
+                table[nextCode] = {quint32(oldString - outBegin), quint32(out - oldString + 1)};
+                ++nextCode;
+            }
+            oldString = out;
+            *out++ = uchar(code);
+            oldCode = code;
+        }
+        else if (code >= lzwFirstCode)
+        {
+            if ((oldCode < 0) || (code > nextCode))
+            {
+                throw QObject::tr("Corrupt LZW data.", "FileFormats::TIFFCodecs");
+            }
+
+            // The new string in the table is the old string, followed by the
+            // first byte of the current string. Since the current string is
+            // written right after the old string, the new string starts at
+            // the old string and is one byte longer. If the current code is
+            // the new code, the current string is the new string.
+            if (nextCode < lzwTableSize)
+            {
+                table[nextCode] = {quint32(oldString - outBegin), quint32(out - oldString + 1)};
+                ++nextCode;
+            }
+            else if (code == nextCode)
+            {
+                throw QObject::tr("Corrupt LZW data.", "FileFormats::TIFFCodecs");
+            }
+
+            const auto& entry = table[code];
+            const auto* source = outBegin + entry.offset;
+            auto length = qMin(qsizetype(entry.length), outEnd - out);
+            oldString = out;
+            if (source + length <= out)
+            {
+                memcpy(out, source, length);
+            }
+            else
+            {
+                // Source and destination overlap
+                for (qsizetype i=0; i<length; ++i)
+                {
+                    out[i] = source[i];
+                }
+            }
+            out += length;
+            oldCode = code;
+        }
+        else if (code == lzwClearCode)
+        {
+            codeLength = 9;
+            nextCode = lzwFirstCode;
+            oldCode = -1;
+            continue;
+        }
+        else
+        {
+            break;
+        }
+
+        // TIFF increases the code length one code early
+        if ((nextCode >= (1 << codeLength) - 1) && (codeLength < 12))
+        {
+            ++codeLength;
+        }
+    }
+
+    return out - outBegin;
+}
+
+qsizetype FileFormats::TIFFCodecs::decompressDeflate(QByteArrayView input, std::span<uchar> output)
+{
+    thread_local Inflater inflater;
+    if (!inflater.isValid || (inflateReset(&inflater.stream) != Z_OK))
+    {
+        throw QObject::tr("Cannot initialize zlib.", "FileFormats::TIFFCodecs");
+    }
+
+    // zlib counts in uInt. Strips and tiles larger than 4 GB do not appear in
+    // practice.
+    auto& stream = inflater.stream;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = uInt(input.size());
+    stream.next_out = output.data();
+    stream.avail_out = uInt(output.size());
+
+    auto result = inflate(&stream, Z_FINISH);
+    if ((result != Z_STREAM_END) && (result != Z_BUF_ERROR) && (result != Z_OK))
+    {
+        throw QObject::tr("Corrupt Deflate data.", "FileFormats::TIFFCodecs");
+    }
+    return qsizetype(output.size()) - stream.avail_out;
+}
+
+qsizetype FileFormats::TIFFCodecs::decompressPackBits(QByteArrayView input, std::span<uchar> output)
+{
+    const auto* in = reinterpret_cast<const uchar*>(input.data());
+    const auto* inEnd = in + input.size();
+    auto* out = output.data();
+    auto* outEnd = out + output.size();
+
+    while ((in < inEnd) && (out < outEnd))
+    {
+        auto header = qint8(*in++);
+        if (header >= 0)
+        {
+            // Literal run of header+1 bytes
+            auto count = std::min<qsizetype>({header + 1, inEnd - in, outEnd - out});
+            memcpy(out, in, count);
+            in += count;
+            out += count;
+        }
+        else if (header != -128)
+        {
+            // Byte repeated 1-header times
+            if (in == inEnd)
+            {
+                break;
+            }
+            auto count = qMin<qsizetype>(1 - header, outEnd - out);
+            memset(out, *in++, count);
+            out += count;
+        }
+    }
+
+    return out - output.data();
+}
+
+QByteArray FileFormats::TIFFCodecs::compressDeflate(QByteArrayView input, int level)
+{
+    auto bound = compressBound(uLong(input.size()));
+    QByteArray output(qsizetype(bound), Qt::Uninitialized);
+    auto size = bound;
+    if (compress2(reinterpret_cast<Bytef*>(output.data()), &size, reinterpret_cast<const Bytef*>(input.data()), uLong(input.size()), level) != Z_OK)
+    {
+        throw QObject::tr("Cannot compress data.", "FileFormats::TIFFCodecs");
+    }
+    output.truncate(qsizetype(size));
+    return output;
+}
@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+#include <span>
+
+namespace FileFormats::TIFFCodecs
+{
+
+/*! \brief Decompressors for TIFF strips and tiles
+ *
+ *  The functions in this namespace decode the compressed data of a single
+ *  strip or tile into a buffer provided by the caller. Apart from one zlib
+ *  stream per thread, which is reused for all Deflate data decoded by that
+ *  thread, they do not allocate memory. Decoding stops when the output buffer
+ *  is full, so that padding at the end of the compressed data is ignored.
+ *
+ *  On failure, the functions throw a QString with a human-readable,
+ *  translated error message.
+ */
+
+
+/*! \brief Check if a compression scheme is supported
+ *
+ *  @param compression Value of the TIFF tag Compression
+ *
+ *  @returns True if decompress() can decode data compressed with the scheme
+ */
+[[nodiscard]] bool isSupported(quint16 compression);
+
+/*! \brief Decompress data
+ *
+ *  This method calls the decompressor that belongs to the compression scheme.
+ *
+ *  @param compression Value of the TIFF tag Compression
+ *
+ *  @param input Compressed data
+ *
+ *  @param output Buffer for the decompressed data
+ *
+ *  @returns Number of bytes written to output
+ */
+qsizetype decompress(quint16 compression, QByteArrayView input, std::span<uchar> output);
+
+/*! \brief Decompress LZW data (compression scheme 5)
+ *
+ *  @param input Compressed data
+ *
+ *  @param output Buffer for the decompressed data
+ *
+ *  @returns Number of bytes written to output
+ */
+qsizetype decompressLZW(QByteArrayView input, std::span<uchar> output);
+
+/*! \brief Decompress Deflate data (compression schemes 8 and 32946)
+ *
+ *  @param input Compressed data, in zlib format
+ *
+ *  @param output Buffer for the decompressed data
+ *
+ *  @returns Number of bytes written to output
+ */
+qsizetype decompressDeflate(QByteArrayView input, std::span<uchar> output);
+
+/*! \brief Decompress PackBits data (compression scheme 32773)
+ *
+ *  @param input Compressed data
+ *
+ *  @param output Buffer for the decompressed data
+ *
+ *  @returns Number of bytes written to output
+ */
+qsizetype decompressPackBits(QByteArrayView input, std::span<uchar> output);
+
+/*! \brief Compress data with Deflate (compression scheme 8)
+ *
+ *  @param input Uncompressed data
+ *
+ *  @param level zlib compression level, between 1 (fastest) and 9 (best)
+ *
+ *  @returns Compressed data in zlib format
+ */
+[[nodiscard]] QByteArray compressDeflate(QByteArrayView input, int level = 6);
+
+} // namespace FileFormats::TIFFCodecs
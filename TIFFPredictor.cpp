@@ -0,0 +1,441 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cstring>
+
+#include "TIFFPredictor.h"
+
+// Vector code is compiled for x86 processors with GCC or Clang, using
+// function attributes, so that no special compiler flags are needed
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TIFFPREDICTOR_X86
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+using FileFormats::TIFFPredictor::Instructions;
+
+
+//
+// Scalar code
+//
+
+// Prefix sum of the samples of one row, with a stride of P bytes and samples
+// of type T, starting at byte offset 'begin'
+template<typename T>
+void horizontalScalar(uchar* row, qsizetype begin, qsizetype bytes, int pixelBytes)
+{
+    auto stride = pixelBytes/qsizetype(sizeof(T));
+    auto* samples = reinterpret_cast<T*>(row);
+    for (auto i=qMax(begin, qsizetype(pixelBytes))/qsizetype(sizeof(T)); i<bytes/qsizetype(sizeof(T)); ++i)
+    {
+        samples[i] = T(samples[i] + samples[i - stride]);
+    }
+}
+
+// Differences of the samples of one row, with a stride of P bytes and samples
+// of type T. The row is processed from the end, so that every difference is
+// taken with the original value of the previous sample.
+template<typename T>
+void differencesScalar(uchar* row, qsizetype bytes, int pixelBytes)
+{
+    auto stride = pixelBytes/qsizetype(sizeof(T));
+    auto* samples = reinterpret_cast<T*>(row);
+    for (auto i=bytes/qsizetype(sizeof(T))-1; i>=stride; --i)
+    {
+        samples[i] = T(samples[i] - samples[i - stride]);
+    }
+}
+
+// Interleaves the byte planes of one row of floating point samples
+void interleaveScalar(const uchar* planes, uchar* row, qsizetype begin, qsizetype samples)
+{
+    for (auto i=begin; i<samples; ++i)
+    {
+        for (int byte=0; byte<4; ++byte)
+        {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            row[4*i + byte] = planes[(3 - byte)*samples + i];
+#else
+            row[4*i + byte] = planes[byte*samples + i];
+#endif
+        }
+    }
+}
+
+
+#ifdef TIFFPREDICTOR_X86
+
+//
+// SSE4.1
+//
+
+// Adds lanes of E bytes
+template<int E>
+__attribute__((target("sse4.1"))) inline __m128i add128(__m128i a, __m128i b)
+{
+    if constexpr (E == 1)
+    {
+        return _mm_add_epi8(a, b);
+    }
+    else
+    {
+        return _mm_add_epi16(a, b);
+    }
+}
+
+// Prefix sum of one block of 16 bytes that holds complete pixels of P bytes,
+// with samples of E bytes. Bytes that do not belong to a complete pixel are
+// left unchanged. Returns the prefix sum, plus the carry from the previous
+// blocks, and adds the last pixel of the block to the carry. The carry holds
+// one pixel, broadcast over the register. Only one addition depends on the
+// carry, so that consecutive blocks overlap in the pipeline.
+template<int P, int E>
+__attribute__((target("sse4.1"))) inline __m128i prefixSSE41(__m128i original, __m128i& carry, __m128i broadcast, __m128i keep)
+{
+    constexpr int blockBytes = (16/P)*P;
+
+    auto x = original;
+    x = add128<E>(x, _mm_slli_si128(x, P));
+    if constexpr (2*P < blockBytes)
+    {
+        x = add128<E>(x, _mm_slli_si128(x, 2*P));
+    }
+    if constexpr (4*P < blockBytes)
+    {
+        x = add128<E>(x, _mm_slli_si128(x, 4*P));
+    }
+    if constexpr (8*P < blockBytes)
+    {
+        x = add128<E>(x, _mm_slli_si128(x, 8*P));
+    }
+    auto result = add128<E>(x, carry);
+    carry = add128<E>(carry, _mm_shuffle_epi8(x, broadcast));
+    if constexpr (blockBytes < 16)
+    {
+        result = _mm_blendv_epi8(result, original, keep);
+    }
+    return result;
+}
+
+// Prefix sum of one row, for pixels of P bytes and samples of E bytes. Each
+// block handles as many complete pixels as fit into 16 bytes. Returns the
+// number of bytes processed.
+template<int P, int E>
+__attribute__((target("sse4.1"))) qsizetype horizontalSSE41(uchar* row, qsizetype bytes)
+{
+    constexpr int blockBytes = (16/P)*P;
+
+    // If P does not divide 16, consecutive blocks overlap. Loading a block
+    // right after storing the previous one then stalls store forwarding, so
+    // several blocks are loaded before any of them is stored.
+    constexpr int blocksPerIteration = (blockBytes < 16) ? 8 : 1;
+
+    // Shuffle that broadcasts the last pixel of a block, and mask of the
+    // bytes that do not belong to the block
+    alignas(16) uchar broadcastIndices[16];
+    alignas(16) uchar keepIndices[16];
+    for (int j=0; j<16; ++j)
+    {
+        broadcastIndices[j] = uchar(blockBytes - P + (j % P));
+        keepIndices[j] = (j >= blockBytes) ? 0xFF : 0x00;
+    }
+    auto const broadcast = _mm_load_si128(reinterpret_cast<const __m128i*>(broadcastIndices));
+    auto const keep = _mm_load_si128(reinterpret_cast<const __m128i*>(keepIndices));
+
+    auto carry = _mm_setzero_si128();
+    qsizetype i = 0;
+    for (; i + (blocksPerIteration-1)*blockBytes + 16 <= bytes; i += blocksPerIteration*blockBytes)
+    {
+        __m128i x[blocksPerIteration];
+        for (int block=0; block<blocksPerIteration; ++block)
+        {
+            x[block] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + block*blockBytes));
+        }
+        for (int block=0; block<blocksPerIteration; ++block)
+        {
+            x[block] = prefixSSE41<P, E>(x[block], carry, broadcast, keep);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i + block*blockBytes), x[block]);
+        }
+    }
+    for (; i + 16 <= bytes; i += blockBytes)
+    {
+        auto* pointer = reinterpret_cast<__m128i*>(row + i);
+        _mm_storeu_si128(pointer, prefixSSE41<P, E>(_mm_loadu_si128(pointer), carry, broadcast, keep));
+    }
+    return i;
+}
+
+// Interleaves 16 samples at a time. Returns the number of samples processed.
+__attribute__((target("sse4.1"))) qsizetype interleaveSSE41(const uchar* planes, uchar* row, qsizetype samples)
+{
+    qsizetype i = 0;
+    for (; i + 16 <= samples; i += 16)
+    {
+        auto p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + i));
+        auto p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + samples + i));
+        auto p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + 2*samples + i));
+        auto p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + 3*samples + i));
+
+        // Least significant byte first
+        auto low32 = _mm_unpacklo_epi8(p3, p2);
+        auto high32 = _mm_unpacklo_epi8(p1, p0);
+        auto low32b = _mm_unpackhi_epi8(p3, p2);
+        auto high32b = _mm_unpackhi_epi8(p1, p0);
+
+        auto* out = reinterpret_cast<__m128i*>(row + 4*i);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(low32, high32));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(low32, high32));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(low32b, high32b));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(low32b, high32b));
+    }
+    return i;
+}
+
+
+//
+// AVX2
+//
+
+// Adds lanes of E bytes
+template<int E>
+__attribute__((target("avx2"))) inline __m256i add256(__m256i a, __m256i b)
+{
+    if constexpr (E == 1)
+    {
+        return _mm256_add_epi8(a, b);
+    }
+    else
+    {
+        return _mm256_add_epi16(a, b);
+    }
+}
+
+// Prefix sum of one row, for pixels of P bytes and samples of E bytes, where
+// P divides 16. The prefix sum is computed in each 128-bit half, and the last
+// pixel of the lower half is then added to the upper half. Returns the number
+// of bytes processed.
+template<int P, int E>
+__attribute__((target("avx2"))) qsizetype horizontalAVX2(uchar* row, qsizetype bytes)
+{
+    static_assert(16 % P == 0);
+
+    alignas(32) uchar broadcastIndices[32];
+    for (int j=0; j<32; ++j)
+    {
+        broadcastIndices[j] = uchar(16 - P + (j % P));
+    }
+    auto const broadcast = _mm256_load_si256(reinterpret_cast<const __m256i*>(broadcastIndices));
+
+    auto carry = _mm256_setzero_si256();
+    qsizetype i = 0;
+    for (; i + 32 <= bytes; i += 32)
+    {
+        auto* pointer = reinterpret_cast<__m256i*>(row + i);
+        auto x = _mm256_loadu_si256(pointer);
+        x = add256<E>(x, _mm256_slli_si256(x, P));
+        if constexpr (2*P < 16)
+        {
+            x = add256<E>(x, _mm256_slli_si256(x, 2*P));
+        }
+        if constexpr (4*P < 16)
+        {
+            x = add256<E>(x, _mm256_slli_si256(x, 4*P));
+        }
+        if constexpr (8*P < 16)
+        {
+            x = add256<E>(x, _mm256_slli_si256(x, 8*P));
+        }
+        auto last = _mm256_shuffle_epi8(x, broadcast);
+        x = add256<E>(x, _mm256_permute2x128_si256(last, last, 0x08));
+
+        // Only one addition depends on the carry from the previous block
+        _mm256_storeu_si256(pointer, add256<E>(x, carry));
+        last = _mm256_shuffle_epi8(x, broadcast);
+        carry = add256<E>(carry, _mm256_permute2x128_si256(last, last, 0x11));
+    }
+    return i;
+}
+
+#endif
+
+
+//
+// Dispatch
+//
+
+// Prefix sum of one row, for pixels of P bytes and samples of E bytes
+template<int P, int E>
+void horizontalRow(uchar* row, qsizetype bytes, Instructions instructions)
+{
+    qsizetype done = 0;
+#ifdef TIFFPREDICTOR_X86
+    if constexpr (16 % P == 0)
+    {
+        if (instructions == Instructions::AVX2)
+        {
+            done = horizontalAVX2<P, E>(row, bytes);
+        }
+    }
+    if ((done == 0) && (instructions != Instructions::Scalar))
+    {
+        done = horizontalSSE41<P, E>(row, bytes);
+    }
+#else
+    Q_UNUSED(instructions)
+#endif
+    if constexpr (E == 1)
+    {
+        horizontalScalar<quint8>(row, done, bytes, P);
+    }
+    else
+    {
+        horizontalScalar<quint16>(row, done, bytes, P);
+    }
+}
+
+using RowFunction = void (*)(uchar*, qsizetype, Instructions);
+
+// Returns the row function for the given pixel layout, or nullptr
+RowFunction horizontalRowFunction(int samplesPerPixel, int bitsPerSample)
+{
+    if (bitsPerSample == 8)
+    {
+        switch (samplesPerPixel)
+        {
+        case 1:
+            return horizontalRow<1, 1>;
+        case 2:
+            return horizontalRow<2, 1>;
+        case 3:
+            return horizontalRow<3, 1>;
+        case 4:
+            return horizontalRow<4, 1>;
+        default:
+            return nullptr;
+        }
+    }
+    if (bitsPerSample == 16)
+    {
+        switch (samplesPerPixel)
+        {
+        case 1:
+            return horizontalRow<2, 2>;
+        case 2:
+            return horizontalRow<4, 2>;
+        case 3:
+            return horizontalRow<6, 2>;
+        case 4:
+            return horizontalRow<8, 2>;
+        default:
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+
+
+FileFormats::TIFFPredictor::Instructions FileFormats::TIFFPredictor::bestInstructions()
+{
+#ifdef TIFFPREDICTOR_X86
+    static const auto best = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Instructions::AVX2;
+        }
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            return Instructions::SSE41;
+        }
+        return Instructions::Scalar;
+    }();
+    return best;
+#else
+    return Instructions::Scalar;
+#endif
+}
+
+void FileFormats::TIFFPredictor::undoHorizontal(uchar* data, qsizetype rows, qsizetype pixelsPerRow, int samplesPerPixel, int bitsPerSample, Instructions instructions)
+{
+    auto rowFunction = horizontalRowFunction(samplesPerPixel, bitsPerSample);
+    if (rowFunction == nullptr)
+    {
+        return;
+    }
+
+    instructions = qMin(instructions, bestInstructions());
+    auto rowBytes = pixelsPerRow*samplesPerPixel*bitsPerSample/8;
+    for (qsizetype row=0; row<rows; ++row)
+    {
+        rowFunction(data + row*rowBytes, rowBytes, instructions);
+    }
+}
+
+void FileFormats::TIFFPredictor::applyHorizontal(uchar* data, qsizetype rows, qsizetype pixelsPerRow, int samplesPerPixel, int bitsPerSample)
+{
+    auto pixelBytes = samplesPerPixel*bitsPerSample/8;
+    auto rowBytes = pixelsPerRow*pixelBytes;
+    for (qsizetype row=0; row<rows; ++row)
+    {
+        if (bitsPerSample == 8)
+        {
+            differencesScalar<quint8>(data + row*rowBytes, rowBytes, pixelBytes);
+        }
+        else if (bitsPerSample == 16)
+        {
+            differencesScalar<quint16>(data + row*rowBytes, rowBytes, pixelBytes);
+        }
+    }
+}
+
+void FileFormats::TIFFPredictor::undoFloatingPoint(uchar* data, qsizetype rows, qsizetype pixelsPerRow, int samplesPerPixel, uchar* scratch, Instructions instructions)
+{
+    // The differences are taken between bytes, with a stride of one byte per
+    // sample
+    auto rowFunction = horizontalRowFunction(samplesPerPixel, 8);
+    if (rowFunction == nullptr)
+    {
+        return;
+    }
+
+    instructions = qMin(instructions, bestInstructions());
+    auto samples = pixelsPerRow*samplesPerPixel;
+    for (qsizetype row=0; row<rows; ++row)
+    {
+        auto* rowData = data + 4*row*samples;
+        rowFunction(rowData, 4*samples, instructions);
+        memcpy(scratch, rowData, 4*samples);
+
+        qsizetype done = 0;
+#ifdef TIFFPREDICTOR_X86
+        if (instructions != Instructions::Scalar)
+        {
+            done = interleaveSSE41(scratch, rowData, samples);
+        }
+#endif
+        interleaveScalar(scratch, rowData, done, samples);
+    }
+}
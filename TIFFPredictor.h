@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QtGlobal>
+
+namespace FileFormats::TIFFPredictor
+{
+
+/*! \brief Reversal of TIFF predictors
+ *
+ *  TIFF predictors store the difference between neighboring samples instead
+ *  of the samples themselves, which improves compression. Reversing a
+ *  predictor is a prefix sum along every row, which is inherently serial in
+ *  scalar code. The functions in this namespace use SSE4.1 or AVX2 if the
+ *  processor supports it, and fall back to scalar code otherwise. The
+ *  instruction set is determined at runtime, so that binaries built for
+ *  generic x86-64 processors still use the vector units.
+ *
+ *  All functions work in place, on decoded data whose samples are in native
+ *  byte order.
+ */
+
+
+/*! \brief Instruction sets */
+enum class Instructions
+{
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+/*! \brief Best instruction set supported by the processor
+ *
+ *  @returns Instruction set used by default
+ */
+[[nodiscard]] Instructions bestInstructions();
+
+/*! \brief Reverse horizontal differencing (predictor 2)
+ *
+ *  @param data Decoded data, in native byte order
+ *
+ *  @param rows Number of rows
+ *
+ *  @param pixelsPerRow Number of pixels per row
+ *
+ *  @param samplesPerPixel Number of samples per pixel, between 1 and 4
+ *
+ *  @param bitsPerSample Number of bits per sample, 8 or 16
+ *
+ *  @param instructions Instruction set. If the processor does not support
+ *  the instruction set, scalar code is used.
+ */
+void undoHorizontal(uchar* data, qsizetype rows, qsizetype pixelsPerRow, int samplesPerPixel, int bitsPerSample, Instructions instructions = bestInstructions());
+
+/*! \brief Apply horizontal differencing (predictor 2)
+ *
+ *  This is the inverse of undoHorizontal(), used when writing TIFF files.
+ *  Unlike the reversal, this has no serial dependency between neighboring
+ *  samples, so that the compiler can vectorize the scalar code.
+ *
+ *  @param data Data, in native byte order
+ *
+ *  @param rows Number of rows
+ *
+ *  @param pixelsPerRow Number of pixels per row
+ *
+ *  @param samplesPerPixel Number of samples per pixel, between 1 and 4
+ *
+ *  @param bitsPerSample Number of bits per sample, 8 or 16
+ */
+void applyHorizontal(uchar* data, qsizetype rows, qsizetype pixelsPerRow, int samplesPerPixel, int bitsPerSample);
+
+/*! \brief Reverse floating point differencing (predictor 3)
+ *
+ *  This predictor is defined for 32-bit floating point samples. The encoder
+ *  splits every row into byte planes, most significant byte first, and takes
+ *  differences between neighboring bytes.
+ *
+ *  @param data Decoded data. On return, the samples are in native byte order.
+ *
+ *  @param rows Number of rows
+ *
+ *  @param pixelsPerRow Number of pixels per row
+ *
+ *  @param samplesPerPixel Number of samples per pixel, between 1 and 4
+ *
+ *  @param scratch Buffer of at least 4*pixelsPerRow*samplesPerPixel bytes
+ *
+ *  @param instructions Instruction set. If the processor does not support
+ *  the instruction set, scalar code is used.
+ */
+void undoFloatingPoint(uchar* data, qsizetype rows, qsizetype pixelsPerRow, int samplesPerPixel, uchar* scratch, Instructions instructions = bestInstructions());
+
+} // namespace FileFormats::TIFFPredictor
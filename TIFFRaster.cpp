@@ -0,0 +1,725 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QMutex>
+#include <QScopeGuard>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "TIFFCodecs.h"
+#include "TIFFPredictor.h"
+#include "TIFFRaster.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// Work items, distributed over workers in contiguous ranges. A worker takes
+// items from the front of its own range. Once its range is empty, it steals
+// the back half of the largest range of another worker. Every range is packed
+// into a single 64-bit atomic, so that taking and stealing are single
+// compare-and-swap operations.
+class WorkStealingRanges
+{
+public:
+    WorkStealingRanges(qsizetype itemCount, int workerCount)
+        : m_ranges(workerCount)
+    {
+        for (int i=0; i<workerCount; ++i)
+        {
+            m_ranges[i] = pack(itemCount*i/workerCount, itemCount*(i+1)/workerCount);
+        }
+    }
+
+    // Returns the next item for the worker, or -1 if no items are left
+    qsizetype next(int worker)
+    {
+        auto& own = m_ranges[worker];
+        while (true)
+        {
+            auto range = own.load();
+            while (begin(range) < end(range))
+            {
+                if (own.compare_exchange_weak(range, pack(begin(range)+1, end(range))))
+                {
+                    return begin(range);
+                }
+            }
+
+            // Find the largest range
+            int victim = -1;
+            quint64 largest = 0;
+            for (int i=0; i<int(m_ranges.size()); ++i)
+            {
+                auto other = m_ranges[i].load();
+                if (end(other) > begin(other) + largest)
+                {
+                    victim = i;
+                    largest = end(other) - begin(other);
+                }
+            }
+            if (victim < 0)
+            {
+                return -1;
+            }
+
+            // Steal its back half, or its only item
+            range = m_ranges[victim].load();
+            if (begin(range) >= end(range))
+            {
+                continue;
+            }
+            auto middle = begin(range) + (end(range) - begin(range))/2;
+            if (m_ranges[victim].compare_exchange_strong(range, pack(begin(range), middle)))
+            {
+                own.store(pack(middle+1, end(range)));
+                return qsizetype(middle);
+            }
+        }
+    }
+
+private:
+    static quint64 pack(quint64 begin, quint64 end) { return (begin << 32) | end; }
+    static quint64 begin(quint64 range) { return range >> 32; }
+    static quint64 end(quint64 range) { return range & 0xFFFFFFFF; }
+
+    std::vector<std::atomic<quint64>> m_ranges;
+};
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+// Expands palette indices to colors, eight at a time. Returns the number of
+// indices processed.
+__attribute__((target("avx2"))) int expandIndicesAVX2(const uchar* indices, QRgb* colors, int count, const QRgb* colorTable)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto eight = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i), _mm256_i32gather_epi32(reinterpret_cast<const int*>(colorTable), eight, 4));
+    }
+    return i;
+}
+#endif
+
+// Expands palette indices to colors, using a color table with 256 entries
+void expandIndices(const uchar* indices, QRgb* colors, int count, const QRgb* colorTable)
+{
+    int i = 0;
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    if (FileFormats::TIFFPredictor::bestInstructions() == FileFormats::TIFFPredictor::Instructions::AVX2)
+    {
+        i = expandIndicesAVX2(indices, colors, count, colorTable);
+    }
+#endif
+    for (; i<count; ++i)
+    {
+        colors[i] = colorTable[indices[i]];
+    }
+}
+
+// Copies one row of pixels with samples of type T, converting samples to the
+// image format. Gray and alpha is expanded to RGBA. Gray and RGB are expanded
+// to RGBX if the image has four samples per pixel. Floating point samples
+// are opaque at 1.0.
+template<typename T>
+void copyRow(const uchar* source, uchar* destination, int pixels, int samplesPerPixel, int imageSamplesPerPixel, bool whiteIsZero)
+{
+    constexpr auto maximum = std::is_floating_point_v<T> ? T(1) : std::numeric_limits<T>::max();
+    const auto* in = reinterpret_cast<const T*>(source);
+    auto* out = reinterpret_cast<T*>(destination);
+
+    if (samplesPerPixel == 2)
+    {
+        // Gray and alpha
+        for (int x=0; x<pixels; ++x)
+        {
+            auto gray = whiteIsZero ? T(maximum - in[2*x]) : in[2*x];
+            out[4*x] = gray;
+            out[4*x+1] = gray;
+            out[4*x+2] = gray;
+            out[4*x+3] = in[2*x+1];
+        }
+    }
+    else if ((samplesPerPixel == 1) && (imageSamplesPerPixel == 4))
+    {
+        // Opaque gray
+        for (int x=0; x<pixels; ++x)
+        {
+            out[4*x] = in[x];
+            out[4*x+1] = in[x];
+            out[4*x+2] = in[x];
+            out[4*x+3] = maximum;
+        }
+    }
+    else if (whiteIsZero)
+    {
+        for (int x=0; x<pixels; ++x)
+        {
+            out[x] = T(maximum - in[x]);
+        }
+    }
+    else if (imageSamplesPerPixel != samplesPerPixel)
+    {
+        // Opaque RGB
+        for (int x=0; x<pixels; ++x)
+        {
+            out[4*x] = in[3*x];
+            out[4*x+1] = in[3*x+1];
+            out[4*x+2] = in[3*x+2];
+            out[4*x+3] = maximum;
+        }
+    }
+    else
+    {
+        memcpy(out, in, qsizetype(pixels)*samplesPerPixel*sizeof(T));
+    }
+}
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::TIFFRaster::TIFFRaster(const TIFFTagTable& fields, bool littleEndian, quint64 ifdOffset)
+    : m_littleEndian(littleEndian), m_ifdOffset(ifdOffset)
+{
+    // Raster size
+    auto width = fields.unsignedInteger(256, 0);
+    auto height = fields.unsignedInteger(257, 0);
+    if ((width == 0) || (height == 0) || (width > INT_MAX) || (height > INT_MAX))
+    {
+        throw QObject::tr("Invalid raster size.", "FileFormats::TIFFRaster");
+    }
+
+    // Samples. Unsigned integer samples have 8 or 16 bits, floating point
+    // samples have 32 bits, so that the sample type follows from the number
+    // of bytes per sample.
+    m_samplesPerPixel = int(fields.unsignedInteger(277, 1));
+    auto bitsPerSample = fields.unsignedInteger(258, 1);
+    auto allBitsPerSample = fields.unsignedIntegers(258);
+    auto sampleFormat = fields.unsignedInteger(339, 1);
+    auto floatingPoint = (sampleFormat == 3);
+    if ((floatingPoint ? (bitsPerSample != 32) : ((bitsPerSample != 8) && (bitsPerSample != 16))) || (allBitsPerSample.count(bitsPerSample) != allBitsPerSample.size()))
+    {
+        throw QObject::tr("Only 8 or 16 bits per sample, or 32-bit floating point samples are supported.", "FileFormats::TIFFRaster");
+    }
+    m_bytesPerSample = int(bitsPerSample/8);
+    if ((sampleFormat != 1) && !floatingPoint)
+    {
+        throw QObject::tr("Only unsigned integer and floating point samples are supported.", "FileFormats::TIFFRaster");
+    }
+    if (fields.unsignedInteger(284, 1) != 1)
+    {
+        throw QObject::tr("Planar sample layout is not supported.", "FileFormats::TIFFRaster");
+    }
+    m_compression = fields.unsignedInteger(259, 1);
+    if (!TIFFCodecs::isSupported(m_compression))
+    {
+        throw QObject::tr("Compression scheme %1 is not supported.", "FileFormats::TIFFRaster").arg(m_compression);
+    }
+    // Horizontal differencing applies to integer samples, floating point
+    // differencing to floating point samples
+    m_predictor = fields.unsignedInteger(317, 1);
+    if ((m_predictor != 1) && (m_predictor != (floatingPoint ? 3 : 2)))
+    {
+        throw QObject::tr("Predictor %1 is not supported.", "FileFormats::TIFFRaster").arg(m_predictor);
+    }
+    m_photometric = fields.unsignedInteger(262, 1);
+
+    // Image format. Associated alpha (ExtraSamples == 1) is premultiplied.
+    // There is no QImage format with three 16-bit samples, so 16-bit RGB is
+    // expanded to RGBX. Floating point samples are expanded to RGBX or
+    // RGBA, because QImage has no floating point formats with fewer samples.
+    auto premultiplied = (fields.unsignedInteger(338, 0) == 1);
+    auto rgba = QImage::Format_Invalid;
+    switch (m_bytesPerSample)
+    {
+    case 1:
+        rgba = premultiplied ? QImage::Format_RGBA8888_Premultiplied : QImage::Format_RGBA8888;
+        break;
+    case 2:
+        rgba = premultiplied ? QImage::Format_RGBA64_Premultiplied : QImage::Format_RGBA64;
+        break;
+    default:
+        rgba = premultiplied ? QImage::Format_RGBA32FPx4_Premultiplied : QImage::Format_RGBA32FPx4;
+        break;
+    }
+    switch (m_photometric)
+    {
+    case 0:
+        // Floating point samples have no maximum to invert against
+        if (floatingPoint)
+        {
+            break;
+        }
+        [[fallthrough]];
+    case 1:
+        if (m_samplesPerPixel == 1)
+        {
+            if (floatingPoint)
+            {
+                m_format = QImage::Format_RGBX32FPx4;
+            }
+            else
+            {
+                m_format = (m_bytesPerSample == 1) ? QImage::Format_Grayscale8 : QImage::Format_Grayscale16;
+            }
+        }
+        else if (m_samplesPerPixel == 2)
+        {
+            m_format = rgba;
+        }
+        break;
+    case 2:
+        if (m_samplesPerPixel == 3)
+        {
+            if (floatingPoint)
+            {
+                m_format = QImage::Format_RGBX32FPx4;
+            }
+            else
+            {
+                m_format = (m_bytesPerSample == 1) ? QImage::Format_RGB888 : QImage::Format_RGBX64;
+            }
+        }
+        else if (m_samplesPerPixel == 4)
+        {
+            m_format = rgba;
+        }
+        break;
+    case 3:
+        // Palette colors are opaque, so premultiplication does not change
+        // them
+        if ((m_samplesPerPixel == 1) && (m_bytesPerSample == 1))
+        {
+            auto colorMap = fields.unsignedIntegers(320);
+            if (colorMap.size() != 3*256)
+            {
+                throw QObject::tr("Invalid color map.", "FileFormats::TIFFRaster");
+            }
+            m_colorTable.reserve(256);
+            for (int i=0; i<256; ++i)
+            {
+                m_colorTable.append(qRgb(int(colorMap[i] >> 8), int(colorMap[256+i] >> 8), int(colorMap[512+i] >> 8)));
+            }
+            m_format = QImage::Format_ARGB32_Premultiplied;
+        }
+        break;
+    default:
+        break;
+    }
+    if (m_format == QImage::Format_Invalid)
+    {
+        throw QObject::tr("Photometric interpretation %1 with %2 samples per pixel is not supported.", "FileFormats::TIFFRaster").arg(m_photometric).arg(m_samplesPerPixel);
+    }
+
+    // Strips or tiles
+    m_size = QSize(int(width), int(height));
+    m_tiled = fields.contains(322);
+    if (m_tiled)
+    {
+        m_tileSize = QSize(int(fields.unsignedInteger(322, 0)), int(fields.unsignedInteger(323, 0)));
+        m_offsets = fields.unsignedIntegers(324);
+        m_byteCounts = fields.unsignedIntegers(325);
+    }
+    else
+    {
+        m_tileSize = QSize(int(width), int(qMin(fields.unsignedInteger(278, height), height)));
+        m_offsets = fields.unsignedIntegers(273);
+        m_byteCounts = fields.unsignedIntegers(279);
+    }
+    if (m_tileSize.isEmpty())
+    {
+        throw QObject::tr("Invalid tile size.", "FileFormats::TIFFRaster");
+    }
+    m_tilesAcross = (m_size.width() + m_tileSize.width() - 1) / m_tileSize.width();
+    auto tilesDown = (m_size.height() + m_tileSize.height() - 1) / m_tileSize.height();
+    if ((m_offsets.size() < m_tilesAcross*tilesDown) || (m_byteCounts.size() < m_offsets.size()))
+    {
+        throw QObject::tr("Strip or tile offsets are missing.", "FileFormats::TIFFRaster");
+    }
+    m_offsets.resize(m_tilesAcross*tilesDown);
+    m_byteCounts.resize(m_tilesAcross*tilesDown);
+
+    // BigTIFF offsets and byte counts are 64-bit values. Ranges of the file
+    // are addressed with signed 64-bit integers.
+    auto const maxOffset = quint64(std::numeric_limits<qint64>::max());
+    for (qsizetype index=0; index<m_offsets.size(); ++index)
+    {
+        if ((m_offsets[index] > maxOffset) || (m_byteCounts[index] > maxOffset - m_offsets[index]))
+        {
+            throw QObject::tr("Invalid strip or tile offset.", "FileFormats::TIFFRaster");
+        }
+    }
+}
+
+
+
+//
+// Methods
+//
+
+QImage FileFormats::TIFFRaster::readWindow(QIODevice& device, const QRect& window, const TIFFReadOptions& options) const
+{
+    auto reader = RangeReader::create(device);
+    return readWindow(*reader, window, options);
+}
+
+QImage FileFormats::TIFFRaster::readWindow(RangeReader& reader, const QRect& window, const TIFFReadOptions& options) const
+{
+    auto clipped = window.intersected(QRect(QPoint(0, 0), m_size));
+    if (clipped.isEmpty())
+    {
+        throw QObject::tr("The window does not intersect the raster.", "FileFormats::TIFFRaster");
+    }
+
+    // Palette images are either kept indexed or expanded while copying
+    auto keepIndexed = options.keepIndexed && !m_colorTable.isEmpty();
+    auto expandPalette = !options.keepIndexed && !m_colorTable.isEmpty();
+    QImage image(clipped.size(), keepIndexed ? QImage::Format_Indexed8 : m_format);
+    if (image.isNull())
+    {
+        throw QObject::tr("Cannot allocate memory.", "FileFormats::TIFFRaster");
+    }
+    if (keepIndexed)
+    {
+        image.setColorTable(m_colorTable);
+    }
+
+    // Read and decode only the strips or tiles that intersect the window
+    QVector<qsizetype> indices;
+    auto firstColumn = clipped.left() / m_tileSize.width();
+    auto lastColumn = clipped.right() / m_tileSize.width();
+    auto firstRow = clipped.top() / m_tileSize.height();
+    auto lastRow = clipped.bottom() / m_tileSize.height();
+    for (auto row=firstRow; row<=lastRow; ++row)
+    {
+        for (auto column=firstColumn; column<=lastColumn; ++column)
+        {
+            indices.append(row*m_tilesAcross + column);
+        }
+    }
+
+    // Decoded strips and tiles are cached only if the file can be identified.
+    // Those found in the cache are copied right away and not read.
+    QString fileIdentity;
+    if ((options.tileCache != nullptr) && (options.tileCache->budget() > 0))
+    {
+        fileIdentity = reader.identity();
+    }
+    if (!fileIdentity.isEmpty())
+    {
+        QVector<qsizetype> uncached;
+        for (auto index : indices)
+        {
+            auto cached = options.tileCache->find({fileIdentity, m_ifdOffset, index});
+            if (cached.isNull())
+            {
+                uncached.append(index);
+                continue;
+            }
+            copyTile(cached, index, image.bits(), image.bytesPerLine(), clipped, expandPalette);
+        }
+        indices = uncached;
+    }
+
+    // Data resident in memory is used in place. Otherwise, raw data is
+    // fetched in batches, each with one call to the reader, so that remote
+    // sources need few round trips. Batches are limited to half of the
+    // memory budget.
+    auto data = reader.data();
+    if (!data.isEmpty())
+    {
+        decodeTiles(indices, [&](qsizetype item) { return rawTile(data, indices[item]); }, image, clipped, expandPalette, fileIdentity, options);
+        return image;
+    }
+    for (qsizetype first=0; first<indices.size(); )
+    {
+        QVector<qsizetype> batch;
+        QVector<RangeReader::Range> batchRanges;
+        qint64 batchBytes = 0;
+        for (; (first < indices.size()) && (batch.isEmpty() || (batchBytes + qint64(m_byteCounts[indices[first]]) <= options.inFlightBudget/2)); ++first)
+        {
+            auto index = indices[first];
+            batch.append(index);
+            batchRanges.append(RangeReader::Range{qint64(m_offsets[index]), qint64(m_byteCounts[index])});
+            batchBytes += qint64(m_byteCounts[index]);
+        }
+
+        auto raw = reader.readRanges(batchRanges);
+        for (qsizetype i=0; i<batch.size(); ++i)
+        {
+            if (raw[i].size() != batchRanges[i].length)
+            {
+                throw QObject::tr("Cannot read data.", "FileFormats::TIFFRaster");
+            }
+        }
+        decodeTiles(batch, [&raw](qsizetype item) { return QByteArrayView(raw[item]); }, image, clipped, expandPalette, fileIdentity, options);
+    }
+    return image;
+}
+
+void FileFormats::TIFFRaster::decodeTiles(const QVector<qsizetype>& indices, const std::function<QByteArrayView(qsizetype)>& raw, QImage& image, const QRect& window, bool expandPalette, const QString& fileIdentity, const TIFFReadOptions& options) const
+{
+    if (indices.isEmpty())
+    {
+        return;
+    }
+
+    // Image data is accessed through a pointer, because QImage::scanLine() is
+    // not safe to call from several threads at once
+    auto* bits = image.bits();
+    auto bytesPerLine = image.bytesPerLine();
+
+    auto workerCount = int(qBound<qsizetype>(1, options.threadCount, indices.size()));
+    WorkStealingRanges ranges(indices.size(), workerCount);
+    auto budgetKiB = int(qBound<qint64>(1, options.inFlightBudget/1024, INT_MAX));
+    QSemaphore budget(budgetKiB);
+    QMutex errorMutex;
+    QString error;
+    std::atomic<bool> failed {false};
+
+    auto worker = [&](int workerIndex) {
+        // The buffer is reused for all strips or tiles decoded by this worker
+        QByteArray buffer;
+        for (auto item=ranges.next(workerIndex); (item >= 0) && !failed; item=ranges.next(workerIndex))
+        {
+            auto index = indices[item];
+            auto cost = int(qMin<quint64>((m_byteCounts[index] + decodedSize(index))/1024 + 1, budgetKiB));
+            budget.acquire(cost);
+            auto releaser = qScopeGuard([&budget, cost]() { budget.release(cost); });
+            try
+            {
+                auto tile = decodeTile(raw(item), index, buffer);
+                copyTile(tile, index, bits, bytesPerLine, window, expandPalette);
+
+                // Data used in place is not worth caching. The buffer is
+                // handed over to the cache, so that the next strip or tile
+                // does not overwrite it.
+                if (!fileIdentity.isEmpty() && (tile.data() == buffer.constData()))
+                {
+                    options.tileCache->insert({fileIdentity, m_ifdOffset, index}, buffer);
+                    buffer = QByteArray();
+                }
+            }
+            catch (QString& message)
+            {
+                QMutexLocker const locker(&errorMutex);
+                if (!failed)
+                {
+                    error = message;
+                    failed = true;
+                }
+            }
+        }
+    };
+
+    // Helper threads are started only if the global thread pool has threads
+    // available right away. The calling thread always works, and steals the
+    // work of helpers that could not be started. The semaphore is shared, so
+    // that it outlives the last release().
+    auto finished = std::make_shared<QSemaphore>();
+    int helperCount = 0;
+    for (int i=1; i<workerCount; ++i)
+    {
+        if (QThreadPool::globalInstance()->tryStart([&worker, finished, i]() {
+                worker(i);
+                finished->release();
+            }))
+        {
+            ++helperCount;
+        }
+    }
+    worker(0);
+    finished->acquire(helperCount);
+
+    if (failed)
+    {
+        throw error;
+    }
+}
+
+
+
+//
+// Static methods
+//
+
+QList<quint16> FileFormats::TIFFRaster::tags()
+{
+    return {256, 257, 258, 259, 262, 273, 277, 278, 279, 284, 317, 320, 322, 323, 324, 325, 338, 339};
+}
+
+
+
+//
+// Private Methods
+//
+
+QRect FileFormats::TIFFRaster::tileRect(qsizetype index) const
+{
+    auto column = index % m_tilesAcross;
+    auto row = index / m_tilesAcross;
+    QRect const rect(int(column)*m_tileSize.width(), int(row)*m_tileSize.height(), m_tileSize.width(), m_tileSize.height());
+    return rect.intersected(QRect(QPoint(0, 0), m_size));
+}
+
+qsizetype FileFormats::TIFFRaster::decodedSize(qsizetype index) const
+{
+    // Strips at the bottom of the raster may have fewer rows. Tiles are always
+    // complete.
+    auto rows = m_tiled ? m_tileSize.height() : tileRect(index).height();
+    return qsizetype(m_tileSize.width())*rows*m_samplesPerPixel*m_bytesPerSample;
+}
+
+QByteArrayView FileFormats::TIFFRaster::rawTile(QByteArrayView data, qsizetype index) const
+{
+    // Sparse files may omit strips or tiles
+    auto byteCount = m_byteCounts[index];
+    if (byteCount == 0)
+    {
+        return {};
+    }
+
+    auto offset = m_offsets[index];
+    if ((offset > quint64(data.size())) || (byteCount > quint64(data.size()) - offset))
+    {
+        throw QObject::tr("Cannot read data.", "FileFormats::TIFFRaster");
+    }
+    return data.sliced(qsizetype(offset), qsizetype(byteCount));
+}
+
+QByteArrayView FileFormats::TIFFRaster::decodeTile(QByteArrayView raw, qsizetype index, QByteArray& buffer) const
+{
+    auto size = decodedSize(index);
+    auto rows = int(size/(qsizetype(m_tileSize.width())*m_samplesPerPixel*m_bytesPerSample));
+
+    // Uncompressed 8-bit data without predictor is used in place. 16-bit and
+    // 32-bit data is copied, because it may need byte swapping and alignment.
+    if (!raw.isEmpty() && (m_compression == 1) && (m_predictor == 1) && (m_bytesPerSample == 1))
+    {
+        if (raw.size() < size)
+        {
+            throw QObject::tr("Strip or tile data is incomplete.", "FileFormats::TIFFRaster");
+        }
+        return raw.first(size);
+    }
+
+    buffer.resize(size);
+    auto* data = reinterpret_cast<uchar*>(buffer.data());
+    if (raw.isEmpty())
+    {
+        memset(data, 0, size);
+        return {buffer.constData(), size};
+    }
+    if (TIFFCodecs::decompress(m_compression, raw, {data, size_t(size)}) < size)
+    {
+        throw QObject::tr("Strip or tile data is incomplete.", "FileFormats::TIFFRaster");
+    }
+    if (m_bytesPerSample == 2)
+    {
+        if (m_littleEndian)
+        {
+            qFromLittleEndian<quint16>(data, size/2, data);
+        }
+        else
+        {
+            qFromBigEndian<quint16>(data, size/2, data);
+        }
+    }
+    else if ((m_bytesPerSample == 4) && (m_predictor != 3))
+    {
+        if (m_littleEndian)
+        {
+            qFromLittleEndian<quint32>(data, size/4, data);
+        }
+        else
+        {
+            qFromBigEndian<quint32>(data, size/4, data);
+        }
+    }
+    if (m_predictor == 2)
+    {
+        TIFFPredictor::undoHorizontal(data, rows, m_tileSize.width(), m_samplesPerPixel, 8*m_bytesPerSample);
+    }
+    else if (m_predictor == 3)
+    {
+        // Floating point differencing stores the bytes of every sample most
+        // significant first, regardless of the byte order of the file. The
+        // predictor restores native byte order.
+        QByteArray scratch(qsizetype(m_tileSize.width())*m_samplesPerPixel*m_bytesPerSample, Qt::Uninitialized);
+        TIFFPredictor::undoFloatingPoint(data, rows, m_tileSize.width(), m_samplesPerPixel, reinterpret_cast<uchar*>(scratch.data()));
+    }
+    return {buffer.constData(), size};
+}
+
+void FileFormats::TIFFRaster::copyTile(QByteArrayView tile, qsizetype index, uchar* bits, qsizetype bytesPerLine, const QRect& window, bool expandPalette) const
+{
+    auto rect = tileRect(index);
+    auto intersection = rect.intersected(window);
+    auto bytesPerPixel = qsizetype(m_samplesPerPixel)*m_bytesPerSample;
+    auto tileStride = m_tileSize.width()*bytesPerPixel;
+    auto pixels = intersection.width();
+
+    // Gray and alpha is expanded to RGBA, 16-bit RGB to RGBX, floating point
+    // samples always to four samples per pixel
+    auto imageSamplesPerPixel = ((m_samplesPerPixel == 2) || ((m_samplesPerPixel == 3) && (m_bytesPerSample == 2)) || (m_bytesPerSample == 4)) ? 4 : m_samplesPerPixel;
+    auto imageBytesPerPixel = expandPalette ? qsizetype(sizeof(QRgb)) : qsizetype(imageSamplesPerPixel)*m_bytesPerSample;
+    auto whiteIsZero = (m_photometric == 0);
+
+    for (auto y=intersection.top(); y<=intersection.bottom(); ++y)
+    {
+        const auto* source = reinterpret_cast<const uchar*>(tile.data()) + (y - rect.top())*tileStride + (intersection.left() - rect.left())*bytesPerPixel;
+        auto* destination = bits + (y - window.top())*bytesPerLine + (intersection.left() - window.left())*imageBytesPerPixel;
+        if (expandPalette)
+        {
+            expandIndices(source, reinterpret_cast<QRgb*>(destination), pixels, m_colorTable.constData());
+        }
+        else if (m_bytesPerSample == 1)
+        {
+            copyRow<quint8>(source, destination, pixels, m_samplesPerPixel, imageSamplesPerPixel, whiteIsZero);
+        }
+        else if (m_bytesPerSample == 2)
+        {
+            copyRow<quint16>(source, destination, pixels, m_samplesPerPixel, imageSamplesPerPixel, whiteIsZero);
+        }
+        else
+        {
+            copyRow<float>(source, destination, pixels, m_samplesPerPixel, imageSamplesPerPixel, whiteIsZero);
+        }
+    }
+}
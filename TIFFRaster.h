@@ -0,0 +1,298 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QIODevice>
+#include <QRect>
+
+#include <functional>
+
+#include "RangeReader.h"
+#include "TIFFTagTable.h"
+#include "TIFFTileCache.h"
+
+namespace FileFormats
+{
+
+/*! \brief Options for TIFFRaster::readWindow() */
+struct TIFFReadOptions
+{
+    /*! \brief Number of threads that decode strips or tiles
+     *
+     *  The calling thread is always one of them. Additional threads are
+     *  taken from the global thread pool, if available.
+     */
+    int threadCount {1};
+
+    /*! \brief Memory budget in bytes
+     *
+     *  Maximal amount of raw and decoded strip or tile data that is held in
+     *  memory at the same time, not counting the image that is returned.
+     *  A strip or tile that exceeds the budget on its own is decoded when
+     *  no other strip or tile is in flight.
+     */
+    qint64 inFlightBudget {64*1024*1024};
+
+    /*! \brief Keep palette images indexed
+     *
+     *  If true, palette images are returned in QImage::Format_Indexed8, with
+     *  the color map as color table. This takes a quarter of the memory of
+     *  the expanded image. Other images are not affected.
+     */
+    bool keepIndexed {false};
+
+    /*! \brief Cache for decoded strips and tiles
+     *
+     *  Strips and tiles of files are looked up in the cache before they are
+     *  read, and inserted after they are decoded. Reads from devices other
+     *  than files are not cached. Set to nullptr to disable caching.
+     */
+    TIFFTileCache* tileCache {&TIFFTileCache::global()};
+};
+
+/*! \brief Raster data of a TIFF image
+ *
+ *  This class describes the layout of the raster data of a TIFF image file
+ *  directory (strips or tiles, samples, compression) and reads rectangular
+ *  windows of the raster. Only the strips or tiles that intersect the window
+ *  are read and decoded, so that the cost of a read depends on the size of
+ *  the window and not on the size of the image.
+ *
+ *  Strips are treated as tiles that span the full width of the image, so
+ *  that both layouts share one code path.
+ *
+ *  This class is restricted to the rasters that appear in real-world aviation
+ *  charts and elevation data: 8 or 16 bits per sample or 32-bit floating
+ *  point samples, chunky sample layout, grayscale or RGB with optional alpha
+ *  channel, or 8-bit palette colors. The data may be uncompressed or
+ *  compressed with LZW, Deflate or PackBits, optionally with horizontal or
+ *  floating point differencing.
+ */
+
+class TIFFRaster
+{
+public:
+    /*! \brief Constructs a null raster */
+    TIFFRaster() = default;
+
+    /*! \brief Constructor
+     *
+     *  The constructor reads the raster layout from the TIFF fields. On
+     *  failure, it throws a QString with a human-readable, translated error
+     *  message.
+     *
+     *  \param fields TIFF fields of the image file directory. The values of
+     *  all tags listed in tags() must have been decoded.
+     *
+     *  \param littleEndian Byte order of the TIFF file
+     *
+     *  \param ifdOffset Offset of the image file directory in the TIFF file.
+     *  This identifies the raster in the tile cache.
+     */
+    TIFFRaster(const TIFFTagTable& fields, bool littleEndian = true, quint64 ifdOffset = 0);
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Check if the raster is null
+     *
+     *  @returns True if this raster was default-constructed
+     */
+    [[nodiscard]] bool isNull() const { return m_size.isEmpty(); }
+
+    /*! \brief Size of the raster
+     *
+     *  @returns Width and height of the raster in pixels
+     */
+    [[nodiscard]] QSize size() const { return m_size; }
+
+    /*! \brief Size of a tile
+     *
+     *  @returns Width and height of a tile in pixels. For rasters organized
+     *  in strips, the width of the raster and the number of rows per strip.
+     */
+    [[nodiscard]] QSize tileSize() const { return m_tileSize; }
+
+    /*! \brief Check if the raster is organized in tiles
+     *
+     *  @returns True if the raster is organized in tiles, false if it is
+     *  organized in strips
+     */
+    [[nodiscard]] bool isTiled() const { return m_tiled; }
+
+    /*! \brief Number of strips or tiles
+     *
+     *  @returns Number of strips or tiles
+     */
+    [[nodiscard]] qsizetype tileCount() const { return m_offsets.size(); }
+
+    /*! \brief Compression scheme
+     *
+     *  @returns Value of the TIFF tag Compression
+     */
+    [[nodiscard]] quint16 compression() const { return m_compression; }
+
+    /*! \brief Photometric interpretation
+     *
+     *  @returns Value of the TIFF tag PhotometricInterpretation
+     */
+    [[nodiscard]] quint16 photometric() const { return m_photometric; }
+
+    /*! \brief Format of images returned by readWindow()
+     *
+     *  @returns Image format. Palette images are expanded to
+     *  QImage::Format_ARGB32_Premultiplied, unless TIFFReadOptions::keepIndexed
+     *  is set. Floating point samples are returned in
+     *  QImage::Format_RGBX32FPx4 or one of the RGBA32FPx4 formats, with gray
+     *  replicated to red, green and blue. Their values are not scaled.
+     */
+    [[nodiscard]] QImage::Format format() const { return m_format; }
+
+    /*! \brief Color table of palette images
+     *
+     *  @returns Colors of the TIFF color map, reduced to 8 bits per
+     *  channel, or an empty list if this is not a palette image
+     */
+    [[nodiscard]] QList<QRgb> colorTable() const { return m_colorTable; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Read a window of the raster
+     *
+     *  The strips or tiles that intersect the window are distributed over
+     *  the decoding threads by work stealing: every thread starts with a
+     *  contiguous range of strips or tiles, and threads that run out of work
+     *  take over half of the largest remaining range. Decoded data is written
+     *  directly into the returned image.
+     *
+     *  If the reader provides the complete data in memory, the threads read
+     *  raw data from there without locking. Otherwise, the raw data of the
+     *  strips or tiles that are not found in the cache is fetched in batches,
+     *  with one call to RangeReader::readRanges() per batch.
+     *
+     *  On failure, this method throws a QString with a human-readable,
+     *  translated error message.
+     *
+     *  @param reader Reader from which the TIFF file is read
+     *
+     *  @param window Window in raster coordinates. The window is clipped to
+     *  the raster.
+     *
+     *  @param options Number of threads and memory budget
+     *
+     *  @returns Image of the clipped window, in format()
+     */
+    [[nodiscard]] QImage readWindow(RangeReader& reader, const QRect& window, const TIFFReadOptions& options = {}) const;
+
+    /*! \brief Read a window of the raster
+     *
+     *  This method reads through RangeReader::create(), so that files that
+     *  can be mapped into memory are read without copying.
+     *
+     *  @param device Device from which the TIFF file is read. The device must
+     *  be open and seekable.
+     *
+     *  @param window Window in raster coordinates. The window is clipped to
+     *  the raster.
+     *
+     *  @param options Number of threads and memory budget
+     *
+     *  @returns Image of the clipped window, in format()
+     */
+    [[nodiscard]] QImage readWindow(QIODevice& device, const QRect& window, const TIFFReadOptions& options = {}) const;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief TIFF tags that describe the raster layout
+     *
+     *  @returns Sorted list of the tags whose values are required by the
+     *  constructor
+     */
+    [[nodiscard]] static QList<quint16> tags();
+
+private:
+    // Returns the rectangle covered by the strip or tile, clipped to the
+    // raster
+    [[nodiscard]] QRect tileRect(qsizetype index) const;
+
+    // Returns the size of the strip or tile after decoding
+    [[nodiscard]] qsizetype decodedSize(qsizetype index) const;
+
+    // Returns the raw data of the strip or tile, as found in the complete
+    // file data. On failure, throws a QString with a human-readable,
+    // translated error message.
+    [[nodiscard]] QByteArrayView rawTile(QByteArrayView data, qsizetype index) const;
+
+    // Decodes raw data of the strip or tile. The
+    // result contains the samples of all rows of the strip or tile, each row
+    // tileSize().width() pixels wide. It points either into raw or into
+    // buffer, which is resized as needed and can be reused for all tiles. On
+    // failure, throws a QString with a human-readable, translated error
+    // message.
+    [[nodiscard]] QByteArrayView decodeTile(QByteArrayView raw, qsizetype index, QByteArray& buffer) const;
+
+    // Copies the part of a decoded strip or tile that lies within the window
+    // to the image data, converting samples to the image format. Palette
+    // indices are expanded to colors if expandPalette is true. The image
+    // data is accessed through a pointer, so that several threads can write
+    // to disjoint parts of the same image.
+    void copyTile(QByteArrayView tile, qsizetype index, uchar* bits, qsizetype bytesPerLine, const QRect& window, bool expandPalette) const;
+
+    // Decodes the strips or tiles with the given indices in parallel and
+    // copies them to the image, which holds the window. Raw data is
+    // returned by raw, which takes a position in indices and is called from
+    // several threads at once. Decoded strips and tiles are inserted into
+    // the cache if fileIdentity is not empty. On failure, throws a QString
+    // with a human-readable, translated error message.
+    void decodeTiles(const QVector<qsizetype>& indices, const std::function<QByteArrayView(qsizetype)>& raw, QImage& image, const QRect& window, bool expandPalette, const QString& fileIdentity, const TIFFReadOptions& options) const;
+
+    // Raster layout
+    QSize m_size;
+    QSize m_tileSize;
+    bool m_tiled {false};
+    qsizetype m_tilesAcross {0};
+
+    // Samples
+    quint16 m_compression {1};
+    quint16 m_photometric {1};
+    quint16 m_predictor {1};
+    int m_samplesPerPixel {1};
+    int m_bytesPerSample {1};
+    bool m_littleEndian {true};
+    quint64 m_ifdOffset {0};
+    QImage::Format m_format {QImage::Format_Invalid};
+    QList<QRgb> m_colorTable;
+
+    // Location of the strips or tiles in the file
+    QVector<quint64> m_offsets;
+    QVector<quint64> m_byteCounts;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,317 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <bit>
+
+#include "TIFFTagTable.h"
+
+
+//
+// Methods
+//
+
+void FileFormats::TIFFTagTable::insert(quint16 tag, quint16 type, quint32 count, QByteArrayView data, bool littleEndian)
+{
+    if (!isSupportedType(type) || (data.size() < qint64(typeSize(type))*count))
+    {
+        return;
+    }
+
+    // Offsets of image file directories are stored as LONG or LONG8 values
+    if (type == DT_Ifd)
+    {
+        type = DT_Long;
+    }
+    if (type == DT_Ifd8)
+    {
+        type = DT_Long8;
+    }
+
+    // Append values to the arena, byte-swapping arrays in bulk
+    Entry entry {tag, type, count, 0};
+    switch (type)
+    {
+    case DT_Ascii:
+        entry.offset = m_asciiArena.size();
+        m_asciiArena.append(data.data(), count);
+        break;
+    case DT_Short:
+        entry.offset = m_shortArena.size();
+        m_shortArena.resize(m_shortArena.size() + count);
+        if (littleEndian)
+        {
+            qFromLittleEndian<quint16>(data.data(), count, m_shortArena.data() + entry.offset);
+        }
+        else
+        {
+            qFromBigEndian<quint16>(data.data(), count, m_shortArena.data() + entry.offset);
+        }
+        break;
+    case DT_Long:
+        entry.offset = m_longArena.size();
+        m_longArena.resize(m_longArena.size() + count);
+        if (littleEndian)
+        {
+            qFromLittleEndian<quint32>(data.data(), count, m_longArena.data() + entry.offset);
+        }
+        else
+        {
+            qFromBigEndian<quint32>(data.data(), count, m_longArena.data() + entry.offset);
+        }
+        break;
+    case DT_Long8:
+        entry.offset = m_long8Arena.size();
+        m_long8Arena.resize(m_long8Arena.size() + count);
+        if (littleEndian)
+        {
+            qFromLittleEndian<quint64>(data.data(), count, m_long8Arena.data() + entry.offset);
+        }
+        else
+        {
+            qFromBigEndian<quint64>(data.data(), count, m_long8Arena.data() + entry.offset);
+        }
+        break;
+    case DT_Double:
+        entry.offset = m_doubleArena.size();
+        m_doubleArena.resize(m_doubleArena.size() + count);
+        if (littleEndian)
+        {
+            qFromLittleEndian<quint64>(data.data(), count, m_doubleArena.data() + entry.offset);
+        }
+        else
+        {
+            qFromBigEndian<quint64>(data.data(), count, m_doubleArena.data() + entry.offset);
+        }
+        break;
+    default:
+        break;
+    }
+
+    // Insert entry. Since TIFF files list their tags in ascending order, this
+    // is typically an append.
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), tag, [](const Entry& entry, quint16 tag) { return entry.tag < tag; });
+    if ((it != m_entries.end()) && (it->tag == tag))
+    {
+        *it = entry;
+        return;
+    }
+    m_entries.insert(it - m_entries.begin(), entry);
+}
+
+void FileFormats::TIFFTagTable::index(quint16 tag, quint16 type, quint32 count)
+{
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), tag, [](const Entry& entry, quint16 tag) { return entry.tag < tag; });
+    if ((it != m_entries.end()) && (it->tag == tag))
+    {
+        return;
+    }
+    m_entries.insert(it - m_entries.begin(), {tag, type, count, notDecoded});
+}
+
+void FileFormats::TIFFTagTable::squeeze()
+{
+    m_entries.squeeze();
+    m_asciiArena.squeeze();
+    m_shortArena.squeeze();
+    m_longArena.squeeze();
+    m_long8Arena.squeeze();
+    m_doubleArena.squeeze();
+}
+
+
+//
+// Getter methods
+//
+
+bool FileFormats::TIFFTagTable::isDecoded(quint16 tag) const
+{
+    const auto* entry = find(tag);
+    return (entry != nullptr) && (entry->offset != notDecoded);
+}
+
+QList<quint16> FileFormats::TIFFTagTable::tags() const
+{
+    QList<quint16> result;
+    result.reserve(m_entries.size());
+    for (const auto& entry : m_entries)
+    {
+        result.append(entry.tag);
+    }
+    return result;
+}
+
+QByteArrayView FileFormats::TIFFTagTable::ascii(quint16 tag) const
+{
+    const auto* entry = findDecoded(tag, DT_Ascii);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return {m_asciiArena.constData() + entry->offset, qsizetype(entry->count)};
+}
+
+std::span<const quint16> FileFormats::TIFFTagTable::shorts(quint16 tag) const
+{
+    const auto* entry = findDecoded(tag, DT_Short);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return {m_shortArena.constData() + entry->offset, entry->count};
+}
+
+std::span<const double> FileFormats::TIFFTagTable::doubles(quint16 tag) const
+{
+    const auto* entry = findDecoded(tag, DT_Double);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return {m_doubleArena.constData() + entry->offset, entry->count};
+}
+
+std::span<const quint32> FileFormats::TIFFTagTable::longs(quint16 tag) const
+{
+    const auto* entry = findDecoded(tag, DT_Long);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return {m_longArena.constData() + entry->offset, entry->count};
+}
+
+std::span<const quint64> FileFormats::TIFFTagTable::long8s(quint16 tag) const
+{
+    const auto* entry = findDecoded(tag, DT_Long8);
+    if (entry == nullptr)
+    {
+        return {};
+    }
+    return {m_long8Arena.constData() + entry->offset, entry->count};
+}
+
+QVector<quint64> FileFormats::TIFFTagTable::unsignedIntegers(quint16 tag) const
+{
+    auto shortValues = shorts(tag);
+    auto longValues = longs(tag);
+    auto long8Values = long8s(tag);
+
+    QVector<quint64> result;
+    result.reserve(qsizetype(shortValues.size() + longValues.size() + long8Values.size()));
+    for (auto value : shortValues)
+    {
+        result.append(value);
+    }
+    for (auto value : longValues)
+    {
+        result.append(value);
+    }
+    for (auto value : long8Values)
+    {
+        result.append(value);
+    }
+    return result;
+}
+
+quint64 FileFormats::TIFFTagTable::unsignedInteger(quint16 tag, quint64 defaultValue) const
+{
+    auto shortValues = shorts(tag);
+    if (!shortValues.empty())
+    {
+        return shortValues.front();
+    }
+    auto longValues = longs(tag);
+    if (!longValues.empty())
+    {
+        return longValues.front();
+    }
+    auto long8Values = long8s(tag);
+    if (!long8Values.empty())
+    {
+        return long8Values.front();
+    }
+    return defaultValue;
+}
+
+
+//
+// Static methods
+//
+
+int FileFormats::TIFFTagTable::typeSize(quint16 type)
+{
+    switch(type)
+    {
+    case DT_Byte:
+    case DT_SByte:
+    case DT_Ascii:
+    case DT_Undefined:
+        return 1;
+
+    case DT_Short:
+    case DT_SShort:
+        return 2;
+
+    case DT_Long:
+    case DT_SLong:
+    case DT_Ifd:
+    case DT_Float:
+        return 4;
+
+    case DT_Rational:
+    case DT_SRational:
+    case DT_Long8:
+    case DT_SLong8:
+    case DT_Ifd8:
+    case DT_Double:
+        return 8;
+
+    default:
+        return 0;
+    }
+}
+
+
+//
+// Private methods
+//
+
+const FileFormats::TIFFTagTable::Entry* FileFormats::TIFFTagTable::find(quint16 tag) const
+{
+    auto it = std::lower_bound(m_entries.cbegin(), m_entries.cend(), tag, [](const Entry& entry, quint16 tag) { return entry.tag < tag; });
+    if ((it == m_entries.cend()) || (it->tag != tag))
+    {
+        return nullptr;
+    }
+    return &*it;
+}
+
+const FileFormats::TIFFTagTable::Entry* FileFormats::TIFFTagTable::findDecoded(quint16 tag, quint16 type) const
+{
+    const auto* entry = find(tag);
+    if ((entry == nullptr) || (entry->type != type) || (entry->offset == notDecoded))
+    {
+        return nullptr;
+    }
+    return entry;
+}
@@ -0,0 +1,276 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+#include <span>
+
+namespace FileFormats
+{
+
+/*! \brief Compact table of TIFF tags
+ *
+ *  This class stores the TIFF fields found in an image file directory. The
+ *  table is a flat array of entries (tag, type, count, offset), sorted by tag.
+ *  The values themselves live in one contiguous arena per data type, in native
+ *  byte order, so that a table with any number of tags requires only a handful
+ *  of allocations.
+ *
+ *  Entries can be indexed without decoding their values, so that the table
+ *  knows about all tags of the directory while only the values that are
+ *  actually needed are read from the file.
+ *
+ *  Values of type ASCII, SHORT, LONG, LONG8 and DOUBLE are stored. Offsets of
+ *  image file directories (types IFD and IFD8) are stored as LONG and LONG8
+ *  values, respectively. Values of other types are indexed only.
+ */
+
+class TIFFTagTable
+{
+public:
+    /*! \brief TIFF data types, as specified in the TIFF standard */
+    enum DataType : quint16 {
+        DT_Byte = 1,
+        DT_Ascii,
+        DT_Short,
+        DT_Long,
+        DT_Rational,
+        DT_SByte,
+        DT_Undefined,
+        DT_SShort,
+        DT_SLong,
+        DT_SRational,
+        DT_Float,
+        DT_Double,
+        DT_Ifd,
+        DT_Long8 = 16,
+        DT_SLong8,
+        DT_Ifd8
+    };
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Decode and insert a TIFF field
+     *
+     *  If the type is not supported, this method does nothing. If the table
+     *  already contains an entry for the tag, the entry is replaced.
+     *
+     *  @param tag TIFF tag
+     *
+     *  @param type TIFF data type
+     *
+     *  @param count Number of values
+     *
+     *  @param data Raw data of the field, as found in the file. The size must
+     *  be at least the byte size of count values of the given type.
+     *
+     *  @param littleEndian Byte order of the raw data
+     */
+    void insert(quint16 tag, quint16 type, quint32 count, QByteArrayView data, bool littleEndian);
+
+    /*! \brief Index a TIFF field without decoding its values
+     *
+     *  If the table already contains an entry for the tag, this method does
+     *  nothing.
+     *
+     *  @param tag TIFF tag
+     *
+     *  @param type TIFF data type
+     *
+     *  @param count Number of values
+     */
+    void index(quint16 tag, quint16 type, quint32 count);
+
+    /*! \brief Release unused memory
+     *
+     *  Call this method once all fields have been inserted.
+     */
+    void squeeze();
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Check if a tag is contained in the table
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns True if the table contains an entry for the tag
+     */
+    [[nodiscard]] bool contains(quint16 tag) const { return find(tag) != nullptr; }
+
+    /*! \brief Check if the values of a tag have been decoded
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns True if the table contains an entry for the tag, and its
+     *  values are available through the typed accessors
+     */
+    [[nodiscard]] bool isDecoded(quint16 tag) const;
+
+    /*! \brief List of tags
+     *
+     *  @returns All tags contained in the table, in ascending order, no matter
+     *  if their values have been decoded or not
+     */
+    [[nodiscard]] QList<quint16> tags() const;
+
+    /*! \brief Values of an ASCII field
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns Raw bytes of the field, including all NUL characters. The view
+     *  is empty if the tag does not exist or has a different type. It remains
+     *  valid until the table is modified or destructed.
+     */
+    [[nodiscard]] QByteArrayView ascii(quint16 tag) const;
+
+    /*! \brief Values of a SHORT field
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns Values of the field. The span is empty if the tag does not
+     *  exist or has a different type. It remains valid until the table is
+     *  modified or destructed.
+     */
+    [[nodiscard]] std::span<const quint16> shorts(quint16 tag) const;
+
+    /*! \brief Values of a DOUBLE field
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns Values of the field. The span is empty if the tag does not
+     *  exist or has a different type. It remains valid until the table is
+     *  modified or destructed.
+     */
+    [[nodiscard]] std::span<const double> doubles(quint16 tag) const;
+
+    /*! \brief Values of a LONG field
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns Values of the field. The span is empty if the tag does not
+     *  exist or has a different type. It remains valid until the table is
+     *  modified or destructed.
+     */
+    [[nodiscard]] std::span<const quint32> longs(quint16 tag) const;
+
+    /*! \brief Values of a LONG8 field
+     *
+     *  LONG8 fields are found in BigTIFF files only.
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns Values of the field. The span is empty if the tag does not
+     *  exist or has a different type. It remains valid until the table is
+     *  modified or destructed.
+     */
+    [[nodiscard]] std::span<const quint64> long8s(quint16 tag) const;
+
+    /*! \brief Values of an unsigned integer field
+     *
+     *  The TIFF standard allows several fields, such as StripOffsets or
+     *  ImageWidth, to be stored either as SHORT or as LONG, and BigTIFF also
+     *  allows LONG8. This method returns the values of such fields, no matter
+     *  which type is used.
+     *
+     *  @param tag TIFF tag
+     *
+     *  @returns Values of the field, or an empty vector if the tag does not
+     *  exist, has not been decoded, or is neither SHORT, LONG nor LONG8
+     */
+    [[nodiscard]] QVector<quint64> unsignedIntegers(quint16 tag) const;
+
+    /*! \brief First value of an unsigned integer field
+     *
+     *  @param tag TIFF tag
+     *
+     *  @param defaultValue Value returned if the field has no value
+     *
+     *  @returns First value of the field, as in unsignedIntegers(), or
+     *  defaultValue
+     */
+    [[nodiscard]] quint64 unsignedInteger(quint16 tag, quint64 defaultValue) const;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Size of a TIFF data type
+     *
+     *  @param type TIFF data type
+     *
+     *  @returns Size of a single value of the given type in bytes, or zero if
+     *  the type is unknown.
+     */
+    [[nodiscard]] static int typeSize(quint16 type);
+
+    /*! \brief Check if a TIFF data type is stored in the table
+     *
+     *  @param type TIFF data type
+     *
+     *  @returns True if values of the given type are stored by insert()
+     */
+    [[nodiscard]] static bool isSupportedType(quint16 type) { return (type == DT_Ascii) || (type == DT_Short) || (type == DT_Long) || (type == DT_Ifd) || (type == DT_Long8) || (type == DT_Ifd8) || (type == DT_Double); }
+
+private:
+    // Entry of the table. The member 'offset' is the index of the first value
+    // in the arena that belongs to 'type', or notDecoded if the entry has only
+    // been indexed.
+    struct Entry
+    {
+        quint16 tag;
+        quint16 type;
+        quint32 count;
+        quint32 offset;
+    };
+
+    // Offset of entries whose values have not been decoded
+    static constexpr quint32 notDecoded = 0xFFFFFFFF;
+
+    // Returns a pointer to the entry for the tag, or nullptr if the tag does
+    // not exist
+    [[nodiscard]] const Entry* find(quint16 tag) const;
+
+    // Returns a pointer to the entry for the tag if the tag exists, its
+    // values have been decoded, and it has the given type. Otherwise, returns
+    // nullptr.
+    [[nodiscard]] const Entry* findDecoded(quint16 tag, quint16 type) const;
+
+    // Entries, sorted by tag
+    QVector<Entry> m_entries;
+
+    // Arenas
+    QByteArray m_asciiArena;
+    QVector<quint16> m_shortArena;
+    QVector<quint32> m_longArena;
+    QVector<quint64> m_long8Arena;
+    QVector<double> m_doubleArena;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,191 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include "TIFFTileCache.h"
+
+
+//
+// Constructors
+//
+
+FileFormats::TIFFTileCache::TIFFTileCache(qint64 budget)
+    : m_budget(qMax<qint64>(0, budget))
+{
+}
+
+
+
+//
+// Getter methods
+//
+
+qint64 FileFormats::TIFFTileCache::budget() const
+{
+    QReadLocker const locker(&m_lock);
+    return m_budget;
+}
+
+qint64 FileFormats::TIFFTileCache::size() const
+{
+    QReadLocker const locker(&m_lock);
+    return m_size;
+}
+
+
+
+//
+// Setter methods
+//
+
+void FileFormats::TIFFTileCache::setBudget(qint64 budget)
+{
+    QWriteLocker const locker(&m_lock);
+    m_budget = qMax<qint64>(0, budget);
+    evict(0);
+}
+
+
+
+//
+// Methods
+//
+
+void FileFormats::TIFFTileCache::clear()
+{
+    QWriteLocker const locker(&m_lock);
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_index.clear();
+    m_hand = 0;
+    m_size = 0;
+}
+
+QByteArray FileFormats::TIFFTileCache::find(const Key& key)
+{
+    QReadLocker const locker(&m_lock);
+    auto slot = m_index.constFind(key);
+    if (slot == m_index.constEnd())
+    {
+        ++m_misses;
+        return {};
+    }
+    ++m_hits;
+    auto& entry = m_slots[*slot];
+    entry.referenced.store(true, std::memory_order_relaxed);
+    return entry.data;
+}
+
+void FileFormats::TIFFTileCache::insert(const Key& key, const QByteArray& data)
+{
+    QWriteLocker const locker(&m_lock);
+    if ((data.size() > m_budget) || m_index.contains(key))
+    {
+        return;
+    }
+    evict(data.size());
+
+    qsizetype slot = 0;
+    if (m_freeSlots.isEmpty())
+    {
+        slot = qsizetype(m_slots.size());
+        m_slots.emplace_back();
+    }
+    else
+    {
+        slot = m_freeSlots.takeLast();
+    }
+    auto& entry = m_slots[slot];
+    entry.key = key;
+    entry.data = data;
+    entry.referenced.store(false, std::memory_order_relaxed);
+    m_index.insert(key, slot);
+    m_size += data.size();
+}
+
+void FileFormats::TIFFTileCache::resetCounters()
+{
+    m_hits = 0;
+    m_misses = 0;
+}
+
+
+
+//
+// Static methods
+//
+
+QString FileFormats::TIFFTileCache::fileIdentity(const QString& fileName)
+{
+    QFileInfo const info(fileName);
+    if (!info.exists())
+    {
+        return {};
+    }
+    return u"%1|%2|%3"_qs.arg(info.canonicalFilePath()).arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+}
+
+FileFormats::TIFFTileCache& FileFormats::TIFFTileCache::global()
+{
+    static TIFFTileCache cache;
+    return cache;
+}
+
+size_t FileFormats::qHash(const TIFFTileCache::Key& key, size_t seed)
+{
+    return qHashMulti(seed, key.file, key.ifd, key.tile);
+}
+
+
+
+//
+// Private Methods
+//
+
+void FileFormats::TIFFTileCache::evict(qint64 additionalBytes)
+{
+    // Entries that were used since the hand last passed get a second chance.
+    // Every pass clears all reference bits, so the loop ends after at most two
+    // passes over the slots.
+    while ((m_size > 0) && (m_size + additionalBytes > m_budget))
+    {
+        if (m_hand >= qsizetype(m_slots.size()))
+        {
+            m_hand = 0;
+        }
+        auto& entry = m_slots[m_hand];
+        if (!entry.data.isNull())
+        {
+            if (entry.referenced.exchange(false, std::memory_order_relaxed))
+            {
+                ++m_hand;
+                continue;
+            }
+            m_index.remove(entry.key);
+            m_size -= entry.data.size();
+            entry.data = QByteArray();
+            entry.key = Key();
+            m_freeSlots.append(m_hand);
+        }
+        ++m_hand;
+    }
+}
@@ -0,0 +1,210 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+
+#include <atomic>
+#include <deque>
+
+namespace FileFormats
+{
+
+/*! \brief Process-wide cache of decoded strips and tiles
+ *
+ *  TIFFRaster::readWindow() stores decoded strips and tiles in this cache, so
+ *  that overlapping windows read while a map is panned do not decompress the
+ *  same strip or tile twice. Entries are identified by the file, the image
+ *  file directory and the index of the strip or tile. The file identity
+ *  includes size and modification time, so that entries of modified files are
+ *  never returned.
+ *
+ *  The total size of the cached data is limited by a byte budget. Entries are
+ *  evicted with the CLOCK algorithm, an approximation of least-recently-used
+ *  that does not need to reorder entries on every lookup. Lookups therefore
+ *  only take a read lock and run concurrently; insertions take a write lock.
+ *
+ *  All methods are thread-safe.
+ */
+
+class TIFFTileCache
+{
+public:
+    /*! \brief Identity of a strip or tile */
+    struct Key
+    {
+        /*! \brief Identity of the file, see fileIdentity() */
+        QString file;
+
+        /*! \brief Offset of the image file directory in the file */
+        quint64 ifd {0};
+
+        /*! \brief Index of the strip or tile */
+        qsizetype tile {0};
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    /*! \brief Constructor
+     *
+     *  \param budget Maximal size of the cached data in bytes
+     */
+    TIFFTileCache(qint64 budget = 128*1024*1024);
+
+    ~TIFFTileCache() = default;
+
+
+    //
+    // Getter methods
+    //
+
+    /*! \brief Maximal size of the cached data
+     *
+     *  @returns Budget in bytes
+     */
+    [[nodiscard]] qint64 budget() const;
+
+    /*! \brief Size of the cached data
+     *
+     *  @returns Total size of all cached strips and tiles in bytes
+     */
+    [[nodiscard]] qint64 size() const;
+
+    /*! \brief Number of lookups that found an entry
+     *
+     *  @returns Number of successful calls to find() since construction or
+     *  the last call to resetCounters()
+     */
+    [[nodiscard]] quint64 hits() const { return m_hits; }
+
+    /*! \brief Number of lookups that found no entry
+     *
+     *  @returns Number of unsuccessful calls to find() since construction or
+     *  the last call to resetCounters()
+     */
+    [[nodiscard]] quint64 misses() const { return m_misses; }
+
+
+    //
+    // Setter methods
+    //
+
+    /*! \brief Set maximal size of the cached data
+     *
+     *  If the cache holds more data than the new budget allows, entries are
+     *  evicted. A budget of zero disables the cache.
+     *
+     *  \param budget Budget in bytes
+     */
+    void setBudget(qint64 budget);
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Remove all entries */
+    void clear();
+
+    /*! \brief Look up a strip or tile
+     *
+     *  @param key Identity of the strip or tile
+     *
+     *  @returns Decoded data, or a null QByteArray if the cache holds no
+     *  entry for the key
+     */
+    [[nodiscard]] QByteArray find(const Key& key);
+
+    /*! \brief Insert a strip or tile
+     *
+     *  Entries are evicted until the data fits into the budget. Data that
+     *  exceeds the budget on its own is not inserted. If the cache already
+     *  holds an entry for the key, the cache is not changed.
+     *
+     *  @param key Identity of the strip or tile
+     *
+     *  @param data Decoded data
+     */
+    void insert(const Key& key, const QByteArray& data);
+
+    /*! \brief Reset hit and miss counters */
+    void resetCounters();
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Identity of a file
+     *
+     *  @param fileName Name of the file
+     *
+     *  @returns String that identifies the file by canonical path, size and
+     *  modification time, or an empty string if the file does not exist
+     */
+    [[nodiscard]] static QString fileIdentity(const QString& fileName);
+
+    /*! \brief Process-wide cache
+     *
+     *  @returns Cache that is shared by all GeoTIFF instances
+     */
+    [[nodiscard]] static TIFFTileCache& global();
+
+private:
+    Q_DISABLE_COPY_MOVE(TIFFTileCache)
+
+    // Cached strip or tile. Slots of evicted entries have null data and are
+    // reused.
+    struct Slot
+    {
+        Key key;
+        QByteArray data;
+
+        // Set on every hit, cleared when the clock hand passes. Modified
+        // under the read lock, hence atomic.
+        std::atomic<bool> referenced {false};
+    };
+
+    // Evicts entries until the cached data and the given number of
+    // additional bytes fit into the budget. Must be called with the write
+    // lock held.
+    void evict(qint64 additionalBytes);
+
+    // Slots in clock order. A deque does not move slots when it grows.
+    std::deque<Slot> m_slots;
+    QVector<qsizetype> m_freeSlots;
+    QHash<Key, qsizetype> m_index;
+    qsizetype m_hand {0};
+
+    qint64 m_budget;
+    qint64 m_size {0};
+
+    std::atomic<quint64> m_hits {0};
+    std::atomic<quint64> m_misses {0};
+
+    mutable QReadWriteLock m_lock;
+};
+
+/*! \brief Hash function for TIFFTileCache::Key */
+size_t qHash(const TIFFTileCache::Key& key, size_t seed = 0);
+
+} // namespace FileFormats
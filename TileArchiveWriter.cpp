@@ -0,0 +1,495 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QtEndian>
+
+#include <cstring>
+
+#include <zlib.h>
+
+#include "TileArchiveWriter.h"
+#include "TileRenderer.h"
+
+
+namespace {
+
+// Appends an unsigned integer in LEB128 encoding, as used by PMTiles
+void appendVarint(QByteArray& data, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        data.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
+
+// Compresses data with gzip, which PMTiles uses for directories and metadata
+QByteArray gzip(QByteArrayView input)
+{
+    z_stream stream {};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw QObject::tr("Cannot compress data.", "FileFormats::PMTilesWriter");
+    }
+    QByteArray output(qsizetype(deflateBound(&stream, uLong(input.size()))), Qt::Uninitialized);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = uInt(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = uInt(output.size());
+    auto result = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END)
+    {
+        throw QObject::tr("Cannot compress data.", "FileFormats::PMTilesWriter");
+    }
+    output.truncate(qsizetype(stream.total_out));
+    return output;
+}
+
+// Tile type of the PMTiles header, for an image format
+quint8 tileType(const QByteArray& format)
+{
+    if (format == "png")
+    {
+        return 2;
+    }
+    if ((format == "jpg") || (format == "jpeg"))
+    {
+        return 3;
+    }
+    if (format == "webp")
+    {
+        return 4;
+    }
+    if (format == "avif")
+    {
+        return 5;
+    }
+    return 0;
+}
+
+// Coordinate in units of 10^-7 degrees, as used by PMTiles
+qint32 e7(double degrees)
+{
+    return qint32(qRound64(degrees*1e7));
+}
+
+} // namespace
+
+
+
+//
+// TileArchiveWriter
+//
+
+void FileFormats::TileArchiveWriter::writeTile(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash)
+{
+    auto bounds = TileRenderer::tileBounds(zoom, x, y);
+    if (!bounds.isValid())
+    {
+        throw QObject::tr("Tile %1/%2/%3 does not exist.", "FileFormats::TileArchiveWriter").arg(zoom).arg(x).arg(y);
+    }
+    m_minZoom = (m_minZoom < 0) ? zoom : qMin(m_minZoom, zoom);
+    m_maxZoom = qMax(m_maxZoom, zoom);
+    m_west = qMin(m_west, bounds.topLeft().longitude());
+    m_north = qMax(m_north, bounds.topLeft().latitude());
+    m_east = qMax(m_east, bounds.bottomRight().longitude());
+    m_south = qMin(m_south, bounds.bottomRight().latitude());
+
+    if (hash.isEmpty())
+    {
+        writeTileData(zoom, x, y, data, QCryptographicHash::hash(data, QCryptographicHash::Sha256));
+        return;
+    }
+    writeTileData(zoom, x, y, data, hash);
+}
+
+std::unique_ptr<FileFormats::TileArchiveWriter> FileFormats::TileArchiveWriter::create(Format format, const QString& fileName)
+{
+    if (format == Format::MBTiles)
+    {
+        return std::make_unique<MBTilesWriter>(fileName);
+    }
+    return std::make_unique<PMTilesWriter>(fileName);
+}
+
+QGeoRectangle FileFormats::TileArchiveWriter::effectiveBounds() const
+{
+    if (m_bounds.isValid() || (m_minZoom < 0))
+    {
+        return m_bounds;
+    }
+    return {QGeoCoordinate(m_north, m_west), QGeoCoordinate(m_south, m_east)};
+}
+
+
+
+//
+// PMTilesWriter
+//
+
+FileFormats::PMTilesWriter::PMTilesWriter(const QString& fileName)
+    : m_file(fileName)
+{
+    if (!m_file.open(QIODevice::WriteOnly))
+    {
+        throw m_file.errorString();
+    }
+
+    // Room for the header and the root directory, which are written by
+    // finish()
+    QByteArray const placeholder(rootSize, '\0');
+    if (m_file.write(placeholder) != placeholder.size())
+    {
+        throw m_file.errorString();
+    }
+}
+
+void FileFormats::PMTilesWriter::writeTileData(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash)
+{
+    if (data.size() > std::numeric_limits<quint32>::max())
+    {
+        throw QObject::tr("Tile %1/%2/%3 is too large.", "FileFormats::PMTilesWriter").arg(zoom).arg(x).arg(y);
+    }
+
+    auto key = hash.toByteArray();
+    if (!m_contents.contains(key))
+    {
+        if (m_file.write(data) != data.size())
+        {
+            throw m_file.errorString();
+        }
+        m_contents.insert(key, {m_tileDataSize, quint32(data.size())});
+        m_tileDataSize += quint64(data.size());
+    }
+    auto [offset, length] = m_contents.value(key);
+    m_entries.append({tileID(zoom, x, y), offset, length, 1});
+}
+
+void FileFormats::PMTilesWriter::finish()
+{
+    // Sort the entries by tile ID. If a tile was written more than once, the
+    // last version wins: the sort is stable, and duplicates are removed
+    // from the back, so that the last one of every tile ID is kept.
+    std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.tileID < b.tileID; });
+    auto firstKept = std::unique(m_entries.rbegin(), m_entries.rend(), [](const Entry& a, const Entry& b) { return a.tileID == b.tileID; });
+    m_entries.erase(m_entries.begin(), firstKept.base());
+
+    // Consecutive tiles with the same data are merged into runs
+    QVector<Entry> entries;
+    entries.reserve(m_entries.size());
+    quint64 addressedTiles = 0;
+    for (const auto& entry : std::as_const(m_entries))
+    {
+        if (!entries.isEmpty() && (entries.last().tileID + entries.last().runLength == entry.tileID)
+            && (entries.last().offset == entry.offset) && (entries.last().length == entry.length))
+        {
+            entries.last().runLength++;
+            continue;
+        }
+        entries.append(entry);
+    }
+    m_entries.clear();
+    m_entries.squeeze();
+
+    // The archive is clustered if the data of every tile either follows the
+    // data of the previous tile or repeats data that came before
+    bool clustered = true;
+    quint64 end = 0;
+    for (const auto& entry : std::as_const(entries))
+    {
+        addressedTiles += entry.runLength;
+        if (entry.offset == end)
+        {
+            end += entry.length;
+        }
+        else if (entry.offset > end)
+        {
+            clustered = false;
+        }
+    }
+
+    // If the root directory does not fit into the space reserved for it,
+    // entries go to leaf directories, which are made larger until the root
+    // directory fits
+    auto rootDirectory = directory(entries);
+    QByteArray leafDirectories;
+    for (qsizetype leafSize = 4096; headerSize + rootDirectory.size() > rootSize; leafSize *= 2)
+    {
+        QVector<Entry> rootEntries;
+        leafDirectories.clear();
+        for (qsizetype first=0; first<entries.size(); first+=leafSize)
+        {
+            auto leaf = directory(entries.mid(first, leafSize));
+            rootEntries.append({entries[first].tileID, quint64(leafDirectories.size()), quint32(leaf.size()), 0});
+            leafDirectories += leaf;
+        }
+        rootDirectory = directory(rootEntries);
+    }
+
+    auto metadataBytes = metadata();
+    quint64 const tileDataOffset = rootSize;
+    auto metadataOffset = tileDataOffset + m_tileDataSize;
+    auto leafDirectoriesOffset = metadataOffset + quint64(metadataBytes.size());
+    if ((m_file.write(metadataBytes) != metadataBytes.size()) || (m_file.write(leafDirectories) != leafDirectories.size()))
+    {
+        throw m_file.errorString();
+    }
+
+    QByteArray header(headerSize, '\0');
+    auto* data = header.data();
+    memcpy(data, "PMTiles", 7);
+    data[7] = 3;
+    qToLittleEndian(quint64(headerSize), data + 8);
+    qToLittleEndian(quint64(rootDirectory.size()), data + 16);
+    qToLittleEndian(metadataOffset, data + 24);
+    qToLittleEndian(quint64(metadataBytes.size()), data + 32);
+    qToLittleEndian(leafDirectoriesOffset, data + 40);
+    qToLittleEndian(quint64(leafDirectories.size()), data + 48);
+    qToLittleEndian(tileDataOffset, data + 56);
+    qToLittleEndian(m_tileDataSize, data + 64);
+    qToLittleEndian(addressedTiles, data + 72);
+    qToLittleEndian(quint64(entries.size()), data + 80);
+    qToLittleEndian(quint64(m_contents.size()), data + 88);
+    data[96] = clustered ? 1 : 0;
+    data[97] = 2; // Directories and metadata are compressed with gzip
+    data[98] = 1; // Tiles are not compressed
+    data[99] = char(tileType(tileFormat()));
+    data[100] = char(qMax(minZoom(), 0));
+    data[101] = char(qMax(maxZoom(), 0));
+    auto bounds = effectiveBounds();
+    if (bounds.isValid())
+    {
+        qToLittleEndian(e7(bounds.topLeft().longitude()), data + 102);
+        qToLittleEndian(e7(bounds.bottomRight().latitude()), data + 106);
+        qToLittleEndian(e7(bounds.bottomRight().longitude()), data + 110);
+        qToLittleEndian(e7(bounds.topLeft().latitude()), data + 114);
+        data[118] = char(qMax(minZoom(), 0));
+        qToLittleEndian(e7(bounds.center().longitude()), data + 119);
+        qToLittleEndian(e7(bounds.center().latitude()), data + 123);
+    }
+
+    header += rootDirectory;
+    if (!m_file.seek(0) || (m_file.write(header) != header.size()) || !m_file.commit())
+    {
+        throw m_file.errorString();
+    }
+}
+
+quint64 FileFormats::PMTilesWriter::tileID(int zoom, int x, int y)
+{
+    // Number of tiles on lower zoom levels
+    quint64 result = ((quint64(1) << (2*zoom)) - 1)/3;
+
+    // Position on the Hilbert curve, from the coarsest to the finest bit.
+    // After every step, the quadrant is rotated into the orientation of the
+    // curve.
+    auto tx = quint64(x);
+    auto ty = quint64(y);
+    for (auto bit=zoom-1; bit>=0; --bit)
+    {
+        auto size = quint64(1) << bit;
+        auto rx = ((tx & size) != 0) ? 1U : 0U;
+        auto ry = ((ty & size) != 0) ? 1U : 0U;
+        result += quint64((3*rx) ^ ry) << (2*bit);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                tx = size - 1 - (tx & (size - 1));
+                ty = size - 1 - (ty & (size - 1));
+            }
+            std::swap(tx, ty);
+        }
+    }
+    return result;
+}
+
+QByteArray FileFormats::PMTilesWriter::directory(const QVector<Entry>& entries)
+{
+    QByteArray result;
+    appendVarint(result, quint64(entries.size()));
+    quint64 last = 0;
+    for (const auto& entry : entries)
+    {
+        appendVarint(result, entry.tileID - last);
+        last = entry.tileID;
+    }
+    for (const auto& entry : entries)
+    {
+        appendVarint(result, entry.runLength);
+    }
+    for (const auto& entry : entries)
+    {
+        appendVarint(result, entry.length);
+    }
+
+    // Offsets that directly follow the previous entry are stored as zero
+    for (qsizetype i=0; i<entries.size(); ++i)
+    {
+        if ((i > 0) && (entries[i].offset == entries[i-1].offset + entries[i-1].length))
+        {
+            appendVarint(result, 0);
+            continue;
+        }
+        appendVarint(result, entries[i].offset + 1);
+    }
+    return gzip(result);
+}
+
+QByteArray FileFormats::PMTilesWriter::metadata() const
+{
+    QJsonObject object;
+    object[u"name"_qs] = name();
+    object[u"description"_qs] = description();
+    object[u"format"_qs] = QString::fromLatin1(tileFormat());
+    return gzip(QJsonDocument(object).toJson(QJsonDocument::Compact));
+}
+
+
+
+//
+// MBTilesWriter
+//
+
+FileFormats::MBTilesWriter::MBTilesWriter(const QString& fileName)
+    : m_fileName(fileName),
+      m_temporaryFileName(fileName + u".part"_qs),
+      m_connectionName(u"FileFormats::MBTilesWriter/%1"_qs.arg(quintptr(this), 0, 16))
+{
+    QFile::remove(m_temporaryFileName);
+    {
+        auto database = QSqlDatabase::addDatabase(u"QSQLITE"_qs, m_connectionName);
+        database.setDatabaseName(m_temporaryFileName);
+        if (!database.open())
+        {
+            throw database.lastError().text();
+        }
+    }
+
+    // The database is a temporary file until finish() succeeds, so it needs
+    // neither a journal nor synchronous writes
+    execute(u"PRAGMA journal_mode = OFF"_qs);
+    execute(u"PRAGMA synchronous = OFF"_qs);
+    execute(u"CREATE TABLE metadata (name TEXT, value TEXT)"_qs);
+    execute(u"CREATE TABLE images (tile_id TEXT, tile_data BLOB)"_qs);
+    execute(u"CREATE TABLE map (zoom_level INTEGER, tile_column INTEGER, tile_row INTEGER, tile_id TEXT)"_qs);
+    execute(u"CREATE UNIQUE INDEX images_id ON images (tile_id)"_qs);
+    execute(u"CREATE UNIQUE INDEX map_index ON map (zoom_level, tile_column, tile_row)"_qs);
+    execute(u"CREATE VIEW tiles AS SELECT map.zoom_level AS zoom_level, map.tile_column AS tile_column, map.tile_row AS tile_row, "
+            "images.tile_data AS tile_data FROM map JOIN images ON images.tile_id = map.tile_id"_qs);
+    execute(u"BEGIN"_qs);
+}
+
+FileFormats::MBTilesWriter::~MBTilesWriter()
+{
+    {
+        auto database = QSqlDatabase::database(m_connectionName, false);
+        database.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+    QFile::remove(m_temporaryFileName);
+}
+
+void FileFormats::MBTilesWriter::writeTileData(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash)
+{
+    auto key = hash.toByteArray();
+    auto tileID = QString::fromLatin1(key.toHex());
+    if (!m_contents.contains(key))
+    {
+        execute(u"INSERT INTO images (tile_id, tile_data) VALUES (?, ?)"_qs, {tileID, data});
+        m_contents.insert(key);
+    }
+    execute(u"INSERT OR REPLACE INTO map (zoom_level, tile_column, tile_row, tile_id) VALUES (?, ?, ?, ?)"_qs,
+            {zoom, x, (1 << zoom) - 1 - y, tileID});
+
+    if (++m_pending >= transactionSize)
+    {
+        execute(u"COMMIT"_qs);
+        execute(u"BEGIN"_qs);
+        m_pending = 0;
+    }
+}
+
+void FileFormats::MBTilesWriter::finish()
+{
+    QVector<std::pair<QString, QString>> metadata {
+        {u"name"_qs, name()},
+        {u"description"_qs, description()},
+        {u"format"_qs, QString::fromLatin1(tileFormat())},
+    };
+    if (minZoom() >= 0)
+    {
+        metadata.append(std::make_pair(u"minzoom"_qs, QString::number(minZoom())));
+        metadata.append(std::make_pair(u"maxzoom"_qs, QString::number(maxZoom())));
+    }
+    auto bounds = effectiveBounds();
+    if (bounds.isValid())
+    {
+        metadata.append(std::make_pair(u"bounds"_qs, u"%1,%2,%3,%4"_qs.arg(bounds.topLeft().longitude()).arg(bounds.bottomRight().latitude())
+                                                     .arg(bounds.bottomRight().longitude()).arg(bounds.topLeft().latitude())));
+        metadata.append(std::make_pair(u"center"_qs, u"%1,%2,%3"_qs.arg(bounds.center().longitude()).arg(bounds.center().latitude()).arg(qMax(minZoom(), 0))));
+    }
+    for (const auto& [key, value] : std::as_const(metadata))
+    {
+        execute(u"INSERT INTO metadata (name, value) VALUES (?, ?)"_qs, {key, value});
+    }
+    execute(u"COMMIT"_qs);
+
+    {
+        auto database = QSqlDatabase::database(m_connectionName, false);
+        database.close();
+    }
+    QFile::remove(m_fileName);
+    if (!QFile::rename(m_temporaryFileName, m_fileName))
+    {
+        throw QObject::tr("Cannot write %1.", "FileFormats::MBTilesWriter").arg(m_fileName);
+    }
+}
+
+
+
+//
+// Private Methods
+//
+
+void FileFormats::MBTilesWriter::execute(const QString& statement, const QVariantList& values)
+{
+    QSqlQuery query(QSqlDatabase::database(m_connectionName, false));
+    if (!query.prepare(statement))
+    {
+        throw query.lastError().text();
+    }
+    for (const auto& value : values)
+    {
+        query.addBindValue(value);
+    }
+    if (!query.exec())
+    {
+        throw query.lastError().text();
+    }
+}
@@ -0,0 +1,344 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoRectangle>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QVariantList>
+
+#include <memory>
+
+namespace FileFormats
+{
+
+/*! \brief Writer for tile archives
+ *
+ *  This is an abstract base class for writers of single-file archives of
+ *  XYZ tiles, such as those rendered by TileRenderer. Tile data is written
+ *  to disk as soon as it is passed to writeTile(), so that the memory used
+ *  by a writer does not depend on the size of the tile data. Tiles whose
+ *  data is identical are stored only once. Duplicates are recognized by a
+ *  SHA-256 hash of the data.
+ *
+ *  Writers must only be used by the thread that constructed them, because
+ *  the database connection of MBTilesWriter belongs to that thread. The
+ *  archive appears under its name only after finish() succeeds. On failure, the methods of this class
+ *  throw a QString with a human-readable, translated error message.
+ */
+
+class TileArchiveWriter
+{
+public:
+    /*! \brief Archive format */
+    enum class Format
+    {
+        /*! \brief PMTiles version 3, see PMTilesWriter */
+        PMTiles,
+
+        /*! \brief MBTiles version 1.3, see MBTilesWriter */
+        MBTiles
+    };
+
+    TileArchiveWriter() = default;
+    virtual ~TileArchiveWriter() = default;
+
+
+    //
+    // Getter/Setter methods
+    //
+
+    /*! \brief Name of the tile set
+     *
+     *  @returns Name stored in the metadata of the archive
+     */
+    [[nodiscard]] QString name() const { return m_name; }
+
+    /*! \brief Set name of the tile set
+     *
+     *  @param name Name stored in the metadata of the archive
+     */
+    void setName(const QString& name) { m_name = name; }
+
+    /*! \brief Description of the tile set
+     *
+     *  @returns Description stored in the metadata of the archive
+     */
+    [[nodiscard]] QString description() const { return m_description; }
+
+    /*! \brief Set description of the tile set
+     *
+     *  @param description Description stored in the metadata of the archive
+     */
+    void setDescription(const QString& description) { m_description = description; }
+
+    /*! \brief Image format of the tiles
+     *
+     *  @returns Name of the image format, as used by QImage::save(). By
+     *  default, this is "png".
+     */
+    [[nodiscard]] QByteArray tileFormat() const { return m_tileFormat; }
+
+    /*! \brief Set image format of the tiles
+     *
+     *  @param format Name of the image format: "png", "jpg" or "webp"
+     */
+    void setTileFormat(const QByteArray& format) { m_tileFormat = format.toLower(); }
+
+    /*! \brief Bounds of the tile set
+     *
+     *  @returns Bounds stored in the metadata of the archive
+     */
+    [[nodiscard]] QGeoRectangle bounds() const { return m_bounds; }
+
+    /*! \brief Set bounds of the tile set
+     *
+     *  @param bounds Bounds stored in the metadata of the archive. If the
+     *  bounds are invalid, the bounds of the tiles written are stored.
+     */
+    void setBounds(const QGeoRectangle& bounds) { m_bounds = bounds; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Write a tile
+     *
+     *  @param zoom Zoom level, between 0 and TileRenderer::maxZoom
+     *
+     *  @param x Column of the tile, counted from the antimeridian eastwards
+     *
+     *  @param y Row of the tile, counted from the north
+     *
+     *  @param data Encoded image
+     *
+     *  @param hash SHA-256 hash of the data, if already known. Callers that
+     *  encode tiles in parallel pass the hash, so that it is not computed
+     *  while the writer is busy.
+     */
+    void writeTile(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash = {});
+
+    /*! \brief Finish the archive
+     *
+     *  Writes the metadata and indices, and moves the archive to its name.
+     *  No tiles can be written afterwards.
+     */
+    virtual void finish() = 0;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Writer for a format
+     *
+     *  @param format Archive format
+     *
+     *  @param fileName Name of the file to write
+     *
+     *  @returns Writer
+     */
+    [[nodiscard]] static std::unique_ptr<TileArchiveWriter> create(Format format, const QString& fileName);
+
+protected:
+    /* Writes a tile whose zoom level, column and row have been checked.
+     * Implementations use the hash to detect duplicates.
+     */
+    virtual void writeTileData(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash) = 0;
+
+    /* Returns the bounds passed to setBounds() if valid, and otherwise the
+     * bounds of the tiles written
+     */
+    [[nodiscard]] QGeoRectangle effectiveBounds() const;
+
+    /* Smallest and largest zoom level of the tiles written, or -1 if no tile
+     * has been written
+     */
+    [[nodiscard]] int minZoom() const { return m_minZoom; }
+    [[nodiscard]] int maxZoom() const { return m_maxZoom; }
+
+private:
+    Q_DISABLE_COPY_MOVE(TileArchiveWriter)
+
+    QString m_name;
+    QString m_description;
+    QByteArray m_tileFormat {"png"};
+    QGeoRectangle m_bounds;
+
+    // Zoom levels and bounds of the tiles written, in degrees
+    int m_minZoom {-1};
+    int m_maxZoom {-1};
+    double m_west {180.0};
+    double m_south {90.0};
+    double m_east {-180.0};
+    double m_north {-90.0};
+};
+
+
+/*! \brief Writer for PMTiles archives
+ *
+ *  This class writes archives in the PMTiles format, version 3, as specified
+ *  here: https://github.com/protomaps/PMTiles/blob/main/spec/v3/spec.md. A
+ *  PMTiles archive is a single file that clients read with HTTP range
+ *  requests: the header and the root directory fit into the first 16 KiB,
+ *  and lead to the tile data either directly or through one level of leaf
+ *  directories.
+ *
+ *  Tile data is appended to the file in the order in which tiles are
+ *  written. The first 16 KiB of the file are reserved for the header and
+ *  the root directory, which are written by finish(), followed by the
+ *  metadata and the leaf directories. Only the directory entries are held in
+ *  memory, which take about 24 bytes per tile. Directories are compressed
+ *  with gzip.
+ */
+
+class PMTilesWriter : public TileArchiveWriter
+{
+public:
+    /*! \brief Constructor
+     *
+     *  \param fileName Name of the file to write
+     */
+    PMTilesWriter(const QString& fileName);
+
+    ~PMTilesWriter() override = default;
+
+
+    //
+    // Methods
+    //
+
+    void finish() override;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Tile ID
+     *
+     *  Tiles are numbered along a Hilbert curve on every zoom level, with
+     *  all tiles of lower zoom levels coming first.
+     *
+     *  @param zoom Zoom level, between 0 and 31
+     *
+     *  @param x Column of the tile
+     *
+     *  @param y Row of the tile
+     *
+     *  @returns Tile ID
+     */
+    [[nodiscard]] static quint64 tileID(int zoom, int x, int y);
+
+    /*! \brief Size of the header */
+    static constexpr qsizetype headerSize = 127;
+
+    /*! \brief Size of the space for header and root directory */
+    static constexpr qsizetype rootSize = 16384;
+
+protected:
+    void writeTileData(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash) override;
+
+private:
+    // Directory entry. Entries with run length zero point to leaf
+    // directories.
+    struct Entry
+    {
+        quint64 tileID {0};
+        quint64 offset {0};
+        quint32 length {0};
+        quint32 runLength {1};
+    };
+
+    // Serialized and compressed directory
+    [[nodiscard]] static QByteArray directory(const QVector<Entry>& entries);
+
+    // Serialized metadata
+    [[nodiscard]] QByteArray metadata() const;
+
+    QSaveFile m_file;
+
+    // Directory entries, in the order written
+    QVector<Entry> m_entries;
+
+    // Position of the data of every distinct tile, by hash
+    QHash<QByteArray, std::pair<quint64, quint32>> m_contents;
+
+    // Size of the tile data written so far
+    quint64 m_tileDataSize {0};
+};
+
+
+/*! \brief Writer for MBTiles archives
+ *
+ *  This class writes archives in the MBTiles format, version 1.3, as
+ *  specified here: https://github.com/mapbox/mbtiles-spec. An MBTiles
+ *  archive is an SQLite database. Duplicate tiles are stored once, in the
+ *  table "images", and referenced from the table "map". The view "tiles"
+ *  joins both tables, as required by the specification. Note that MBTiles
+ *  counts rows from the south.
+ *
+ *  The database is written to a temporary file next to the target, in
+ *  transactions of a thousand tiles, and renamed by finish().
+ */
+
+class MBTilesWriter : public TileArchiveWriter
+{
+public:
+    /*! \brief Constructor
+     *
+     *  \param fileName Name of the file to write
+     */
+    MBTilesWriter(const QString& fileName);
+
+    ~MBTilesWriter() override;
+
+
+    //
+    // Methods
+    //
+
+    void finish() override;
+
+protected:
+    void writeTileData(int zoom, int x, int y, const QByteArray& data, QByteArrayView hash) override;
+
+private:
+    // Executes a statement with the given values bound to its placeholders
+    void execute(const QString& statement, const QVariantList& values = {});
+
+    // Number of tiles written per transaction
+    static constexpr int transactionSize = 1000;
+
+    QString m_fileName;
+    QString m_temporaryFileName;
+    QString m_connectionName;
+
+    // Hashes of the tiles stored in the table "images"
+    QSet<QByteArray> m_contents;
+
+    // Number of tiles written in the current transaction
+    int m_pending {0};
+};
+
+} // namespace FileFormats
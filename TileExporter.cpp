@@ -0,0 +1,293 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QMutex>
+#include <QQueue>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include "TileExporter.h"
+
+
+namespace {
+
+// Checks if all pixels of a tile in QImage::Format_ARGB32_Premultiplied are
+// transparent
+bool isTransparent(const QImage& tile)
+{
+    for (int y=0; y<tile.height(); ++y)
+    {
+        const auto* row = reinterpret_cast<const quint32*>(tile.constScanLine(y));
+        for (int x=0; x<tile.width(); ++x)
+        {
+            if ((row[x] >> 24) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::TileExporter::TileExporter(const QVector<const GeoTIFF*>& sources)
+    : m_sources(sources), m_renderer(sources)
+{
+}
+
+
+
+//
+// Methods
+//
+
+void FileFormats::TileExporter::write(const QString& fileName, TileArchiveWriter::Format format)
+{
+    m_canceled = false;
+    auto writer = TileArchiveWriter::create(format, fileName);
+    writer->setName(m_name);
+    writer->setTileFormat(m_tileFormat);
+    auto total = tileCount();
+
+    // Tiles are rendered, encoded and hashed on the pool, and passed through
+    // the queue to this thread, which owns the writer. The number of tiles
+    // that are rendered or waiting in the queue is bounded. The pool is
+    // declared last, so that it waits for all tasks before the objects they
+    // use are destructed.
+    struct EncodedTile
+    {
+        int zoom {0};
+        int x {0};
+        int y {0};
+        QByteArray data;
+        QByteArray hash;
+    };
+    QQueue<EncodedTile> queue;
+    int inFlight = 0;
+    auto const maxInFlight = 2*m_maxThreadCount;
+    QMutex mutex;
+    QWaitCondition changed;
+    QString error;
+    std::atomic<bool> failed {false};
+    std::atomic<qint64> done {0};
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_maxThreadCount);
+
+    // Records the first error
+    auto fail = [&](const QString& message) {
+        if (!failed)
+        {
+            error = message;
+            failed = true;
+        }
+    };
+
+    // Writes the queued tiles, until fewer than limit tiles are in flight
+    auto writeQueued = [&](int limit) {
+        QMutexLocker locker(&mutex);
+        while (true)
+        {
+            while (!queue.isEmpty())
+            {
+                auto tile = queue.dequeue();
+                inFlight--;
+                if (failed || m_canceled)
+                {
+                    continue;
+                }
+                locker.unlock();
+                try
+                {
+                    writer->writeTile(tile.zoom, tile.x, tile.y, tile.data, tile.hash);
+                }
+                catch (QString& message)
+                {
+                    locker.relock();
+                    fail(message);
+                    continue;
+                }
+                locker.relock();
+            }
+            if (inFlight < limit)
+            {
+                return;
+            }
+            changed.wait(&mutex);
+        }
+    };
+
+    forEachTile([&](int zoom, int x, int y) {
+        if (failed || m_canceled)
+        {
+            return false;
+        }
+        writeQueued(maxInFlight);
+        {
+            QMutexLocker const locker(&mutex);
+            inFlight++;
+        }
+        pool.start([&, zoom, x, y]() {
+            EncodedTile result {zoom, x, y, {}, {}};
+            QString message;
+            try
+            {
+                auto tile = m_renderer.render(zoom, x, y);
+                if (!tile.isNull() && !isTransparent(tile))
+                {
+                    QBuffer buffer(&result.data);
+                    if (!buffer.open(QIODevice::WriteOnly) || !tile.save(&buffer, m_tileFormat.constData()))
+                    {
+                        throw QObject::tr("Cannot encode tile %1/%2/%3.", "FileFormats::TileExporter").arg(zoom).arg(x).arg(y);
+                    }
+                    result.hash = QCryptographicHash::hash(result.data, QCryptographicHash::Sha256);
+                }
+            }
+            catch (QString& exception)
+            {
+                message = exception;
+            }
+            auto count = ++done;
+            if (m_progressCallback)
+            {
+                m_progressCallback(count, total);
+            }
+
+            QMutexLocker const locker(&mutex);
+            if (!message.isEmpty())
+            {
+                fail(message);
+                inFlight--;
+            }
+            else if (result.data.isEmpty())
+            {
+                inFlight--;
+            }
+            else
+            {
+                queue.enqueue(result);
+            }
+            changed.wakeAll();
+        });
+        return true;
+    });
+    writeQueued(1);
+    pool.waitForDone();
+
+    if (failed)
+    {
+        throw error;
+    }
+    if (!m_canceled)
+    {
+        writer->finish();
+    }
+}
+
+qint64 FileFormats::TileExporter::tileCount() const
+{
+    qint64 result = 0;
+    forEachTile([&result](int /*zoom*/, int /*x*/, int /*y*/) {
+        result++;
+        return true;
+    });
+    return result;
+}
+
+
+
+//
+// Private Methods
+//
+
+void FileFormats::TileExporter::forEachTile(const std::function<bool(int, int, int)>& visit) const
+{
+    for (int zoom=m_minZoom; zoom<=m_maxZoom; ++zoom)
+    {
+        // Tile ranges of the bounding boxes. Bounding boxes that cross the
+        // antimeridian give two ranges.
+        QVector<QRect> ranges;
+        auto last = (1 << zoom) - 1;
+        for (const auto* source : m_sources)
+        {
+            auto bBox = source->bBox();
+            if (!source->isValid() || !bBox.isValid())
+            {
+                continue;
+            }
+            auto topLeft = TileRenderer::tileAt(zoom, bBox.topLeft());
+            auto bottomRight = TileRenderer::tileAt(zoom, bBox.bottomRight());
+            if (bBox.topLeft().longitude() > bBox.bottomRight().longitude())
+            {
+                ranges << QRect(QPoint(topLeft.x(), topLeft.y()), QPoint(last, bottomRight.y()));
+                ranges << QRect(QPoint(0, topLeft.y()), QPoint(bottomRight.x(), bottomRight.y()));
+                continue;
+            }
+            ranges << QRect(topLeft, bottomRight);
+        }
+        if (ranges.isEmpty())
+        {
+            return;
+        }
+
+        // Visit every row once, merging the column intervals of all ranges
+        // that contain the row
+        int top = last;
+        int bottom = 0;
+        for (const auto& range : std::as_const(ranges))
+        {
+            top = qMin(top, range.top());
+            bottom = qMax(bottom, range.bottom());
+        }
+        QVector<std::pair<int, int>> intervals;
+        for (int y=top; y<=bottom; ++y)
+        {
+            intervals.clear();
+            for (const auto& range : std::as_const(ranges))
+            {
+                if ((range.top() <= y) && (y <= range.bottom()))
+                {
+                    intervals.append(std::make_pair(range.left(), range.right()));
+                }
+            }
+            std::sort(intervals.begin(), intervals.end());
+            int next = 0;
+            for (const auto& [left, right] : std::as_const(intervals))
+            {
+                for (int x=qMax(left, next); x<=right; ++x)
+                {
+                    if (!visit(zoom, x, y))
+                    {
+                        return;
+                    }
+                }
+                next = qMax(next, right + 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,233 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QThread>
+
+#include <atomic>
+#include <functional>
+
+#include "TileArchiveWriter.h"
+#include "TileRenderer.h"
+
+namespace FileFormats
+{
+
+/*! \brief Exporter of GeoTIFF files to tile archives
+ *
+ *  This class renders all Web Mercator tiles of a range of zoom levels that
+ *  intersect the bounding boxes of a list of GeoTIFF files, and writes them
+ *  to a tile archive, see TileArchiveWriter. Tiles are rendered with
+ *  TileRenderer and encoded in parallel, on a thread pool of bounded size.
+ *  Encoded tiles are queued and passed to the writer by the thread that
+ *  calls write(), which is the only thread that uses the writer. The number
+ *  of tiles in flight is bounded, so that memory use does not depend on the
+ *  number of tiles. Tiles that are fully transparent are not written.
+ *
+ *  An export can be canceled from any thread. Progress is reported through
+ *  an optional callback.
+ */
+
+class TileExporter
+{
+public:
+    /*! \brief Progress callback
+     *
+     *  The callback is called from worker threads, once for every tile that
+     *  has been rendered. Implementations must be thread-safe.
+     *
+     *  The first argument is the number of tiles rendered so far, the second
+     *  argument is the total number of tiles, see tileCount().
+     */
+    using ProgressCallback = std::function<void(qint64, qint64)>;
+
+    /*! \brief Constructor
+     *
+     *  \param sources GeoTIFF files, see TileRenderer::TileRenderer(). The
+     *  objects are not copied and must outlive the exporter.
+     */
+    TileExporter(const QVector<const GeoTIFF*>& sources);
+
+    ~TileExporter() = default;
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Export tiles
+     *
+     *  This method blocks until all tiles have been written or the export
+     *  has been canceled. On failure, it throws a QString with a
+     *  human-readable, translated error message. If the export fails or is
+     *  canceled, no archive is written.
+     *
+     *  @param fileName Name of the archive
+     *
+     *  @param format Format of the archive
+     */
+    void write(const QString& fileName, TileArchiveWriter::Format format);
+
+    /*! \brief Cancel a running export
+     *
+     *  This method can be called from any thread. The running export stops
+     *  as soon as the tiles currently being rendered are done.
+     */
+    void cancel() { m_canceled = true; }
+
+    /*! \brief Number of tiles
+     *
+     *  @returns Number of tiles in the zoom range that intersect the
+     *  bounding box of at least one source
+     */
+    [[nodiscard]] qint64 tileCount() const;
+
+
+    //
+    // Getter/Setter methods
+    //
+
+    /*! \brief Check if the last export has been canceled
+     *
+     *  @returns True if cancel() has been called during the last export
+     */
+    [[nodiscard]] bool isCanceled() const { return m_canceled; }
+
+    /*! \brief Smallest zoom level
+     *
+     *  @returns Smallest zoom level exported. By default, this is 0.
+     */
+    [[nodiscard]] int minZoom() const { return m_minZoom; }
+
+    /*! \brief Largest zoom level
+     *
+     *  @returns Largest zoom level exported. By default, this is 12.
+     */
+    [[nodiscard]] int maxZoom() const { return m_maxZoom; }
+
+    /*! \brief Set range of zoom levels
+     *
+     *  Zoom levels are clamped to the range from 0 to TileRenderer::maxZoom.
+     *
+     *  @param minZoom Smallest zoom level exported
+     *
+     *  @param maxZoom Largest zoom level exported
+     */
+    void setZoomRange(int minZoom, int maxZoom)
+    {
+        m_minZoom = qBound(0, minZoom, TileRenderer::maxZoom);
+        m_maxZoom = qBound(0, maxZoom, TileRenderer::maxZoom);
+    }
+
+    /*! \brief Tile size
+     *
+     *  @returns Width and height of the tiles in pixels, see
+     *  TileRenderer::tileSize()
+     */
+    [[nodiscard]] int tileSize() const { return m_renderer.tileSize(); }
+
+    /*! \brief Set tile size
+     *
+     *  @param size Width and height of the tiles in pixels, see
+     *  TileRenderer::setTileSize()
+     */
+    void setTileSize(int size) { m_renderer.setTileSize(size); }
+
+    /*! \brief Resampling method
+     *
+     *  @returns Resampling method, see TileRenderer::resampling()
+     */
+    [[nodiscard]] TileRenderer::Resampling resampling() const { return m_renderer.resampling(); }
+
+    /*! \brief Set resampling method
+     *
+     *  @param resampling Resampling method
+     */
+    void setResampling(TileRenderer::Resampling resampling) { m_renderer.setResampling(resampling); }
+
+    /*! \brief Image format of the tiles
+     *
+     *  @returns Name of the image format, as used by QImage::save(). By
+     *  default, this is "png".
+     */
+    [[nodiscard]] QByteArray tileFormat() const { return m_tileFormat; }
+
+    /*! \brief Set image format of the tiles
+     *
+     *  @param format Name of the image format: "png", "jpg" or "webp". JPEG
+     *  has no transparency, so that areas not covered by any source are
+     *  black.
+     */
+    void setTileFormat(const QByteArray& format) { m_tileFormat = format.toLower(); }
+
+    /*! \brief Name of the tile set
+     *
+     *  @returns Name stored in the metadata of the archive
+     */
+    [[nodiscard]] QString name() const { return m_name; }
+
+    /*! \brief Set name of the tile set
+     *
+     *  @param name Name stored in the metadata of the archive
+     */
+    void setName(const QString& name) { m_name = name; }
+
+    /*! \brief Maximal number of worker threads
+     *
+     *  @returns Maximal number of threads used to render tiles. By default,
+     *  this is QThread::idealThreadCount().
+     */
+    [[nodiscard]] int maxThreadCount() const { return m_maxThreadCount; }
+
+    /*! \brief Set maximal number of worker threads
+     *
+     *  @param count Maximal number of threads used to render tiles. Values
+     *  smaller than one are treated as one.
+     */
+    void setMaxThreadCount(int count) { m_maxThreadCount = qMax(1, count); }
+
+    /*! \brief Set progress callback
+     *
+     *  @param callback Callback, or an empty function to disable progress
+     *  reporting
+     */
+    void setProgressCallback(const ProgressCallback& callback) { m_progressCallback = callback; }
+
+private:
+    Q_DISABLE_COPY_MOVE(TileExporter)
+
+    // Calls visit for every tile in the zoom range that intersects the
+    // bounding box of a source, ordered by zoom level, row and column, until
+    // visit returns false
+    void forEachTile(const std::function<bool(int, int, int)>& visit) const;
+
+    QVector<const GeoTIFF*> m_sources;
+    TileRenderer m_renderer;
+    std::atomic<bool> m_canceled {false};
+    int m_minZoom {0};
+    int m_maxZoom {12};
+    QByteArray m_tileFormat {"png"};
+    QString m_name;
+    int m_maxThreadCount {QThread::idealThreadCount()};
+    ProgressCallback m_progressCallback;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,577 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+#include "TileRenderer.h"
+
+// Vector code is compiled for x86 processors with GCC or Clang, using
+// function attributes, so that no special compiler flags are needed
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TILERENDERER_X86
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+using FileFormats::TIFFPredictor::Instructions;
+
+// Pixels of a source image in QImage::Format_ARGB32_Premultiplied. Pixel
+// coordinates refer to pixel corners, as in GeoTransform.
+struct Pixels
+{
+    const quint32* bits {nullptr};
+    qsizetype stride {0};
+    int width {0};
+    int height {0};
+};
+
+
+//
+// Scalar code
+//
+
+// Interpolates between two samples with a weight between 0 and 128. The
+// arithmetic is that of 16-bit lanes, so that the vector code gives the same
+// results.
+inline int lerp(int a, int b, int weight)
+{
+    return a + (((b - a)*weight + 64) >> 7);
+}
+
+// Samples the pixels at the points (x[i], y[i]) with nearest neighbor
+// resampling. Points outside of the image give transparent pixels.
+void nearestScalar(const Pixels& pixels, const float* x, const float* y, quint32* out, qsizetype begin, qsizetype count)
+{
+    for (auto i=begin; i<count; ++i)
+    {
+        auto X = x[i];
+        auto Y = y[i];
+        if (!((X >= 0.0F) && (X < float(pixels.width)) && (Y >= 0.0F) && (Y < float(pixels.height))))
+        {
+            out[i] = 0;
+            continue;
+        }
+        out[i] = pixels.bits[qsizetype(Y)*pixels.stride + qsizetype(X)];
+    }
+}
+
+// Samples the pixels at the points (x[i], y[i]) with bilinear resampling.
+// Points outside of the image give transparent pixels. At the edges of the
+// image, the edge pixels are repeated.
+void bilinearScalar(const Pixels& pixels, const float* x, const float* y, quint32* out, qsizetype begin, qsizetype count)
+{
+    for (auto i=begin; i<count; ++i)
+    {
+        auto X = x[i];
+        auto Y = y[i];
+        if (!((X >= 0.0F) && (X < float(pixels.width)) && (Y >= 0.0F) && (Y < float(pixels.height))))
+        {
+            out[i] = 0;
+            continue;
+        }
+
+        // Pixel centers are at half-integer coordinates
+        auto fx = X - 0.5F;
+        auto fy = Y - 0.5F;
+        auto x0f = std::floor(fx);
+        auto y0f = std::floor(fy);
+        auto wx = int(std::nearbyint((fx - x0f)*128.0F));
+        auto wy = int(std::nearbyint((fy - y0f)*128.0F));
+        auto x0 = int(x0f);
+        auto y0 = int(y0f);
+        auto x1 = qMin(x0 + 1, pixels.width - 1);
+        auto y1 = qMin(y0 + 1, pixels.height - 1);
+        x0 = qMax(x0, 0);
+        y0 = qMax(y0, 0);
+
+        const auto* row0 = pixels.bits + y0*pixels.stride;
+        const auto* row1 = pixels.bits + y1*pixels.stride;
+        quint32 result = 0;
+        for (int shift=0; shift<32; shift+=8)
+        {
+            auto top = lerp(int((row0[x0] >> shift) & 0xFF), int((row0[x1] >> shift) & 0xFF), wx);
+            auto bottom = lerp(int((row1[x0] >> shift) & 0xFF), int((row1[x1] >> shift) & 0xFF), wx);
+            result |= quint32(lerp(top, bottom, wy)) << shift;
+        }
+        out[i] = result;
+    }
+}
+
+
+#ifdef TILERENDERER_X86
+
+//
+// AVX2
+//
+
+// Interpolates between the 16-bit lanes of a and b, as lerp() does
+__attribute__((target("avx2"))) inline __m256i lerpAVX2(__m256i a, __m256i b, __m256i weight)
+{
+    auto product = _mm256_mullo_epi16(_mm256_sub_epi16(b, a), weight);
+    return _mm256_add_epi16(a, _mm256_srai_epi16(_mm256_add_epi16(product, _mm256_set1_epi16(64)), 7));
+}
+
+// Returns the green and alpha channels of packed pixels in 16-bit lanes
+__attribute__((target("avx2"))) inline __m256i oddBytesAVX2(__m256i pixels)
+{
+    return _mm256_and_si256(_mm256_srli_epi32(pixels, 8), _mm256_set1_epi32(0x00FF00FF));
+}
+
+// Samples groups of eight points with bilinear resampling, as
+// bilinearScalar() does, and returns the number of points done. The four
+// neighbors of every point are gathered, and the channels are interpolated in
+// 16-bit lanes, with blue and red in one register and green and alpha in
+// another.
+__attribute__((target("avx2"))) qsizetype bilinearAVX2(const Pixels& pixels, const float* x, const float* y, quint32* out, qsizetype count)
+{
+    auto zero = _mm256_setzero_ps();
+    auto half = _mm256_set1_ps(0.5F);
+    auto scale = _mm256_set1_ps(128.0F);
+    auto width = _mm256_set1_ps(float(pixels.width));
+    auto height = _mm256_set1_ps(float(pixels.height));
+    auto one = _mm256_set1_epi32(1);
+    auto lastColumn = _mm256_set1_epi32(pixels.width - 1);
+    auto lastRow = _mm256_set1_epi32(pixels.height - 1);
+    auto stride = _mm256_set1_epi32(int(pixels.stride));
+    auto evenBytes = _mm256_set1_epi32(0x00FF00FF);
+    const auto* bits = reinterpret_cast<const int*>(pixels.bits);
+
+    qsizetype i = 0;
+    for (; i+8<=count; i+=8)
+    {
+        auto X = _mm256_loadu_ps(x + i);
+        auto Y = _mm256_loadu_ps(y + i);
+        auto inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(X, zero, _CMP_GE_OQ), _mm256_cmp_ps(X, width, _CMP_LT_OQ)),
+                                    _mm256_and_ps(_mm256_cmp_ps(Y, zero, _CMP_GE_OQ), _mm256_cmp_ps(Y, height, _CMP_LT_OQ)));
+        auto valid = _mm256_castps_si256(inside);
+
+        auto fx = _mm256_sub_ps(X, half);
+        auto fy = _mm256_sub_ps(Y, half);
+        auto x0f = _mm256_floor_ps(fx);
+        auto y0f = _mm256_floor_ps(fy);
+        auto wx = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sub_ps(fx, x0f), scale));
+        auto wy = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sub_ps(fy, y0f), scale));
+        wx = _mm256_or_si256(wx, _mm256_slli_epi32(wx, 16));
+        wy = _mm256_or_si256(wy, _mm256_slli_epi32(wy, 16));
+        auto x0 = _mm256_cvtps_epi32(x0f);
+        auto y0 = _mm256_cvtps_epi32(y0f);
+        auto x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), lastColumn);
+        auto y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), lastRow);
+        x0 = _mm256_max_epi32(x0, _mm256_setzero_si256());
+        y0 = _mm256_max_epi32(y0, _mm256_setzero_si256());
+
+        // Indices of invalid points are set to zero, so that the gathers
+        // stay within the image
+        auto row0 = _mm256_mullo_epi32(y0, stride);
+        auto row1 = _mm256_mullo_epi32(y1, stride);
+        auto p00 = _mm256_i32gather_epi32(bits, _mm256_and_si256(_mm256_add_epi32(row0, x0), valid), 4);
+        auto p01 = _mm256_i32gather_epi32(bits, _mm256_and_si256(_mm256_add_epi32(row0, x1), valid), 4);
+        auto p10 = _mm256_i32gather_epi32(bits, _mm256_and_si256(_mm256_add_epi32(row1, x0), valid), 4);
+        auto p11 = _mm256_i32gather_epi32(bits, _mm256_and_si256(_mm256_add_epi32(row1, x1), valid), 4);
+
+        auto lo = lerpAVX2(lerpAVX2(_mm256_and_si256(p00, evenBytes), _mm256_and_si256(p01, evenBytes), wx),
+                           lerpAVX2(_mm256_and_si256(p10, evenBytes), _mm256_and_si256(p11, evenBytes), wx), wy);
+        auto hi = lerpAVX2(lerpAVX2(oddBytesAVX2(p00), oddBytesAVX2(p01), wx), lerpAVX2(oddBytesAVX2(p10), oddBytesAVX2(p11), wx), wy);
+        auto result = _mm256_and_si256(_mm256_or_si256(lo, _mm256_slli_epi32(hi, 8)), valid);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    return i;
+}
+
+#endif
+
+
+//
+// Dispatch
+//
+
+void resample(const Pixels& pixels, const float* x, const float* y, quint32* out, qsizetype count, FileFormats::TileRenderer::Resampling resampling, Instructions instructions)
+{
+    if (resampling == FileFormats::TileRenderer::Resampling::Nearest)
+    {
+        nearestScalar(pixels, x, y, out, 0, count);
+        return;
+    }
+
+    instructions = qMin(instructions, FileFormats::TIFFPredictor::bestInstructions());
+    qsizetype done = 0;
+#ifdef TILERENDERER_X86
+    // Gathers take 32-bit indices
+    if ((instructions == Instructions::AVX2) && (qsizetype(pixels.height)*pixels.stride <= std::numeric_limits<int>::max()))
+    {
+        done = bilinearAVX2(pixels, x, y, out, count);
+    }
+#else
+    Q_UNUSED(instructions)
+#endif
+    bilinearScalar(pixels, x, y, out, done, count);
+}
+
+// Composites a row of premultiplied pixels under another one, and returns the
+// number of destination pixels that became opaque
+int compositeUnder(const quint32* source, quint32* destination, qsizetype count)
+{
+    int opaque = 0;
+    for (qsizetype i=0; i<count; ++i)
+    {
+        auto above = destination[i];
+        auto alpha = above >> 24;
+        auto pixel = source[i];
+        if ((alpha == 0xFF) || ((pixel >> 24) == 0))
+        {
+            continue;
+        }
+        if (alpha == 0)
+        {
+            destination[i] = pixel;
+        }
+        else
+        {
+            quint32 result = 0;
+            for (int shift=0; shift<32; shift+=8)
+            {
+                auto below = (pixel >> shift) & 0xFF;
+                result |= (((above >> shift) & 0xFF) + (below*(0xFF - alpha) + 127)/0xFF) << shift;
+            }
+            destination[i] = result;
+        }
+        if ((destination[i] >> 24) == 0xFF)
+        {
+            opaque++;
+        }
+    }
+    return opaque;
+}
+
+} // namespace
+
+
+
+//
+// Constructors
+//
+
+FileFormats::TileRenderer::TileRenderer(const QVector<const GeoTIFF*>& sources)
+    : m_sources(sources)
+{
+    QVector<QGeoRectangle> boxes;
+    boxes.reserve(m_sources.size());
+    for (const auto* source : m_sources)
+    {
+        boxes << (source->isValid() ? source->bBox() : QGeoRectangle());
+    }
+    m_index = GeoTIFFIndex(boxes);
+}
+
+
+
+//
+// Methods
+//
+
+QImage FileFormats::TileRenderer::render(int zoom, int x, int y, TIFFPredictor::Instructions instructions) const
+{
+    auto bounds = tileBounds(zoom, x, y);
+    if (!bounds.isValid())
+    {
+        return {};
+    }
+
+    // Longitudes of the grid columns and latitudes of the grid rows
+    auto nodes = m_tileSize/gridStep + 1;
+    QVector<double> lon(nodes);
+    QVector<double> lat(nodes);
+    for (int n=0; n<nodes; ++n)
+    {
+        auto fraction = double(n*gridStep)/m_tileSize;
+        lon[n] = longitude(zoom, x + fraction);
+        lat[n] = latitude(zoom, y + fraction);
+    }
+    return renderGrid(bounds, lon, lat, {m_tileSize, m_tileSize}, instructions);
+}
+
+QImage FileFormats::TileRenderer::render(const QGeoRectangle& bounds, const QSize& size, TIFFPredictor::Instructions instructions) const
+{
+    if (!bounds.isValid() || size.isEmpty() || (bounds.topLeft().longitude() > bounds.bottomRight().longitude()))
+    {
+        return {};
+    }
+
+    // Longitudes of the grid columns and latitudes of the grid rows. The last
+    // node may lie beyond the image.
+    auto west = bounds.topLeft().longitude();
+    auto north = bounds.topLeft().latitude();
+    auto degreesX = bounds.width()/size.width();
+    auto degreesY = bounds.height()/size.height();
+    QVector<double> lon((size.width() + gridStep - 1)/gridStep + 1);
+    QVector<double> lat((size.height() + gridStep - 1)/gridStep + 1);
+    for (qsizetype n=0; n<lon.size(); ++n)
+    {
+        lon[n] = west + double(n*gridStep)*degreesX;
+    }
+    for (qsizetype n=0; n<lat.size(); ++n)
+    {
+        lat[n] = north - double(n*gridStep)*degreesY;
+    }
+    return renderGrid(bounds, lon, lat, size, instructions);
+}
+
+
+
+//
+// Static methods
+//
+
+QGeoRectangle FileFormats::TileRenderer::tileBounds(int zoom, int x, int y)
+{
+    if ((zoom < 0) || (zoom > maxZoom) || (x < 0) || (y < 0) || (x >= (1 << zoom)) || (y >= (1 << zoom)))
+    {
+        return {};
+    }
+    return {QGeoCoordinate(latitude(zoom, y), longitude(zoom, x)), QGeoCoordinate(latitude(zoom, y + 1.0), longitude(zoom, x + 1.0))};
+}
+
+QPoint FileFormats::TileRenderer::tileAt(int zoom, const QGeoCoordinate& coordinate)
+{
+    auto tiles = std::ldexp(1.0, zoom);
+    auto latitude = qDegreesToRadians(qBound(-maxLatitude, coordinate.latitude(), maxLatitude));
+    auto x = (coordinate.longitude() + 180.0)/360.0*tiles;
+    auto y = (1.0 - std::asinh(std::tan(latitude))/std::numbers::pi)/2.0*tiles;
+    auto last = (1 << zoom) - 1;
+    return {qBound(0, int(std::floor(x)), last), qBound(0, int(std::floor(y)), last)};
+}
+
+double FileFormats::TileRenderer::longitude(int zoom, double x)
+{
+    return 360.0*std::ldexp(x, -zoom) - 180.0;
+}
+
+double FileFormats::TileRenderer::latitude(int zoom, double y)
+{
+    return qRadiansToDegrees(std::atan(std::sinh(std::numbers::pi*(1.0 - 2.0*std::ldexp(y, -zoom)))));
+}
+
+
+
+//
+// Private Methods
+//
+
+QImage FileFormats::TileRenderer::renderGrid(const QGeoRectangle& bounds, const QVector<double>& lon, const QVector<double>& lat, const QSize& size, TIFFPredictor::Instructions instructions) const
+{
+    auto sources = m_index.find(bounds);
+    if (sources.isEmpty())
+    {
+        return {};
+    }
+
+    // Sources are drawn from the top down, so that sources below are not
+    // read where the sources above are opaque
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+    QVector<int> opaque(size.height(), 0);
+    for (auto i=sources.size(); i-- > 0; )
+    {
+        if (std::all_of(opaque.cbegin(), opaque.cend(), [&size](int count) { return count == size.width(); }))
+        {
+            break;
+        }
+        renderSource(*m_sources[sources[i]], lon, lat, image, opaque, instructions);
+    }
+    return image;
+}
+
+void FileFormats::TileRenderer::renderSource(const GeoTIFF& source, const QVector<double>& lon, const QVector<double>& lat, QImage& image, QVector<int>& opaque, TIFFPredictor::Instructions instructions) const
+{
+    const auto& transform = source.transform();
+    if (!source.isValid() || !transform.isValid() || source.raster().isNull())
+    {
+        return;
+    }
+
+    // Grid rows around the image rows that are not yet opaque
+    auto width = image.width();
+    auto height = image.height();
+    int firstRow = 0;
+    int lastRow = height - 1;
+    while ((firstRow <= lastRow) && (opaque[firstRow] == width))
+    {
+        firstRow++;
+    }
+    while ((lastRow >= firstRow) && (opaque[lastRow] == width))
+    {
+        lastRow--;
+    }
+    if (firstRow > lastRow)
+    {
+        return;
+    }
+    auto firstNodeRow = firstRow/gridStep;
+    auto lastNodeRow = lastRow/gridStep + 1;
+
+    // Raster coordinates of the grid nodes, row by row
+    auto columns = lon.size();
+    auto rows = lat.size();
+    QVector<double> nodeX(columns*rows);
+    QVector<double> nodeY(columns*rows);
+    for (qsizetype j=0; j<rows; ++j)
+    {
+        for (qsizetype n=0; n<columns; ++n)
+        {
+            nodeX[j*columns + n] = lon[n];
+            nodeY[j*columns + n] = lat[j];
+        }
+    }
+    transform.toRaster(nodeX, nodeY, nodeX, nodeY, instructions);
+
+    // Bounding box of the nodes, and size of the smallest image pixel in
+    // raster pixels, which determines the overview that is read
+    auto minX = std::numeric_limits<double>::infinity();
+    auto minY = std::numeric_limits<double>::infinity();
+    auto maxX = -std::numeric_limits<double>::infinity();
+    auto maxY = -std::numeric_limits<double>::infinity();
+    auto footprint = std::numeric_limits<double>::infinity();
+    for (qsizetype j=firstNodeRow; j<=lastNodeRow; ++j)
+    {
+        for (qsizetype n=0; n<columns; ++n)
+        {
+            auto k = j*columns + n;
+            if (!std::isfinite(nodeX[k]) || !std::isfinite(nodeY[k]))
+            {
+                continue;
+            }
+            minX = qMin(minX, nodeX[k]);
+            minY = qMin(minY, nodeY[k]);
+            maxX = qMax(maxX, nodeX[k]);
+            maxY = qMax(maxY, nodeY[k]);
+            if ((n+1 < columns) && (j < lastNodeRow))
+            {
+                auto along = std::hypot(nodeX[k+1] - nodeX[k], nodeY[k+1] - nodeY[k]);
+                auto across = std::hypot(nodeX[k+columns] - nodeX[k], nodeY[k+columns] - nodeY[k]);
+                if (std::isfinite(along) && std::isfinite(across))
+                {
+                    footprint = qMin(footprint, qMax(along, across)/gridStep);
+                }
+            }
+        }
+    }
+    if (!std::isfinite(minX) || !std::isfinite(footprint) || (footprint <= 0.0))
+    {
+        return;
+    }
+
+    // Window of the raster, with a margin of two pixels of the overview, so
+    // that bilinear resampling sees the neighbors of all pixels
+    auto scale = 1.0/footprint;
+    auto rasterSize = source.rasterSize();
+    const auto& raster = source.rasterForScale(scale);
+    auto scaleX = double(raster.size().width())/rasterSize.width();
+    auto scaleY = double(raster.size().height())/rasterSize.height();
+    auto marginX = 2.0/scaleX;
+    auto marginY = 2.0/scaleY;
+    QPoint const topLeft(int(std::floor(qBound(-1.0, minX - marginX, double(rasterSize.width())))),
+                         int(std::floor(qBound(-1.0, minY - marginY, double(rasterSize.height())))));
+    QPoint const bottomRight(int(std::ceil(qBound(0.0, maxX + marginX, rasterSize.width() + 1.0)))-1,
+                             int(std::ceil(qBound(0.0, maxY + marginY, rasterSize.height() + 1.0)))-1);
+    auto window = QRect(topLeft, bottomRight).intersected(QRect(QPoint(0, 0), rasterSize));
+    if (window.isEmpty())
+    {
+        return;
+    }
+    auto sourceImage = source.readWindow(window, scale, m_readOptions);
+    if (sourceImage.isNull())
+    {
+        return;
+    }
+    if (sourceImage.format() != QImage::Format_ARGB32_Premultiplied)
+    {
+        sourceImage.convertTo(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    // Pixels without data are transparent
+    if (auto noData = source.noDataColor())
+    {
+        for (int py=0; py<sourceImage.height(); ++py)
+        {
+            auto* line = reinterpret_cast<quint32*>(sourceImage.scanLine(py));
+            std::replace(line, line + sourceImage.width(), quint32(*noData), quint32(0));
+        }
+    }
+
+    // Coordinates of the nodes in the source image, which starts at the pixel
+    // of the overview that contains the top left corner of the window, see
+    // GeoTIFF::readWindow()
+    auto originX = std::floor(window.left()*scaleX);
+    auto originY = std::floor(window.top()*scaleY);
+    QVector<float> imageX(columns*rows);
+    QVector<float> imageY(columns*rows);
+    for (qsizetype k=0; k<columns*rows; ++k)
+    {
+        imageX[k] = float(nodeX[k]*scaleX - originX);
+        imageY[k] = float(nodeY[k]*scaleY - originY);
+    }
+
+    // Resample row by row. The source image coordinates of a row are
+    // interpolated linearly between the grid rows, and then between the grid
+    // columns. Rows that are already opaque are skipped.
+    Pixels const pixels {reinterpret_cast<const quint32*>(sourceImage.constBits()), sourceImage.bytesPerLine()/4, sourceImage.width(), sourceImage.height()};
+    QVector<float> weights(qMax(width, height));
+    for (qsizetype i=0; i<weights.size(); ++i)
+    {
+        weights[i] = (float(i % gridStep) + 0.5F)/gridStep;
+    }
+    QVector<float> rowX(columns);
+    QVector<float> rowY(columns);
+    QVector<float> x(width);
+    QVector<float> y(width);
+    QVector<quint32> row(width);
+    for (int py=firstRow; py<=lastRow; ++py)
+    {
+        if (opaque[py] == width)
+        {
+            continue;
+        }
+        auto j = py/gridStep;
+        auto t = weights[py];
+        const auto* upperX = imageX.constData() + j*columns;
+        const auto* upperY = imageY.constData() + j*columns;
+        for (qsizetype n=0; n<columns; ++n)
+        {
+            rowX[n] = upperX[n] + (upperX[n + columns] - upperX[n])*t;
+            rowY[n] = upperY[n] + (upperY[n + columns] - upperY[n])*t;
+        }
+        for (int px=0; px<width; ++px)
+        {
+            auto n = px/gridStep;
+            auto s = weights[px];
+            x[px] = rowX[n] + (rowX[n+1] - rowX[n])*s;
+            y[px] = rowY[n] + (rowY[n+1] - rowY[n])*s;
+        }
+        resample(pixels, x.constData(), y.constData(), row.data(), width, m_resampling, instructions);
+        opaque[py] += compositeUnder(row.constData(), reinterpret_cast<quint32*>(image.scanLine(py)), width);
+    }
+}
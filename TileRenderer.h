@@ -0,0 +1,250 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QGeoRectangle>
+#include <QImage>
+
+#include "GeoTIFF.h"
+#include "GeoTIFFIndex.h"
+
+namespace FileFormats
+{
+
+/*! \brief Renderer of Web Mercator tiles
+ *
+ *  This class renders XYZ tiles in the Web Mercator projection (EPSG:3857),
+ *  as used by web maps, from a list of GeoTIFF files. Tiles are computed on
+ *  the fly: for every tile, the renderer finds the GeoTIFF files whose
+ *  bounding boxes intersect the tile, reads only the window of each raster
+ *  that the tile covers, at the coarsest overview that is fine enough, and
+ *  resamples the window into the tile.
+ *
+ *  The mapping from tile pixels to raster coordinates is computed exactly on
+ *  a grid with a spacing of 16 tile pixels, using the batch methods of
+ *  GeoTransform, and interpolated linearly in between. The error of the
+ *  interpolation is far below one raster pixel. Resampling uses AVX2 if the
+ *  processor supports it, see TIFFPredictor::bestInstructions().
+ *
+ *  Sources are composited in the order in which they are passed to the
+ *  constructor, so that later sources are drawn on top of earlier ones. The
+ *  renderer works from the top down: sources below are not read where the
+ *  sources above are opaque. Pixels of the color GeoTIFF::noDataColor() are
+ *  transparent, and so are sources that cannot be read.
+ *
+ *  All methods are const and thread-safe, so that any number of threads can
+ *  render tiles with the same renderer.
+ */
+
+class TileRenderer
+{
+public:
+    /*! \brief Resampling method */
+    enum class Resampling
+    {
+        /*! \brief Nearest neighbor, which keeps the colors of the raster */
+        Nearest,
+
+        /*! \brief Bilinear interpolation */
+        Bilinear,
+    };
+
+    /*! \brief Constructor
+     *
+     *  Sources must have been constructed from a file name, see
+     *  GeoTIFF::readWindow(). Invalid sources are ignored.
+     *
+     *  \param sources GeoTIFF files. The objects are not copied and must
+     *  outlive the renderer.
+     */
+    TileRenderer(const QVector<const GeoTIFF*>& sources = {});
+
+
+    //
+    // Getter/Setter methods
+    //
+
+    /*! \brief Tile size
+     *
+     *  @returns Width and height of the tiles in pixels. By default, this
+     *  is 256.
+     */
+    [[nodiscard]] int tileSize() const { return m_tileSize; }
+
+    /*! \brief Set tile size
+     *
+     *  @param size Width and height of the tiles in pixels, typically 256 or
+     *  512. The value is rounded up to a multiple of 16.
+     */
+    void setTileSize(int size) { m_tileSize = qMax(16, (size + 15) & ~15); }
+
+    /*! \brief Resampling method
+     *
+     *  @returns Resampling method. By default, this is bilinear.
+     */
+    [[nodiscard]] Resampling resampling() const { return m_resampling; }
+
+    /*! \brief Set resampling method
+     *
+     *  @param resampling Resampling method
+     */
+    void setResampling(Resampling resampling) { m_resampling = resampling; }
+
+    /*! \brief Options for reading source windows
+     *
+     *  @returns Options passed to GeoTIFF::readWindow()
+     */
+    [[nodiscard]] const TIFFReadOptions& readOptions() const { return m_readOptions; }
+
+    /*! \brief Set options for reading source windows
+     *
+     *  @param options Options passed to GeoTIFF::readWindow()
+     */
+    void setReadOptions(const TIFFReadOptions& options) { m_readOptions = options; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Render a tile
+     *
+     *  @param zoom Zoom level, between 0 and 30
+     *
+     *  @param x Column of the tile, between 0 and 2^zoom-1, counted from
+     *  the antimeridian eastwards
+     *
+     *  @param y Row of the tile, between 0 and 2^zoom-1, counted from the
+     *  north
+     *
+     *  @param instructions Instruction set used for resampling. If the
+     *  processor does not support the instruction set, scalar code is used.
+     *
+     *  @returns Tile in QImage::Format_ARGB32_Premultiplied, transparent
+     *  where no source covers it. If the tile does not exist, or if it does
+     *  not intersect the bounding box of any source, a null image is
+     *  returned.
+     */
+    [[nodiscard]] QImage render(int zoom, int x, int y, TIFFPredictor::Instructions instructions = TIFFPredictor::bestInstructions()) const;
+
+    /*! \brief Render a geographic rectangle
+     *
+     *  The image is in the equirectangular projection, so that longitude and
+     *  latitude are linear functions of the pixel coordinates. The tile size
+     *  is ignored.
+     *
+     *  @param bounds Rectangle, which must not cross the antimeridian
+     *
+     *  @param size Width and height of the image in pixels
+     *
+     *  @param instructions Instruction set used for resampling. If the
+     *  processor does not support the instruction set, scalar code is used.
+     *
+     *  @returns Image in QImage::Format_ARGB32_Premultiplied, transparent
+     *  where no source covers it. If the rectangle or the size is invalid, or
+     *  if the rectangle does not intersect the bounding box of any source, a
+     *  null image is returned.
+     */
+    [[nodiscard]] QImage render(const QGeoRectangle& bounds, const QSize& size, TIFFPredictor::Instructions instructions = TIFFPredictor::bestInstructions()) const;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Bounding box of a tile
+     *
+     *  @param zoom Zoom level, between 0 and 30
+     *
+     *  @param x Column of the tile
+     *
+     *  @param y Row of the tile
+     *
+     *  @returns Bounding box, or an invalid rectangle if the tile does not
+     *  exist
+     */
+    [[nodiscard]] static QGeoRectangle tileBounds(int zoom, int x, int y);
+
+    /*! \brief Tile that contains a coordinate
+     *
+     *  @param zoom Zoom level, between 0 and 30
+     *
+     *  @param coordinate Coordinate. Latitudes beyond the limits of the Web
+     *  Mercator projection are clamped.
+     *
+     *  @returns Column and row of the tile
+     */
+    [[nodiscard]] static QPoint tileAt(int zoom, const QGeoCoordinate& coordinate);
+
+    /*! \brief Longitude of a tile column boundary
+     *
+     *  @param zoom Zoom level
+     *
+     *  @param x Column, possibly fractional. Column 2^zoom is the eastern
+     *  boundary of the last column.
+     *
+     *  @returns Longitude in degrees
+     */
+    [[nodiscard]] static double longitude(int zoom, double x);
+
+    /*! \brief Latitude of a tile row boundary
+     *
+     *  @param zoom Zoom level
+     *
+     *  @param y Row, possibly fractional. Row 2^zoom is the southern
+     *  boundary of the last row.
+     *
+     *  @returns Latitude in degrees
+     */
+    [[nodiscard]] static double latitude(int zoom, double y);
+
+    /*! \brief Highest supported zoom level */
+    static constexpr int maxZoom = 30;
+
+    /*! \brief Latitude of the northern boundary of the Web Mercator
+     *  projection, in degrees */
+    static constexpr double maxLatitude = 85.051128779806589;
+
+private:
+    // Renders an image whose grid columns have the longitudes lon and whose
+    // grid rows have the latitudes lat, in degrees, from the sources whose
+    // bounding boxes intersect bounds
+    [[nodiscard]] QImage renderGrid(const QGeoRectangle& bounds, const QVector<double>& lon, const QVector<double>& lat, const QSize& size, TIFFPredictor::Instructions instructions) const;
+
+    // Resamples one source and composites it under the image. The array
+    // opaque holds the number of opaque pixels in every row of the image and
+    // is updated. Rows that are opaque are skipped.
+    void renderSource(const GeoTIFF& source, const QVector<double>& lon, const QVector<double>& lat, QImage& image, QVector<int>& opaque, TIFFPredictor::Instructions instructions) const;
+
+    // Spacing of the grid on which the mapping from tile pixels to raster
+    // coordinates is computed exactly, in tile pixels
+    static constexpr int gridStep = 16;
+
+    // Sources and spatial index over their bounding boxes
+    QVector<const GeoTIFF*> m_sources;
+    GeoTIFFIndex m_index;
+
+    int m_tileSize {256};
+    Resampling m_resampling {Resampling::Bilinear};
+    TIFFReadOptions m_readOptions;
+};
+
+} // namespace FileFormats
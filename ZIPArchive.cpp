@@ -0,0 +1,591 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <zlib.h>
+
+#include "ZIPArchive.h"
+
+
+namespace {
+
+// Signatures of the records of a ZIP archive
+const quint32 localHeaderSignature = 0x04034b50;
+const quint32 centralHeaderSignature = 0x02014b50;
+const quint32 endOfCentralDirectorySignature = 0x06054b50;
+const quint32 zip64EndOfCentralDirectorySignature = 0x06064b50;
+const quint32 zip64LocatorSignature = 0x07064b50;
+
+// Sizes of the fixed parts of the records
+const qint64 localHeaderSize = 30;
+const qint64 centralHeaderSize = 46;
+const qint64 endOfCentralDirectorySize = 22;
+const qint64 zip64EndOfCentralDirectorySize = 56;
+const qint64 zip64LocatorSize = 20;
+
+// The end of central directory record is followed by a comment of at most
+// 65535 bytes
+const qint64 maxCommentSize = 65535;
+
+// Size of the deflate window, which is the history needed to restart
+// inflation at an access point
+const qint64 windowSize = 32768;
+
+// Distance between access points, in bytes of inflated data. Every access
+// point holds a copy of the window.
+const qint64 accessPointSpan = 1024*1024;
+
+// Number of compressed bytes read from the archive at once
+const qint64 inputChunkSize = 65536;
+
+// Reads a little-endian number from data. On failure, throws a QString with a
+// human-readable, translated error message.
+template<typename T>
+T readLittleEndian(QByteArrayView data, qint64 offset)
+{
+    if ((offset < 0) || (offset + qint64(sizeof(T)) > data.size()))
+    {
+        throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+    }
+    return qFromLittleEndian<T>(data.data() + offset);
+}
+
+// Reads from the archive. Reads are serialized with the mutex, unless the
+// archive is resident in memory.
+QByteArray readArchive(FileFormats::RangeReader& archive, QMutex& mutex, qint64 offset, qint64 length)
+{
+    auto data = archive.data();
+    if (!data.isEmpty())
+    {
+        if ((offset < 0) || (offset >= data.size()) || (length <= 0))
+        {
+            return {};
+        }
+        return data.sliced(offset, qMin(length, data.size() - offset)).toByteArray();
+    }
+    QMutexLocker const locker(&mutex);
+    return archive.read(offset, length);
+}
+
+
+// Reader for a file that is stored without compression
+class StoredEntryReader : public FileFormats::RangeReader
+{
+public:
+    StoredEntryReader(FileFormats::RangeReader& archive, QMutex& mutex, qint64 dataOffset, qint64 size, const QString& identity)
+        : m_archive(archive), m_mutex(mutex), m_dataOffset(dataOffset), m_size(size), m_identity(identity)
+    {
+        auto data = archive.data();
+        if (!data.isEmpty())
+        {
+            m_data = data.sliced(dataOffset, size);
+        }
+    }
+
+    [[nodiscard]] qint64 size() override { return m_size; }
+
+    [[nodiscard]] QByteArray read(qint64 offset, qint64 length) override
+    {
+        if ((offset < 0) || (offset >= m_size) || (length <= 0))
+        {
+            return {};
+        }
+        return readArchive(m_archive, m_mutex, m_dataOffset + offset, qMin(length, m_size - offset));
+    }
+
+    // Forwards the batch to the archive, so that remote archives answer it
+    // with a single request
+    [[nodiscard]] QVector<QByteArray> readRanges(const QVector<Range>& ranges) override
+    {
+        if (!m_data.isEmpty())
+        {
+            return RangeReader::readRanges(ranges);
+        }
+        QVector<Range> archiveRanges;
+        archiveRanges.reserve(ranges.size());
+        for (const auto& range : ranges)
+        {
+            auto offset = qBound<qint64>(0, range.offset, m_size);
+            auto length = qBound<qint64>(0, range.length, m_size - offset);
+            archiveRanges.append(Range{m_dataOffset + offset, length});
+        }
+        QMutexLocker const locker(&m_mutex);
+        return m_archive.readRanges(archiveRanges);
+    }
+
+    [[nodiscard]] QByteArrayView data() const override { return m_data; }
+    [[nodiscard]] QString identity() const override { return m_identity; }
+
+private:
+    FileFormats::RangeReader& m_archive;
+    QMutex& m_mutex;
+    qint64 m_dataOffset;
+    qint64 m_size;
+    QString m_identity;
+    QByteArrayView m_data;
+};
+
+
+// Reader for a file that is compressed with deflate. The reader keeps one
+// zlib stream, and the position in the inflated data up to which the stream
+// has progressed. Reads behind that position continue the stream, all other
+// reads restart it at the last access point before the read.
+class DeflatedEntryReader : public FileFormats::RangeReader
+{
+public:
+    DeflatedEntryReader(FileFormats::RangeReader& archive, QMutex& mutex, qint64 dataOffset, qint64 compressedSize, qint64 size, const QString& identity)
+        : m_archive(archive), m_mutex(mutex), m_dataOffset(dataOffset), m_compressedSize(compressedSize), m_size(size), m_identity(identity)
+    {
+        if (inflateInit2(&m_stream, -MAX_WBITS) != Z_OK)
+        {
+            throw QObject::tr("Cannot initialize zlib.", "FileFormats::ZIPArchive");
+        }
+        m_window.resize(windowSize);
+        m_accessPoints.append(AccessPoint());
+    }
+
+    ~DeflatedEntryReader() override
+    {
+        inflateEnd(&m_stream);
+    }
+
+    [[nodiscard]] qint64 size() override { return m_size; }
+
+    [[nodiscard]] QByteArray read(qint64 offset, qint64 length) override
+    {
+        if ((offset < 0) || (offset >= m_size) || (length <= 0))
+        {
+            return {};
+        }
+        length = qMin(length, m_size - offset);
+
+        // Restart at the last access point before the read, unless the stream
+        // is already there or closer
+        auto point = std::upper_bound(m_accessPoints.cbegin(), m_accessPoints.cend(), offset, [](qint64 offset, const AccessPoint& point) { return offset < point.out; });
+        --point;
+        if ((m_out > offset) || (m_out < point->out))
+        {
+            restart(*point);
+        }
+
+        QByteArray result(length, Qt::Uninitialized);
+        while (m_out < offset + length)
+        {
+            auto begin = m_windowPosition % windowSize;
+            auto produced = inflateStep();
+            auto from = qMax(offset, m_out - produced);
+            auto to = qMin(offset + length, m_out);
+            if (from < to)
+            {
+                memcpy(result.data() + (from - offset), m_window.constData() + begin + (from - (m_out - produced)), to - from);
+            }
+        }
+        return result;
+    }
+
+    // Reads the ranges in the order of increasing offset, so that the stream
+    // restarts as rarely as possible
+    [[nodiscard]] QVector<QByteArray> readRanges(const QVector<Range>& ranges) override
+    {
+        QVector<qsizetype> order(ranges.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&ranges](qsizetype a, qsizetype b) { return ranges[a].offset < ranges[b].offset; });
+        QVector<QByteArray> result(ranges.size());
+        for (auto index : order)
+        {
+            result[index] = read(ranges[index].offset, ranges[index].length);
+        }
+        return result;
+    }
+
+    [[nodiscard]] QString identity() const override { return m_identity; }
+
+private:
+    // Position from which inflation can be restarted. At the position, the
+    // stream is at the start of a deflate block. If the block does not start
+    // at a byte boundary, the first bits of the block are found in the byte
+    // preceding in.
+    struct AccessPoint
+    {
+        qint64 out {0};
+        qint64 in {0};
+        int bits {0};
+        QByteArray window;
+    };
+
+    // Resets the stream to the access point
+    void restart(const AccessPoint& point)
+    {
+        if (inflateReset(&m_stream) != Z_OK)
+        {
+            throw QObject::tr("Cannot initialize zlib.", "FileFormats::ZIPArchive");
+        }
+        m_stream.avail_in = 0;
+        m_in = point.in;
+        if (point.bits != 0)
+        {
+            auto byte = readArchive(m_archive, m_mutex, m_dataOffset + point.in - 1, 1);
+            if (byte.size() != 1)
+            {
+                throw QObject::tr("Cannot read data.", "FileFormats::ZIPArchive");
+            }
+            inflatePrime(&m_stream, point.bits, uchar(byte[0]) >> (8 - point.bits));
+        }
+        if (!point.window.isEmpty())
+        {
+            inflateSetDictionary(&m_stream, reinterpret_cast<const Bytef*>(point.window.constData()), uInt(point.window.size()));
+        }
+
+        // The window holds the history in the order in which it was written
+        memcpy(m_window.data(), point.window.constData(), point.window.size());
+        m_windowPosition = point.window.size() % windowSize;
+        m_out = point.out;
+    }
+
+    // Inflates up to the end of the window or of the current deflate block.
+    // Returns the number of bytes written to the window, which end at
+    // m_windowPosition, and records an access point if the stream is at the
+    // start of a block far enough from the last access point.
+    qint64 inflateStep()
+    {
+        if (m_windowPosition == windowSize)
+        {
+            m_windowPosition = 0;
+        }
+        if (m_stream.avail_in == 0)
+        {
+            m_input = readArchive(m_archive, m_mutex, m_dataOffset + m_in, qMin(inputChunkSize, m_compressedSize - m_in));
+            if (m_input.isEmpty())
+            {
+                throw QObject::tr("The compressed data ends prematurely.", "FileFormats::ZIPArchive");
+            }
+            m_stream.next_in = reinterpret_cast<Bytef*>(m_input.data());
+            m_stream.avail_in = uInt(m_input.size());
+            m_in += m_input.size();
+        }
+
+        auto available = windowSize - m_windowPosition;
+        m_stream.next_out = reinterpret_cast<Bytef*>(m_window.data() + m_windowPosition);
+        m_stream.avail_out = uInt(available);
+        auto result = inflate(&m_stream, Z_BLOCK);
+        if ((result != Z_OK) && (result != Z_STREAM_END) && (result != Z_BUF_ERROR))
+        {
+            throw QObject::tr("The compressed data is corrupt.", "FileFormats::ZIPArchive");
+        }
+        auto produced = available - qint64(m_stream.avail_out);
+        m_windowPosition += produced;
+        m_out += produced;
+        if ((result == Z_STREAM_END) && (m_out < m_size))
+        {
+            throw QObject::tr("The compressed data ends prematurely.", "FileFormats::ZIPArchive");
+        }
+
+        // Bit 7 of data_type marks the end of a block, bit 6 the last block
+        auto atBlockStart = ((m_stream.data_type & 128) != 0) && ((m_stream.data_type & 64) == 0);
+        if (atBlockStart && (m_out >= m_accessPoints.last().out + accessPointSpan))
+        {
+            AccessPoint point;
+            point.out = m_out;
+            point.in = m_in - m_stream.avail_in;
+            point.bits = m_stream.data_type & 7;
+            if (m_out >= windowSize)
+            {
+                point.window = m_window.mid(m_windowPosition % windowSize) + m_window.left(m_windowPosition % windowSize);
+            }
+            else
+            {
+                point.window = m_window.left(m_windowPosition);
+            }
+            m_accessPoints.append(point);
+        }
+        return produced;
+    }
+
+    FileFormats::RangeReader& m_archive;
+    QMutex& m_mutex;
+    qint64 m_dataOffset;
+    qint64 m_compressedSize;
+    qint64 m_size;
+    QString m_identity;
+
+    // State of the stream. The stream has consumed compressed data up to m_in
+    // minus the bytes still available in m_input, and written inflated data up
+    // to m_out. The window holds the last inflated bytes, written cyclically.
+    z_stream m_stream {};
+    QByteArray m_input;
+    qint64 m_in {0};
+    qint64 m_out {0};
+    QByteArray m_window;
+    qint64 m_windowPosition {0};
+
+    // Sorted by position
+    QVector<AccessPoint> m_accessPoints;
+};
+
+} // namespace
+
+
+//
+// Constructors
+//
+
+FileFormats::ZIPArchive::ZIPArchive(const QString& fileName)
+    : m_file(fileName)
+{
+    if (!m_file.open(QFile::ReadOnly))
+    {
+        setError(m_file.errorString());
+        return;
+    }
+    m_fileReader = RangeReader::create(m_file);
+    m_reader = m_fileReader.get();
+    try
+    {
+        readCentralDirectory();
+    }
+    catch (QString& message)
+    {
+        setError(message);
+    }
+}
+
+FileFormats::ZIPArchive::ZIPArchive(RangeReader& reader)
+    : m_reader(&reader)
+{
+    try
+    {
+        readCentralDirectory();
+    }
+    catch (QString& message)
+    {
+        setError(message);
+    }
+}
+
+
+
+//
+// Methods
+//
+
+std::unique_ptr<FileFormats::RangeReader> FileFormats::ZIPArchive::reader(const QString& name) const
+{
+    if (!isValid())
+    {
+        throw error();
+    }
+    auto entry = std::find_if(m_entries.cbegin(), m_entries.cend(), [&name](const Entry& entry) { return entry.name == name; });
+    if (entry == m_entries.cend())
+    {
+        throw QObject::tr("The file %1 does not exist in the ZIP archive.", "FileFormats::ZIPArchive").arg(name);
+    }
+    if (entry->isEncrypted)
+    {
+        throw QObject::tr("The file %1 in the ZIP archive is encrypted.", "FileFormats::ZIPArchive").arg(name);
+    }
+    if ((entry->method != 0) && (entry->method != 8))
+    {
+        throw QObject::tr("The file %1 in the ZIP archive uses an unsupported compression method.", "FileFormats::ZIPArchive").arg(name);
+    }
+
+    // The local header repeats name and extra field, whose lengths may differ
+    // from those in the central directory
+    auto header = readArchive(*m_reader, m_mutex, entry->localHeaderOffset, localHeaderSize);
+    if ((header.size() != localHeaderSize) || (readLittleEndian<quint32>(header, 0) != localHeaderSignature))
+    {
+        throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+    }
+    auto dataOffset = entry->localHeaderOffset + localHeaderSize + readLittleEndian<quint16>(header, 26) + readLittleEndian<quint16>(header, 28);
+    if (dataOffset + entry->compressedSize > m_reader->size())
+    {
+        throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+    }
+
+    // Decoded strips and tiles can be cached if the archive can be identified
+    auto identity = m_reader->identity();
+    if (!identity.isEmpty())
+    {
+        identity += u"|"_qs + name;
+    }
+
+    if (entry->method == 0)
+    {
+        if (entry->compressedSize != entry->size)
+        {
+            throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+        }
+        return std::make_unique<StoredEntryReader>(*m_reader, m_mutex, dataOffset, entry->size, identity);
+    }
+    return std::make_unique<DeflatedEntryReader>(*m_reader, m_mutex, dataOffset, entry->compressedSize, entry->size, identity);
+}
+
+
+
+//
+// Static methods
+//
+
+bool FileFormats::ZIPArchive::splitPath(const QString& path, QString& archiveName, QString& entryName)
+{
+    if (QFileInfo::exists(path))
+    {
+        return false;
+    }
+    for (auto separator = path.lastIndexOf(u'/'); separator > 0; separator = path.lastIndexOf(u'/', separator - 1))
+    {
+        QFileInfo const info(path.left(separator));
+        if (info.isFile())
+        {
+            archiveName = path.left(separator);
+            entryName = path.mid(separator + 1);
+            return true;
+        }
+        if (info.exists())
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+
+
+//
+// Private Methods
+//
+
+void FileFormats::ZIPArchive::readCentralDirectory()
+{
+    // Find the end of central directory record, searching backwards through
+    // the comment that may follow it
+    auto size = m_reader->size();
+    auto tailOffset = qMax<qint64>(0, size - endOfCentralDirectorySize - maxCommentSize);
+    auto tail = readArchive(*m_reader, m_mutex, tailOffset, size - tailOffset);
+    qint64 end = -1;
+    for (auto i = tail.size() - endOfCentralDirectorySize; i >= 0; --i)
+    {
+        if (readLittleEndian<quint32>(tail, i) == endOfCentralDirectorySignature)
+        {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0)
+    {
+        throw QObject::tr("The file is not a ZIP archive.", "FileFormats::ZIPArchive");
+    }
+    qint64 entryCount = readLittleEndian<quint16>(tail, end + 10);
+    qint64 directorySize = readLittleEndian<quint32>(tail, end + 12);
+    qint64 directoryOffset = readLittleEndian<quint32>(tail, end + 16);
+
+    // ZIP64 archives store the true values in a separate record, found via
+    // the locator that precedes the end of central directory record
+    if ((entryCount == 0xFFFF) || (directorySize == 0xFFFFFFFF) || (directoryOffset == 0xFFFFFFFF))
+    {
+        auto locatorOffset = tailOffset + end - zip64LocatorSize;
+        auto locator = readArchive(*m_reader, m_mutex, locatorOffset, zip64LocatorSize);
+        if ((locator.size() != zip64LocatorSize) || (readLittleEndian<quint32>(locator, 0) != zip64LocatorSignature))
+        {
+            throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+        }
+        auto record = readArchive(*m_reader, m_mutex, qint64(readLittleEndian<quint64>(locator, 8)), zip64EndOfCentralDirectorySize);
+        if ((record.size() != zip64EndOfCentralDirectorySize) || (readLittleEndian<quint32>(record, 0) != zip64EndOfCentralDirectorySignature))
+        {
+            throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+        }
+        entryCount = qint64(readLittleEndian<quint64>(record, 32));
+        directorySize = qint64(readLittleEndian<quint64>(record, 40));
+        directoryOffset = qint64(readLittleEndian<quint64>(record, 48));
+    }
+    if ((directoryOffset < 0) || (directorySize < 0) || (directoryOffset + directorySize > size) || (entryCount > directorySize/centralHeaderSize))
+    {
+        throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+    }
+
+    // Read the central directory with a single read
+    auto directory = readArchive(*m_reader, m_mutex, directoryOffset, directorySize);
+    if (directory.size() != directorySize)
+    {
+        throw QObject::tr("Cannot read data.", "FileFormats::ZIPArchive");
+    }
+    m_entries.reserve(entryCount);
+    qint64 offset = 0;
+    for (qint64 i=0; i<entryCount; ++i)
+    {
+        if (readLittleEndian<quint32>(directory, offset) != centralHeaderSignature)
+        {
+            throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+        }
+        auto flags = readLittleEndian<quint16>(directory, offset + 8);
+        auto nameLength = readLittleEndian<quint16>(directory, offset + 28);
+        auto extraLength = readLittleEndian<quint16>(directory, offset + 30);
+        auto commentLength = readLittleEndian<quint16>(directory, offset + 32);
+        if (offset + centralHeaderSize + nameLength + extraLength > directory.size())
+        {
+            throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+        }
+
+        Entry entry;
+        entry.method = readLittleEndian<quint16>(directory, offset + 10);
+        entry.compressedSize = readLittleEndian<quint32>(directory, offset + 20);
+        entry.size = readLittleEndian<quint32>(directory, offset + 24);
+        entry.localHeaderOffset = readLittleEndian<quint32>(directory, offset + 42);
+        entry.isEncrypted = ((flags & 1) != 0);
+
+        // Bit 11 of the flags marks names in UTF-8. Other names are in code
+        // page 437, which agrees with Latin-1 for ASCII.
+        auto name = QByteArrayView(directory).sliced(offset + centralHeaderSize, nameLength);
+        entry.name = ((flags & 0x0800) != 0) ? QString::fromUtf8(name) : QString::fromLatin1(name);
+
+        // The ZIP64 extra field holds those sizes and offsets whose value in
+        // the header is 0xFFFFFFFF, in this order
+        auto extra = QByteArrayView(directory).sliced(offset + centralHeaderSize + nameLength, extraLength);
+        for (qint64 field=0; field + 4 <= extra.size(); )
+        {
+            auto id = readLittleEndian<quint16>(extra, field);
+            auto fieldSize = readLittleEndian<quint16>(extra, field + 2);
+            if (id == 0x0001)
+            {
+                auto value = field + 4;
+                for (auto* member : {&entry.size, &entry.compressedSize, &entry.localHeaderOffset})
+                {
+                    if (*member == 0xFFFFFFFF)
+                    {
+                        *member = qint64(readLittleEndian<quint64>(extra, value));
+                        value += 8;
+                    }
+                }
+            }
+            field += 4 + fieldSize;
+        }
+        if ((entry.size < 0) || (entry.compressedSize < 0) || (entry.localHeaderOffset < 0))
+        {
+            throw QObject::tr("The ZIP archive is corrupt.", "FileFormats::ZIPArchive");
+        }
+
+        m_entries.append(entry);
+        offset += centralHeaderSize + nameLength + extraLength + commentLength;
+    }
+}
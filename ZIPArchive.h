@@ -0,0 +1,187 @@
+/***************************************************************************
+ *   Copyright (C) 2023 by Stefan Kebekus                                  *
+ *   stefan.kebekus@gmail.com                                              *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#pragma once
+
+#include <QFile>
+#include <QMutex>
+#include <QStringList>
+
+#include <memory>
+
+#include "DataFileAbstract.h"
+#include "RangeReader.h"
+
+namespace FileFormats
+{
+
+/*! \brief Read access to the files in a ZIP archive
+ *
+ *  This class reads the central directory of a ZIP archive, including
+ *  archives in ZIP64 format, and gives random access to the files in the
+ *  archive through RangeReader, without extracting them.
+ *
+ *  - Files that are stored without compression are read from the archive
+ *    directly. If the archive is mapped into memory, their data is a view
+ *    into the mapping and is never copied.
+ *
+ *  - Files compressed with deflate are inflated as needed. While inflating,
+ *    the reader records access points, from which inflation can later be
+ *    restarted, so that random reads do not inflate the file from the start
+ *    every time. Reads that begin where the last read ended continue
+ *    inflation without restarting.
+ *
+ *  Files with other compression methods and encrypted files are listed, but
+ *  cannot be read. Checksums are not verified, because files are read
+ *  partially.
+ *
+ *  Files in archives can be addressed by paths of the form
+ *  "<archive>/<file in archive>", see splitPath(). GeoTIFF and
+ *  GeoTIFFCatalog accept such paths.
+ */
+
+class ZIPArchive : public DataFileAbstract
+{
+public:
+    /*! \brief File in the archive */
+    struct Entry
+    {
+        /*! \brief Path of the file within the archive */
+        QString name;
+
+        /*! \brief Compression method, 0 for stored and 8 for deflate */
+        quint16 method {0};
+
+        /*! \brief Size of the compressed data in bytes */
+        qint64 compressedSize {0};
+
+        /*! \brief Size of the file in bytes */
+        qint64 size {0};
+
+        /*! \brief Offset of the local file header in the archive */
+        qint64 localHeaderOffset {0};
+
+        /*! \brief True if the file is encrypted */
+        bool isEncrypted {false};
+    };
+
+    /*! \brief Constructor
+     *
+     *  The constructor opens the archive, maps it into memory if possible,
+     *  and reads the central directory. It does not read the files in the
+     *  archive.
+     *
+     *  \param fileName File name of a ZIP archive
+     */
+    ZIPArchive(const QString& fileName);
+
+    /*! \brief Constructor
+     *
+     *  The constructor reads the central directory of the archive. It does
+     *  not read the files in the archive.
+     *
+     *  \param reader Reader from which the archive is read. The reader must
+     *  outlive this object.
+     */
+    ZIPArchive(RangeReader& reader);
+
+    ~ZIPArchive() = default;
+
+
+    //
+    // Getter Methods
+    //
+
+    /*! \brief Files in the archive
+     *
+     *  @returns Files in the archive, in the order of the central directory
+     */
+    [[nodiscard]] QVector<Entry> entries() const { return m_entries; }
+
+
+    //
+    // Methods
+    //
+
+    /*! \brief Reader for a file in the archive
+     *
+     *  Readers of the same archive can be used in different threads at the
+     *  same time. Every reader keeps its own access points, so readers of
+     *  compressed files should be kept for as long as the file is read.
+     *
+     *  On failure, this method throws a QString with a human-readable,
+     *  translated error message.
+     *
+     *  @param name Path of the file within the archive
+     *
+     *  @returns Reader for the file. The reader must not outlive this
+     *  object.
+     */
+    [[nodiscard]] std::unique_ptr<RangeReader> reader(const QString& name) const;
+
+
+    //
+    // Static methods
+    //
+
+    /*! \brief Mime type for files that can be opened by this class
+     *
+     *  @returns Name of mime type
+     */
+    [[nodiscard]] static QStringList mimeTypes() { return {u"application/zip"_qs}; }
+
+    /*! \brief Split a path to a file in an archive
+     *
+     *  Paths of the form "<archive>/<file in archive>" address files in
+     *  archives, for instance "/maps/charts.zip/germany/EDKA.tiff". Paths of
+     *  files that exist in the file system are never split.
+     *
+     *  @param path Path to split
+     *
+     *  @param archiveName On success, set to the file name of the archive
+     *
+     *  @param entryName On success, set to the path of the file within the
+     *  archive
+     *
+     *  @returns True if a prefix of the path is an existing file, and the
+     *  path was split
+     */
+    [[nodiscard]] static bool splitPath(const QString& path, QString& archiveName, QString& entryName);
+
+private:
+    Q_DISABLE_COPY_MOVE(ZIPArchive)
+
+    // Reads the central directory and fills m_entries. On failure, throws a
+    // QString with a human-readable, translated error message.
+    void readCentralDirectory();
+
+    // Set if the archive is opened by file name
+    QFile m_file;
+    std::unique_ptr<RangeReader> m_fileReader;
+
+    // Reader of the archive. Reads are serialized with the mutex, unless the
+    // archive is resident in memory.
+    RangeReader* m_reader {nullptr};
+    mutable QMutex m_mutex;
+
+    QVector<Entry> m_entries;
+};
+
+} // namespace FileFormats
@@ -0,0 +1,48 @@
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+
+#include "GeoTIFFOverviewBuilder.h"
+
+auto main(int argc, char *argv[]) -> int
+{
+    QCoreApplication const app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Write a tiled copy of a GeoTIFF file, with internal overviews"_qs);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"input"_qs, u"GeoTIFF file"_qs);
+    parser.addPositionalArgument(u"output"_qs, u"Tiled GeoTIFF file with overviews"_qs);
+    QCommandLineOption const tileSizeOption(u"tile-size"_qs, u"Width and height of the tiles in pixels"_qs, u"size"_qs, u"256"_qs);
+    parser.addOption(tileSizeOption);
+    QCommandLineOption const threadsOption(u"threads"_qs, u"Number of worker threads"_qs, u"count"_qs, QString::number(QThread::idealThreadCount()));
+    parser.addOption(threadsOption);
+    QCommandLineOption const sequentialOption(u"sequential"_qs, u"Write image file directories after the tile data, instead of a Cloud Optimized GeoTIFF"_qs);
+    parser.addOption(sequentialOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2)
+    {
+        parser.showHelp(-1);
+    }
+
+    FileFormats::GeoTIFFOverviewBuilder builder;
+    builder.setTileSize(parser.value(tileSizeOption).toInt());
+    builder.setMaxThreadCount(parser.value(threadsOption).toInt());
+    builder.setCloudOptimized(!parser.isSet(sequentialOption));
+
+    QElapsedTimer timer;
+    timer.start();
+    try
+    {
+        builder.write(args[0], args[1]);
+    }
+    catch (QString& message)
+    {
+        qWarning() << message;
+        return 1;
+    }
+    qWarning() << u"Wrote %1 in %2 ms"_qs.arg(args[1]).arg(timer.elapsed());
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include <memory>
+#include <vector>
+
+#include "GeoTIFFCatalog.h"
+#include "TileExporter.h"
+
+auto main(int argc, char *argv[]) -> int
+{
+    QCoreApplication const app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Render GeoTIFF files to Web Mercator tiles, and write them to a PMTiles or MBTiles archive"_qs);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"output"_qs, u"Tile archive. Files ending in .mbtiles are written as MBTiles, all others as PMTiles."_qs);
+    parser.addPositionalArgument(u"inputs"_qs, u"GeoTIFF files, or directories that are searched for GeoTIFF files"_qs, u"inputs..."_qs);
+    QCommandLineOption const minZoomOption(u"min-zoom"_qs, u"Smallest zoom level"_qs, u"zoom"_qs, u"0"_qs);
+    parser.addOption(minZoomOption);
+    QCommandLineOption const maxZoomOption(u"max-zoom"_qs, u"Largest zoom level"_qs, u"zoom"_qs, u"12"_qs);
+    parser.addOption(maxZoomOption);
+    QCommandLineOption const tileSizeOption(u"tile-size"_qs, u"Width and height of the tiles in pixels"_qs, u"size"_qs, u"256"_qs);
+    parser.addOption(tileSizeOption);
+    QCommandLineOption const formatOption(u"format"_qs, u"Image format of the tiles: png, jpg or webp"_qs, u"format"_qs, u"png"_qs);
+    parser.addOption(formatOption);
+    QCommandLineOption const nearestOption(u"nearest"_qs, u"Resample with nearest neighbor instead of bilinear interpolation"_qs);
+    parser.addOption(nearestOption);
+    QCommandLineOption const nameOption(u"name"_qs, u"Name of the tile set"_qs, u"name"_qs);
+    parser.addOption(nameOption);
+    QCommandLineOption const threadsOption(u"threads"_qs, u"Number of worker threads"_qs, u"count"_qs, QString::number(QThread::idealThreadCount()));
+    parser.addOption(threadsOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 2)
+    {
+        parser.showHelp(-1);
+    }
+
+    // Open all GeoTIFF files. Directories are scanned with the catalog.
+    std::vector<std::unique_ptr<FileFormats::GeoTIFF>> geoTIFFs;
+    for (const auto& input : args.mid(1))
+    {
+        QStringList paths {input};
+        if (QFileInfo(input).isDir())
+        {
+            paths.clear();
+            FileFormats::GeoTIFFCatalog catalog;
+            catalog.setMaxThreadCount(parser.value(threadsOption).toInt());
+            for (const auto& entry : catalog.scan(input))
+            {
+                if (entry.isValid)
+                {
+                    paths << entry.path;
+                }
+            }
+        }
+        for (const auto& path : std::as_const(paths))
+        {
+            auto geoTIFF = std::make_unique<FileFormats::GeoTIFF>(path);
+            if (!geoTIFF->isValid())
+            {
+                qWarning() << u"Skipping %1: %2"_qs.arg(path, geoTIFF->error());
+                continue;
+            }
+            geoTIFFs.push_back(std::move(geoTIFF));
+        }
+    }
+    QVector<const FileFormats::GeoTIFF*> sources;
+    for (const auto& geoTIFF : geoTIFFs)
+    {
+        sources << geoTIFF.get();
+    }
+
+    FileFormats::TileExporter exporter(sources);
+    exporter.setZoomRange(parser.value(minZoomOption).toInt(), parser.value(maxZoomOption).toInt());
+    exporter.setTileSize(parser.value(tileSizeOption).toInt());
+    exporter.setTileFormat(parser.value(formatOption).toLatin1());
+    exporter.setName(parser.value(nameOption));
+    exporter.setMaxThreadCount(parser.value(threadsOption).toInt());
+    if (parser.isSet(nearestOption))
+    {
+        exporter.setResampling(FileFormats::TileRenderer::Resampling::Nearest);
+    }
+    std::atomic<int> percent {-1};
+    exporter.setProgressCallback([&percent](qint64 done, qint64 total) {
+        auto current = int(100*done/qMax(total, qint64(1)));
+        if (percent.exchange(current) != current)
+        {
+            qWarning() << u"%1 %"_qs.arg(current);
+        }
+    });
+
+    auto format = args[0].endsWith(u".mbtiles"_qs, Qt::CaseInsensitive) ? FileFormats::TileArchiveWriter::Format::MBTiles
+                                                                         : FileFormats::TileArchiveWriter::Format::PMTiles;
+    QElapsedTimer timer;
+    timer.start();
+    try
+    {
+        exporter.write(args[0], format);
+    }
+    catch (QString& message)
+    {
+        qWarning() << message;
+        return 1;
+    }
+    qWarning() << u"Rendered %1 tiles of %2 files into %3 in %4 ms"_qs.arg(exporter.tileCount()).arg(sources.size()).arg(args[0]).arg(timer.elapsed());
+
+    return 0;
+}
@@ -33,8 +33,13 @@ auto main(int argc, char *argv[]) -> int
                    << rect.bottomLeft().latitude()
                    << rect.topLeft().latitude() ;
 
-        // Quick check if we can read the raster image
-        QImage const img(fileName);
+        // Quick check if we can read the raster image. Fall back to Qt's
+        // image reader if the raster layout is not supported.
+        auto img = geoTIFF.readWindow(QRect(QPoint(0, 0), geoTIFF.rasterSize()));
+        if (img.isNull())
+        {
+            img = QImage(fileName);
+        }
         qWarning() << img;
         img.save(u"t.png"_qs);
     }